@@ -18,12 +18,48 @@
 #include <signal.h>
 #include <string.h>
 #include <pthread.h>
+#include <sys/inotify.h>
 
 #include "ssh.h"
 #include "fs.h"
 #include "assets.h"
+#include "cache.h"
+#include "match.h"
+#include "search.h"
+#include "index.h"
+#include "thumb.h"
+#include "viewer.h"
+#include "edit.h"
 
 #define LAYOUT_PATH "../layout/FileManagerUI.glade" /** Path to the glade file */
+#define LIST_QUEUE_INTERVAL 15 /**< Interval (ms) at which listQueue is polled while listings are pending */
+#define FILTER_MAX_ADDED 1024 /**< Names added since the NameTable after which a filter request builds a new one */
+#define FILESTORE_FIRST_BATCH 256 /**< Rows inserted with the model detached, roughly the first screenful */
+#define FILESTORE_BATCH 512 /**< Rows inserted per idle callback after the first batch */
+// Build with -DFILESTORE_TIMING to log the time from a listing request to the first rows and to the last row
+#define WATCH_DEBOUNCE 200 /**< Time (ms) local directory changes are coalesced before they are applied */
+#define WATCH_BUF_SIZE 65536 /**< Buffer size for reading inotify events */
+#define REMOTE_WATCH_INTERVAL 2000 /**< Interval (ms) at which a watched remote folder is polled */
+#define PREFETCH_DELAY 300 /**< Time (ms) the remote view must stay still before prefetching */
+#define PREFETCH_MAX_DIRS 6 /**< Maximum number of directories listed per prefetch */
+#define PREFETCH_MAX_ENTRIES 2000 /**< Larger directories are not prefetched, reading stops at this many entries */
+#define SORT_THREAD_MIN 5000 /**< Listings with at least this many entries are sorted in a thread */
+#define SORT_FILL_MAX 64 /**< Local entries without metadata filled on the UI thread when sorting by size or mtime */
+#define SORT_DELAY 200 /**< Time (ms) entries added in place are coalesced before the listing is sorted again */
+#define FOLDER_SIZE_INTERVAL 100 /**< Interval (ms) at which the progress of a folder size is shown */
+#define DETAILS_NAME_WIDTH 280 /**< Initial width of the name column in DetailsViews */
+#define DETAILS_SIZE_WIDTH 90 /**< Width of the size column in DetailsViews */
+#define DETAILS_MTIME_WIDTH 170 /**< Width of the modified column in DetailsViews */
+#define SEARCH_INTERVAL 100 /**< Interval (ms) at which search matches are added to searchWindow */
+#define SEARCH_PATH_WIDTH 420 /**< Initial width of the path column in searchWindow */
+#define SEARCH_LINE_WIDTH 60 /**< Width of the line number column in searchWindow */
+#define THUMB_DELAY 150 /**< Time (ms) an IconView must stay still before thumbnails are requested */
+#define THUMB_INTERVAL 100 /**< Interval (ms) at which finished thumbnails are shown */
+#define THUMB_MAX_VISIBLE 256 /**< Most thumbnails requested per pane at a time */
+#define VIEWER_INTERVAL 50 /**< Interval (ms) at which viewerQueue is polled while pages are read */
+#define VIEWER_FOLLOW_INTERVAL 1000 /**< Interval (ms) at which a followed file is checked for appended lines */
+#define EDIT_INTERVAL 100 /**< Interval (ms) at which editQueue is polled while files are downloaded or written back */
+#define EDIT_POLL_INTERVAL 1000 /**< Interval (ms) at which local copies of edited files are checked for saves */
 
 // UI top-level windows
 
@@ -42,7 +78,17 @@ typedef struct {
   GtkMenuItem *create_folder; /**< GtkMenuItem triggers create folder operation */
   GtkMenuItem *delete; /**< GtkMenuItem triggers recursive file/directory removal */
   GtkMenuItem *show_hidden_files; /**< GtkMenuItem to show/hide hidden files */
+  GtkMenuItem *watch_remote; /**< GtkMenuItem to start/stop watching the remote folder */
+  GtkMenuItem *sort; /**< GtkMenuItem opening the sort submenu */
+  GtkMenuItem *sort_columns[SORT_BY_TYPE + 1]; /**< GtkRadioMenuItems in the sort submenu, indexed by SortColumn */
+  GtkMenuItem *sort_descending; /**< GtkCheckMenuItem in the sort submenu to reverse the order */
+  GtkMenuItem *details_view; /**< GtkCheckMenuItem to switch the pane between icons and details */
+  gulong details_view_toggled; /**< toggle_DetailsView handler of details_view, blocked while its state is updated */
+  GtkMenuItem *search; /**< GtkMenuItem to show searchWindow */
   GtkMenuItem *properties; /**< GtkMenuItem to show filePropertiesDialog */
+  GtkMenuItem *view; /**< GtkMenuItem to show the file in viewerWindow */
+  GtkMenuItem *edit; /**< GtkMenuItem to open the file in an editor */
+  GtkMenuItem *shell_delete; /**< GtkCheckMenuItem to allow deleting remote folders with rm -rf */
 } ContextMenu;
 
 /**
@@ -56,7 +102,15 @@ enum ContextMenuActions {
   CREATE_FOLDER, /**< Create new folder */
   DELETE, /**< Delete file/directory */
   SHOW_HIDDEN_FILES, /**< Show hidden files */
-  FILE_PROPERTIES /**< Show filePropertiesDialog */
+  WATCH_REMOTE, /**< Watch remote folder for changes */
+  SORT_BY, /**< Choose the order of the listings */
+  SORT_DESCENDING, /**< Reverse the order of the listings */
+  DETAILS_VIEW, /**< Show the pane as a details list */
+  SEARCH, /**< Search the folder recursively */
+  FILE_PROPERTIES, /**< Show filePropertiesDialog */
+  VIEW_FILE, /**< Show the file in viewerWindow */
+  EDIT_FILE, /**< Open the file in an editor, remote files through a local copy */
+  SHELL_DELETE /**< Allow deleting remote folders with a shell command */
 };
 
 /**< String names for ContextMenuActions */
@@ -68,7 +122,15 @@ static const char* const ContextMenuAction_names[] =
   "Create new folder",
   "Delete",
   "Show hidden files",
-  "Properties"
+  "Watch remote folder",
+  "Sort by",
+  "Descending",
+  "Details view",
+  "Search",
+  "Properties",
+  "View",
+  "Edit",
+  "Delete with rm -rf on server"
 };
 
 /**
@@ -80,6 +142,24 @@ static inline const char* get_ContextMenuAction_name(const enum ContextMenuActio
   return ContextMenuAction_names[action];
 }
 
+/**< String names for SortColumns */
+static const char* const SortColumn_names[] =
+{
+  "Name",
+  "Size",
+  "Modified",
+  "Type"
+};
+
+/**
+  *   @brief Get matching string for SortColumn
+  *   @param column SortColumn
+  *   @return Correct entry from SortColumn_names
+  */
+static inline const char* get_SortColumn_name(const enum SortColumn column) {
+  return SortColumn_names[column];
+}
+
 /**
   *   @struct MainWindow
   *   @brief Contains TopWindow and its child UI elements
@@ -101,11 +181,14 @@ typedef struct {
                 GtkWidget *LeftFileSelectFrameAlignment;  /**< @see FileManagerUI.glade LeftFileSelectFrameAlignment */
                   GtkWidget *LeftFileScrollWindow;  /**< @see FileManagerUI.glade LeftFileScrollWindow */
                     GtkWidget *LeftScrollWindowViewPort;  /**< @see FileManagerUI.glade LeftFileScrollWindowViewPort */
-                      GtkWidget *LeftFileView;  /**< @see FileManagerUI.glade LeftFileView */
+                      GtkWidget *LeftFileView;  /**< Displayed view of the left-hand side, LeftIconView or LeftDetailsView */
+                      GtkWidget *LeftIconView;  /**< @see FileManagerUI.glade LeftFileView */
+                    GtkWidget *LeftDetailsView; /**< GtkTreeView replacing LeftScrollWindowViewPort in details mode */
                 GtkWidget *LeftFileSelectGrid;  /**< @see FileManagerUI.glade LeftFileSelectGrid */
                   GtkWidget *LeftFileHomeButton;  /**< @see FileManagerUI.glade LeftFileHomeButton */
                   GtkWidget *LeftFileBackButton;  /**< @see FileManagerUI.glade LeftFileBackButton */
                   GtkWidget *LeftNewFolderButton; /**< @see FileManagerUI.glade LeftNewFolderButton */
+                  GtkWidget *LeftFilterEntry; /**< @see FileManagerUI.glade LeftFilterEntry */
       // right-hand side
       GtkWidget *RightTopFrame; /**< @see FileManagerUI.glade RightTopFrame */
         GtkWidget *RightTopFrameBox; /**< @see FileManagerUI.glade RightTopFrameBox */
@@ -120,11 +203,14 @@ typedef struct {
                 GtkWidget *RightFileSelectFrameAlignment; /**< @see FileManagerUI.glade RightFileSelectFrameAlignment */
                   GtkWidget *RightFileScrollWindow; /**< @see FileManagerUI.glade RightFileScrollWindow */
                     GtkWidget *RightScrollWindowViewPort; /**< @see FileManagerUI.glade RightScrollWindowViewPort */
-                      GtkWidget *RightFileView; /**< @see FileManagerUI.glade RightFileView */
+                      GtkWidget *RightFileView; /**< Displayed view of the right-hand side, RightIconView or RightDetailsView */
+                      GtkWidget *RightIconView; /**< @see FileManagerUI.glade RightFileView */
+                    GtkWidget *RightDetailsView; /**< GtkTreeView replacing RightScrollWindowViewPort in details mode */
                 GtkWidget *RightFileSelectGrid; /**< @see FileManagerUI.glade RightFileSelectGrid */
                   GtkWidget *RightFileHomeButton; /**< @see FileManagerUI.glade RightFileHomeButton */
                   GtkWidget *RightFileBackButton; /**< @see FileManagerUI.glade RightFileBackButton */
                   GtkWidget *RightNewFolderButton;  /**< @see FileManagerUI.glade RightNewFolderButton */
+                  GtkWidget *RightFilterEntry; /**< @see FileManagerUI.glade RightFilterEntry */
 
       ContextMenu *contextMenu;
 } MainWindow;
@@ -157,7 +243,8 @@ enum MessageType {
   MESSAGETYPE_ERROR, /**< Message is an error */
   ASK_SSH, /**< A message contains a ssh key which needs user interaction */
   ASK_DELETE, /**< Ask user whether he/she wants to permanently delete file */
-  ASK_OVERWRITE /**< Ask user whether to overwrite existing files */
+  ASK_OVERWRITE, /**< Ask user whether to overwrite existing files */
+  ASK_EDIT_CONFLICT /**< Ask user whether to overwrite a remote file which changed while it was edited */
 };
 
 /**
@@ -218,28 +305,182 @@ typedef struct {
   GtkWidget *FilePropertiesGroup; /**< @see FileManagerUI.glade FilePropertiesGroup */
   GtkWidget *FilePropertiesGroupPermissions; /**< @see FileManagerUI.glade FilePropertiesGroupPermissions */
   GtkWidget *FilePropertiesOthersPermissions; /**< @see FileManagerUI.glade FilePropertiesOthersPermissions */
+  GtkWidget *FilePropertiesDownloadCache; /**< Download cache statistics, shown for remote files */
 } FilePropertiesDialog;
 
+/**
+  *   @struct SearchWindow
+  *   @brief Contains searchWindow and its child elements, built in init_SearchWindow
+  */
+typedef struct {
+  GtkWidget *SearchWindow; /**< Top-level window */
+  GtkWidget *SearchFolder; /**< GtkLabel showing the searched folder */
+  GtkWidget *SearchEntry; /**< GtkEntry for a name, a shell glob or a regular expression */
+  GtkWidget *SearchRegex; /**< GtkCheckButton to match names with a regular expression */
+  GtkWidget *SearchIgnoreCase; /**< GtkCheckButton to match names case-insensitively */
+  GtkWidget *SearchContents; /**< GtkCheckButton to search the content of remote files with grep */
+  GtkWidget *SearchMinSize; /**< GtkSpinButton for the smallest size in KiB, 0 for no limit */
+  GtkWidget *SearchMaxSize; /**< GtkSpinButton for the largest size in KiB, 0 for no limit */
+  GtkWidget *SearchMaxAge; /**< GtkSpinButton for the days within which matches were modified, 0 for no limit */
+  GtkWidget *SearchButton; /**< GtkButton starting the search */
+  GtkWidget *SearchStopButton; /**< GtkButton stopping the search */
+  GtkWidget *SearchStatus; /**< GtkLabel showing the progress */
+  GtkWidget *SearchResults; /**< GtkTreeView of the matches */
+  GtkWidget *SearchUseIndex; /**< GtkCheckButton to search remoteIndex instead of the server */
+  GtkWidget *SearchIndexButton; /**< GtkButton indexing the searched folder */
+  GtkWidget *SearchIndexStatus; /**< GtkLabel showing how up to date the index of the folder is */
+  GtkTreeViewColumn *SizeColumn; /**< Size of a matching file */
+  GtkTreeViewColumn *MtimeColumn; /**< Modification time of a matching file */
+  GtkTreeViewColumn *LineColumn; /**< Line number of a matching line */
+  GtkTreeViewColumn *TextColumn; /**< Text of a matching line */
+  GtkListStore *results; /**< Matches, @see SearchColumns */
+  char *root; /**< Folder searched */
+  bool remote; /**< Whether root is on the remote */
+} SearchWindow;
+
+/**
+  *   @struct ViewerWindow
+  *   @brief Contains viewerWindow and its child elements, built in init_ViewerWindow
+  */
+typedef struct {
+  GtkWidget *ViewerWindow; /**< Top-level window */
+  GtkWidget *ViewerPath; /**< GtkLabel showing the viewed file */
+  GtkWidget *ViewerText; /**< Read-only GtkTextView of the page */
+  GtkWidget *ViewerStartButton; /**< GtkButton showing the first page */
+  GtkWidget *ViewerPreviousButton; /**< GtkButton showing the previous page */
+  GtkWidget *ViewerNextButton; /**< GtkButton showing the next page */
+  GtkWidget *ViewerEndButton; /**< GtkButton showing the last lines */
+  GtkWidget *ViewerFollow; /**< GtkCheckButton showing lines as they are appended, as tail -f */
+  GtkWidget *ViewerStatus; /**< GtkLabel showing the position and the bytes transferred */
+  PagedFile *file; /**< File shown, NULL while opening or after closing */
+  char *path; /**< Path of the file shown */
+  bool remote; /**< Whether the file is on the remote */
+  uint64_t start; /**< Offset of the first byte shown */
+  uint64_t end; /**< Offset after the last byte shown */
+} ViewerWindow;
+
+/**
+  *   @enum ViewerAction
+  *   @brief Reads done by viewer threads
+  */
+enum ViewerAction {
+  VIEWER_OPEN, /**< Open the file and read the first page */
+  VIEWER_PAGE, /**< Read the page starting from offset */
+  VIEWER_PREVIOUS, /**< Read the page ending at offset */
+  VIEWER_END, /**< Read the last page, including lines appended since the file was opened */
+  VIEWER_FOLLOW /**< Read the bytes appended after offset */
+};
+
+/**
+  *   @enum IndexAction
+  *   @brief Work done by indexer threads
+  */
+enum IndexAction {
+  INDEX_WALK, /**< Index the folder with sftp_session_index */
+  INDEX_FRESHNESS /**< Get the freshness of the index of the folder */
+};
+
+/**
+  *   @enum EditAction
+  *   @brief Transfers done by editor threads
+  */
+enum EditAction {
+  EDIT_OPEN, /**< Download the file to its local copy */
+  EDIT_SAVE, /**< Write back the changed blocks of the local copy */
+  EDIT_OVERWRITE /**< Write the whole local copy over a remote file which changed under the edit */
+};
+
+/**
+  *   @enum SearchColumns
+  *   @brief Columns of SearchWindow results
+  */
+enum SearchColumns {
+  SEARCH_PATH_COLUMN, /**< Full path of the match */
+  SEARCH_SIZE_COLUMN, /**< Size in bytes */
+  SEARCH_MTIME_COLUMN, /**< Time when the match was modified */
+  SEARCH_TYPE_COLUMN, /**< File type */
+  SEARCH_LINE_COLUMN, /**< Line number of a content match */
+  SEARCH_TEXT_COLUMN, /**< Matching line of a content match */
+  SEARCH_N_COLUMNS /**< Number of columns */
+};
+
+/**
+  *   @struct FileRow
+  *   @brief Links an entry of FileStore files to its row in the GtkListStore
+  */
+typedef struct {
+  File_t *file; /**< Entry in FileStore files */
+  GtkTreeIter it; /**< Row of the entry in listStore, valid only when shown */
+  bool shown; /**< Whether the entry has a row (pending entries do not) */
+  unsigned matched; /**< Filter generation in which the entry matched the filter, @see FileStore */
+  const char *content_type; /**< Interned content type of the entry, NULL until needed or after a change */
+  GdkPixbuf *thumbnail; /**< Thumbnail shown in IconViews, NULL if none */
+  unsigned thumb_requested; /**< Thumbnailer generation of the latest request, 0 if none */
+  bool thumb_failed; /**< Whether the entry could not be thumbnailed */
+} FileRow;
+
+/**
+  *   @brief Free FileRow, the GDestroyNotify of FileStore index
+  *   @param ptr Pointer to a FileRow
+  */
+static inline void free_FileRow(gpointer ptr) {
+  FileRow *row = (FileRow *) ptr;
+  if (row) {
+    if (row->thumbnail) g_object_unref(row->thumbnail);
+    free(row);
+  }
+}
+
 /**
   *   @struct FileStore
   *   @brief Used to store displayed files
   */
 typedef struct {
-  GtkListStore *listStore; /**< Store displayed files */
+  GtkListStore *listStore; /**< Store a row for each listed file */
+  GtkTreeModel *filter; /**< GtkTreeModelFilter over listStore, the model of fileView */
   GtkTreeIter it;  /**< Iterator to the GtkListStore */
   GSList *files; /**< Linked list storing matching file details, @see File */
+  GHashTable *index; /**< Filename -> FileRow for every entry in files, allows patching rows in place */
+  unsigned generation; /**< Incremented for each listing request, results of older requests are discarded */
+  bool loading; /**< Whether a listing for the newest request is still in progress */
+  GtkWidget *fileView; /**< Displayed FileView of the pane, the hidden one has no model */
+  bool remote; /**< Whether the FileStore displays remote files */
+  GSList *pending; /**< Next entry of files still to be inserted to listStore */
+  guint fill_source; /**< Idle source inserting pending entries, 0 when not running */
+  gint64 requested; /**< Monotonic time of the newest listing request, logged with FILESTORE_TIMING */
+  NameTable *names; /**< Snapshot of the names for filtering, built on demand, NULL after a new listing */
+  GHashTable *added; /**< Names added or renamed since names was built, matched one by one */
+  char *filter_pattern; /**< Applied case folded filter, NULL when all entries are displayed */
+  bool filter_fuzzy; /**< Whether filter is applied as a subsequence match */
+  unsigned filter_generation; /**< Incremented for each filter request, results of older requests are discarded */
+  unsigned filter_applied; /**< Generation of the applied filter, matching entries have it in FileRow matched */
+  unsigned modified; /**< Incremented when entries are listed, added, removed or renamed, outdates pending sorts */
+  guint sort_source; /**< Pending sort_FileStore timeout after entries were added, 0 when not scheduled */
 } FileStore;
 
 enum {
   STRING_COLUMN, /**< Used for GtkListStore, the first column: 0 */
   PIXBUF_COLUMN, /**< Used for GtkListStore, the second column: 1 */
   UINT_COLUMN, /**< Used for GtkListStore, the third column: 2 */
-  N_COLUMNS /**< Used for GtkListStore, amount of columns: 3 */
+  ROW_COLUMN, /**< Used for GtkListStore, the FileRow of the entry: 3 */
+  N_COLUMNS /**< Used for GtkListStore, amount of columns: 4 */
+};
+
+/**
+  *   @enum WatchChange
+  *   @brief Coalesced change of a local directory entry, @see LocalWatch_OnEvent
+  */
+enum WatchChange {
+  WATCH_CREATED = 1, /**< Entry was created or moved into the directory */
+  WATCH_DELETED, /**< Entry was deleted or moved out of the directory */
+  WATCH_CHANGED /**< Entry content or attributes changed */
 };
 
 enum WorkerType {
   PASTE_FILES, /**< Paste copied files */
   DELETE_FILES, /**< Delete files */
+  RENAME_FILE, /**< Rename a remote file */
+  MAKE_FOLDER, /**< Create a remote folder */
 };
 
 /**
@@ -247,7 +488,7 @@ enum WorkerType {
   *   @brief Data passed to worker threads
   *   @details Depending on the work type only some values are used, non-used
   *   values are set to NULL or 0. (for PASTE_FILES filepath==NULL and for
-  *   DELETE_FILES fileCopies==NULL, overwrite==0)
+  *   DELETE_FILES fileCopies==NULL, overwrite==0, only RENAME_FILE sets new_path)
   */
 typedef struct {
   char *pwd; /**< Present working directory passed for the worker thread */
@@ -255,6 +496,7 @@ typedef struct {
   bool overwrite; /**< Whether to overwrite files or not */
   bool target_remote; /**< Whether the target filepath is on remote */
   char *filepath; /**< FilePath passed to the worker thread */
+  char *new_path; /**< New path of filepath for RENAME_FILE */
   enum WorkerType workType; /**< Specifies what thread should do and passed values */
 } WorkerThread_t;
 
@@ -267,6 +509,7 @@ static inline void free_WorkerThread_t(WorkerThread_t *ptr) {
     if (ptr->pwd) free(ptr->pwd);
     if (ptr->fileCopies) clear_FileCopyList(ptr->fileCopies);
     if (ptr->filepath) free(ptr->filepath);
+    free(ptr->new_path);
     free(ptr);
   }
 }
@@ -278,6 +521,10 @@ static inline void free_WorkerThread_t(WorkerThread_t *ptr) {
 typedef struct {
   int msg; /**< Int message from the worker */
   char *pwd; /**< pwd where the workers is operating */
+  char *filepath; /**< Path of the deleted, renamed or created file, NULL for PASTE_FILES */
+  char *new_path; /**< New path of the renamed file for RENAME_FILE, otherwise NULL */
+  GSList *files; /**< Entries created or overwritten in pwd by PASTE_FILES and MAKE_FOLDER, @see File */
+  bool target_remote; /**< Whether the worker modified the remote filesystem */
   enum WorkerType workType; /**< Specifies which work the worker has executed */
 } WorkerMessage_t;
 
@@ -288,10 +535,233 @@ typedef struct {
 static inline void free_WorkerMessage_t(WorkerMessage_t *msg) {
   if (msg) {
     if (msg->pwd) free(msg->pwd);
+    if (msg->filepath) free(msg->filepath);
+    free(msg->new_path);
+    clear_Filelist(msg->files);
     free(msg);
   }
 }
 
+/**
+  *   @struct ListerJob_t
+  *   @brief Directory listing passed to a lister thread and back to the main thread
+  */
+typedef struct {
+  char *pwd; /**< Directory to be listed */
+  bool remote; /**< Whether the directory is on the remote */
+  unsigned generation; /**< FileStore generation at the time of the request */
+  GSList *files; /**< Listed files set by the lister, NULL on error */
+  bool validate; /**< Revalidate the cached listing before listing the directory again */
+  bool unchanged; /**< Set by the lister when the cached listing was still valid */
+  bool watch; /**< Poll of the watched remote folder: list only if the mtime differs from mtime */
+  uint64_t mtime; /**< Known directory mtime for watch polls (0 forces listing), set to the polled mtime */
+  enum SortColumn sort; /**< Column the listing is sorted by */
+  bool descending; /**< Whether the listing is sorted in descending order */
+  bool sorted; /**< Set by the lister when files are sorted by sort and descending */
+  unsigned invalidations; /**< ListingCache invalidation count taken by the lister while listing */
+} ListerJob_t;
+
+/**
+  *   @brief Free memory used for ListerJob_t
+  *   @param job Pointer to a ListerJob_t to be freed
+  */
+static inline void free_ListerJob_t(ListerJob_t *job) {
+  if (job) {
+    if (job->pwd) free(job->pwd);
+    clear_Filelist(job->files);
+    free(job);
+  }
+}
+
+/**
+  *   @struct FilterJob_t
+  *   @brief Filter request passed to a filter thread and back to the main thread
+  */
+typedef struct {
+  NameTable *table; /**< Referenced snapshot of the names to be matched */
+  char *pattern; /**< Case folded pattern */
+  gint generation; /**< FileStore filter generation at the time of the request */
+  bool remote; /**< Whether the request is for remoteFileStore */
+  bool fuzzy; /**< Set by the filter thread when pattern had to be matched as a subsequence */
+  GArray *matches; /**< Indexes (unsigned) of the matching names in table, set by the filter thread */
+  bool cancelled; /**< Set by the filter thread if a newer request arrived */
+} FilterJob_t;
+
+/**
+  *   @brief Free memory used for FilterJob_t
+  *   @param job Pointer to a FilterJob_t to be freed
+  */
+static inline void free_FilterJob_t(FilterJob_t *job) {
+  if (job) {
+    NameTable_unref(job->table);
+    if (job->pattern) free(job->pattern);
+    if (job->matches) g_array_free(job->matches, TRUE);
+    free(job);
+  }
+}
+
+/**
+  *   @struct SortJob_t
+  *   @brief Sort request passed to a sorter thread and back to the main thread
+  */
+typedef struct {
+  SortKey *keys; /**< Keys of the entries in FileStore files order */
+  char *strings; /**< Names and collation keys referenced by keys */
+  unsigned count; /**< Number of keys */
+  enum SortColumn column; /**< Column to be sorted by */
+  bool descending; /**< Whether to sort in descending order */
+  bool remote; /**< Whether the request is for remoteFileStore */
+  unsigned modified; /**< FileStore modified at the time of the request */
+} SortJob_t;
+
+/**
+  *   @brief Free memory used for SortJob_t
+  *   @param job Pointer to a SortJob_t to be freed
+  */
+static inline void free_SortJob_t(SortJob_t *job) {
+  if (job) {
+    if (job->keys) free(job->keys);
+    if (job->strings) free(job->strings);
+    free(job);
+  }
+}
+
+/**
+  *   @struct FolderSizeJob_t
+  *   @brief Recursive folder size computed by a sizer thread
+  */
+typedef struct {
+  char *path; /**< Path of the folder */
+  bool remote; /**< Whether the folder is on the remote */
+  DirSizeProgress progress; /**< Totals read by the main thread while the sizer runs */
+  int status; /**< Set by the sizer thread: 0 when finished, -1 if cancelled */
+} FolderSizeJob_t;
+
+/**
+  *   @brief Free memory used for FolderSizeJob_t
+  *   @param job Pointer to a FolderSizeJob_t no longer used by its thread
+  */
+static inline void free_FolderSizeJob_t(FolderSizeJob_t *job) {
+  if (job) {
+    if (job->path) free(job->path);
+    DirSizeProgress_destroy(&(job->progress));
+    free(job);
+  }
+}
+
+/**
+  *   @struct SearchJob_t
+  *   @brief Recursive search run by a searcher thread
+  */
+typedef struct {
+  char *root; /**< Folder searched */
+  bool remote; /**< Whether the folder is on the remote */
+  bool indexed; /**< Whether remoteIndex is searched instead of the server */
+  bool contents; /**< Whether file contents are searched with grep, matches are GrepMatch */
+  SearchQuery query; /**< Predicates, pattern owned by the job */
+  SearchProgress progress; /**< Matches taken by the main thread while the searcher runs */
+  int status; /**< Set by the searcher thread: 0 when finished, -1 on error or if cancelled,
+                   SEARCH_UNSUPPORTED if the server cannot run grep */
+} SearchJob_t;
+
+/**
+  *   @brief Free memory used for SearchJob_t
+  *   @param job Pointer to a SearchJob_t no longer used by its thread
+  */
+static inline void free_SearchJob_t(SearchJob_t *job) {
+  if (job) {
+    if (job->root) free(job->root);
+    if (job->query.pattern) free(job->query.pattern);
+    SearchProgress_destroy(&(job->progress));
+    free(job);
+  }
+}
+
+/**
+  *   @struct IndexJob_t
+  *   @brief Indexing of a remote folder run by an indexer thread
+  */
+typedef struct {
+  enum IndexAction action; /**< What to do */
+  char *root; /**< Folder indexed */
+  volatile gint folders; /**< Folders indexed so far */
+  volatile gint cancel; /**< Set to non-zero to stop indexing */
+  int status; /**< Set by the indexer thread: 0 when finished, -1 on error or if cancelled */
+  IndexFreshness freshness; /**< Set by the indexer thread for INDEX_FRESHNESS */
+  bool found; /**< Set by the indexer thread for INDEX_FRESHNESS: whether root is in the index */
+} IndexJob_t;
+
+/**
+  *   @brief Free memory used for IndexJob_t
+  *   @param job Pointer to an IndexJob_t no longer used by its thread
+  */
+static inline void free_IndexJob_t(IndexJob_t *job) {
+  if (job) {
+    if (job->root) free(job->root);
+    free(job);
+  }
+}
+
+/**
+  *   @struct ViewerJob_t
+  *   @brief Page read for viewerWindow by a viewer thread
+  */
+typedef struct {
+  enum ViewerAction action; /**< What to read */
+  PagedFile *file; /**< File read, set by the viewer thread for VIEWER_OPEN */
+  char *path; /**< File opened by VIEWER_OPEN */
+  bool remote; /**< Whether path is on the remote */
+  uint64_t offset; /**< Start (VIEWER_PAGE) or end (VIEWER_PREVIOUS, VIEWER_FOLLOW) of the page */
+  GString *text; /**< Lines read */
+  uint64_t start; /**< Offset of text in the file */
+  uint64_t end; /**< Offset after text */
+  bool replace; /**< Whether text replaces the page, VIEWER_FOLLOW appends unless the file shrank */
+  int status; /**< Set by the viewer thread: 0 on success, -1 on error */
+} ViewerJob_t;
+
+/**
+  *   @brief Free memory used for ViewerJob_t
+  *   @param job Pointer to a ViewerJob_t no longer used by its thread
+  *   @remark The file is not closed
+  */
+static inline void free_ViewerJob_t(ViewerJob_t *job) {
+  if (job) {
+    if (job->path) free(job->path);
+    if (job->text) g_string_free(job->text, TRUE);
+    free(job);
+  }
+}
+
+/**
+  *   @struct EditJob_t
+  *   @brief Transfer of an edited file done by an editor thread
+  */
+typedef struct {
+  enum EditAction action; /**< What to transfer */
+  EditFile *edit; /**< File transferred, owned by editFiles */
+  int status; /**< Set by the editor thread: 0 on success, EDIT_CONFLICT or -1 on error */
+} EditJob_t;
+
+/**
+  *   @struct PrefetchJob_t
+  *   @brief Remote directories passed to the prefetcher thread
+  */
+typedef struct {
+  GSList *paths; /**< Remote directory paths (char *) in priority order */
+  gint generation; /**< remoteFileStore generation the paths were picked for */
+} PrefetchJob_t;
+
+/**
+  *   @brief Free memory used for PrefetchJob_t
+  *   @param job Pointer to a PrefetchJob_t to be freed
+  */
+static inline void free_PrefetchJob_t(PrefetchJob_t *job) {
+  if (job) {
+    g_slist_free_full(job->paths, free);
+    free(job);
+  }
+}
+
 // Global variables
 GtkBuilder *builder; /**< GtkBuilder used to create all the windows */
 MainWindow *mainWindow; /**< Pointer to the main window instance */
@@ -299,14 +769,46 @@ MessageWindow *messageWindow; /**< Pointer to a message window */
 ConnectWindow *connectWindow; /**< Pointer to the connect window */
 PopOverDialog *popOverDialog; /**< Pointer to a PopOverDialog struct */
 FilePropertiesDialog *filePropertiesDialog; /**< Pointer to a FilePropertiesDialog  struct */
+SearchWindow *searchWindow; /**< Pointer to a SearchWindow struct */
+ViewerWindow *viewerWindow; /**< Pointer to a ViewerWindow struct */
 Session *session; /**< SSH Session pointer */
+ListingCache *remoteCache; /**< Cache for remote listings, created per session */
+SizeCache *localSizes; /**< Cache for computed local folder sizes */
+SizeCache *remoteSizes; /**< Cache for computed remote folder sizes, created per session */
+GAsyncQueue *folderSizeQueue; /**< Queue where sizer threads deliver FolderSizeJob_t results to the main thread */
+volatile gint pending_folder_sizes; /**< Number of sizer threads which have not delivered their result yet */
+GAsyncQueue *searchQueue; /**< Queue where searcher threads deliver finished SearchJob_t to the main thread */
+volatile gint pending_searches; /**< Number of searcher threads which have not delivered their result yet */
+RemoteIndex *remoteIndex; /**< Index of the server, NULL until the user has indexed a folder on it */
+char *remoteIndexFile; /**< Index file of the server, set per session */
+GAsyncQueue *indexQueue; /**< Queue where indexer threads deliver finished IndexJob_t to the main thread */
+volatile gint pending_indexers; /**< Number of indexer threads which have not delivered their result yet */
+Thumbnailer *thumbnailer; /**< Generates thumbnails for the IconViews */
+DownloadCache *downloadCache; /**< Cache of downloaded remote files, NULL if disabled */
+GAsyncQueue *viewerQueue; /**< Queue where viewer threads deliver finished ViewerJob_t to the main thread */
+volatile gint pending_viewers; /**< Number of viewer threads which have not delivered their result yet */
+GHashTable *editFiles; /**< Remote files edited during the session: remote path -> EditFile */
+GAsyncQueue *editQueue; /**< Queue where editor threads deliver finished EditJob_t to the main thread */
+volatile gint pending_editors; /**< Number of editor threads which have not delivered their result yet */
 FileStore *remoteFileStore; /**< Used to store displayed elements which correspond to RemoteFiles */
 FileStore *localFileStore; /**< Uses to store displayed elements which correspond to LocalFiles */
 GSList *fileCopies; /**< GSList which stores FileCopy structs for files selected for a copy operation */
 GAsyncQueue *asyncQueue; /**< Queue used for cross-thread communication, only main thread should listen for incoming messages */
+GAsyncQueue *listQueue; /**< Queue where lister threads deliver ListerJob_t results to the main thread */
+volatile gint pending_listers; /**< Number of lister threads which have not delivered their result yet */
+GAsyncQueue *filterQueue; /**< Queue where filter threads deliver FilterJob_t results to the main thread */
+volatile gint pending_filters; /**< Number of filter threads which have not delivered their result yet */
+GAsyncQueue *sortQueue; /**< Queue where sorter threads deliver SortJob_t results to the main thread */
+volatile gint pending_sorts; /**< Number of sorter threads which have not delivered their result yet */
+volatile gint prefetch_running; /**< Whether the prefetcher thread is running */
+volatile gint prefetch_generation; /**< Generation of the newest remote listing request, stops outdated prefetches */
 volatile sig_atomic_t worker_running; /**< Whether a worker is running */
 volatile sig_atomic_t working_on_remote; /**< Whether the worker is working on remote filesystem */
 bool show_hidden_files; /**< Whether to show hidden files or not */
+bool watch_remote; /**< Whether the remote folder is watched for changes */
+bool shell_delete; /**< Whether remote folders may be deleted with rm -rf, @see Session */
+enum SortColumn sort_column; /**< Column both listings are sorted by */
+bool sort_descending; /**< Whether listings are sorted in descending order */
 
 
 /* Queue (Worker thread) handling */
@@ -331,6 +833,503 @@ gboolean check_asyncQueue(gpointer user_data);
   */
 void *init_worker(void *ptr);
 
+/**
+  *   @brief Check whether lister threads have delivered listings to listQueue
+  *   @remark Installed as a timeout source when a listing is started. Only the
+  *   result of the newest request for a FileStore is displayed
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all listers have finished
+  */
+gboolean check_listQueue(gpointer user_data);
+
+/**
+  *   @brief List a directory in a detached thread
+  *   @param ptr Void pointer which should be casted to ListerJob_t
+  *   @remark The job is pushed back to listQueue with files set. Remote
+  *   listings hold the session lock (@see session_lock) and are stored to
+  *   remoteCache. When job->validate is set, the directory is only listed if
+  *   its mtime has changed
+  *   @return NULL from pthread_exit
+  */
+void *init_lister(void *ptr);
+
+/**
+  *   @brief Schedule prefetching remote directories near the cursor
+  *   @remark The prefetch starts after the remote view has stayed still for
+  *   PREFETCH_DELAY, rescheduling restarts the delay
+  */
+void schedule_prefetch();
+
+/**
+  *   @brief Schedule requesting thumbnails for the images shown in the IconViews
+  *   @remark Thumbnails are requested after the views have stayed still for
+  *   THUMB_DELAY, rescheduling restarts the delay
+  */
+void schedule_thumbnails();
+
+/**
+  *   @brief Request thumbnails for the images shown in the IconViews
+  *   @param user_data Not used
+  *   @return FALSE, the timeout is removed
+  *   @remark Requests still waiting for a thread are dropped first, so only
+  *   the rows in view are thumbnailed
+  */
+gboolean start_thumbnails(gpointer user_data);
+
+/**
+  *   @brief Show finished thumbnails in the IconViews
+  *   @param user_data Not used
+  *   @return Whether to keep running this: stops when no requests are pending
+  */
+gboolean check_thumbQueue(gpointer user_data);
+
+/**
+  *   @brief Pick directories to be prefetched and start the prefetcher thread
+  *   @param user_data Not used
+  *   @return TRUE to retry later while the link is busy, otherwise FALSE
+  *   @remark Candidates are the parent directory and the subdirectories nearest
+  *   to the cursor in RightFileView which are not cached yet
+  */
+gboolean start_prefetch(gpointer user_data);
+
+/**
+  *   @brief List directories to remoteCache in a detached thread
+  *   @param ptr Void pointer which should be casted to PrefetchJob_t
+  *   @remark Gives way to user initiated listings and workers by stopping as
+  *   soon as the link is needed or the user has navigated elsewhere
+  *   @return NULL from pthread_exit
+  */
+void *init_prefetcher(void *ptr);
+
+/* Filtering */
+
+/**
+  *   @brief Filter the entries of a FileStore by name
+  *   @remark The names are matched in a detached thread against a snapshot
+  *   (@see NameTable), each request cancels the previous one. The displayed
+  *   entries change when the result arrives, @see check_filterQueue. Nothing
+  *   is listed again. Entries added after the snapshot are matched one by one,
+  *   the snapshot is built again only once FILTER_MAX_ADDED have been added
+  *   @param fileStore FileStore to be filtered
+  *   @param text Filter as typed, NULL or "" displays all entries
+  */
+void filter_FileStore(FileStore *fileStore, const char *text);
+
+/**
+  *   @brief Drop the name snapshot of a FileStore after it has been listed again
+  *   @remark The next filter request creates a new snapshot
+  *   @param fileStore FileStore
+  */
+void drop_FileStore_names(FileStore *fileStore);
+
+/**
+  *   @brief Record a name which is not in the name snapshot of a FileStore
+  *   @param fileStore FileStore
+  *   @param name Added or new name of an entry, copied
+  */
+void add_FileStore_name(FileStore *fileStore, const char *name);
+
+/**
+  *   @brief Match a filter in a detached thread
+  *   @param ptr Void pointer which should be casted to FilterJob_t
+  *   @remark Names containing the pattern match. If none does, the pattern is
+  *   matched as a subsequence instead. The job is pushed back to filterQueue
+  *   @return NULL from pthread_exit
+  */
+void *init_filter(void *ptr);
+
+/**
+  *   @brief Check whether filter threads have delivered results to filterQueue
+  *   @remark Only the result of the newest request for a FileStore is applied
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all filters have finished
+  */
+gboolean check_filterQueue(gpointer user_data);
+
+/**
+  *   @brief Filter the matching pane when a FilterEntry changes
+  *   @param entry LeftFilterEntry or RightFilterEntry
+  *   @param ptr Not used
+  */
+void FilterEntry_OnChanged(GtkSearchEntry *entry, gpointer ptr);
+
+/**
+  *   @brief Clear a FilterEntry and move the focus back to its FileView
+  *   @remark Connected to the stop-search signal, emitted on Escape
+  *   @param entry LeftFilterEntry or RightFilterEntry
+  *   @param ptr Not used
+  */
+void FilterEntry_OnStop(GtkSearchEntry *entry, gpointer ptr);
+
+/* Sorting */
+
+/**
+  *   @brief Sort the entries of a FileStore by sort_column and sort_descending
+  *   @remark Listings with at least SORT_THREAD_MIN entries are sorted in a
+  *   detached thread using a copy of the keys (@see SortKey). The rows are
+  *   reordered in place when the order arrives, @see check_sortQueue. Local
+  *   listings without metadata are listed again when sorted by size or mtime
+  *   @param fileStore FileStore to be sorted
+  */
+void sort_FileStore(FileStore *fileStore);
+
+/**
+  *   @brief Sort a FileStore again after entries were added in place
+  *   @remark Coalesces bursts of additions, rescheduling restarts the SORT_DELAY
+  *   @param fileStore FileStore to be sorted
+  */
+void schedule_sort(FileStore *fileStore);
+
+/**
+  *   @brief Sort SortKeys in a detached thread
+  *   @param ptr Void pointer which should be casted to SortJob_t
+  *   @remark The job is pushed back to sortQueue
+  *   @return NULL from pthread_exit
+  */
+void *init_sorter(void *ptr);
+
+/**
+  *   @brief Check whether sorter threads have delivered results to sortQueue
+  *   @remark Orders of outdated listings are discarded and the listing is sorted again
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all sorters have finished
+  */
+gboolean check_sortQueue(gpointer user_data);
+
+/**
+  *   @brief Sort both listings by the column of a sort submenu item
+  *   @param item GtkRadioMenuItem of the column
+  *   @param column SortColumn passed with GINT_TO_POINTER
+  */
+void SortMenuItem_toggled(GtkCheckMenuItem *item, gpointer column);
+
+/**
+  *   @brief Reverse the order of both listings
+  *   @param item The sort_descending GtkCheckMenuItem
+  *   @param ptr Not used
+  */
+void toggle_SortDescending(GtkCheckMenuItem *item, gpointer ptr);
+
+/* Folder sizes */
+
+/**
+  *   @brief Show the recursive size of a folder in filePropertiesDialog
+  *   @remark Cached sizes are shown at once. Otherwise a sizer thread is
+  *   started and its totals are shown as they grow, @see check_folderSizeQueue.
+  *   A computation still running for another folder is cancelled
+  *   @param path Path of the folder
+  *   @param remote Whether the folder is on the remote
+  */
+void start_FolderSize(const char *path, const bool remote);
+
+/**
+  *   @brief Cancel the folder size computation shown in filePropertiesDialog
+  *   @remark The thread stops after the folder it is reading, its result is discarded
+  */
+void cancel_FolderSize();
+
+/**
+  *   @brief Compute a folder size in a detached thread
+  *   @param ptr Void pointer which should be casted to FolderSizeJob_t
+  *   @remark Local folders are read by DIR_SIZE_THREADS threads, remote
+  *   folders by the pipelined sftp_session_walk. The job is pushed back to
+  *   folderSizeQueue
+  *   @return NULL from pthread_exit
+  */
+void *init_folder_sizer(void *ptr);
+
+/**
+  *   @brief Show the progress of the displayed folder size and collect finished sizer threads
+  *   @remark Finished sizes are stored to localSizes or remoteSizes
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all sizers have finished
+  */
+gboolean check_folderSizeQueue(gpointer user_data);
+
+/* Searching */
+
+/**
+  *   @brief Start searching searchWindow->root with the predicates of searchWindow
+  *   @remark A search still running is cancelled and the results are cleared.
+  *   Matches are shown as they arrive, @see check_searchQueue. Content
+  *   searches show the matching lines instead of sizes and modification times
+  */
+void start_Search();
+
+/**
+  *   @brief Cancel the search shown in searchWindow
+  *   @remark The searcher thread stops at its next read, its job is freed when delivered
+  */
+void cancel_Search();
+
+/**
+  *   @brief Run a search in a detached thread
+  *   @param ptr Void pointer which should be casted to SearchJob_t
+  *   @remark The job is pushed back to searchQueue when the search ends
+  *   @return NULL from pthread_exit
+  */
+void *init_searcher(void *ptr);
+
+/**
+  *   @brief Add new matches to searchWindow and collect finished searcher threads
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all searchers have finished
+  */
+gboolean check_searchQueue(gpointer user_data);
+
+/**
+  *   @brief Open the folder of an activated search result in the pane it was searched from
+  *   @remark Folders are opened themselves, files show their parent folder
+  */
+void SearchResults_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer ptr);
+
+/**
+  *   @brief Index searchWindow->root in the background
+  *   @remark Creates remoteIndex if the server has not been indexed before.
+  *   Listings of the remote pane update remoteIndex once it exists
+  */
+void start_Indexer();
+
+/**
+  *   @brief Cancel the running indexer
+  *   @remark The indexer stops at its next reply, what it has indexed is kept
+  */
+void cancel_Indexer();
+
+/**
+  *   @brief Run sftp_session_index or RemoteIndex_freshness in a detached thread
+  *   @param ptr Void pointer which should be casted to IndexJob_t
+  *   @remark The job is pushed back to indexQueue when it ends
+  *   @return NULL from pthread_exit
+  */
+void *init_indexer(void *ptr);
+
+/**
+  *   @brief Show the indexer progress and collect finished indexer threads
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all indexers have finished
+  */
+gboolean check_indexQueue(gpointer user_data);
+
+/**
+  *   @brief Start a search from searchWindow
+  */
+void SearchButton_action(GtkButton *SearchButton);
+
+/**
+  *   @brief Start or stop indexing the folder of searchWindow
+  */
+void SearchIndexButton_action(GtkButton *SearchIndexButton);
+
+/**
+  *   @brief Stop the search of searchWindow
+  */
+void SearchStopButton_action(GtkButton *SearchStopButton);
+
+/* Viewing */
+
+/**
+  *   @brief Read a page of viewerWindow->file in the background
+  *   @param action What to read, @see ViewerAction
+  *   @param offset Start or end of the page
+  *   @remark Ignored while a page is being read, only one thread reads a file at a time
+  */
+void start_Viewer(const enum ViewerAction action, const uint64_t offset);
+
+/**
+  *   @brief Close the file of viewerWindow
+  *   @remark A file still being read is closed when its thread delivers the page
+  */
+void close_Viewer();
+
+/**
+  *   @brief Read a page in a detached thread
+  *   @param ptr Void pointer which should be casted to ViewerJob_t
+  *   @remark The job is pushed back to viewerQueue when the page has been read
+  *   @return NULL from pthread_exit
+  */
+void *init_viewer(void *ptr);
+
+/**
+  *   @brief Show pages read by viewer threads in viewerWindow
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all viewer threads have finished
+  */
+gboolean check_viewerQueue(gpointer user_data);
+
+/**
+  *   @brief Check a followed file for appended lines
+  *   @param user_data Not used
+  *   @return Whether to keep running this: stops when following is turned off
+  *   @remark Only the size is requested while nothing is appended
+  */
+gboolean follow_Viewer(gpointer user_data);
+
+/**
+  *   @brief Move viewerWindow to another page
+  *   @param button ViewerStartButton, ViewerPreviousButton, ViewerNextButton or ViewerEndButton
+  */
+void ViewerButton_action(GtkButton *button);
+
+/**
+  *   @brief Start or stop following the file of viewerWindow
+  */
+void toggle_ViewerFollow(GtkToggleButton *button, gpointer ptr);
+
+/* Editing */
+
+/**
+  *   @brief Open a file of a pane in the editor
+  *   @param filename Name of the file in the current folder of the pane
+  *   @param remote Whether the file is on the remote
+  *   @remark Remote files are downloaded first, opening one already being edited
+  *   launches the editor on its local copy again
+  */
+void transition_Editor(const char *filename, const bool remote);
+
+/**
+  *   @brief Write the edited copy over the remote file messageWindow asked about
+  *   @remark Called when the user accepts ASK_EDIT_CONFLICT
+  */
+void overwrite_EditConflict();
+
+/**
+  *   @brief Download or write back an edited file in a detached thread
+  *   @param ptr Void pointer which should be casted to EditJob_t
+  *   @remark The job is pushed back to editQueue when the transfer has finished
+  *   @return NULL from pthread_exit
+  */
+void *init_editor(void *ptr);
+
+/**
+  *   @brief Handle transfers finished by editor threads
+  *   @param user_data Pointer to the queue
+  *   @return Whether to keep running this: stops after all editor threads have finished
+  */
+gboolean check_editQueue(gpointer user_data);
+
+/**
+  *   @brief Check the local copies in editFiles for saves and write them back
+  *   @param user_data Not used
+  *   @return Whether to keep running this: stops when no files are edited
+  */
+gboolean poll_EditFiles(gpointer user_data);
+
+/* File views */
+
+/**
+  *   @brief Create a details view for a pane
+  *   @remark Rows have a fixed height and the columns a fixed width, so the
+  *   view lays out only the visible rows. It is placed directly in the
+  *   GtkScrolledWindow, not in a GtkViewport, to scroll natively
+  *   @param remote Whether the view displays remoteFileStore
+  *   @return Sunk reference to a GtkTreeView, owned by mainWindow
+  */
+GtkWidget *new_DetailsView(const bool remote);
+
+/**
+  *   @brief Display a pane as icons or as a details list
+  *   @remark The model is moved to the displayed view, the hidden view keeps no model
+  *   @param remote Whether to switch the remote (right) pane
+  *   @param details Whether to display the details view
+  */
+void set_FileView_details(const bool remote, const bool details);
+
+/**
+  *   @brief Switch the pane of ContextMenuEmitter between icons and details
+  *   @param item The details_view GtkCheckMenuItem
+  *   @param ptr Not used
+  */
+void toggle_DetailsView(GtkCheckMenuItem *item, gpointer ptr);
+
+/**
+  *   @brief Sort the listings by the column of a clicked DetailsView header
+  *   @remark Clicking the current column reverses the order
+  *   @param column Clicked GtkTreeViewColumn
+  *   @param sort SortColumn passed with GINT_TO_POINTER
+  */
+void DetailsColumn_clicked(GtkTreeViewColumn *column, gpointer sort);
+
+/**
+  *   @brief Show the sort column and order in the DetailsView headers
+  */
+void update_DetailsView_headers();
+
+/**
+  *   @brief Get the path of the item at a position of a FileView
+  *   @param fileView GtkIconView or GtkTreeView
+  *   @param x X coordinate of a button event on fileView
+  *   @param y Y coordinate of a button event on fileView
+  *   @return GtkTreePath which must be freed, NULL if there is no item
+  */
+GtkTreePath *FileView_get_path_at_pos(GtkWidget *fileView, const gint x, const gint y);
+
+/**
+  *   @brief Get the selected items of a FileView
+  *   @param fileView GtkIconView or GtkTreeView
+  *   @return GList of GtkTreePaths, free with g_list_free_full and gtk_tree_path_free
+  */
+GList *FileView_get_selected_items(GtkWidget *fileView);
+
+/**
+  *   @brief Select only one item of a FileView
+  *   @param fileView GtkIconView or GtkTreeView
+  *   @param path Item to be selected, NULL clears the selection
+  */
+void FileView_select_only(GtkWidget *fileView, GtkTreePath *path);
+
+/**
+  *   @brief Get the cursor item of a FileView
+  *   @param fileView GtkIconView or GtkTreeView
+  *   @param path Set to a GtkTreePath which must be freed
+  *   @return TRUE if the cursor is set, otherwise FALSE
+  */
+gboolean FileView_get_cursor(GtkWidget *fileView, GtkTreePath **path);
+
+/**
+  *   @brief Set the model of a FileView
+  *   @param fileView GtkIconView or GtkTreeView
+  *   @param model GtkTreeModel, NULL detaches the current model
+  */
+void FileView_set_model(GtkWidget *fileView, GtkTreeModel *model);
+
+/* Local directory watching */
+
+/**
+  *   @brief Create the inotify instance used for watching local_pwd
+  *   @remark Intended to be called only once from initUI. Without inotify the
+  *   local pane is only refreshed by our own operations
+  */
+void init_LocalWatch();
+
+/**
+  *   @brief Watch a local directory instead of the previously watched one
+  *   @param dir_name Path of the directory
+  *   @remark Called when a listing of dir_name is requested, so changes made
+  *   while the listing is running are applied on top of it
+  */
+void watch_local_dir(const char *dir_name);
+
+/**
+  *   @brief Read inotify events and coalesce them by filename
+  *   @param source GIOChannel of the inotify instance
+  *   @param condition Not used
+  *   @param data Not used
+  *   @return TRUE to keep watching
+  */
+gboolean LocalWatch_OnEvent(GIOChannel *source, GIOCondition condition, gpointer data);
+
+/**
+  *   @brief Apply coalesced local changes to localFileStore in place
+  *   @param data Not used
+  *   @return TRUE while the listing of the watched directory is still loading,
+  *   otherwise FALSE
+  *   @remark Runs at most once per WATCH_DEBOUNCE, so a continuous burst of
+  *   events updates the view in steady steps. A full listing is only
+  *   requested if the inotify queue overflows or the directory itself goes away
+  */
+gboolean apply_LocalWatch_changes(gpointer data);
+
 /* UI initialization */
 
 /**
@@ -396,10 +1395,37 @@ void init_FilePropertiesDialog();
 
 /**
   *   @brief Close filePropertiesDialog
+  *   @remark Cancels a running folder size computation
   *   @return TRUE to indicate that the event has been handled
   */
 gboolean close_FilePropertiesDialog();
 
+/**
+  *   @brief Init searchWindow
+  *   @remark Intended to be called only once from initUI
+  */
+void init_SearchWindow();
+
+/**
+  *   @brief Close searchWindow
+  *   @remark Cancels a running search, the results are kept
+  *   @return TRUE to indicate that the event has been handled
+  */
+gboolean close_SearchWindow();
+
+/**
+  *   @brief Init viewerWindow
+  *   @remark Intended to be called only once from initUI
+  */
+void init_ViewerWindow();
+
+/**
+  *   @brief Close viewerWindow
+  *   @remark Stops following and closes the file
+  *   @return TRUE to indicate that the event has been handled
+  */
+gboolean close_ViewerWindow();
+
 /**
   *   @brief Clear ContextMenu
   *   @remark Intended to be called from quitUI
@@ -433,10 +1459,25 @@ gboolean transition_ContextMenu(GtkWidget *widget, GdkEvent *event);
 
 /**
 *   @brief Show FilePropertiesDialog
-*   @remark mainWindow->contextMenu->ContextMenuEmitter must have been set
+*   @remark mainWindow->contextMenu->ContextMenuEmitter must have been set. The
+*   size of a folder is computed recursively in the background, @see start_FolderSize
 */
 void transition_FilePropertiesDialog();
 
+/**
+  *   @brief Show searchWindow for the folder of the ContextMenuEmitter pane
+  *   @remark Results of an earlier search of the same folder are kept
+  */
+void transition_SearchWindow();
+
+/**
+  *   @brief Show a file of a pane in viewerWindow
+  *   @remark Only the pages shown are read, so huge remote files open at once
+  *   @param filename File in the folder of the pane
+  *   @param remote Whether the file is in the remote pane
+  */
+void transition_ViewerWindow(const char *filename, const bool remote);
+
 /**
   *   @brief Show correct ContextMenu buttons
   *   @param file_selected Boolean whether context menu is show for a selected file
@@ -577,26 +1618,70 @@ gboolean MainWindow_keypress_handler(GtkWidget *widget, GdkEventKey *event, gpoi
 
 /**
   *   @brief Toggle hidden files either shown or hidden
+  *   @remark Only refilters the rows already in the FileStores, nothing is listed again
   *   @param ptr Additional pointer not used
   */
 void toggle_HiddenFiles(gpointer ptr);
 
+/**
+  *   @brief Start or stop watching the remote folder
+  *   @param item The watch_remote GtkCheckMenuItem
+  *   @param ptr Additional pointer not used
+  */
+void toggle_RemoteWatch(GtkCheckMenuItem *item, gpointer ptr);
+
+/**
+  *   @brief Poll the watched remote folder for changes
+  *   @param data Not used
+  *   @return TRUE while watch_remote is set
+  *   @remark Each poll costs one sftp_stat while the folder is unchanged.
+  *   After a change the folder is listed once more, since a second change
+  *   within the same second would not change the mtime again
+  */
+gboolean poll_RemoteWatch(gpointer data);
+
+/**
+  *   @brief Allow or deny deleting remote folders with rm -rf on the server
+  *   @param item The shell_delete GtkCheckMenuItem
+  *   @param ptr Additional pointer not used
+  */
+void toggle_ShellDelete(GtkCheckMenuItem *item, gpointer ptr);
+
 
 /*  File handling */
 
 /**
-  *   @brief Update fileStore to contains contents of GSList which holds struct File entries
+  *   @brief Create an empty FileStore and set it as the model of fileView
+  *   @param fileView LeftFileView or RightFileView, the displayed view of the pane
+  *   @param remote Whether the FileStore displays remote files
+  *   @return Valid pointer, NULL on error
+  */
+FileStore *new_FileStore(GtkWidget *fileView, const bool remote);
+
+/**
+  *   @brief Replace fileStore contents with a listing
   *   @param fileStore FileStore to be updated
-  *   @param dir_name Target directory name (i.e. which files should be displayed)
-  *   @param remote Whether this is a remote filesystem (connect using sftp)
-  *   @return Valid pointer on success, otherwise NULL
+  *   @param files Linked list of struct File entries, fileStore takes ownership
+  *   @remark The first FILESTORE_FIRST_BATCH rows are inserted with the model
+  *   detached from the FileView, the rest in batches from an idle source
+  *   (@see fill_FileStore) so that the first rows are shown at once. Later
+  *   batches keep the model attached: detaching it would reset the scroll
+  *   position and selection while the user is already browsing the rows
   */
-FileStore *update_FileStore(FileStore *fileStore, const char *dir_name, const bool remote);
+void update_FileStore(FileStore *fileStore, GSList *files);
+
+/**
+  *   @brief Insert the next batch of pending entries to the FileStore
+  *   @param ptr Pointer to a FileStore
+  *   @return Whether entries are still pending (keeps the idle source running)
+  */
+gboolean fill_FileStore(gpointer ptr);
 
 /**
   *   @brief Add entry to FileStore
-  *   @remark This is called from update_FileStore via iterate_FileList. This
-  *   does not add "." and ".." filenames to FileStore
+  *   @remark This is called for each entry inserted by update_FileStore and
+  *   fill_FileStore. Every entry gets a row, the filter of the FileStore
+  *   decides which rows are displayed
   *   @param file struct File instance
   *   @param ptr Pointer to a FileStore passed as void *
   *   @param remote Whether this is a remote filesystem
@@ -610,14 +1695,24 @@ void add_FileStore(struct File *file, void *ptr, const bool remote);
 void clear_FileStore(FileStore *fileStore);
 
 /**
-  *   @brief Update FileStore to show correct files
+  *   @brief Start listing pwd in the background to update the FileStore
   *   @param pwd Present working directory, @see assets.h
   *   @param remote Whether the corresponding FileStore is remote or local
-  *   @return 0 on success, -1 on error (sets error using Session_message and
-  *   transitions to MessageWindow)
+  *   @return 0 when the listing was started, -1 on error (sets error using
+  *   Session_message and transitions to MessageWindow)
+  *   @remark The FileView and its path label are updated when the listing
+  *   arrives, @see check_listQueue. Remote listings found in remoteCache are
+  *   shown at once and revalidated in the background only when stale
   */
 int show_FileStore(const char *pwd, bool remote);
 
+/**
+  *   @brief Display a finished listing in the matching FileView
+  *   @param job Listing delivered by a lister thread, job->files is taken over
+  *   @remark On listing error the FileView is cleared and an error is shown
+  */
+void display_FileStore(ListerJob_t *job);
+
 /**
   *   @brief Update FileViews to show updated FileStores
   *   @remark This is basically only a wrapper for show_FileStore
@@ -625,6 +1720,94 @@ int show_FileStore(const char *pwd, bool remote);
   */
 void update_FileView(bool remote);
 
+/**
+  *   @brief Drop cached remote listings affected by a change of path
+  *   @param path Remote path which was created, renamed or removed
+  *   @remark Removes the listing of the parent directory and all listings
+  *   under path. Listings read before the call are not cached afterwards,
+  *   @see ListingCache_store_since
+  */
+void invalidate_remote_path(const char *path);
+
+/**
+  *   @brief Insert all entries still pending from update_FileStore at once
+  *   @param fileStore FileStore whose idle fill is completed
+  *   @remark Needed before entries are added or removed in place
+  */
+void complete_FileStore_fill(FileStore *fileStore);
+
+/**
+  *   @brief Add a new entry to a displayed FileStore without relisting
+  *   @param fileStore FileStore to be updated, its fill must be complete
+  *   @param file New entry, fileStore takes ownership
+  */
+void FileStore_add_File(FileStore *fileStore, File_t *file);
+
+/**
+  *   @brief Remove entries from a displayed FileStore without relisting
+  *   @param fileStore FileStore to be updated, its fill must be complete
+  *   @param names Set of filenames to be removed (GHashTable used as a set)
+  *   @remark Goes through files once regardless of the number of names
+  */
+void FileStore_remove_Files(FileStore *fileStore, GHashTable *names);
+
+/**
+  *   @brief Refresh the row of an entry after its type has changed
+  *   @param fileStore FileStore containing the entry
+  *   @param row FileRow of the entry
+  */
+void FileStore_update_row(FileStore *fileStore, FileRow *row);
+
+/**
+  *   @brief Add a new entry or update the existing entry of the same name
+  *   @param fileStore FileStore to be updated
+  *   @param file Entry, fileStore takes ownership
+  */
+void FileStore_put_File(FileStore *fileStore, File_t *file);
+
+/**
+  *   @brief Remove one entry from a displayed FileStore
+  *   @param fileStore FileStore to be updated
+  *   @param name Filename to be removed
+  */
+void FileStore_remove_File(FileStore *fileStore, const char *name);
+
+/**
+  *   @brief Rename an entry in place, keeping its row, position and selection
+  *   @param fileStore FileStore to be updated
+  *   @param old_name Current filename
+  *   @param new_name New filename, an existing entry with this name is replaced
+  */
+void FileStore_rename_File(FileStore *fileStore, const char *old_name, const char *new_name);
+
+/**
+  *   @brief Get the FileStore displaying pwd
+  *   @param pwd Directory where an operation changed files
+  *   @param remote Whether pwd is on the remote
+  *   @return The matching FileStore if it displays pwd, otherwise NULL
+  */
+FileStore *get_pwd_FileStore(const char *pwd, const bool remote);
+
+/**
+  *   @brief Apply a new listing of the displayed directory as a diff
+  *   @param fileStore FileStore to be updated, its fill is completed first
+  *   @param files New listing of the same directory, entries are taken over
+  *   or freed
+  *   @return Number of added, removed and retyped entries (metadata updates of
+  *   existing entries are not counted)
+  *   @remark Rows are sorted again only when entries changed or a size or
+  *   mtime the rows are sorted by differs
+  */
+unsigned apply_FileStore_diff(FileStore *fileStore, GSList *files);
+
+/**
+  *   @brief Find a displayed file by name
+  *   @param fileStore FileStore to search
+  *   @param filename Name of the file
+  *   @return Matching File, NULL if not found
+  */
+File_t *get_FileStore_file(FileStore *fileStore, const char *filename);
+
 /**
   *   @brief Rename file, creates PopOverWindow for renaming
   *   @remark FileView (mainWindow->contextMenu->ContextMenuEmitter) must have
@@ -649,7 +1832,7 @@ void create_folder();
 void delete_file_threaded(bool finalize);
 
 /**
-  *   @brief Delete file or directory
+  *   @brief Delete file or directory, @see delete_file_threaded
   *   @param finalize true -> permanently delete files, false -> show promt
   *   whether to permanently delete files
   *   @remark FileView (mainWindow->contextMenu->ContextMenuEmitter) must have
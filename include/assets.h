@@ -21,6 +21,11 @@
 #include <time.h>
 
 #define CSS_FILE_PATH "../layout/styles.css" /**< Path to the css file */
+#define ICON_SIZE 48 /**< Size (px) of the icons in IconViews */
+#define DETAILS_ICON_SIZE 16 /**< Size (px) of the icons in DetailsViews */
+#define FOLDER_CONTENT_TYPE "inode/directory" /**< Content type of folders */
+#define UNKNOWN_CONTENT_TYPE "application/octet-stream" /**< Content type when the name tells nothing */
+#define CONTENT_TYPE_MAX_EXTENSION 16 /**< Longest extension whose content type is cached */
 
 /**
   *   @enum bool
@@ -122,6 +127,29 @@ inline static const GdkPixbuf *get_Icon_filetype(const uint8_t file_type, const
   return  is_folder(file_type, remote) ? iconImages[FOLDER_ICON] : iconImages[FILE_ICON];
 }
 
+/**
+  *   @brief Get the content type of a file from its name
+  *   @details Only the name is used, the file is not read. Content types are
+  *   cached by extension
+  *   @param name Filename, may be a path
+  *   @param file_type File type spesification
+  *   @param remote Remote file (true) or local file (false)
+  *   @return Interned content type (do not free), FOLDER_CONTENT_TYPE for folders
+  *   @remark Call this only from the main thread
+  */
+const char *get_content_type(const char *name, const uint8_t file_type, const bool remote);
+
+/**
+  *   @brief Get the icon of a content type
+  *   @details Icons are loaded from the icon theme once per content type and
+  *   size and shared afterwards
+  *   @param content_type Interned content type, @see get_content_type
+  *   @param size Icon size in pixels
+  *   @return const pointer to a GdkPixbuf owned by the cache, NULL if no icon could be loaded
+  *   @remark Call this only from the main thread
+  */
+const GdkPixbuf *get_Icon_content_type(const char *content_type, const int size);
+
 /**
   *   @brief Initialize all assets
   *   @remark Call this when the main window is started (from initUI)
@@ -0,0 +1,178 @@
+/**
+  *   @file cache.h
+  *   @author Lauri Westerholm
+  *   @brief Cache for remote directory listings and folder sizes, header
+  */
+
+#ifndef CACHE_HEADER
+#define CACHE_HEADER
+
+#include <gmodule.h> // Linked list implementation, GSList
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fs.h"
+#include "assets.h"
+
+#define REMOTE_CACHE_TTL 10000000 /**< Time (us) a remote listing is served without revalidation */
+#define REMOTE_CACHE_MAX_ENTRIES 256 /**< Maximum number of cached remote listings */
+#define REMOTE_CACHE_REVALIDATIONS 6 /**< Ttls after which a listing is fetched again even if its mtime is unchanged */
+#define FOLDER_SIZE_TTL 60000000 /**< Time (us) a computed folder size is served from SizeCache */
+
+/**
+  *   @enum CacheState
+  *   @brief Result of a ListingCache lookup
+  */
+enum CacheState {
+  CACHE_MISS, /**< Path is not cached */
+  CACHE_FRESH, /**< Cached listing can be used as is */
+  CACHE_STALE /**< Cached listing can be shown but should be revalidated */
+};
+
+/**
+  *   @struct ListingCache
+  *   @brief Directory listings keyed by path
+  *   @remark All functions lock the cache, so it can be shared between threads
+  */
+typedef struct {
+  GHashTable *entries; /**< Path -> cached listing */
+  pthread_mutex_t lock; /**< Protects entries */
+  gint64 ttl; /**< Time (us) after which entries are considered stale */
+  unsigned max_entries; /**< The oldest entry is evicted when this is exceeded */
+  unsigned invalidations; /**< Number of ListingCache_invalidate calls */
+} ListingCache;
+
+/**
+  *   @brief Create a new ListingCache
+  *   @param ttl Time (us) entries are considered fresh
+  *   @param max_entries Maximum number of cached listings
+  *   @return Valid pointer, NULL on error
+  */
+ListingCache *new_ListingCache(const gint64 ttl, const unsigned max_entries);
+
+/**
+  *   @brief Free ListingCache and all cached listings
+  *   @param cache ListingCache to be freed
+  */
+void free_ListingCache(ListingCache *cache);
+
+/**
+  *   @brief Look up a cached listing
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param files Set to a copy of the cached listing (free using clear_Filelist)
+  *   when the path is cached, otherwise NULL
+  *   @return CacheState of the path
+  */
+enum CacheState ListingCache_lookup(ListingCache *cache, const char *path, GSList **files);
+
+/**
+  *   @brief Check whether a listing is cached without copying it
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @return true if the path is cached (fresh or stale)
+  */
+bool ListingCache_contains(ListingCache *cache, const char *path);
+
+/**
+  *   @brief Store a listing to the cache
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param files Listing, copied. The mtime of its "." entry is used for
+  *   revalidation, listings without one are always refetched when stale
+  */
+void ListingCache_store(ListingCache *cache, const char *path, const GSList *files);
+
+/**
+  *   @brief Get the number of invalidations so far
+  *   @param cache ListingCache
+  *   @return Counter to be passed to ListingCache_store_since
+  */
+unsigned ListingCache_invalidations(ListingCache *cache);
+
+/**
+  *   @brief Store a listing unless the cache has been invalidated since it was read
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param files Listing, copied, @see ListingCache_store
+  *   @param invalidations ListingCache_invalidations before the listing was read
+  *   @return true if the listing was stored
+  *   @remark A change made while the listing is read and invalidated before it
+  *   is stored would otherwise leave the old listing cached
+  */
+bool ListingCache_store_since(ListingCache *cache, const char *path, const GSList *files, const unsigned invalidations);
+
+/**
+  *   @brief Revalidate a stale listing against the current directory mtime
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param mtime Current mtime of the directory
+  *   @return true if the cached listing is still valid (it becomes fresh
+  *   again), false if it has changed or cannot be trusted (the entry is removed)
+  *   @remark mtime is compared with the one of the fetched listing, never with the
+  *   local clock. It has a one second resolution, so a change in the same second as
+  *   the fetch goes unnoticed: listings older than REMOTE_CACHE_REVALIDATIONS ttls
+  *   are not trusted
+  */
+bool ListingCache_revalidate(ListingCache *cache, const char *path, const uint64_t mtime);
+
+/**
+  *   @brief Remove a cached listing
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param recursive Whether to also remove listings of all subdirectories
+  */
+void ListingCache_invalidate(ListingCache *cache, const char *path, const bool recursive);
+
+/**
+  *   @struct SizeCache
+  *   @brief Recursive folder sizes keyed by path
+  *   @remark All functions lock the cache, so it can be shared between threads
+  */
+typedef struct {
+  GHashTable *entries; /**< Path -> cached size */
+  pthread_mutex_t lock; /**< Protects entries */
+  gint64 ttl; /**< Time (us) after which entries are dropped */
+} SizeCache;
+
+/**
+  *   @brief Create a new SizeCache
+  *   @param ttl Time (us) sizes are served
+  *   @return Valid pointer, NULL on error
+  */
+SizeCache *new_SizeCache(const gint64 ttl);
+
+/**
+  *   @brief Free SizeCache and all cached sizes
+  *   @param cache SizeCache to be freed
+  */
+void free_SizeCache(SizeCache *cache);
+
+/**
+  *   @brief Look up a cached folder size
+  *   @param cache SizeCache
+  *   @param path Folder path
+  *   @param size Set to the cached totals when found
+  *   @return true if a size younger than the ttl was found
+  */
+bool SizeCache_lookup(SizeCache *cache, const char *path, DirSize *size);
+
+/**
+  *   @brief Store a folder size to the cache
+  *   @param cache SizeCache
+  *   @param path Folder path
+  *   @param size Totals of a finished computation
+  */
+void SizeCache_store(SizeCache *cache, const char *path, const DirSize *size);
+
+/**
+  *   @brief Remove the sizes a change in a folder affects
+  *   @param cache SizeCache
+  *   @param path Changed folder, its ancestors and descendants are removed too
+  */
+void SizeCache_invalidate(SizeCache *cache, const char *path);
+
+#endif // end CACHE_HEADER
@@ -0,0 +1,160 @@
+/**
+  *   @file download.h
+  *   @author Lauri Westerholm
+  *   @brief Content addressed local cache of downloaded remote files, header
+  */
+
+#ifndef DOWNLOAD_HEADER
+#define DOWNLOAD_HEADER
+
+#include <gmodule.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "assets.h"
+
+#define DOWNLOAD_FOLDER "FileManager/downloads" /**< Cache folder under the user cache dir */
+#define DOWNLOAD_INDEX "index" /**< Index file in the cache folder */
+#define DOWNLOAD_OBJECTS "objects" /**< Folder of the cached contents, named by their SHA-256 */
+#define DOWNLOAD_CACHE_SIZE 1024 /**< Default size limit of the cache in MiB */
+#define DOWNLOAD_CACHE_ENV "FILEMANAGER_DOWNLOAD_CACHE" /**< Size limit in MiB, 0 disables the cache */
+#define DOWNLOAD_LINKS_ENV "FILEMANAGER_DOWNLOAD_LINKS" /**< Set to 1 to hard link hits with the mode of the content */
+#define DOWNLOAD_HASH_LEN 64 /**< Length of a hex SHA-256 */
+#define DOWNLOAD_COPY_SIZE 1048576 /**< Bytes copied with one sendfile */
+#define DOWNLOAD_MODE_MASK (S_IRWXU | S_IRWXG | S_IRWXO) /**< Permission bits compared and copied to contents */
+
+/**
+  *   @struct DownloadStats
+  *   @brief Lookups of a DownloadCache
+  */
+typedef struct {
+  uint64_t hits; /**< Downloads served from the cache */
+  uint64_t misses; /**< Downloads transferred from the server */
+  uint64_t saved; /**< Bytes not transferred thanks to hits */
+  uint64_t evictions; /**< Entries dropped to stay under the size limit */
+} DownloadStats;
+
+/**
+  *   @struct DownloadBlob
+  *   @brief Cached content, shared by every entry with the same SHA-256
+  */
+typedef struct {
+  char *hash; /**< Hex SHA-256 of the content, the name of the file in DOWNLOAD_OBJECTS */
+  uint64_t size; /**< Size of the content */
+  unsigned refs; /**< Number of entries with this content */
+} DownloadBlob;
+
+/**
+  *   @struct DownloadEntry
+  *   @brief Remote file whose content is cached
+  */
+typedef struct {
+  char *key; /**< "user@host:path" */
+  uint64_t size; /**< Size of the remote file when downloaded */
+  uint64_t mtime; /**< Modification time of the remote file when downloaded */
+  gint64 last_used; /**< Real time (us) of the latest store or hit */
+  DownloadBlob *blob; /**< Content */
+  GList *link; /**< Link of the entry in the LRU queue */
+} DownloadEntry;
+
+/**
+  *   @struct DownloadCache
+  *   @brief LRU cache of downloaded files keyed by server, path, size and mtime
+  *   @details Contents are stored once per SHA-256, so the same artifact downloaded from
+  *   several paths or servers takes space only once. Contents keep the permissions of the
+  *   first download without its write bits. Hits are materialized with a reflink when the
+  *   file system supports it, otherwise copied. Optionally a hit is hard linked instead
+  *   when its permissions are those of the content, so downloads never change mode
+  *   @remark All functions lock the cache, so it can be shared between threads
+  */
+typedef struct {
+  char *dir; /**< Cache folder */
+  GHashTable *entries; /**< Key -> DownloadEntry */
+  GHashTable *blobs; /**< Hash -> DownloadBlob */
+  GQueue lru; /**< DownloadEntries, the most recently used first */
+  uint64_t max_bytes; /**< Contents are evicted when their size exceeds this */
+  uint64_t bytes; /**< Size of the cached contents */
+  bool hard_links; /**< Whether hits requesting the permissions of the content are hard linked */
+  bool dirty; /**< Whether the index has changed since it was loaded or saved */
+  DownloadStats stats; /**< Lookups since the cache was created */
+  DownloadStats total; /**< Lookups of all runs, kept in the index */
+  pthread_mutex_t lock; /**< Lock for the cache */
+} DownloadCache;
+
+/**
+  *   @brief Read the cache configuration from the environment
+  *   @param max_bytes Set to the size limit, DOWNLOAD_CACHE_SIZE MiB by default
+  *   @param hard_links Set to whether hits are hard linked
+  *   @return false if the cache is disabled
+  */
+bool download_cache_config(uint64_t *max_bytes, bool *hard_links);
+
+/**
+  *   @brief Create a DownloadCache and load its index
+  *   @param dir Cache folder, created if needed
+  *   @param max_bytes Size limit of the cached contents
+  *   @param hard_links Whether hits are hard linked
+  *   @return Valid pointer, NULL on error
+  *   @remark Entries whose content is missing are dropped
+  */
+DownloadCache *new_DownloadCache(const char *dir, const uint64_t max_bytes, const bool hard_links);
+
+/**
+  *   @brief Save the index and free DownloadCache
+  *   @param cache DownloadCache, may be NULL
+  */
+void free_DownloadCache(DownloadCache *cache);
+
+/**
+  *   @brief Save the index of the cache
+  *   @param cache DownloadCache
+  *   @return 0 on success, -1 on error
+  */
+int DownloadCache_save(DownloadCache *cache);
+
+/**
+  *   @brief Materialize a cached remote file
+  *   @param cache DownloadCache
+  *   @param host user@host of the server
+  *   @param path Path of the file on the server
+  *   @param size Current size of the remote file
+  *   @param mtime Current modification time of the remote file
+  *   @param dst Local path the file is downloaded to
+  *   @param overwrite Whether an existing dst is replaced
+  *   @param permissions Permissions of dst, only a hit with the permissions of the content is hard linked
+  *   @return 0 on a hit, -1 on a miss: the file has to be transferred
+  *   @remark An entry whose size or mtime differs from the remote file is dropped
+  */
+int DownloadCache_fetch(DownloadCache *cache, const char *host, const char *path, const uint64_t size,
+                        const uint64_t mtime, const char *dst, const bool overwrite, const mode_t permissions);
+
+/**
+  *   @brief Add a downloaded file to the cache
+  *   @param cache DownloadCache
+  *   @param host user@host of the server
+  *   @param path Path of the file on the server
+  *   @param size Size of the remote file when downloaded
+  *   @param mtime Modification time of the remote file when downloaded
+  *   @param src Local file the remote file was downloaded to, copied so its permissions are kept
+  *   @param hash Hex SHA-256 of the content if computed during the download, NULL to compute it
+  *   @return 0 on success, -1 on error or if the file does not fit in the cache
+  *   @remark Evicts the least recently used entries until the cache fits its limit
+  */
+int DownloadCache_store(DownloadCache *cache, const char *host, const char *path, const uint64_t size,
+                        const uint64_t mtime, const char *src, const char *hash);
+
+/**
+  *   @brief Describe the cache usage and its hits and misses
+  *   @param cache DownloadCache
+  *   @return String, free with g_free
+  */
+gchar *DownloadCache_summary(DownloadCache *cache);
+
+#endif
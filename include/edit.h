@@ -0,0 +1,181 @@
+/**
+  *   @file edit.h
+  *   @author Lauri Westerholm
+  *   @brief Local editing of remote files with block level write-back, header
+  */
+
+#ifndef EDIT_HEADER
+#define EDIT_HEADER
+
+#include <gmodule.h>
+#include <gio/gio.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "ssh.h"
+#include "assets.h"
+
+#define EDIT_BLOCK_SIZE 65536 /**< Bytes per hashed block, changed blocks are written back whole */
+#define EDIT_HASH_LEN 16 /**< Length of the MD5 digest of a block */
+#define EDIT_FOLDER "FileManager/edit" /**< Local copies are kept under this in the user cache dir */
+#define EDITOR_ENV "FILEMANAGER_EDITOR" /**< Environment variable naming the editor command */
+#define EDIT_CONFLICT 1 /**< sftp_session_edit_save return value when the remote file has changed */
+
+/**
+  *   @brief Write to the target of a write-back
+  *   @param target Target given to EditFile_write_back
+  *   @param buff Data to write
+  *   @param len Bytes to write
+  *   @param offset Offset in the file
+  *   @return 0 on success, -1 on error
+  */
+typedef int (*EditWrite)(void *target, const char *buff, const size_t len, const uint64_t offset);
+
+/**
+  *   @brief Truncate the target of a write-back
+  *   @param target Target given to EditFile_write_back
+  *   @param size New size of the file
+  *   @return 0 on success, -1 on error
+  */
+typedef int (*EditTruncate)(void *target, const uint64_t size);
+
+/**
+  *   @struct EditFile
+  *   @brief Remote file edited through a local copy
+  *   @remark Not thread safe, busy tells whether a thread is using the EditFile
+  */
+typedef struct {
+  char *remote_path; /**< Path of the file on the remote */
+  char *local_path; /**< Path of the local copy */
+  GByteArray *hashes; /**< EDIT_HASH_LEN bytes per block of the content last synced */
+  uint64_t size; /**< Size of the content last synced */
+  uint64_t remote_mtime; /**< Modification time of the remote file after the last sync */
+  gint64 local_mtime; /**< Modification time of the local copy after the last sync, in nanoseconds */
+  uint64_t local_size; /**< Size of the local copy after the last sync */
+  uint64_t written; /**< Bytes written back by the latest sync */
+  uint64_t stale_from; /**< First block which may differ on the remote from hashes after a failed write-back,
+                            UINT64_MAX if none. It and the blocks after it are always written */
+  bool busy; /**< Whether a thread is downloading or writing back the file */
+  bool conflict; /**< Whether the remote file changed under the edit, no more write-backs are done */
+} EditFile;
+
+/**
+  *   @brief Create an EditFile
+  *   @param remote_path Path of the file on the remote
+  *   @param local_path Path of the local copy
+  *   @return Valid pointer, NULL on error
+  */
+EditFile *new_EditFile(const char *remote_path, const char *local_path);
+
+/**
+  *   @brief Free EditFile
+  *   @param edit EditFile, the local copy is kept
+  */
+void free_EditFile(EditFile *edit);
+
+/**
+  *   @brief Get the path of the local copy of a remote file
+  *   @param host user@host of the session
+  *   @param remote_path Path of the file on the remote
+  *   @return Path in a folder of its own under EDIT_FOLDER, keeps the name of the file
+  *   so editors recognize its type. Free with free, NULL on error
+  */
+char *edit_local_path(const char *host, const char *remote_path);
+
+/**
+  *   @brief Remove the local copy and its folder
+  *   @param edit EditFile
+  */
+void EditFile_remove_copy(EditFile *edit);
+
+/**
+  *   @brief Check whether the local copy has been saved since the last sync
+  *   @param edit EditFile
+  *   @return true if the modification time or size differs from the last sync
+  */
+bool EditFile_modified(EditFile *edit);
+
+/**
+  *   @brief Record the current state of the local copy as seen
+  *   @param edit EditFile
+  *   @remark Used after a failed write-back so only the next save tries again
+  */
+void EditFile_seen(EditFile *edit);
+
+/**
+  *   @brief Forget the synced content, so the next write-back writes every block
+  *   @details Used to overwrite a remote file which changed under the edit
+  *   @param edit EditFile
+  *   @param size Current size of the target, a shorter local copy truncates it
+  */
+void EditFile_forget(EditFile *edit, const uint64_t size);
+
+/**
+  *   @brief Set the local copy as the synced content
+  *   @details Hashes the local copy block by block, used after it has been downloaded
+  *   @param edit EditFile
+  *   @return 0 on success, -1 on error
+  */
+int EditFile_sync(EditFile *edit);
+
+/**
+  *   @brief Write the blocks of the local copy which differ from the synced content
+  *   @details The local copy is hashed block by block and only blocks whose hash,
+  *   or length, differ from the synced ones are written. A shorter copy truncates the
+  *   target. On success the local copy becomes the synced content. A failed
+  *   write or truncate keeps the blocks written before it as synced and marks
+  *   the rest stale, so the next write-back completes the target
+  *   @param edit EditFile
+  *   @param write Positioned write to the target
+  *   @param truncate Truncates the target
+  *   @param target Target passed to write and truncate
+  *   @return 0 on success, -1 on error
+  */
+int EditFile_write_back(EditFile *edit, EditWrite write, EditTruncate truncate, void *target);
+
+/**
+  *   @brief Download a remote file to the local copy of an EditFile
+  *   @param session Session which contains already established sftp connection
+  *   @param edit EditFile, synced to the downloaded content
+  *   @return 0 on success, -1 on error
+  *   @remark Locks the session, call this outside the main thread
+  */
+int sftp_session_edit_open(Session *session, EditFile *edit);
+
+/**
+  *   @brief Write back the changed blocks of the local copy with positioned writes
+  *   @param session Session which contains already established sftp connection
+  *   @param edit EditFile
+  *   @return 0 on success, EDIT_CONFLICT if the remote file has changed since
+  *   the last sync, -1 on error. After a failed write the modification time
+  *   and size of the remote file are read again, so the next save is not a
+  *   conflict
+  *   @remark Locks the session, call this outside the main thread
+  */
+int sftp_session_edit_save(Session *session, EditFile *edit);
+
+/**
+  *   @brief Write the whole local copy over a remote file which changed under the edit
+  *   @param session Session which contains already established sftp connection
+  *   @param edit EditFile
+  *   @return 0 on success, EDIT_CONFLICT if the remote file changed again, -1 on error
+  *   @remark Locks the session, call this outside the main thread
+  */
+int sftp_session_edit_overwrite(Session *session, EditFile *edit);
+
+/**
+  *   @brief Open a file in the configured editor
+  *   @details Runs the command in EDITOR_ENV, or VISUAL, with the path appended.
+  *   Without either the default application of the file type is used
+  *   @param path Local path of the file
+  *   @return true on success, false on error
+  */
+bool launch_editor(const char *path);
+
+#endif
@@ -22,9 +22,13 @@
 #include <pwd.h>
 #include <grp.h>
 #include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <pthread.h>
 
 #include "assets.h"
 
+#define LS_DIR_BUF_SIZE 262144 /**< Buffer size for getdents64 calls in ls_dir_names */
+#define DIR_SIZE_THREADS 4 /**< Threads reading folders in parallel in fs_dir_size */
 
 /**
   *   @enum FileStatus
@@ -57,9 +61,37 @@ struct File {
   char *group; /**< Group the file belongs to */
   uint32_t permissions; /**< File permissions */
   uint64_t mtime;  /**< Time when the file was modified */
+  bool has_metadata; /**< Whether size, owner, permissions etc. have been filled */
+  char *collate_key; /**< Collation key of name, NULL until computed (@see fs_collate_File) */
 };
 typedef struct File File_t; /**< Needed for FileList iteration */
 
+/**
+  *   @enum SortColumn
+  *   @brief Orders in which listings can be sorted, directories are always first
+  */
+enum SortColumn {
+  SORT_BY_NAME, /**< Natural, locale-aware order of names */
+  SORT_BY_SIZE, /**< File size */
+  SORT_BY_MTIME, /**< Modification time */
+  SORT_BY_TYPE /**< Filename extension */
+};
+
+/**
+  *   @struct SortKey
+  *   @brief Values a listing entry is sorted by
+  *   @remark Does not reference the File, so a copy of the keys can be sorted
+  *   in another thread while the listing is modified
+  */
+typedef struct {
+  const char *name; /**< Filename */
+  const char *collate_key; /**< Collation key of name */
+  uint64_t size; /**< File size */
+  uint64_t mtime; /**< Time when the file was modified */
+  bool folder; /**< Whether the entry is a folder */
+  unsigned position; /**< Position of the entry before sorting, breaks ties */
+} SortKey;
+
 /**
   *   @brief Comparison function to find correct element from GSList
   *   containing File structs
@@ -107,6 +139,28 @@ inline static void free_FileContent(struct FileContent *content) {
 
 /* Linked list management */
 
+/**
+  *   @brief Allocate a new File struct which only contains name and type
+  *   @param name Filename, copied
+  *   @param type File type (d_type or SSH_FILEXFER_TYPE)
+  *   @return Dynamically allocated File (free using free_File) or NULL on error
+  *   @remark Metadata fields are zeroed and has_metadata is set to false
+  */
+inline static struct File *new_File(const char *name, const uint8_t type) {
+  struct File *file = calloc(1, sizeof(struct File));
+  if (file) {
+    file->name = malloc(strlen(name) + 1);
+    if (!file->name) {
+      free(file);
+      return NULL;
+    }
+    strcpy(file->name, name);
+    file->type = type;
+    file->has_metadata = false;
+  }
+  return file;
+}
+
 /**
   *   @brief Free File struct
   *   @param pointer Pointer to a File struct, passed as void *
@@ -117,10 +171,38 @@ inline static void free_File(void *pointer) {
     if (file->name) free(file->name);
     if (file->owner) free(file->owner);
     if (file->group) free(file->group);
+    if (file->collate_key) g_free(file->collate_key);
     free(file);
   }
 }
 
+/**
+  *   @brief Deep copy a File struct
+  *   @param file File to be copied
+  *   @return Dynamically allocated File (free using free_File) or NULL on error
+  */
+inline static struct File *copy_File(const struct File *file) {
+  struct File *copy = new_File(file->name, file->type);
+  if (copy) {
+    copy->size = file->size;
+    copy->uid = file->uid;
+    copy->gid = file->gid;
+    copy->permissions = file->permissions;
+    copy->mtime = file->mtime;
+    copy->has_metadata = file->has_metadata;
+    if (file->owner) {
+      copy->owner = malloc(strlen(file->owner) + 1);
+      if (copy->owner) strcpy(copy->owner, file->owner);
+    }
+    if (file->group) {
+      copy->group = malloc(strlen(file->group) + 1);
+      if (copy->group) strcpy(copy->group, file->group);
+    }
+    if (file->collate_key) copy->collate_key = g_strdup(file->collate_key);
+  }
+  return copy;
+}
+
 /**
   *   @brief Clear linked list containing File items
   *   @param files Pointer to a GSList
@@ -131,6 +213,24 @@ inline static void clear_Filelist(GSList *files) {
   g_slist_free_full(files, free_File);
 }
 
+/**
+  *   @brief Deep copy a linked list containing File items
+  *   @param files Pointer to a GSList
+  *   @return The copied list, NULL on error (or if files was empty)
+  */
+inline static GSList *copy_Filelist(const GSList *files) {
+  GSList *copy = NULL;
+  for (; files; files = files->next) {
+    struct File *file = copy_File((const struct File *) files->data);
+    if (!file) {
+      clear_Filelist(copy);
+      return NULL;
+    }
+    copy = g_slist_prepend(copy, file);
+  }
+  return g_slist_reverse(copy);
+}
+
 /**
   *   @brief Append one element to a list containing File elements
   *   @param files Pointer to a GSList which contains directory files
@@ -252,6 +352,207 @@ enum FileStatus fs_rmdir(const char *dir_name, const bool recursive);
   */
 GSList *ls_dir(GSList *files, const char *dir_name);
 
+/**
+  *   @brief List only names and types of directory entries
+  *   @details Reads the directory with large getdents64 buffers and does not
+  *   stat the entries, so this is much faster than ls_dir for big directories.
+  *   Fill the rest of the File fields with fs_fill_File when they are needed
+  *   @param files Linked list of struct File
+  *   @param dir_name Path of the directory to be listed
+  *   @return Valid pointer on success, otherwise a NULL pointer
+  *   @remark Contents of files are cleared first, make sure files content is
+  *   dynamically allocated
+  */
+GSList *ls_dir_names(GSList *files, const char *dir_name);
+
+/**
+  *   @brief Fill metadata (size, owner, permissions, mtime) of a File
+  *   @param file File which has been listed using ls_dir_names
+  *   @param dir_name Path of the directory containing the file
+  *   @return true on success (file->has_metadata is set), false on error
+  */
+bool fs_fill_File(File_t *file, const char *dir_name);
+
+/**
+  *   @brief Create a File for a single directory entry, as ls_dir_names would
+  *   @param dir_name Path of the directory containing the file
+  *   @param name Filename in the directory
+  *   @return Dynamically allocated File with name and type (free using
+  *   free_File), NULL if the file does not exist or on error
+  */
+File_t *fs_new_File(const char *dir_name, const char *name);
+
+/**
+  *   @brief Compute the collation key of a File if it is not set yet
+  *   @param file File whose collate_key is set
+  *   @remark Keys are computed once per entry, comparing them is a plain strcmp
+  */
+void fs_collate_File(File_t *file);
+
+/**
+  *   @brief Check whether sorting by a column needs File metadata
+  *   @param column SortColumn
+  *   @return true for columns which need metadata (@see fs_fill_File)
+  */
+static inline bool sort_needs_metadata(const enum SortColumn column) {
+  return column == SORT_BY_SIZE || column == SORT_BY_MTIME;
+}
+
+/**
+  *   @brief Sort an array of SortKeys, directories first
+  *   @param keys SortKeys to be sorted in place
+  *   @param count Number of keys
+  *   @param column Column to be sorted by, ties are broken by name
+  *   @param descending Whether to reverse the order (directories stay first)
+  */
+void sort_SortKeys(SortKey *keys, const unsigned count, const enum SortColumn column, const bool descending);
+
+/**
+  *   @brief Sort a listing, directories first
+  *   @param files Linked list containing File structs
+  *   @param column Column to be sorted by
+  *   @param descending Whether to reverse the order (directories stay first)
+  *   @param remote Whether the files are remote files (affects folder detection)
+  *   @return Head of the sorted list, the Files are not copied
+  *   @remark Computes missing collation keys. Sorting by size or mtime expects
+  *   metadata to be filled
+  */
+GSList *sort_Filelist(GSList *files, const enum SortColumn column, const bool descending, const bool remote);
+
+/**
+  *   @struct DirSize
+  *   @brief Totals of a recursive folder size computation
+  */
+typedef struct {
+  uint64_t size; /**< Total size (bytes) of the regular files */
+  uint64_t files; /**< Number of entries which are not folders */
+  uint64_t folders; /**< Number of subfolders */
+  uint64_t unreadable; /**< Number of folders which could not be read */
+} DirSize;
+
+/**
+  *   @struct DirSizeProgress
+  *   @brief Running DirSize shared between the walking threads and a reader
+  */
+typedef struct {
+  DirSize total; /**< Totals so far, read using DirSizeProgress_get */
+  pthread_mutex_t lock; /**< Protects total */
+  volatile gint cancel; /**< Set (g_atomic_int_set) to stop the walk */
+} DirSizeProgress;
+
+/**
+  *   @brief Initialize a DirSizeProgress with zero totals
+  *   @param progress DirSizeProgress
+  */
+inline static void DirSizeProgress_init(DirSizeProgress *progress) {
+  memset(&(progress->total), 0, sizeof(DirSize));
+  pthread_mutex_init(&(progress->lock), NULL);
+  progress->cancel = 0;
+}
+
+/**
+  *   @brief Release the resources of a DirSizeProgress
+  *   @param progress DirSizeProgress no longer used by any thread
+  */
+inline static void DirSizeProgress_destroy(DirSizeProgress *progress) {
+  pthread_mutex_destroy(&(progress->lock));
+}
+
+/**
+  *   @brief Add the totals of a folder to a DirSizeProgress
+  *   @param progress DirSizeProgress
+  *   @param delta Totals to be added
+  */
+inline static void DirSizeProgress_add(DirSizeProgress *progress, const DirSize *delta) {
+  pthread_mutex_lock(&(progress->lock));
+  progress->total.size += delta->size;
+  progress->total.files += delta->files;
+  progress->total.folders += delta->folders;
+  progress->total.unreadable += delta->unreadable;
+  pthread_mutex_unlock(&(progress->lock));
+}
+
+/**
+  *   @brief Get the totals so far
+  *   @param progress DirSizeProgress
+  *   @return Copy of the totals
+  */
+inline static DirSize DirSizeProgress_get(DirSizeProgress *progress) {
+  pthread_mutex_lock(&(progress->lock));
+  DirSize total = progress->total;
+  pthread_mutex_unlock(&(progress->lock));
+  return total;
+}
+
+/**
+  *   @struct FsWalkDir
+  *   @brief Folder being read by a fs_walk thread
+  *   @remark Read the entries with FsWalkDir_next, the other fields are
+  *   managed by fs_walk
+  */
+typedef struct {
+  const char *path; /**< Path of the folder */
+  int fd; /**< Open folder for fstatat, -1 if it could not be opened */
+  unsigned thread; /**< Index of the reading thread, less than the thread count of fs_walk */
+  bool failed; /**< Whether the folder could not be read completely */
+  char *buff; /**< getdents64 buffer of the thread, LS_DIR_BUF_SIZE bytes */
+  long nread; /**< Bytes in buff */
+  long pos; /**< Next entry in buff */
+  GSList *found; /**< Paths of the subfolders to be read, @see FsWalkDir_descend */
+  volatile gint *cancel; /**< Cancel flag of the walk */
+} FsWalkDir;
+
+/**
+  *   @brief Visitor of one folder, called by several fs_walk threads at once
+  *   @param dir Folder being read
+  *   @param data Data passed to fs_walk
+  */
+typedef void (*FsWalkVisit)(FsWalkDir *dir, void *data);
+
+/**
+  *   @brief Read the next entry of a folder
+  *   @param dir Folder
+  *   @param name Set to the entry name, valid until the next call
+  *   @param type Set to the d_type of the entry, resolved with fstatat if the
+  *   filesystem does not fill it
+  *   @return false after the last entry, on error (sets dir->failed) or if the walk was cancelled
+  */
+bool FsWalkDir_next(FsWalkDir *dir, const char **name, unsigned char *type);
+
+/**
+  *   @brief Read a subfolder after the current folder
+  *   @param dir Folder
+  *   @param name Name of the subfolder in dir
+  */
+void FsWalkDir_descend(FsWalkDir *dir, const char *name);
+
+/**
+  *   @brief Walk a local directory tree with several threads
+  *   @details Every thread keeps the folders it finds in an own deque and
+  *   reads them depth first. A thread running out of folders steals the
+  *   oldest folder of another thread, which is usually the root of a large
+  *   unread subtree, so the threads stay busy on unbalanced trees
+  *   @param root Path of the folder to be walked
+  *   @param threads Number of threads, the calling thread included
+  *   @param cancel Walk stops when set to non-zero
+  *   @param visit Called for every folder, root included. Only the folders
+  *   passed to FsWalkDir_descend are read
+  *   @param data Passed to visit
+  *   @return 0 on success, -1 if the walk was cancelled or did not finish
+  */
+int fs_walk(const char *root, const unsigned threads, volatile gint *cancel, FsWalkVisit visit, void *data);
+
+/**
+  *   @brief Compute the recursive size of a local folder
+  *   @param path Path of the folder
+  *   @param progress DirSizeProgress, totals are added per folder as the walk proceeds
+  *   @param threads Number of threads reading folders, the calling thread included
+  *   @return 0 on success, -1 if the walk was cancelled or did not finish
+  *   @remark Symbolic links are not followed. Folders which cannot be read are
+  *   counted in unreadable
+  */
+int fs_dir_size(const char *path, DirSizeProgress *progress, const unsigned threads);
+
 /**
   *   @brief Get home directory for the user
   *   @return Pointer to dynamically allocated memory, this must be freed elsewhere.
@@ -0,0 +1,191 @@
+/**
+  *   @file index.h
+  *   @author Lauri Westerholm
+  *   @brief Persistent index of remote directory trees, header
+  */
+
+#ifndef INDEX_HEADER
+#define INDEX_HEADER
+
+#include <gmodule.h> // Linked list implementation, GSList
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "search.h"
+#include "fs.h"
+#include "assets.h"
+
+#define INDEX_MAGIC "FMINDEX" /**< First bytes of an index file, '\0' included */
+#define INDEX_VERSION 1 /**< Format version of the index file */
+#define INDEX_NONE UINT32_MAX /**< Node index meaning no node */
+#define INDEX_FOLDER "FileManager" /**< Folder for the index files in the user cache folder */
+#define INDEX_SAVE_ENTRIES 200000 /**< Least entries an indexer adds before merging them to the file */
+
+/**
+  *   @struct IndexHeader
+  *   @brief Start of an index file, followed by the nodes and the names
+  */
+typedef struct {
+  char magic[8]; /**< INDEX_MAGIC */
+  uint32_t version; /**< INDEX_VERSION */
+  uint32_t node_count; /**< Number of IndexNodes */
+  uint64_t names_size; /**< Bytes in the name table */
+  int64_t saved; /**< Real time (us) when the file was written */
+} IndexHeader;
+
+/**
+  *   @struct IndexNode
+  *   @brief Entry of an index file
+  *   @details Nodes are stored breadth first from "/" (node 0, empty name), so
+  *   the children of a folder are consecutive and sorted by name
+  */
+typedef struct {
+  uint32_t name; /**< Offset of the '\0' terminated name in the name table */
+  uint32_t parent; /**< Parent node, INDEX_NONE for "/" */
+  uint32_t first_child; /**< First child node */
+  uint32_t child_count; /**< Number of children */
+  uint64_t size; /**< File size */
+  uint64_t mtime; /**< Time when the file was modified */
+  int64_t listed; /**< Real time (us) when the folder was listed, 0 if never or not a folder */
+  uint32_t type; /**< SSH_FILEXFER_TYPE */
+  uint32_t reserved; /**< Zero */
+} IndexNode;
+
+/**
+  *   @struct IndexFreshness
+  *   @brief How up to date the index of a subtree is
+  */
+typedef struct {
+  unsigned folders; /**< Folders in the subtree, its root included */
+  unsigned unlisted; /**< Folders never listed, their content is unknown */
+  int64_t oldest; /**< Real time (us) of the oldest listing, 0 if none */
+  int64_t newest; /**< Real time (us) of the newest listing, 0 if none */
+} IndexFreshness;
+
+/**
+  *   @struct RemoteIndex
+  *   @brief Names, sizes and mtimes of remote trees
+  *   @details The saved index is memory-mapped and used in place. Folders
+  *   listed after that are kept in memory until RemoteIndex_save merges them
+  *   to a new file
+  *   @remark All functions lock the index, so it can be shared between threads.
+  *   RemoteIndex_update does not wait for the lock: a listing stored while
+  *   the index is searched is queued and merged when the search releases it
+  */
+typedef struct {
+  char *filename; /**< Index file */
+  void *map; /**< Mapped index file, NULL if there is none */
+  size_t map_size; /**< Size of the mapping */
+  const IndexNode *nodes; /**< Nodes in map */
+  uint32_t node_count; /**< Number of nodes */
+  const char *names; /**< Name table in map */
+  uint64_t names_size; /**< Bytes in names */
+  GHashTable *folders; /**< Folder path -> listing newer than the file */
+  unsigned entries; /**< Entries in folders */
+  GHashTable *saving; /**< Listings RemoteIndex_save is writing, read without the lock, NULL when not saving */
+  GSList *pending; /**< Listings waiting for the lock, newest first */
+  pthread_mutex_t lock; /**< Protects the index */
+  pthread_mutex_t pending_lock; /**< Protects pending */
+  pthread_mutex_t save_lock; /**< Held by RemoteIndex_save, so the mapping is kept while it is read */
+} RemoteIndex;
+
+/**
+  *   @brief Get the index file of a server
+  *   @param user Username
+  *   @param host Address of the server
+  *   @return Dynamically allocated path in the user cache folder, NULL on error
+  */
+char *index_filename(const char *user, const char *host);
+
+/**
+  *   @brief Create a RemoteIndex
+  *   @param filename Index file, mapped if it exists and is valid
+  *   @return Valid pointer, NULL on error
+  */
+RemoteIndex *new_RemoteIndex(const char *filename);
+
+/**
+  *   @brief Free RemoteIndex, listings not saved are lost
+  *   @param index RemoteIndex to be freed
+  */
+void free_RemoteIndex(RemoteIndex *index);
+
+/**
+  *   @brief Store a folder listing to the index
+  *   @details Replaces what was known of the folder. Subfolders which are
+  *   still listed keep their content, the ancestors of the folder are added
+  *   if they are missing
+  *   @param index RemoteIndex
+  *   @param path Absolute path of the folder
+  *   @param files Listing, "." and ".." are ignored
+  *   @param listed Real time (us) when the folder was listed
+  *   @return true on success, false if path is not absolute or on error
+  *   @remark Does not block while the index is searched or saved
+  */
+bool RemoteIndex_update(RemoteIndex *index, const char *path, const GSList *files, const int64_t listed);
+
+/**
+  *   @brief Check whether the index has listings which are not saved
+  *   @param index RemoteIndex
+  *   @return true if RemoteIndex_save would write the file
+  */
+bool RemoteIndex_is_dirty(RemoteIndex *index);
+
+/**
+  *   @brief Merge the listings to the index file
+  *   @details Writes a new file next to the old one, renames it over the old
+  *   one and maps it. The lock is held only while the listings are taken and
+  *   while the new file replaces the mapping, listings stored meanwhile are
+  *   kept for the next save
+  *   @param index RemoteIndex
+  *   @return 0 on success, -1 on error (the listings are kept in memory)
+  */
+int RemoteIndex_save(RemoteIndex *index);
+
+/**
+  *   @brief Get the freshness of a subtree
+  *   @param index RemoteIndex
+  *   @param root Path of the subtree
+  *   @param freshness Filled
+  *   @return true if the subtree is in the index
+  *   @remark Visits the whole subtree, so it is not called from the main thread
+  */
+bool RemoteIndex_freshness(RemoteIndex *index, const char *root, IndexFreshness *freshness);
+
+/**
+  *   @brief Search a subtree in the index
+  *   @param index RemoteIndex
+  *   @param root Folder to be searched, not matched itself
+  *   @param query SearchQuery
+  *   @param progress SearchProgress where matches are added
+  *   @return 0 on success, -1 if root is not in the index, the regular
+  *   expression is invalid or the search was cancelled
+  */
+int RemoteIndex_find(RemoteIndex *index, const char *root, const SearchQuery *query, SearchProgress *progress);
+
+/**
+  *   @brief Index a remote folder recursively
+  *   @details Lists the tree with sftp_session_walk and stores every folder
+  *   listed completely. Listings are merged to the index file when the walk
+  *   ends and whenever as many entries as the file has (at least
+  *   INDEX_SAVE_ENTRIES) have been listed, so an interrupted indexer keeps
+  *   what it has listed and the file is rewritten a logarithmic number of times
+  *   @param session Session struct
+  *   @param index RemoteIndex
+  *   @param root Folder to be indexed
+  *   @param cancel Indexing stops when set to non-zero
+  *   @param folders Incremented for every folder indexed
+  *   @return 0 on success, -1 on error or if cancelled
+  *   @remark Locks the session only around network I/O, the caller must not
+  *   hold the lock
+  */
+int sftp_session_index(Session *session, RemoteIndex *index, const char *root, volatile gint *cancel,
+                       volatile gint *folders);
+
+#endif
@@ -0,0 +1,100 @@
+/**
+  *   @file match.h
+  *   @author Lauri Westerholm
+  *   @brief Filename matching for filtering large listings, header
+  */
+
+#ifndef MATCH_HEADER
+#define MATCH_HEADER
+
+#include <gmodule.h> // Linked list implementation, GSList
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs.h"
+#include "assets.h"
+
+#define MATCH_CANCEL_INTERVAL 4096 /**< Entries matched between checks for a newer request */
+
+/**
+  *   @struct NameTable
+  *   @brief Compact snapshot of the names of a listing
+  *   @details Names are stored back to back in one buffer, so a substring
+  *   search is a single memmem scan instead of one call per entry. The
+  *   snapshot does not reference the listing, it can be matched from another
+  *   thread while the listing is modified
+  */
+typedef struct {
+  char *names; /**< Names, each terminated by '\0' */
+  char *folded; /**< names with ASCII letters in lower case */
+  size_t len; /**< Length of names and folded in bytes */
+  unsigned *offsets; /**< Start of each name in names */
+  unsigned count; /**< Number of names */
+  volatile gint generation; /**< Newest match request, older requests are cancelled */
+  volatile gint refs; /**< Reference count */
+} NameTable;
+
+/**
+  *   @brief Create a NameTable from a listing
+  *   @param files Listing, names are stored in the list order
+  *   @return Valid pointer with one reference, NULL on error
+  */
+NameTable *new_NameTable(GSList *files);
+
+/**
+  *   @brief Take a reference to a NameTable
+  *   @param table NameTable
+  *   @return table
+  */
+NameTable *NameTable_ref(NameTable *table);
+
+/**
+  *   @brief Drop a reference to a NameTable, the last one frees it
+  *   @param table NameTable, may be NULL
+  */
+void NameTable_unref(NameTable *table);
+
+/**
+  *   @brief Get a name stored in a NameTable
+  *   @param table NameTable
+  *   @param index Index of the name, less than table->count
+  *   @return Name in the original case, owned by table
+  */
+static inline const char *NameTable_name(const NameTable *table, const unsigned index) {
+  return table->names + table->offsets[index];
+}
+
+/**
+  *   @brief Find the names matching a pattern
+  *   @param table NameTable to be searched
+  *   @param pattern Case folded pattern (@see fold_pattern)
+  *   @param fuzzy Whether the characters of pattern may be spread over the name
+  *   (subsequence match) instead of appearing as a substring
+  *   @param generation Generation of the request, matching stops when
+  *   table->generation changes
+  *   @param matches GArray of unsigned where indexes of the matching names are
+  *   appended in order
+  *   @return Number of matches, -1 if the request was cancelled
+  */
+int NameTable_match(NameTable *table, const char *pattern, const bool fuzzy, const gint generation, GArray *matches);
+
+/**
+  *   @brief Check whether a single name matches a pattern
+  *   @remark Used for entries added after a NameTable was created
+  *   @param name Name in the original case
+  *   @param pattern Case folded pattern (@see fold_pattern)
+  *   @param fuzzy Whether to use a subsequence match
+  *   @return true if name matches
+  */
+bool name_matches(const char *name, const char *pattern, const bool fuzzy);
+
+/**
+  *   @brief Fold ASCII letters of a pattern to lower case
+  *   @remark Other UTF-8 characters are matched as is
+  *   @param pattern Pattern as typed
+  *   @return Dynamically allocated folded pattern, NULL on error
+  */
+char *fold_pattern(const char *pattern);
+
+#endif
@@ -0,0 +1,322 @@
+/**
+  *   @file search.h
+  *   @author Lauri Westerholm
+  *   @brief Recursive filename search, header
+  */
+
+#ifndef SEARCH_HEADER
+#define SEARCH_HEADER
+
+#include <gmodule.h> // Linked list implementation, GSList
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <regex.h>
+
+#include "ssh.h"
+#include "walk.h"
+#include "fs.h"
+#include "assets.h"
+
+#define SEARCH_MAX_RESULTS 100000 /**< Search stops after this many matches */
+#define FIND_SENTINEL "FileManager-find" /**< Printed before the results when GNU find is available */
+#define GREP_SENTINEL "FileManager-grep" /**< Printed before the results when grep is available */
+#define GREP_MAX_PATH 4096 /**< Longest path accepted in grep output */
+#define GREP_MAX_TEXT 256 /**< Bytes of a matching line kept */
+#define SEARCH_UNSUPPORTED 1 /**< Returned when the server cannot run the search command */
+
+/**
+  *   @enum OutputAction
+  *   @brief Returned by the parsers of search command output
+  */
+enum OutputAction {
+  OUTPUT_CONTINUE, /**< Continue reading */
+  OUTPUT_STOP, /**< Stop reading, SEARCH_MAX_RESULTS was reached */
+  OUTPUT_UNSUPPORTED /**< Output does not start with the sentinel of the command */
+};
+
+/**
+  *   @struct SearchQuery
+  *   @brief Predicates an entry must match, zero fields match everything
+  */
+typedef struct {
+  char *pattern; /**< Shell glob matched against names, NULL matches all names */
+  bool regex; /**< Whether pattern is a POSIX extended regular expression instead of a glob */
+  bool ignore_case; /**< Whether pattern is matched case-insensitively */
+  uint64_t min_size; /**< Smallest size in bytes */
+  uint64_t max_size; /**< Largest size in bytes */
+  unsigned max_age; /**< Modified within this many days */
+} SearchQuery;
+
+/**
+  *   @struct SearchProgress
+  *   @brief Matches collected by a search thread and taken by the main thread
+  */
+typedef struct {
+  GSList *matches; /**< File_t whose name is the full path or GrepMatch, newest first */
+  GDestroyNotify free_match; /**< Frees a match, free_File unless set otherwise after SearchProgress_init */
+  unsigned count; /**< Matches added in total */
+  bool truncated; /**< Whether the search stopped at SEARCH_MAX_RESULTS */
+  volatile gint fallback; /**< Set when the tree is listed over sftp instead of running find */
+  pthread_mutex_t lock; /**< Protects matches, count and truncated */
+  volatile gint cancel; /**< Set to non-zero to stop the search */
+} SearchProgress;
+
+/**
+  *   @brief Initialize SearchProgress
+  *   @param progress SearchProgress
+  */
+void SearchProgress_init(SearchProgress *progress);
+
+/**
+  *   @brief Free matches not taken and destroy SearchProgress
+  *   @param progress SearchProgress
+  */
+void SearchProgress_destroy(SearchProgress *progress);
+
+/**
+  *   @brief Add a match
+  *   @param progress SearchProgress
+  *   @param match Match, owned by progress afterwards
+  *   @return false if SEARCH_MAX_RESULTS was reached and the search should stop
+  */
+bool SearchProgress_add(SearchProgress *progress, gpointer match);
+
+/**
+  *   @brief Take the matches added since the last call
+  *   @param progress SearchProgress
+  *   @return GSList of the matches in the order found, owned by the caller
+  */
+GSList *SearchProgress_take(SearchProgress *progress);
+
+/**
+  *   @brief Get a glob for text typed by the user
+  *   @param text Search text
+  *   @return Dynamically allocated glob: text as is if it contains glob
+  *   characters, otherwise *text*. NULL for empty text or on error
+  */
+char *search_glob(const char *text);
+
+/**
+  *   @brief Compile the regular expression of a query
+  *   @param query SearchQuery
+  *   @param regex Compiled if query->regex is set and query->pattern is not
+  *   NULL, free it with regfree in that case
+  *   @return 0 on success, -1 if the pattern is not a valid regular expression
+  */
+int SearchQuery_compile(const SearchQuery *query, regex_t *regex);
+
+/**
+  *   @brief Check whether a name matches the pattern of a query
+  *   @param query SearchQuery
+  *   @param regex Compiled by SearchQuery_compile, NULL for globs
+  *   @param name Filename without the folder
+  *   @return true if the name matches
+  *   @remark A regular expression matches if it matches any part of the name
+  */
+bool SearchQuery_matches_name(const SearchQuery *query, const regex_t *regex, const char *name);
+
+/**
+  *   @brief Check whether an entry matches a query
+  *   @param query SearchQuery
+  *   @param regex Compiled by SearchQuery_compile, NULL for globs
+  *   @param file Entry, only the name is matched against the pattern
+  *   @param now Current time
+  *   @return true if all predicates match
+  */
+bool SearchQuery_matches(const SearchQuery *query, const regex_t *regex, const File_t *file, const time_t now);
+
+/**
+  *   @brief Build the shell command searching a folder with find
+  *   @details The command prints FIND_SENTINEL first if GNU find is
+  *   available, then one record per match, @see parse_find_record. A regular
+  *   expression only narrows the search to paths with a matching part, the
+  *   names must still be checked with SearchQuery_matches_name. A leading ^
+  *   and a trailing $ are anchored to the last path component
+  *   @param root Folder to be searched
+  *   @param query SearchQuery
+  *   @return Dynamically allocated command, NULL on error
+  */
+char *find_command(const char *root, const SearchQuery *query);
+
+/**
+  *   @brief Parse a record printed by find_command
+  *   @param record "type size mtime path" without the terminating '\0'
+  *   @return Dynamically allocated File whose name is the path, NULL if the
+  *   record is malformed. Size and mtime are set but has_metadata is false
+  */
+File_t *parse_find_record(const char *record);
+
+/**
+  *   @struct FindParser
+  *   @brief Parses find output as it arrives
+  */
+typedef struct {
+  GByteArray *output; /**< Output not parsed yet */
+  bool sentinel; /**< Whether FIND_SENTINEL has been seen */
+  const SearchQuery *query; /**< SearchQuery */
+  const regex_t *regex; /**< Compiled pattern, NULL for globs */
+  SearchProgress *progress; /**< Where matches are added */
+} FindParser;
+
+/**
+  *   @brief Initialize FindParser
+  *   @param parser FindParser
+  *   @param query SearchQuery of the command
+  *   @param regex Compiled pattern, NULL for globs
+  *   @param progress Where matches are added
+  */
+void FindParser_init(FindParser *parser, const SearchQuery *query, const regex_t *regex, SearchProgress *progress);
+
+/**
+  *   @brief Destroy FindParser
+  *   @param parser FindParser
+  */
+void FindParser_destroy(FindParser *parser);
+
+/**
+  *   @brief Parse a chunk of the output of find_command
+  *   @param parser FindParser
+  *   @param data Output, NULL at the end of the output
+  *   @param len Length of data
+  *   @return OutputAction, OUTPUT_UNSUPPORTED if the output does not start
+  *   with FIND_SENTINEL or ends before it
+  */
+enum OutputAction FindParser_feed(FindParser *parser, const char *data, const size_t len);
+
+/**
+  *   @brief Get the result of a search command from how it ended
+  *   @param status ExecStatus of the command
+  *   @param action Last OutputAction of the parser, for EXEC_FINISHED the
+  *   result of parsing the end of the output
+  *   @return 0 on success, -1 on error or if cancelled, SEARCH_UNSUPPORTED if
+  *   the command could not be started or its output did not start with its
+  *   sentinel: sftp_session_find then falls back to the sftp walk
+  */
+int search_exec_status(const enum ExecStatus status, const enum OutputAction action);
+
+/**
+  *   @struct GrepMatch
+  *   @brief Line matched by a content search
+  */
+typedef struct {
+  char *path; /**< Path of the file */
+  unsigned line; /**< Line number, the first line is 1 */
+  char *text; /**< Matching line as valid UTF-8, cut to GREP_MAX_TEXT bytes */
+} GrepMatch;
+
+/**
+  *   @brief Free GrepMatch
+  *   @param match Pointer to a GrepMatch
+  */
+void free_GrepMatch(gpointer match);
+
+/**
+  *   @enum GrepField
+  *   @brief Field of grep output being parsed
+  */
+enum GrepField {
+  GREP_FIELD_SENTINEL, /**< GREP_SENTINEL, '\0' terminated */
+  GREP_FIELD_PATH, /**< Path, '\0' terminated */
+  GREP_FIELD_LINE, /**< Line number, ':' terminated */
+  GREP_FIELD_TEXT /**< Matching line, '\n' terminated */
+};
+
+/**
+  *   @struct GrepParser
+  *   @brief Parses grep output as it arrives
+  *   @remark Memory use is bounded: paths longer than GREP_MAX_PATH are
+  *   skipped and lines are cut to GREP_MAX_TEXT bytes
+  */
+typedef struct {
+  enum GrepField field; /**< Field being parsed */
+  GString *path; /**< Path of the current match */
+  GString *text; /**< Line of the current match */
+  unsigned line; /**< Line number of the current match */
+  bool invalid; /**< Whether the current match is malformed and is skipped */
+  bool cut; /**< Whether the line of the current match was cut */
+  SearchProgress *progress; /**< Where matches are added */
+} GrepParser;
+
+/**
+  *   @brief Initialize GrepParser
+  *   @param parser GrepParser
+  *   @param progress Where matches are added, its free_match is set to free_GrepMatch
+  */
+void GrepParser_init(GrepParser *parser, SearchProgress *progress);
+
+/**
+  *   @brief Destroy GrepParser
+  *   @param parser GrepParser
+  */
+void GrepParser_destroy(GrepParser *parser);
+
+/**
+  *   @brief Parse a chunk of the output of grep_command
+  *   @param parser GrepParser
+  *   @param data Output, NULL at the end of the output
+  *   @param len Length of data
+  *   @return OutputAction
+  */
+enum OutputAction GrepParser_feed(GrepParser *parser, const char *data, const size_t len);
+
+/**
+  *   @brief Build the shell command searching the content of the files in a folder
+  *   @details The command prints GREP_SENTINEL first if grep is available,
+  *   then "path\0line:text\n" for every matching line
+  *   @param root Folder to be searched
+  *   @param query SearchQuery: pattern is a fixed string or an extended
+  *   regular expression, size and age select the files
+  *   @return Dynamically allocated command, NULL on error or if there is no pattern
+  */
+char *grep_command(const char *root, const SearchQuery *query);
+
+/**
+  *   @brief Search the content of the files in a remote folder
+  *   @details Runs grep on the server and streams the matching lines, so
+  *   files are not downloaded. Binary files are skipped
+  *   @param session Session struct
+  *   @param root Folder to be searched
+  *   @param query SearchQuery, @see grep_command
+  *   @param progress SearchProgress where GrepMatches are added as they
+  *   arrive, its free_match is set
+  *   @return 0 on success, -1 on error or if cancelled, SEARCH_UNSUPPORTED if
+  *   the server cannot run grep
+  *   @remark Locks the session only around network I/O, the caller must not
+  *   hold the lock
+  */
+int sftp_session_grep(Session *session, const char *root, const SearchQuery *query, SearchProgress *progress);
+
+/**
+  *   @brief Search a local folder recursively
+  *   @details Walks the tree with fs_walk. Names are matched straight from
+  *   the getdents64 buffers and only matching entries are stat'ed
+  *   @param root Folder to be searched, not matched itself
+  *   @param query SearchQuery
+  *   @param progress SearchProgress where matches are added as they are found
+  *   @param threads Number of threads reading folders
+  *   @return 0 on success, -1 on error, if cancelled or if the regular
+  *   expression is invalid
+  *   @remark Symbolic links are not followed
+  */
+int fs_find(const char *root, const SearchQuery *query, SearchProgress *progress, const unsigned threads);
+
+/**
+  *   @brief Search a remote folder recursively
+  *   @details Runs find on the server so only matches are transferred. If
+  *   the account has no shell or no GNU find, falls back to listing the tree
+  *   with sftp_session_walk and matching names locally
+  *   @param session Session struct
+  *   @param root Folder to be searched, not matched itself
+  *   @param query SearchQuery
+  *   @param progress SearchProgress where matches are added as they arrive
+  *   @return 0 on success, -1 on error or if cancelled
+  *   @remark Locks the session only around network I/O, the caller must not
+  *   hold the lock
+  */
+int sftp_session_find(Session *session, const char *root, const SearchQuery *query, SearchProgress *progress);
+
+#endif
@@ -18,13 +18,18 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "str_messages.h"
 #include "fs.h"
 #include "assets.h"
+#include "download.h"
 
 #define MAX_BUF_SIZE 16384 /**< Used for sftp_session_read_file */
 #define WRITE_CHUNK_SIZE 50000 /**< Used for sftp_session_write_file */
+#define DIR_SIZE_BATCH 1024 /**< Entries counted by sftp_session_dir_size between progress updates */
+#define EXEC_READ_SIZE 65536 /**< Bytes of command output read at a time */
+#define EXEC_POLL_TIMEOUT 100 /**< Time (ms) remote_exec waits for output before checking cancel and timeout */
 
 /**
   *   @struct Session
@@ -38,6 +43,11 @@ typedef struct {
   unsigned char *hash; /**< Remote server public key hash */
   size_t hash_len; /**< Length of the hash */
   char *home_dir; /**< Home dir for on the remote server */
+  pthread_mutex_t lock; /**< Serializes libssh calls between threads, @see session_lock */
+  char *name; /**< user@host, identifies the server in local caches */
+  DownloadCache *downloads; /**< Consulted by sftp_session_read_file, NULL to always transfer */
+  volatile gint shell_delete; /**< Whether folders may be deleted with rm -rf over an exec channel,
+                                   accessed atomically so setting it does not wait for the lock */
 } Session;
 
 
@@ -50,6 +60,25 @@ typedef struct {
   */
 void Session_message(Session *session, const char *message);
 
+/**
+  *   @brief Lock the session for exclusive use of the libssh/sftp connection
+  *   @param session Session struct
+  *   @remark libssh sessions are not thread-safe: every thread other than the
+  *   main thread must hold the lock while using the session. The main thread
+  *   locks only when a background thread may be using the session
+  */
+static inline void session_lock(Session *session) {
+  if (session) pthread_mutex_lock(&session->lock);
+}
+
+/**
+  *   @brief Unlock the session locked with session_lock
+  *   @param session Session struct
+  */
+static inline void session_unlock(Session *session) {
+  if (session) pthread_mutex_unlock(&session->lock);
+}
+
 
 /**
   *   @enum AuthenticationAction
@@ -112,23 +141,150 @@ enum AuthenticationAction authenticate_password(Session *session, const char *pa
 
 /*  Executing remote commands */
 
+/**
+  *   @struct RemoteCommand
+  *   @brief Command started on the server, its output is read as it arrives
+  */
+typedef struct {
+  Session *session; /**< Session the command runs on */
+  ssh_channel channel; /**< Exec channel of the command */
+  bool eof; /**< Whether all output has been read */
+} RemoteCommand;
+
+/**
+  *   @brief Start a command on the server
+  *   @param session Session struct, locked by the caller
+  *   @param cmd Shell command, its stdin is closed
+  *   @return Dynamically allocated RemoteCommand (free using end_RemoteCommand),
+  *   NULL if the command could not be started
+  */
+RemoteCommand *start_RemoteCommand(Session *session, const char *cmd);
+
+/**
+  *   @brief Read the next chunk of the output of a command
+  *   @param command RemoteCommand
+  *   @param buff Buffer for the output
+  *   @param len Size of buff
+  *   @param is_stderr Whether stderr is read instead of stdout
+  *   @param timeout Time (ms) to wait for output, 0 does not wait, -1 waits
+  *   until output arrives or the output ends
+  *   @return Number of bytes read, 0 if no output arrived within timeout or
+  *   the output has ended (stdout sets command->eof), -1 on error
+  *   @remark The session must be locked, a timeout lets other threads use it
+  *   while the command is busy
+  */
+int RemoteCommand_read(RemoteCommand *command, char *buff, const unsigned len, const bool is_stderr, const int timeout);
+
+/**
+  *   @brief Get the exit status of a command whose output has ended
+  *   @param command RemoteCommand
+  *   @return Exit status, -1 if the server did not report it
+  *   @remark The session must be locked
+  */
+int RemoteCommand_exit_status(RemoteCommand *command);
+
+/**
+  *   @brief Close the channel of a command and free RemoteCommand
+  *   @param command RemoteCommand, a command still running is terminated
+  *   @remark The session must be locked
+  */
+void end_RemoteCommand(RemoteCommand *command);
+
+/**
+  *   @brief Receives a chunk of the output of a command
+  *   @param data Output, not '\0' terminated
+  *   @param len Length of data
+  *   @param user_data RemoteExec user_data
+  *   @return true to continue, false to stop the command
+  */
+typedef bool (*ExecOutput)(const char *data, const size_t len, void *user_data);
+
+/**
+  *   @enum ExecStatus
+  *   @brief Result of remote_exec
+  */
+enum ExecStatus {
+  EXEC_FINISHED, /**< Output ended, exit_status is set */
+  EXEC_STOPPED, /**< An ExecOutput stopped the command */
+  EXEC_NOT_STARTED, /**< Server refused to run the command */
+  EXEC_FAILED, /**< Reading the output failed */
+  EXEC_TIMED_OUT, /**< Command ran longer than its timeout */
+  EXEC_CANCELLED /**< cancel was set */
+};
+
+/**
+  *   @struct RemoteExec
+  *   @brief How remote_exec runs a command and where the output goes
+  */
+typedef struct {
+  ExecOutput out; /**< Called for every chunk of stdout, NULL drops stdout */
+  ExecOutput err; /**< Called for every chunk of stderr, NULL drops stderr */
+  void *user_data; /**< Passed to out and err */
+  unsigned timeout; /**< Time (ms) the command may run, 0 for no limit */
+  volatile gint *cancel; /**< Command is stopped when set to non-zero, may be NULL */
+  bool shared; /**< Lock the session only around reads, the caller must not hold the lock.
+                    Otherwise the caller holds it for the whole command */
+  int exit_status; /**< Set by remote_exec, -1 if the server did not report it */
+} RemoteExec;
+
+/**
+  *   @brief Run a command on the server and stream its output to callbacks
+  *   @details The command runs on a channel of the existing session. Output of
+  *   any size is passed on in chunks of at most EXEC_READ_SIZE bytes, stderr
+  *   separately from stdout. A command stopped early is terminated by
+  *   closing its channel
+  *   @param session Session struct
+  *   @param cmd Shell command, its stdin is closed
+  *   @param exec RemoteExec
+  *   @return ExecStatus
+  *   @remark ExecOutput callbacks run without the session lock when
+  *   exec->shared is set
+  */
+enum ExecStatus remote_exec(Session *session, const char *cmd, RemoteExec *exec);
+
+/**
+  *   @brief Read output of a running command
+  *   @param target ExecChannel target
+  *   @return @see RemoteCommand_read
+  */
+typedef int (*ExecRead)(void *target, char *buff, const unsigned len, const bool is_stderr, const int timeout);
+
+/**
+  *   @struct ExecChannel
+  *   @brief Running command whose output ExecChannel_run reads
+  */
+typedef struct {
+  ExecRead read; /**< Read output, @see RemoteCommand_read */
+  bool (*eof)(void *target); /**< Whether stdout has ended */
+  int (*exit_status)(void *target); /**< Exit status once stdout has ended, -1 if unknown */
+  void *target; /**< Passed to the functions */
+} ExecChannel;
+
+/**
+  *   @brief Read the output of a running command to the callbacks of a RemoteExec
+  *   @details This is the read loop of remote_exec, exec->shared is left to the channel
+  *   @param channel ExecChannel
+  *   @param exec RemoteExec
+  *   @return ExecStatus, never EXEC_NOT_STARTED
+  */
+enum ExecStatus ExecChannel_run(ExecChannel *channel, RemoteExec *exec);
+
 /**
   *   @brief Execute remote command
-  *   @param session Session struct which contains already established ssh session
+  *   @param session Session struct which contains already established ssh session, locked by the caller
   *   @param cmd Command to be executed
-  *   @param res Buffer where result of the comand is updated (this needs to be a valid pointer)
-  *   @param res_len Length of the res buffer, the memory need to be pre-allocated
+  *   @param exit_status Set to the exit status of the command, -1 if unknown, may be NULL
+  *   @return Dynamically allocated stdout of the command without its trailing
+  *   newline, NULL on error (sets corresponding error message)
   */
-int execute_remote_command( Session *session,
-                            const char *cmd,
-                            char **res,
-                            const unsigned res_len);
+char *execute_remote_command(Session *session, const char *cmd, int *exit_status);
 
 /**
   *   @brief Get remote home directory
   *   @param session Already established ssh session
   *   @return 0 on success, -1 on error (sets corresponding error message)
-  *   @remark This should be called only once per session
+  *   @remark This should be called only once per session. session->home_dir
+  *   is left NULL if $HOME is not an absolute path
   */
 int get_remote_home_dir(Session *session);
 
@@ -152,6 +308,16 @@ int init_sftp_session(Session *session);
   */
 bool sftp_session_is_filename_folder(Session *session, const char *filename, const char *pwd);
 
+/**
+  *   @brief Get the modification time of a remote directory
+  *   @param session Session struct with already established sftp session
+  *   @param path Path of the directory
+  *   @param mtime Set to the directory mtime on success
+  *   @return 0 on success, -1 on error
+  *   @remark Costs a single round trip, used to revalidate cached listings
+  */
+int sftp_session_dir_mtime(Session *session, const char *path, uint64_t *mtime);
+
 /**
   *   @brief Create new directory using sftp
   *   @param session Session which contains already established sftp connection
@@ -173,6 +339,40 @@ enum FileStatus sftp_session_mkdir(Session *session, const char *dir_name, mode_
   */
 GSList *sftp_session_ls_dir(Session *session, GSList *files, const char *dir_name);
 
+/**
+  *   @brief List remote files using sftp, giving up on large directories
+  *   @param session Session which contains already established sftp connection
+  *   @param files As for sftp_session_ls_dir
+  *   @param dir_name Path of the directory to be listed
+  *   @param max_entries Largest accepted number of entries including . and .., 0 for no limit
+  *   @return Valid pointer on success, NULL on error or if the directory has more
+  *   than max_entries entries. Reading stops at the first entry over the limit
+  */
+GSList *sftp_session_ls_dir_limit(Session *session, GSList *files, const char *dir_name, const unsigned max_entries);
+
+/**
+  *   @brief Compute the recursive size of a remote folder
+  *   @param session Session which contains already established sftp connection
+  *   @param path Path of the folder
+  *   @param progress DirSizeProgress, totals are added per folder as the walk proceeds
+  *   @return 0 on success, -1 if the walk was cancelled or failed
+  *   @remark Enumerates with sftp_session_walk and locks the session only
+  *   around network I/O, so other work is interleaved with the walk. The
+  *   caller must not hold the lock
+  */
+int sftp_session_dir_size(Session *session, const char *path, DirSizeProgress *progress);
+
+/**
+  *   @brief Create a File for a single remote directory entry
+  *   @param session Session which contains already established sftp connection
+  *   @param dir_name Path of the directory containing the file
+  *   @param name Filename in the directory
+  *   @return Dynamically allocated File with metadata, as sftp_session_ls_dir
+  *   would list it (free using free_File), NULL if the file does not exist
+  *   @remark Costs a single round trip, used to patch views after operations
+  */
+File_t *sftp_session_new_File(Session *session, const char *dir_name, const char *name);
+
 /**
   *   @brief Write to remote file using sftp
   *   @param session Session which contains already established sftp connection
@@ -199,7 +399,8 @@ enum FileStatus sftp_session_write_file(  Session *session,
   *   @param overwrite Whether to overwrite possibly already existing local file
   *   @return FileStatus (sets corresponding error message, @see Session_message)
   *   @remark This implements blocking read/write, call this from another thread
-  *   than the main thread
+  *   than the main thread. A file cached in session->downloads with the same size
+  *   and mtime is not transferred, transferred files are added to the cache
   */
 enum FileStatus sftp_session_read_file( Session *session,
                                         const char *remote_filename,
@@ -222,13 +423,16 @@ enum FileStatus sftp_session_rename_file(Session *session, const char *path, con
   *   @param dir_name Name of the directory to be removed
   *   @param recursive Whether to remove an empty directory or all the contents
   *   @return 0 on success, < 0 on error
+  *   @remark The contents are removed with sftp_session_walk, many removals in flight
+  *   at once. If that fails the rest is removed one entry at a time. The session must be locked
   */
 enum FileStatus sftp_session_rmdir(Session *session, const char *dir_name, bool recursive);
 
 /**
   *   @brief Remove filepath completely (works for both files and directories)
   *   @details For directories this will call sftp_session_rmdir to recursively
-  *   erase the whole directory. For files this will call sftp_unlink
+  *   erase the whole directory, or first runs rm -rf on the server if session->shell_delete
+  *   is set. For files this will call sftp_unlink
   *   @param session Session struct which contains already established sftp session
   *   @param filepath To be removed
   *   @return 0 on success, < 0 on error (sets corresponding error message, @see Session_message)
@@ -260,8 +464,9 @@ enum FileStatus sftp_session_copy_to_remote(  Session *session,
   *   @param remote_filepath Filepath on the remote filesystem (the actual file, not parent dir)
   *   @param filename File or directory which is copied
   *   @param overwrite Whether to overwrite possible already existing local files
-  *   @remark This is a recursive function. This will return with STOP_FILE_OPERATIONS
-  *   when global stop == 1 (stop is defined in @see assets.h)
+  *   @remark Folders are enumerated with sftp_session_walk, links are copied as
+  *   their targets. This will return with STOP_FILE_OPERATIONS when global
+  *   stop == 1 (stop is defined in @see assets.h)
   *   @return 0 on success, otherwise return < 0 and matching FileStatus
   */
 enum FileStatus sftp_session_copy_from_remote(  Session *session,
@@ -270,6 +475,15 @@ enum FileStatus sftp_session_copy_from_remote(  Session *session,
                                                 const char *filename,
                                                 const bool overwrite);
 
+/**
+  *   @brief Build the shell command copying files on the server
+  *   @param src_filepath Path of the copied file or folder
+  *   @param dst_dir Target directory
+  *   @param folder Whether src_filepath is a folder
+  *   @return Dynamically allocated command, paths are quoted for the shell
+  */
+char *copy_command(const char *src_filepath, const char *dst_dir, const bool folder);
+
 /**
   *   @brief Copy files on remote filesystem
   *   @param session Session struct which contains already established sftp session
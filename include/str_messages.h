@@ -51,7 +51,10 @@ static const char* const error_strings[] =
   "Error: unhandled file copy error\n",
   "Error: severe thread communication error\n",
   "Info: canceled file transfer operation\n",
-  "Error: unhandled file delete error\n"
+  "Error: unhandled file delete error\n",
+  "Error: the remote file has changed since it was opened for editing, the changes were not written back\n"
+  "OK overwrites it with the edited copy, Cancel keeps the copy without writing it back\n",
+  "Error: cannot launch an editor\n"
 };
 
 /** Error enums */
@@ -86,7 +89,9 @@ enum ErrorCode {
   ERROR_FILE_COPY_FAILED,
   SEVERE_THREAD_COMMUNICATION_ERROR,
   INFO_CANCELED_OPERATION,
-  ERROR_FILE_DELETE_FAILED
+  ERROR_FILE_DELETE_FAILED,
+  ERROR_EDIT_CONFLICT,
+  ERROR_LAUNCHING_EDITOR
 };
 
 /**
@@ -0,0 +1,192 @@
+/**
+  *   @file thumb.h
+  *   @author Lauri Westerholm
+  *   @brief Image thumbnails with a freedesktop compatible disk cache, header
+  */
+
+#ifndef THUMB_HEADER
+#define THUMB_HEADER
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "ssh.h"
+#include "assets.h"
+
+#define THUMB_SIZE 128 /**< Size (px) of freedesktop "normal" thumbnails */
+#define THUMB_FOLDER "thumbnails/normal" /**< Folder of THUMB_SIZE thumbnails in the user cache folder */
+#define THUMB_THREADS 2 /**< Threads generating thumbnails */
+#define THUMB_LOCAL_MAX_SIZE 67108864 /**< Larger local images are not thumbnailed */
+#define THUMB_REMOTE_HEAD 65536 /**< Bytes read from the start of a remote image to find an EXIF thumbnail */
+#define THUMB_REMOTE_MAX_SIZE 2097152 /**< Largest remote image downloaded whole when it has no EXIF thumbnail */
+#define THUMB_REMOTE_RATE 1048576 /**< Bytes per second remote thumbnailing may read */
+#define THUMB_READ_CHUNK 32768 /**< Bytes of a remote image read at a time */
+#define THUMB_WAIT 50 /**< Time (ms) a thumbnailer waits for the session or the budget before trying again */
+
+/**
+  *   @struct ThumbBudget
+  *   @brief Token bucket limiting the bandwidth of remote thumbnailing
+  */
+typedef struct {
+  double rate; /**< Bytes per second, also the largest burst */
+  double tokens; /**< Bytes which may be read now */
+  gint64 updated; /**< Monotonic time (us) tokens were last refilled */
+} ThumbBudget;
+
+/**
+  *   @brief Initialize ThumbBudget with a full bucket
+  *   @param budget ThumbBudget
+  *   @param rate Bytes per second
+  *   @param now Monotonic time (us)
+  */
+void ThumbBudget_init(ThumbBudget *budget, const double rate, const gint64 now);
+
+/**
+  *   @brief Take bytes from the budget
+  *   @param budget ThumbBudget
+  *   @param bytes Bytes to be read, at most rate
+  *   @param now Monotonic time (us)
+  *   @return true if the bytes may be read now, false if the caller should wait
+  */
+bool ThumbBudget_take(ThumbBudget *budget, const size_t bytes, const gint64 now);
+
+/**
+  *   @brief Build the URI a thumbnail is stored for
+  *   @param path Absolute path of the image
+  *   @param remote_prefix "sftp://user@host" for remote images, NULL for local ones
+  *   @return Dynamically allocated URI, NULL on error
+  */
+char *thumbnail_uri(const char *path, const char *remote_prefix);
+
+/**
+  *   @brief Get the cache file of a thumbnail
+  *   @param uri URI of the image, @see thumbnail_uri
+  *   @return Dynamically allocated path: the md5 of uri in THUMB_FOLDER, NULL on error
+  */
+char *thumbnail_path(const char *uri);
+
+/**
+  *   @brief Load a cached thumbnail
+  *   @param uri URI of the image
+  *   @param mtime Time when the image was modified
+  *   @return New GdkPixbuf, NULL if there is none or it is outdated
+  */
+GdkPixbuf *load_thumbnail(const char *uri, const time_t mtime);
+
+/**
+  *   @brief Store a thumbnail to the cache
+  *   @details The PNG carries Thumb::URI, Thumb::MTime and Thumb::Size and is
+  *   renamed into place, so readers never see a partial file
+  *   @param uri URI of the image
+  *   @param mtime Time when the image was modified
+  *   @param size Size of the image
+  *   @param thumbnail At most THUMB_SIZE pixels wide and high
+  *   @return 0 on success, -1 on error
+  */
+int save_thumbnail(const char *uri, const time_t mtime, const uint64_t size, GdkPixbuf *thumbnail);
+
+/**
+  *   @brief Find the thumbnail embedded to the EXIF data of a JPEG
+  *   @param data Start of the JPEG file
+  *   @param len Length of data
+  *   @param offset Set to the offset of the embedded JPEG in the file
+  *   @param length Set to the length of the embedded JPEG
+  *   @return true if there is an embedded thumbnail, it may end beyond data
+  */
+bool exif_thumbnail(const unsigned char *data, const size_t len, size_t *offset, size_t *length);
+
+/**
+  *   @brief Scale an image to fit a square, smaller images are not enlarged
+  *   @param pixbuf Image
+  *   @param size Side of the square in pixels
+  *   @return New reference to a GdkPixbuf, NULL on error
+  */
+GdkPixbuf *scale_thumbnail(GdkPixbuf *pixbuf, const int size);
+
+/**
+  *   @struct ThumbJob
+  *   @brief Thumbnail requested from a Thumbnailer
+  */
+typedef struct {
+  char *path; /**< Absolute path of the image */
+  char *name; /**< Name of the entry in its FileStore */
+  bool remote; /**< Whether the image is on the remote */
+  uint64_t size; /**< Size of a remote image, local images are stat'ed by the thumbnailer */
+  time_t mtime; /**< Time when a remote image was modified */
+  int icon_size; /**< Size the thumbnail is scaled to */
+  unsigned generation; /**< Thumbnailer generation of the request */
+  unsigned store_generation; /**< FileStore generation of the listing the entry belongs to */
+  GdkPixbuf *thumbnail; /**< Result, NULL if the image could not be thumbnailed or the request was dropped */
+} ThumbJob;
+
+/**
+  *   @brief Free ThumbJob
+  *   @param job ThumbJob
+  */
+void free_ThumbJob(ThumbJob *job);
+
+/**
+  *   @struct Thumbnailer
+  *   @brief Pool of threads generating thumbnails in the background
+  *   @details Requests older than the generation are dropped without any
+  *   I/O. Remote images are read only while the session is free and within
+  *   a ThumbBudget, so thumbnails never hold up foreground transfers
+  */
+typedef struct {
+  GAsyncQueue *requests; /**< ThumbJobs waiting for a thread */
+  GAsyncQueue *results; /**< Finished ThumbJobs, also dropped ones */
+  pthread_t *threads; /**< Thread pool */
+  unsigned thread_count; /**< Threads in the pool */
+  volatile gint generation; /**< Incremented by Thumbnailer_cancel */
+  volatile gint stopping; /**< Set when the pool is freed */
+  Session *session; /**< Session for remote images, NULL when not connected */
+  char *remote_prefix; /**< "sftp://user@host" for the URIs of remote images */
+  ThumbBudget budget; /**< Bandwidth of remote thumbnailing */
+  pthread_mutex_t lock; /**< Protects budget */
+} Thumbnailer;
+
+/**
+  *   @brief Start a Thumbnailer
+  *   @param threads Number of threads
+  *   @return Valid pointer, NULL on error
+  */
+Thumbnailer *new_Thumbnailer(const unsigned threads);
+
+/**
+  *   @brief Stop the threads and free Thumbnailer
+  *   @param thumbnailer Thumbnailer
+  *   @remark Waits for the threads, a remote read in progress is finished first
+  */
+void free_Thumbnailer(Thumbnailer *thumbnailer);
+
+/**
+  *   @brief Set the session used for remote images
+  *   @param thumbnailer Thumbnailer, no remote requests may be pending
+  *   @param session Session struct, NULL to stop thumbnailing remote images
+  *   @param remote_prefix "sftp://user@host", copied
+  */
+void Thumbnailer_set_session(Thumbnailer *thumbnailer, Session *session, const char *remote_prefix);
+
+/**
+  *   @brief Request a thumbnail
+  *   @param thumbnailer Thumbnailer
+  *   @param job ThumbJob, owned by the thumbnailer until it is popped from results
+  */
+void Thumbnailer_request(Thumbnailer *thumbnailer, ThumbJob *job);
+
+/**
+  *   @brief Drop the requests not started yet
+  *   @param thumbnailer Thumbnailer
+  *   @return New generation for the next requests
+  */
+unsigned Thumbnailer_cancel(Thumbnailer *thumbnailer);
+
+#endif
@@ -0,0 +1,180 @@
+/**
+  *   @file viewer.h
+  *   @author Lauri Westerholm
+  *   @brief Paged reading of large files for the file viewer, header
+  */
+
+#ifndef VIEWER_HEADER
+#define VIEWER_HEADER
+
+#include <gmodule.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "ssh.h"
+#include "assets.h"
+
+#define VIEWER_BLOCK_SIZE 4096 /**< Bytes fetched and cached at a time */
+#define VIEWER_CACHE_BLOCKS 2048 /**< Blocks kept in the cache of a PagedFile (8 MiB) */
+#define VIEWER_MAX_RUN 64 /**< Most consecutive missing blocks fetched with a single ranged read */
+#define VIEWER_PAGE_LINES 1000 /**< Lines shown per page */
+#define VIEWER_PAGE_BYTES 1048576 /**< Most bytes shown per page, limits pages of very long lines */
+
+/**
+  *   @brief Read from the source of a PagedFile
+  *   @param source Source given to new_PagedFile
+  *   @param buff Buffer for the data
+  *   @param len Bytes to read
+  *   @param offset Offset in the file
+  *   @return Bytes read, fewer than len only at the end of the file, -1 on error
+  */
+typedef long (*PagedRead)(void *source, char *buff, const size_t len, const uint64_t offset);
+
+/**
+  *   @brief Get the current size of the source of a PagedFile
+  *   @param source Source given to new_PagedFile
+  *   @param size Set to the size in bytes
+  *   @return 0 on success, -1 on error
+  */
+typedef int (*PagedSize)(void *source, uint64_t *size);
+
+/**
+  *   @brief Reopen the source of a PagedFile if its path names another file,
+  *   as after a log was rotated by renaming it
+  *   @param source Source given to new_PagedFile
+  *   @param reopened Set to true if the source now reads the new file
+  *   @return 0 on success, also when the path is missing, -1 on error
+  */
+typedef int (*PagedReopen)(void *source, bool *reopened);
+
+/**
+  *   @brief Close the source of a PagedFile
+  *   @param source Source given to new_PagedFile
+  */
+typedef void (*PagedClose)(void *source);
+
+/**
+  *   @struct PagedBlock
+  *   @brief Cached block of a PagedFile
+  */
+typedef struct {
+  uint64_t index; /**< Block number, the key of the block */
+  char *data; /**< VIEWER_BLOCK_SIZE bytes allocated */
+  size_t len; /**< Bytes of data read, less than VIEWER_BLOCK_SIZE only for the last block */
+  GList *link; /**< Link of the block in the LRU queue */
+} PagedBlock;
+
+/**
+  *   @struct PagedFile
+  *   @brief File read in blocks through an LRU cache, only the ranges viewed are transferred
+  *   @remark Not thread safe, used by one viewer thread at a time
+  */
+typedef struct {
+  PagedRead read; /**< Ranged read of the source */
+  PagedSize get_size; /**< Size of the source */
+  PagedReopen reopen; /**< Follows the path of the source to a new file, NULL if not supported */
+  PagedClose close; /**< Closes the source */
+  void *source; /**< Open file */
+  uint64_t size; /**< Size seen by the latest PagedFile_refresh */
+  GHashTable *blocks; /**< Block number -> PagedBlock */
+  GQueue lru; /**< PagedBlocks, the most recently used first */
+  unsigned max_blocks; /**< The least recently used block is evicted when this is exceeded */
+  uint64_t transferred; /**< Bytes read from the source */
+} PagedFile;
+
+/**
+  *   @brief Create a PagedFile
+  *   @param read Ranged read of the source
+  *   @param get_size Size of the source
+  *   @param reopen Follows the path of the source to a new file, may be NULL
+  *   @param close Closes the source, may be NULL
+  *   @param source Open file, owned by the PagedFile
+  *   @param max_blocks Blocks kept in the cache
+  *   @return Valid pointer, NULL on error (source is closed)
+  */
+PagedFile *new_PagedFile(PagedRead read, PagedSize get_size, PagedReopen reopen, PagedClose close, void *source,
+                         const unsigned max_blocks);
+
+/**
+  *   @brief Open a local file for paged reading
+  *   @details The file is reopened when its path gets another device or
+  *   inode number, so a renamed log is followed to its successor
+  *   @param path Path of the file
+  *   @return Valid pointer, NULL on error
+  */
+PagedFile *open_local_PagedFile(const char *path);
+
+/**
+  *   @brief Open a remote file for paged reading
+  *   @param session Session which contains already established sftp connection
+  *   @param path Path of the file on the remote
+  *   @return Valid pointer, NULL on error
+  *   @remark Locks the session for each read, call this and the reads outside the main thread.
+  *   SFTP has no inode numbers: the file is reopened when its path is smaller
+  *   than the open file or has another owner or permissions, so a renamed log
+  *   is followed only if its successor is noticed before outgrowing it
+  */
+PagedFile *open_remote_PagedFile(Session *session, const char *path);
+
+/**
+  *   @brief Close the source and free PagedFile
+  *   @param file PagedFile
+  */
+void free_PagedFile(PagedFile *file);
+
+/**
+  *   @brief Update the size of the file
+  *   @details Reopens the source first if its path names another file. A
+  *   shrunk or reopened file drops the cache and counts as rewritten
+  *   @param file PagedFile
+  *   @param appended Set to the number of bytes appended since the previous
+  *   refresh, 0 if none or if the file was rewritten
+  *   @return 0 on success, 1 if the file was rewritten, -1 on error
+  */
+int PagedFile_refresh(PagedFile *file, uint64_t *appended);
+
+/**
+  *   @brief Read a range of the file through the cache
+  *   @details Runs of missing blocks are fetched with one ranged read. A cached
+  *   last block shorter than a block is completed with the bytes appended after it
+  *   @param file PagedFile
+  *   @param buff Buffer for the data
+  *   @param len Bytes to read
+  *   @param offset Offset in the file
+  *   @return Bytes read, fewer than len at the end of the file, -1 on error
+  */
+long PagedFile_read(PagedFile *file, char *buff, const size_t len, const uint64_t offset);
+
+/**
+  *   @brief Find the start of the lines preceding an offset
+  *   @details Reads backwards from end only until enough line breaks are found,
+  *   so showing the end of a huge file transfers only the lines shown
+  *   @param file PagedFile
+  *   @param end Offset the lines end at, a line break just before it ends the last line
+  *   @param lines Number of lines
+  *   @param start Set to the offset of the first of the lines, 0 if there are fewer lines
+  *   @return 0 on success, -1 on error
+  */
+int PagedFile_lines_before(PagedFile *file, const uint64_t end, const unsigned lines, uint64_t *start);
+
+/**
+  *   @brief Read lines starting from an offset
+  *   @param file PagedFile
+  *   @param offset Offset of the first line
+  *   @param lines Maximum number of lines
+  *   @param max_bytes Maximum number of bytes
+  *   @param text Lines are appended to this, line breaks included
+  *   @param end Set to the offset after the last byte read
+  *   @return 0 on success, -1 on error
+  */
+int PagedFile_lines(PagedFile *file, const uint64_t offset, const unsigned lines, const size_t max_bytes,
+                    GString *text, uint64_t *end);
+
+#endif
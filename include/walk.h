@@ -0,0 +1,217 @@
+/**
+  *   @file walk.h
+  *   @author Lauri Westerholm
+  *   @brief Pipelined enumeration of remote directory trees, header
+  */
+
+#ifndef WALK_HEADER
+#define WALK_HEADER
+
+#include <gmodule.h> // Linked list implementation, GSList
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "ssh.h"
+#include "fs.h"
+#include "assets.h"
+
+#define WALK_MAX_FOLDERS 64 /**< Folders read concurrently, each with one request in flight */
+#define WALK_MAX_PACKET (1024 * 1024) /**< Largest accepted sftp reply in bytes */
+#define WALK_SFTP_VERSION 3 /**< Protocol version requested from the server */
+#define WALK_MAX_REMOVALS 256 /**< Remove requests kept in flight when RemoteWalk remove is set */
+#define WALK_POLL_TIMEOUT 100 /**< Time (ms) the walker waits for a reply before checking cancel */
+
+/**
+  *   @enum WalkAction
+  *   @brief Returned by the RemoteWalk callbacks
+  */
+enum WalkAction {
+  WALK_CONTINUE, /**< Continue, descend to a folder */
+  WALK_SKIP, /**< Do not descend to the folder just reported */
+  WALK_STOP /**< Stop the whole walk */
+};
+
+/**
+  *   @struct RemoteWalk
+  *   @brief Callbacks and options of sftp_session_walk
+  */
+typedef struct {
+  /**
+    *   @brief Called for every entry except . and ..
+    *   @param parent Path of the folder containing the entry
+    *   @param file Entry with metadata, owned by the walker
+    *   @param data RemoteWalk data
+    */
+  enum WalkAction (*entry)(const char *parent, const File_t *file, void *data);
+  /**
+    *   @brief Called after a folder and everything below it has been reported,
+    *   so folders are left in post-order. May be NULL
+    *   @param path Path of the folder
+    *   @param readable false if the folder could not be listed completely
+    *   @param data RemoteWalk data
+    */
+  enum WalkAction (*leave)(const char *path, const bool readable, void *data);
+  void *data; /**< Passed to the callbacks */
+  bool follow_links; /**< Descend to symbolic links which point to folders */
+  bool lock_session; /**< Lock the session only around network I/O instead of
+                          expecting the caller to hold the lock */
+  volatile gint *cancel; /**< Walk stops when set to non-zero, may be NULL */
+  bool remove; /**< Remove every entry and the root, each folder once everything
+                    below it is removed. Links are removed, never followed */
+} RemoteWalk;
+
+/**
+  *   @brief Enumerate a remote directory tree
+  *   @details Opens an own sftp channel and keeps listings of up to
+  *   WALK_MAX_FOLDERS folders in flight at once, so a large tree is limited by
+  *   bandwidth instead of one round trip per folder. Entries are streamed to
+  *   walk->entry as replies arrive: the order between folders is not defined.
+  *   With walk->follow_links, links to folders are resolved and a link is not
+  *   followed if its target contains the link or has already been visited.
+  *   With walk->remove, up to WALK_MAX_REMOVALS remove requests are in flight
+  *   besides the listings, and a folder is removed after it has been left
+  *   @param session Session struct
+  *   @param root Path of the folder to be enumerated, not reported to walk->entry
+  *   @param walk Callbacks and options, with walk->lock_session the session is
+  *   locked only around each read and write, never while waiting for a reply
+  *   longer than WALK_POLL_TIMEOUT or while calling the callbacks
+  *   @return 0 on success, -1 if the walk failed, was cancelled or stopped, or
+  *   if an entry could not be removed
+  *   @remark If walk->lock_session is false the caller must hold the session lock
+  */
+int sftp_session_walk(Session *session, const char *root, RemoteWalk *walk);
+
+/**
+  *   @brief Write to the channel of a walk
+  *   @param target WalkChannel target
+  *   @param buff Data to write
+  *   @param len Bytes to write
+  *   @return Bytes written, -1 on error
+  */
+typedef int (*WalkWrite)(void *target, const uint8_t *buff, const uint32_t len);
+
+/**
+  *   @brief Read from the channel of a walk
+  *   @param target WalkChannel target
+  *   @param buff Destination
+  *   @param len Size of buff
+  *   @param timeout Time (ms) to wait for data
+  *   @return Bytes read, 0 if nothing arrived in time, -1 on error or end of file
+  */
+typedef int (*WalkRead)(void *target, uint8_t *buff, const uint32_t len, const int timeout);
+
+/**
+  *   @struct WalkChannel
+  *   @brief Byte stream to a sftp server
+  */
+typedef struct {
+  WalkWrite write; /**< Write to the server */
+  WalkRead read; /**< Read from the server */
+  void *target; /**< Passed to write and read */
+} WalkChannel;
+
+/**
+  *   @brief Enumerate a directory tree over an open sftp channel
+  *   @details This is the walk of sftp_session_walk: the protocol is
+  *   initialized here and the channel is left open
+  *   @param channel WalkChannel to a sftp subsystem
+  *   @param root Path of the folder to be enumerated, not reported to walk->entry
+  *   @param real Canonical path of root, needed only with walk->follow_links
+  *   @param walk Callbacks and options, lock_session is left to the channel
+  *   @return @see sftp_session_walk
+  */
+int WalkChannel_walk(WalkChannel *channel, const char *root, const char *real, RemoteWalk *walk);
+
+
+/* Sftp packets */
+
+/**
+  *   @brief Start a sftp packet
+  *   @param type Packet type, SSH_FXP_*
+  *   @param id Request id, or the version for SSH_FXP_INIT
+  *   @return GByteArray with the length left to be filled by SftpPacket_finish
+  */
+GByteArray *new_SftpPacket(const uint8_t type, const uint32_t id);
+
+/**
+  *   @brief Append an uint32 to a sftp packet
+  *   @param packet Packet
+  *   @param value Value appended in network byte order
+  */
+void SftpPacket_u32(GByteArray *packet, const uint32_t value);
+
+/**
+  *   @brief Append an uint64 to a sftp packet
+  *   @param packet Packet
+  *   @param value Value appended in network byte order
+  */
+void SftpPacket_u64(GByteArray *packet, const uint64_t value);
+
+/**
+  *   @brief Append a string to a sftp packet
+  *   @param packet Packet
+  *   @param str String, does not need to be '\0' terminated
+  *   @param len Length of str
+  */
+void SftpPacket_string(GByteArray *packet, const char *str, const uint32_t len);
+
+/**
+  *   @brief Fill the length of a sftp packet
+  *   @param packet Packet
+  */
+void SftpPacket_finish(GByteArray *packet);
+
+/**
+  *   @struct SftpReader
+  *   @brief Position in a received sftp packet
+  */
+typedef struct {
+  const uint8_t *pos; /**< Next unread byte */
+  const uint8_t *end; /**< End of the packet */
+} SftpReader;
+
+/**
+  *   @brief Read an uint32 from a sftp packet
+  *   @param reader SftpReader
+  *   @param value Set to the value read
+  *   @return true on success, false if the packet is too short
+  */
+bool SftpReader_u32(SftpReader *reader, uint32_t *value);
+
+/**
+  *   @brief Read an uint64 from a sftp packet
+  *   @param reader SftpReader
+  *   @param value Set to the value read
+  *   @return true on success, false if the packet is too short
+  */
+bool SftpReader_u64(SftpReader *reader, uint64_t *value);
+
+/**
+  *   @brief Read a string from a sftp packet
+  *   @param reader SftpReader
+  *   @param str Set to point to the string in the packet, not '\0' terminated
+  *   @param len Set to the length of the string
+  *   @return true on success, false if the packet is too short
+  */
+bool SftpReader_string(SftpReader *reader, const char **str, uint32_t *len);
+
+/**
+  *   @brief Read file attributes (ATTRS) from a sftp packet
+  *   @param reader SftpReader
+  *   @param file File whose type, size, uid, gid, permissions and mtime are set
+  *   @return true on success, false if the packet is malformed
+  */
+bool SftpReader_attrs(SftpReader *reader, File_t *file);
+
+/**
+  *   @brief Read one entry of a SSH_FXP_NAME reply
+  *   @details Owner and group are taken from the ls -l style long name
+  *   @param reader SftpReader
+  *   @return Dynamically allocated File with metadata, NULL on error
+  */
+File_t *SftpReader_File(SftpReader *reader);
+
+#endif
@@ -9,6 +9,70 @@
 /* Queue and worker handling */
 static pthread_t tid; /**< Worker thread */
 static pthread_attr_t tattr; /**< Attributes for the thread */
+static pthread_attr_t list_tattr; /**< Attributes for the detached lister threads */
+static guint list_source_id = 0; /**< check_listQueue source, 0 when not installed */
+static guint prefetch_source = 0; /**< Pending start_prefetch timeout, 0 when not scheduled */
+static guint filter_source_id = 0; /**< check_filterQueue source, 0 when not installed */
+static guint sort_source_id = 0; /**< check_sortQueue source, 0 when not installed */
+static guint folder_size_source_id = 0; /**< check_folderSizeQueue source, 0 when not installed */
+static FolderSizeJob_t *folder_size_job = NULL; /**< Computation shown in filePropertiesDialog, NULL if none */
+static guint search_source_id = 0; /**< check_searchQueue source, 0 when not installed */
+static SearchJob_t *search_job = NULL; /**< Search shown in searchWindow, NULL if none */
+static guint index_source_id = 0; /**< check_indexQueue source, 0 when not installed */
+static IndexJob_t *index_job = NULL; /**< Indexing shown in searchWindow, NULL if none */
+static IndexJob_t *freshness_job = NULL; /**< Freshness check shown in searchWindow, NULL if none */
+
+/* Remote directory watching */
+static guint remote_watch_source = 0; /**< poll_RemoteWatch timeout, 0 when not watching */
+static bool remote_watch_polling = false; /**< Whether a poll is in progress */
+static unsigned remote_watch_generation = 0; /**< remoteFileStore generation remote_watch_mtime belongs to */
+static uint64_t remote_watch_mtime = 0; /**< Directory mtime seen by the latest poll */
+static bool remote_watch_settled = true; /**< Whether the latest poll found no changes */
+
+/* Local directory watching */
+static int inotify_fd = -1; /**< inotify instance watching local_pwd, -1 if not available */
+static int watch_wd = -1; /**< Watch descriptor of the watched directory, -1 if none */
+static GHashTable *watch_changes = NULL; /**< Coalesced changes: filename -> enum WatchChange */
+static bool watch_relist = false; /**< Whether changes were lost and the directory must be listed again */
+static guint watch_source = 0; /**< Pending apply_LocalWatch_changes timeout, 0 when not scheduled */
+static guint thumb_source = 0; /**< Pending start_thumbnails timeout, 0 when not scheduled */
+static guint thumb_source_id = 0; /**< check_thumbQueue source, 0 when not installed */
+static unsigned thumb_generation = 0; /**< Thumbnailer generation of the latest requests */
+static unsigned pending_thumbs = 0; /**< Requests not returned by the thumbnailer yet */
+static guint viewer_source_id = 0; /**< check_viewerQueue source, 0 when not installed */
+static ViewerJob_t *viewer_job = NULL; /**< Page being read for viewerWindow, NULL if none */
+static guint follow_source = 0; /**< follow_Viewer timeout, 0 when not following */
+static guint edit_source_id = 0; /**< check_editQueue source, 0 when not installed */
+static guint edit_poll_source = 0; /**< poll_EditFiles timeout, 0 when no files are edited */
+static char *conflict_path = NULL; /**< Remote path of the EditFile messageWindow asks about, NULL if none */
+
+/**
+  *   @brief Check whether a file is shown in FileViews
+  *   @param file struct File instance
+  *   @return false for "." and "..", and for hidden files unless shown
+  */
+static bool is_File_displayed(const File_t *file) {
+  if ((strcmp(file->name, ".") == 0) || (strcmp(file->name, "..") == 0)) return false;
+  return show_hidden_files || (file->name[0] != '.');
+}
+
+/**
+  *   @struct PrefetchCandidate
+  *   @brief Subdirectory and its distance from the cursor, used by start_prefetch
+  */
+typedef struct {
+  unsigned distance; /**< Distance in displayed rows from the cursor */
+  const char *name; /**< Name of the subdirectory */
+} PrefetchCandidate;
+
+/**
+  *   @brief Compare PrefetchCandidates by their distance
+  */
+static gint compare_PrefetchCandidates(gconstpointer a, gconstpointer b) {
+  const unsigned d1 = ((const PrefetchCandidate *) a)->distance;
+  const unsigned d2 = ((const PrefetchCandidate *) b)->distance;
+  return d1 < d2 ? -1 : d1 > d2;
+}
 
 
 gboolean check_asyncQueue(gpointer user_data) {
@@ -19,7 +83,21 @@ gboolean check_asyncQueue(gpointer user_data) {
     worker_running = 0;
     // Go through the worker return value
     WorkerMessage_t *worker_msg = (WorkerMessage_t *) data;
-    if ((worker_msg->msg == FILE_ALREADY_EXISTS) || (worker_msg->msg == DIR_ALREADY_EXISTS)) {
+    if (worker_msg->target_remote) {
+      // Drop cached listings touched by the worker, even if it failed halfway
+      if (worker_msg->filepath) {
+        invalidate_remote_path(worker_msg->filepath);
+        if (worker_msg->new_path) invalidate_remote_path(worker_msg->new_path);
+      } else {
+        for (GSList *node = fileCopies; node; node = node->next) {
+          char *path = construct_filepath(worker_msg->pwd, ((FileCopy_t *) node->data)->filename);
+          if (path) invalidate_remote_path(path);
+          free(path);
+        }
+      }
+    }
+    if (worker_msg->workType == PASTE_FILES &&
+        ((worker_msg->msg == FILE_ALREADY_EXISTS) || (worker_msg->msg == DIR_ALREADY_EXISTS))) {
       // Prompt user whether to overwrite the existing files
       const char *info = OVERWRITE_PROMPT_MSG;
       File_t *file = (File_t *) fileCopies->data;
@@ -41,18 +119,43 @@ gboolean check_asyncQueue(gpointer user_data) {
     } else if (worker_msg->msg != FILE_WRITTEN_SUCCESSFULLY) {
       if (worker_msg->workType == PASTE_FILES) {
         Session_message(session, get_error(ERROR_FILE_COPY_FAILED));
+      } else if (worker_msg->workType == RENAME_FILE) {
+        Session_message(session, get_error(ERROR_RENAMING_FILE));
+      } else if (worker_msg->workType == MAKE_FOLDER) {
+        Session_message(session, get_error(ERROR_MK_DIR));
       } else {
         Session_message(session, get_error(ERROR_DELETE_FILE));
       }
       transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
     }
-    free_WorkerMessage_t(worker_msg);
     gtk_widget_hide(mainWindow->LeftStopButton);
     gtk_widget_hide(mainWindow->RightStopButton);
-    gtk_spinner_stop(GTK_SPINNER(mainWindow->LeftSpinner));
-    gtk_spinner_stop(GTK_SPINNER(mainWindow->RightSpinner));
-    show_FileStore(local_pwd, false);
-    show_FileStore(remote_pwd, true);
+    if (!localFileStore->loading) gtk_spinner_stop(GTK_SPINNER(mainWindow->LeftSpinner));
+    if (!remoteFileStore->loading) gtk_spinner_stop(GTK_SPINNER(mainWindow->RightSpinner));
+    // Patch the changed pane with the entries the worker reported
+    FileStore *target = get_pwd_FileStore(worker_msg->pwd, worker_msg->target_remote);
+    if (target) {
+      if (worker_msg->workType == PASTE_FILES || worker_msg->workType == MAKE_FOLDER) {
+        for (GSList *node = worker_msg->files; node; node = node->next) {
+          FileStore_put_File(target, (File_t *) node->data);
+          node->data = NULL; // Owned by target
+        }
+      } else if (worker_msg->workType == RENAME_FILE) {
+        if (worker_msg->msg == FILE_WRITTEN_SUCCESSFULLY) {
+          const char *name = strrchr(worker_msg->filepath, '/');
+          const char *new_name = strrchr(worker_msg->new_path, '/');
+          FileStore_rename_File(target, name ? name + 1 : worker_msg->filepath,
+                                new_name ? new_name + 1 : worker_msg->new_path);
+        }
+      } else if (worker_msg->msg == FILE_WRITTEN_SUCCESSFULLY && worker_msg->filepath) {
+        const char *name = strrchr(worker_msg->filepath, '/');
+        FileStore_remove_File(target, name ? name + 1 : worker_msg->filepath);
+      } else {
+        // Partially deleted, list again to show what is left
+        show_FileStore(worker_msg->pwd, worker_msg->target_remote);
+      }
+    }
+    free_WorkerMessage_t(worker_msg);
     return FALSE;
   }
   if (working_on_remote) {
@@ -64,11 +167,61 @@ gboolean check_asyncQueue(gpointer user_data) {
   return TRUE;
 }
 
+/**
+  *   @brief Check whether a worker job needs the ssh session
+  *   @param data Job passed to init_worker
+  *   @return true if the job touches the remote filesystem
+  */
+static bool worker_uses_remote(const WorkerThread_t *data) {
+  if (data->target_remote) return true;
+  for (GSList *node = data->fileCopies; node; node = node->next) {
+    if (((FileCopy_t *) node->data)->remote) return true;
+  }
+  return false;
+}
+
+/**
+  *   @brief Rename or create a remote file in the worker thread
+  *   @param workType RENAME_FILE or MAKE_FOLDER
+  *   @param filepath Path of the file, freed by this function
+  *   @param new_path New path for RENAME_FILE, freed by this function, otherwise NULL
+  *   @return true if the worker was started, check_asyncQueue reports the result
+  */
+static bool start_remote_worker(const enum WorkerType workType, char *filepath, char *new_path) {
+  WorkerThread_t *worker_data = calloc(1, sizeof(WorkerThread_t));
+  if (!worker_data || worker_running || !filepath || (workType == RENAME_FILE && !new_path)) {
+    free(worker_data);
+    free(filepath);
+    free(new_path);
+    return false;
+  }
+  worker_data->filepath = filepath;
+  worker_data->new_path = new_path;
+  worker_data->workType = workType;
+  worker_data->target_remote = true;
+  worker_data->pwd = malloc(strlen(remote_pwd) + 1);
+  if (worker_data->pwd) strcpy(worker_data->pwd, remote_pwd);
+  if (!worker_data->pwd || pthread_create(&tid, &tattr, init_worker, (void *) worker_data) != 0) {
+    free_WorkerThread_t(worker_data);
+    return false;
+  }
+  g_idle_add((GSourceFunc) check_asyncQueue, asyncQueue);
+  worker_running = 1;
+  working_on_remote = 1;
+  return true;
+}
+
 void *init_worker(void *ptr) {
   WorkerThread_t *data = (WorkerThread_t *) ptr;
   int ret;
+  const bool uses_remote = worker_uses_remote(data);
+  if (uses_remote) session_lock(session);
   if (data->workType == PASTE_FILES) {
     ret = iterate_FileCopyList(data->fileCopies, paste_file, (const void *) data->pwd, data->overwrite, data->target_remote);
+  } else if (data->workType == RENAME_FILE) {
+    ret = sftp_session_rename_file(session, data->filepath, data->new_path);
+  } else if (data->workType == MAKE_FOLDER) {
+    ret = sftp_session_mkdir(session, data->filepath, 0);
   } else {
     if (data->target_remote) {
       ret = sftp_session_remove_completely_file(session, data->filepath);
@@ -76,31 +229,1582 @@ void *init_worker(void *ptr) {
       ret = remove_completely(data->filepath);
     }
   }
+  GSList *files = NULL;
+  if (data->workType == PASTE_FILES) {
+    // Stat the pasted entries so that the view can be patched without listing pwd
+    for (GSList *node = data->fileCopies; node; node = node->next) {
+      const char *filename = ((FileCopy_t *) node->data)->filename;
+      File_t *file = data->target_remote ? sftp_session_new_File(session, data->pwd, filename)
+                                         : fs_new_File(data->pwd, filename);
+      if (file) files = g_slist_prepend(files, file);
+    }
+  } else if (data->workType == MAKE_FOLDER && ret >= 0) {
+    const char *name = strrchr(data->filepath, '/');
+    File_t *dir = sftp_session_new_File(session, data->pwd, name ? name + 1 : data->filepath);
+    if (dir) files = g_slist_prepend(files, dir);
+  }
+  if (uses_remote) session_unlock(session);
   // Send a message to the main thread
   WorkerMessage_t *msg = malloc(sizeof(WorkerMessage_t));
   if (msg) {
     msg->msg = ret;
+    msg->files = files;
     msg->workType = data->workType;
+    msg->target_remote = data->target_remote;
     msg->pwd = malloc(strlen(data->pwd) + 1);
     if (msg->pwd) strcpy(msg->pwd, data->pwd);
-  }
+    msg->filepath = NULL;
+    if (data->filepath) {
+      msg->filepath = malloc(strlen(data->filepath) + 1);
+      if (msg->filepath) strcpy(msg->filepath, data->filepath);
+    }
+    msg->new_path = NULL;
+    if (data->new_path) {
+      msg->new_path = malloc(strlen(data->new_path) + 1);
+      if (msg->new_path) strcpy(msg->new_path, data->new_path);
+    }
+  } else clear_Filelist(files);
   free_WorkerThread_t(data);
   g_async_queue_push(asyncQueue, msg);
   pthread_exit(NULL);
 }
 
+gboolean check_listQueue(gpointer user_data) {
+  ListerJob_t *job;
+  while ((job = (ListerJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_listers);
+    FileStore *fileStore = job->remote ? remoteFileStore : localFileStore;
+    if (job->watch) {
+      // Watch polls never replace the view, only patch it
+      remote_watch_polling = false;
+      if (job->generation == fileStore->generation && !fileStore->loading) {
+        unsigned changes = 0;
+        if (!job->unchanged && job->files) {
+          changes = apply_FileStore_diff(fileStore, job->files);
+          job->files = NULL;
+        }
+        remote_watch_generation = job->generation;
+        remote_watch_mtime = job->mtime;
+        remote_watch_settled = job->unchanged || changes == 0;
+      }
+      free_ListerJob_t(job);
+      continue;
+    }
+    // Results of older requests are stale, the user has already moved on
+    if (job->generation == fileStore->generation) {
+      fileStore->loading = false;
+      if (!worker_running) {
+        gtk_spinner_stop(GTK_SPINNER(job->remote ? mainWindow->RightSpinner : mainWindow->LeftSpinner));
+      }
+      // An unchanged cached listing is already displayed
+      if (!job->unchanged) display_FileStore(job);
+    }
+    free_ListerJob_t(job);
+  }
+  if (g_atomic_int_get(&pending_listers) == 0) {
+    list_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void schedule_prefetch() {
+  if (!remoteCache) return;
+  if (prefetch_source) g_source_remove(prefetch_source);
+  prefetch_source = g_timeout_add(PREFETCH_DELAY, (GSourceFunc) start_prefetch, NULL);
+}
+
+gboolean start_prefetch(__attribute__((unused)) gpointer user_data) {
+  // Only use an idle link, user requests always go first
+  if (g_atomic_int_get(&prefetch_running) || g_atomic_int_get(&pending_listers) > 0 || worker_running) return TRUE;
+  prefetch_source = 0;
+  PrefetchJob_t *job = calloc(1, sizeof(PrefetchJob_t));
+  if (!job) return FALSE;
+  job->generation = remoteFileStore->generation;
+
+  // Parent directory first, then subdirectories nearest to the cursor
+  char *parent = malloc(strlen(remote_pwd) + 1);
+  if (parent) {
+    strcpy(parent, remote_pwd);
+    cd_back_pwd(parent);
+    if ((strcmp(parent, remote_pwd) != 0) && !ListingCache_contains(remoteCache, parent)) {
+      job->paths = g_slist_prepend(job->paths, parent);
+    } else free(parent);
+  }
+  unsigned cursor = 0;
+  GtkTreePath *path;
+  if (FileView_get_cursor(mainWindow->RightFileView, &path)) {
+    cursor = gtk_tree_path_get_indices(path)[0];
+    gtk_tree_path_free(path);
+  }
+  GArray *candidates = g_array_new(FALSE, FALSE, sizeof(PrefetchCandidate));
+  unsigned row = 0;
+  for (GSList *node = remoteFileStore->files; node; node = node->next) {
+    const File_t *file = (const File_t *) node->data;
+    if (!is_File_displayed(file)) continue;
+    if (is_folder(file->type, true)) {
+      PrefetchCandidate candidate = { row > cursor ? row - cursor : cursor - row, file->name };
+      g_array_append_val(candidates, candidate);
+    }
+    row++;
+  }
+  g_array_sort(candidates, compare_PrefetchCandidates);
+  unsigned count = g_slist_length(job->paths);
+  for (guint i = 0; i < candidates->len && count < PREFETCH_MAX_DIRS; i++) {
+    char *dir_path = construct_filepath(remote_pwd, g_array_index(candidates, PrefetchCandidate, i).name);
+    if (!dir_path) break;
+    if (ListingCache_contains(remoteCache, dir_path)) {
+      free(dir_path);
+      continue;
+    }
+    job->paths = g_slist_prepend(job->paths, dir_path);
+    count++;
+  }
+  g_array_free(candidates, TRUE);
+  job->paths = g_slist_reverse(job->paths);
+
+  pthread_t prefetcher;
+  if (!job->paths || pthread_create(&prefetcher, &list_tattr, init_prefetcher, (void *) job) != 0) {
+    free_PrefetchJob_t(job);
+    return FALSE;
+  }
+  g_atomic_int_set(&prefetch_running, 1);
+  return FALSE;
+}
+
+void *init_prefetcher(void *ptr) {
+  PrefetchJob_t *job = (PrefetchJob_t *) ptr;
+  for (GSList *node = job->paths; node; node = node->next) {
+    // Give way as soon as the user needs the link or has moved on
+    if (stop || worker_running || g_atomic_int_get(&pending_listers) > 0 ||
+        g_atomic_int_get(&prefetch_generation) != job->generation) break;
+    session_lock(session);
+    // Changes are made under the lock and invalidated after it
+    const unsigned invalidations = ListingCache_invalidations(remoteCache);
+    GSList *files = sftp_session_ls_dir_limit(session, NULL, (const char *) node->data, PREFETCH_MAX_ENTRIES);
+    session_unlock(session);
+    if (files && ListingCache_store_since(remoteCache, (const char *) node->data, files, invalidations) && remoteIndex) {
+      RemoteIndex_update(remoteIndex, (const char *) node->data, files, g_get_real_time());
+    }
+    clear_Filelist(files);
+  }
+  free_PrefetchJob_t(job);
+  g_atomic_int_set(&prefetch_running, 0);
+  pthread_exit(NULL);
+}
+
+void *init_lister(void *ptr) {
+  ListerJob_t *job = (ListerJob_t *) ptr;
+  if (job->remote) {
+    session_lock(session);
+    // Remote changes are made under the lock, their invalidations come later
+    job->invalidations = ListingCache_invalidations(remoteCache);
+    uint64_t mtime;
+    if (job->watch) {
+      if (sftp_session_dir_mtime(session, job->pwd, &mtime) == 0) {
+        job->unchanged = (job->mtime != 0) && (mtime == job->mtime);
+        job->mtime = mtime;
+      } else job->mtime = 0;
+    } else if (job->validate && (sftp_session_dir_mtime(session, job->pwd, &mtime) == 0)) {
+      job->unchanged = ListingCache_revalidate(remoteCache, job->pwd, mtime);
+    }
+    if (!job->unchanged) job->files = sftp_session_ls_dir(session, NULL, job->pwd);
+    session_unlock(session);
+  } else {
+    job->files = ls_dir_names(NULL, job->pwd);
+    if (sort_needs_metadata(job->sort)) {
+      for (GSList *node = job->files; node; node = node->next) fs_fill_File((File_t *) node->data, job->pwd);
+    }
+  }
+  if (job->files) {
+    // Collation keys are computed here once per listing, cached copies keep them
+    job->files = sort_Filelist(job->files, job->sort, job->descending, job->remote);
+    job->sorted = true;
+    // A listing taken before an invalidation of its folder is not kept
+    if (job->remote && ListingCache_store_since(remoteCache, job->pwd, job->files, job->invalidations)) {
+      if (remoteIndex) RemoteIndex_update(remoteIndex, job->pwd, job->files, g_get_real_time());
+    }
+  }
+  g_async_queue_push(listQueue, job);
+  pthread_exit(NULL);
+}
+
+/* Thumbnails */
+
+void schedule_thumbnails() {
+  if (!thumbnailer) return;
+  if (thumb_source) g_source_remove(thumb_source);
+  thumb_source = g_timeout_add(THUMB_DELAY, (GSourceFunc) start_thumbnails, NULL);
+}
+
+/**
+  *   @brief Request thumbnails for the images in view of a pane
+  *   @param fileStore FileStore of the pane, only IconViews show thumbnails
+  *   @param viewPort GtkViewport scrolling the IconView of the pane
+  *   @param pwd Folder displayed in the pane
+  */
+static void request_thumbnails(FileStore *fileStore, GtkWidget *viewPort, const char *pwd) {
+  if (!fileStore || !pwd || !GTK_IS_ICON_VIEW(fileStore->fileView)) return;
+  if (fileStore->remote && !session) return;
+  GtkTreeModel *model = fileStore->filter;
+  const gint count = gtk_tree_model_iter_n_children(model, NULL);
+  GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment((GtkScrollable *) viewPort);
+  const gdouble upper = gtk_adjustment_get_upper(adjustment);
+  if (count == 0 || upper <= 0) return;
+  // The IconView gets its whole height from the viewport, so it cannot tell
+  // which items are in view: estimate them from the scroll position instead
+  const gdouble value = gtk_adjustment_get_value(adjustment);
+  const gdouble page = gtk_adjustment_get_page_size(adjustment);
+  gint first = (gint) (count * value / upper);
+  gint last = (gint) (count * (value + page) / upper) + 1;
+  const gint margin = (last - first) / 4 + 1;
+  first = first > margin ? first - margin : 0;
+  last = last + margin < count ? last + margin : count;
+  if (last - first > THUMB_MAX_VISIBLE) last = first + THUMB_MAX_VISIBLE;
+  GtkTreeIter it;
+  gboolean valid = gtk_tree_model_iter_nth_child(model, &it, NULL, first);
+  for (gint i = first; valid && i < last; i++, valid = gtk_tree_model_iter_next(model, &it)) {
+    FileRow *row;
+    gtk_tree_model_get(model, &it, ROW_COLUMN, &row, -1);
+    if (!row || row->thumbnail || row->thumb_failed || row->thumb_requested == thumb_generation) continue;
+    if (!row->content_type) row->content_type = get_content_type(row->file->name, row->file->type, fileStore->remote);
+    if (!g_str_has_prefix(row->content_type, "image/")) continue;
+    ThumbJob *job = calloc(1, sizeof(ThumbJob));
+    if (!job) return;
+    job->path = construct_filepath(pwd, row->file->name);
+    job->name = malloc(strlen(row->file->name) + 1);
+    if (!job->path || !job->name) {
+      free_ThumbJob(job);
+      return;
+    }
+    strcpy(job->name, row->file->name);
+    job->remote = fileStore->remote;
+    job->size = row->file->size;
+    job->mtime = row->file->mtime;
+    job->icon_size = ICON_SIZE;
+    job->generation = thumb_generation;
+    job->store_generation = fileStore->generation;
+    row->thumb_requested = thumb_generation;
+    Thumbnailer_request(thumbnailer, job);
+    pending_thumbs++;
+  }
+}
+
+gboolean start_thumbnails(__attribute__((unused)) gpointer user_data) {
+  thumb_source = 0;
+  thumb_generation = Thumbnailer_cancel(thumbnailer);
+  request_thumbnails(localFileStore, mainWindow->LeftScrollWindowViewPort, local_pwd);
+  request_thumbnails(remoteFileStore, mainWindow->RightScrollWindowViewPort, remote_pwd);
+  if (pending_thumbs > 0 && !thumb_source_id) {
+    thumb_source_id = g_timeout_add(THUMB_INTERVAL, (GSourceFunc) check_thumbQueue, NULL);
+  }
+  return FALSE;
+}
+
+gboolean check_thumbQueue(__attribute__((unused)) gpointer user_data) {
+  ThumbJob *job;
+  while ((job = (ThumbJob *) g_async_queue_try_pop(thumbnailer->results))) {
+    pending_thumbs--;
+    FileStore *fileStore = job->remote ? remoteFileStore : localFileStore;
+    FileRow *row = NULL;
+    // The listing may have been replaced since the request
+    if (fileStore && fileStore->generation == job->store_generation) {
+      row = (FileRow *) g_hash_table_lookup(fileStore->index, job->name);
+    }
+    if (row && row->thumb_requested == job->generation) {
+      if (job->thumbnail) {
+        if (row->thumbnail) g_object_unref(row->thumbnail);
+        row->thumbnail = job->thumbnail; // Owned by row
+        job->thumbnail = NULL;
+        if (row->shown) gtk_list_store_set(fileStore->listStore, &(row->it), PIXBUF_COLUMN, row->thumbnail, -1);
+      } else if (job->generation == thumb_generation) {
+        row->thumb_failed = true; // Not dropped, the image could not be thumbnailed
+      }
+    }
+    free_ThumbJob(job);
+  }
+  if (pending_thumbs == 0) {
+    thumb_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Filtering */
+
+void filter_FileStore(FileStore *fileStore, const char *text) {
+  fileStore->filter_generation++;
+  if (fileStore->names) g_atomic_int_set(&fileStore->names->generation, (gint) fileStore->filter_generation);
+  if (!text || !text[0]) {
+    // Displaying everything needs no matching
+    if (fileStore->filter_pattern) {
+      free(fileStore->filter_pattern);
+      fileStore->filter_pattern = NULL;
+      fileStore->filter_applied = fileStore->filter_generation;
+      gtk_tree_model_filter_refilter((GtkTreeModelFilter *) fileStore->filter);
+    }
+    return;
+  }
+  FilterJob_t *job = calloc(1, sizeof(FilterJob_t));
+  if (!job) return;
+  if (fileStore->names && g_hash_table_size(fileStore->added) > FILTER_MAX_ADDED) drop_FileStore_names(fileStore);
+  if (!fileStore->names) {
+    // Snapshot once per listing, later requests only match
+    fileStore->names = new_NameTable(fileStore->files);
+    if (!fileStore->names) goto error;
+    fileStore->names->generation = (gint) fileStore->filter_generation;
+  }
+  job->table = NameTable_ref(fileStore->names);
+  job->pattern = fold_pattern(text);
+  job->generation = (gint) fileStore->filter_generation;
+  job->remote = fileStore->remote;
+  job->matches = g_array_new(FALSE, FALSE, sizeof(unsigned));
+  if (!job->pattern) goto error;
+  pthread_t filter;
+  if (pthread_create(&filter, &list_tattr, init_filter, (void *) job) != 0) goto error;
+  g_atomic_int_inc(&pending_filters);
+  if (!filter_source_id) {
+    filter_source_id = g_timeout_add(LIST_QUEUE_INTERVAL, (GSourceFunc) check_filterQueue, filterQueue);
+  }
+  return;
+
+  error:
+    free_FilterJob_t(job);
+}
+
+void *init_filter(void *ptr) {
+  FilterJob_t *job = (FilterJob_t *) ptr;
+  int count = NameTable_match(job->table, job->pattern, false, job->generation, job->matches);
+  if (count == 0) {
+    job->fuzzy = true;
+    count = NameTable_match(job->table, job->pattern, true, job->generation, job->matches);
+  }
+  job->cancelled = count < 0;
+  g_async_queue_push(filterQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_filterQueue(gpointer user_data) {
+  FilterJob_t *job;
+  while ((job = (FilterJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_filters);
+    FileStore *fileStore = job->remote ? remoteFileStore : localFileStore;
+    if (job->cancelled || job->generation != (gint) fileStore->filter_generation) {
+      free_FilterJob_t(job);
+      continue;
+    }
+    if (job->table != fileStore->names) {
+      // Listed again while matching, additions and renames keep the snapshot
+      filter_FileStore(fileStore, job->pattern);
+      free_FilterJob_t(job);
+      continue;
+    }
+    // Names of removed or renamed entries are no longer in the index
+    for (guint i = 0; i < job->matches->len; i++) {
+      const char *name = NameTable_name(job->table, g_array_index(job->matches, unsigned, i));
+      FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, name);
+      if (row) row->matched = (unsigned) job->generation;
+    }
+    // Entries added after the snapshot, also while matching
+    GHashTableIter it;
+    gpointer name;
+    g_hash_table_iter_init(&it, fileStore->added);
+    while (g_hash_table_iter_next(&it, &name, NULL)) {
+      FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, name);
+      if (row && name_matches((const char *) name, job->pattern, job->fuzzy)) row->matched = (unsigned) job->generation;
+    }
+    if (fileStore->filter_pattern) free(fileStore->filter_pattern);
+    fileStore->filter_pattern = job->pattern;
+    job->pattern = NULL;
+    fileStore->filter_fuzzy = job->fuzzy;
+    fileStore->filter_applied = (unsigned) job->generation;
+    gtk_tree_model_filter_refilter((GtkTreeModelFilter *) fileStore->filter);
+    free_FilterJob_t(job);
+  }
+  if (g_atomic_int_get(&pending_filters) == 0) {
+    filter_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void FilterEntry_OnChanged(GtkSearchEntry *entry, __attribute__((unused)) gpointer ptr) {
+  FileStore *fileStore = (GtkWidget *) entry == mainWindow->LeftFilterEntry ? localFileStore : remoteFileStore;
+  if (fileStore) filter_FileStore(fileStore, gtk_entry_get_text((GtkEntry *) entry));
+}
+
+void FilterEntry_OnStop(GtkSearchEntry *entry, __attribute__((unused)) gpointer ptr) {
+  gtk_entry_set_text((GtkEntry *) entry, "");
+  gtk_widget_grab_focus((GtkWidget *) entry == mainWindow->LeftFilterEntry ? mainWindow->LeftFileView : mainWindow->RightFileView);
+}
+
+/* Local directory watching */
+
+void init_LocalWatch() {
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) return;
+  watch_changes = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  GIOChannel *channel = g_io_channel_unix_new(inotify_fd);
+  g_io_add_watch(channel, G_IO_IN, LocalWatch_OnEvent, NULL);
+  g_io_channel_unref(channel); // The watch holds a reference
+}
+
+void watch_local_dir(const char *dir_name) {
+  if (inotify_fd < 0) return;
+  // Changes of the previous directory are covered by the new listing
+  g_hash_table_remove_all(watch_changes);
+  watch_relist = false;
+  int wd = inotify_add_watch(inotify_fd, dir_name, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                                   IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF |
+                                                   IN_MOVE_SELF | IN_ONLYDIR);
+  // Watching the same directory again returns the same descriptor
+  if (watch_wd >= 0 && watch_wd != wd) inotify_rm_watch(inotify_fd, watch_wd);
+  watch_wd = wd;
+}
+
+gboolean LocalWatch_OnEvent(GIOChannel *source,
+                            __attribute__((unused)) GIOCondition condition,
+                            __attribute__((unused)) gpointer data)
+{
+  char buff[WATCH_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(g_io_channel_unix_get_fd(source), buff, sizeof(buff))) > 0) {
+    const struct inotify_event *event;
+    for (char *ptr = buff; ptr < buff + len; ptr += sizeof(struct inotify_event) + event->len) {
+      event = (const struct inotify_event *) ptr;
+      if (event->mask & IN_Q_OVERFLOW) {
+        watch_relist = true;
+      } else if (event->wd != watch_wd) {
+        continue; // Previously watched directory
+      } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        watch_relist = true;
+      } else if (event->len > 0) {
+        enum WatchChange change = WATCH_CHANGED;
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) change = WATCH_CREATED;
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) change = WATCH_DELETED;
+        // The latest event wins, but a new entry stays new when it is modified
+        gpointer old = g_hash_table_lookup(watch_changes, event->name);
+        if (change == WATCH_CHANGED && GPOINTER_TO_INT(old) == WATCH_CREATED) continue;
+        char *name = malloc(strlen(event->name) + 1);
+        if (!name) continue;
+        strcpy(name, event->name);
+        g_hash_table_replace(watch_changes, name, GINT_TO_POINTER(change));
+      }
+    }
+  }
+  if (!watch_source && (watch_relist || g_hash_table_size(watch_changes) > 0)) {
+    watch_source = g_timeout_add(WATCH_DEBOUNCE, (GSourceFunc) apply_LocalWatch_changes, NULL);
+  }
+  return TRUE;
+}
+
+gboolean apply_LocalWatch_changes(__attribute__((unused)) gpointer data) {
+  // Changes are applied on top of the listing of the watched directory
+  if (!localFileStore || localFileStore->loading) return TRUE;
+  watch_source = 0;
+  if (watch_relist) {
+    show_FileStore(local_pwd, false);
+    return FALSE;
+  }
+  complete_FileStore_fill(localFileStore);
+  // Modified files change the folder sizes too
+  SizeCache_invalidate(localSizes, local_pwd);
+  // Large bursts are applied with the model detached, like update_FileStore does
+  const bool detach = g_hash_table_size(watch_changes) > FILESTORE_FIRST_BATCH;
+  GtkTreeModel *model = localFileStore->filter;
+  if (detach) {
+    g_object_ref(model);
+    FileView_set_model(localFileStore->fileView, NULL);
+  }
+  GHashTable *removed = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, watch_changes);
+  while (g_hash_table_iter_next(&it, &key, &value)) {
+    const char *name = (const char *) key;
+    FileRow *row = (FileRow *) g_hash_table_lookup(localFileStore->index, name);
+    if (GPOINTER_TO_INT(value) == WATCH_DELETED) {
+      g_hash_table_add(removed, key);
+    } else if (row) {
+      // Metadata is outdated, the type may have changed if the entry was replaced
+      row->file->has_metadata = false;
+      File_t *file = fs_new_File(local_pwd, name);
+      if (file && file->type != row->file->type) {
+        row->file->type = file->type;
+        FileStore_update_row(localFileStore, row);
+      }
+      free_File(file);
+    } else if (GPOINTER_TO_INT(value) == WATCH_CREATED) {
+      File_t *file = fs_new_File(local_pwd, name);
+      if (file) FileStore_add_File(localFileStore, file);
+    }
+  }
+  FileStore_remove_Files(localFileStore, removed);
+  g_hash_table_destroy(removed);
+  g_hash_table_remove_all(watch_changes);
+  if (detach) {
+    FileView_set_model(localFileStore->fileView, model);
+    g_object_unref(model);
+  }
+  return FALSE;
+}
+
+/* Folder sizes */
+
+/**
+  *   @brief Show folder totals in filePropertiesDialog
+  *   @param size Totals
+  *   @param finished Whether the computation has finished
+  */
+static void show_FolderSize(const DirSize *size, const bool finished) {
+  gchar *bytes = g_format_size(size->size);
+  gchar *text = g_strdup_printf("%s (%" G_GUINT64_FORMAT " files, %" G_GUINT64_FORMAT " folders)%s%s", bytes,
+                                size->files, size->folders,
+                                size->unreadable ? ", some folders could not be read" : "",
+                                finished ? "" : "…");
+  gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesFileSize), text);
+  g_free(text);
+  g_free(bytes);
+}
+
+void start_FolderSize(const char *path, const bool remote) {
+  cancel_FolderSize();
+  DirSize size;
+  SizeCache *sizes = remote ? remoteSizes : localSizes;
+  if (sizes && SizeCache_lookup(sizes, path, &size)) {
+    show_FolderSize(&size, true);
+    return;
+  }
+  FolderSizeJob_t *job = calloc(1, sizeof(FolderSizeJob_t));
+  if (!job) return;
+  DirSizeProgress_init(&(job->progress));
+  job->remote = remote;
+  job->path = malloc(strlen(path) + 1);
+  if (!job->path) {
+    free_FolderSizeJob_t(job);
+    return;
+  }
+  strcpy(job->path, path);
+  pthread_t sizer;
+  if (pthread_create(&sizer, &list_tattr, init_folder_sizer, (void *) job) != 0) {
+    free_FolderSizeJob_t(job);
+    return;
+  }
+  g_atomic_int_inc(&pending_folder_sizes);
+  folder_size_job = job;
+  memset(&size, 0, sizeof(DirSize));
+  show_FolderSize(&size, false);
+  if (!folder_size_source_id) {
+    folder_size_source_id = g_timeout_add(FOLDER_SIZE_INTERVAL, (GSourceFunc) check_folderSizeQueue, folderSizeQueue);
+  }
+}
+
+void cancel_FolderSize() {
+  if (folder_size_job) {
+    // The job is freed when its thread delivers it
+    g_atomic_int_set(&(folder_size_job->progress.cancel), 1);
+    folder_size_job = NULL;
+  }
+}
+
+void *init_folder_sizer(void *ptr) {
+  FolderSizeJob_t *job = (FolderSizeJob_t *) ptr;
+  if (job->remote) job->status = sftp_session_dir_size(session, job->path, &(job->progress));
+  else job->status = fs_dir_size(job->path, &(job->progress), DIR_SIZE_THREADS);
+  g_async_queue_push(folderSizeQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_folderSizeQueue(gpointer user_data) {
+  FolderSizeJob_t *job;
+  while ((job = (FolderSizeJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_folder_sizes);
+    if (job->status == 0) {
+      DirSize size = DirSizeProgress_get(&(job->progress));
+      SizeCache *sizes = job->remote ? remoteSizes : localSizes;
+      if (sizes) SizeCache_store(sizes, job->path, &size);
+      if (job == folder_size_job) {
+        show_FolderSize(&size, true);
+        folder_size_job = NULL;
+      }
+    }
+    free_FolderSizeJob_t(job);
+  }
+  if (folder_size_job) {
+    DirSize size = DirSizeProgress_get(&(folder_size_job->progress));
+    show_FolderSize(&size, false);
+  }
+  if (g_atomic_int_get(&pending_folder_sizes) == 0) {
+    folder_size_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Searching */
+
+/**
+  *   @brief Cell data function of the search results size column
+  */
+static void SearchResults_size_data(__attribute__((unused)) GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                    GtkTreeModel *model, GtkTreeIter *it, __attribute__((unused)) gpointer ptr) {
+  guint64 size;
+  guint type;
+  gtk_tree_model_get(model, it, SEARCH_SIZE_COLUMN, &size, SEARCH_TYPE_COLUMN, &type, -1);
+  if (!is_folder(type, searchWindow->remote)) {
+    gchar *text = g_format_size(size);
+    g_object_set(renderer, "text", text, NULL);
+    g_free(text);
+  } else g_object_set(renderer, "text", "", NULL);
+}
+
+/**
+  *   @brief Cell data function of the search results modified column
+  */
+static void SearchResults_mtime_data(__attribute__((unused)) GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                     GtkTreeModel *model, GtkTreeIter *it, __attribute__((unused)) gpointer ptr) {
+  guint64 mtime_value;
+  char mtime[32] = "";
+  gtk_tree_model_get(model, it, SEARCH_MTIME_COLUMN, &mtime_value, -1);
+  struct tm lt;
+  const time_t t = (time_t) mtime_value;
+  if (localtime_r(&t, &lt)) strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M", &lt);
+  g_object_set(renderer, "text", mtime, NULL);
+}
+
+/**
+  *   @brief Append matches to searchWindow results
+  *   @param matches GSList of File_t whose names are full paths, or of GrepMatch, freed
+  *   @param contents Whether matches are GrepMatch
+  */
+static void add_SearchResults(GSList *matches, const bool contents) {
+  for (GSList *node = matches; node; node = node->next) {
+    if (contents) {
+      const GrepMatch *match = (const GrepMatch *) node->data;
+      gtk_list_store_insert_with_values(searchWindow->results, NULL, -1,
+                                        SEARCH_PATH_COLUMN, match->path,
+                                        SEARCH_TYPE_COLUMN, (guint) SSH_FILEXFER_TYPE_REGULAR,
+                                        SEARCH_LINE_COLUMN, (guint) match->line,
+                                        SEARCH_TEXT_COLUMN, match->text, -1);
+    } else {
+      const File_t *file = (const File_t *) node->data;
+      gtk_list_store_insert_with_values(searchWindow->results, NULL, -1,
+                                        SEARCH_PATH_COLUMN, file->name,
+                                        SEARCH_SIZE_COLUMN, (guint64) file->size,
+                                        SEARCH_MTIME_COLUMN, (guint64) file->mtime,
+                                        SEARCH_TYPE_COLUMN, (guint) file->type, -1);
+    }
+  }
+  g_slist_free_full(matches, contents ? free_GrepMatch : free_File);
+}
+
+/**
+  *   @brief Show the columns of content or name matches in searchWindow results
+  *   @param contents Whether content matches are shown
+  */
+static void show_SearchColumns(const bool contents) {
+  gtk_tree_view_column_set_visible(searchWindow->SizeColumn, !contents);
+  gtk_tree_view_column_set_visible(searchWindow->MtimeColumn, !contents);
+  gtk_tree_view_column_set_visible(searchWindow->LineColumn, contents);
+  gtk_tree_view_column_set_visible(searchWindow->TextColumn, contents);
+}
+
+/**
+  *   @brief Show the progress of a search in searchWindow
+  *   @param job Search shown
+  *   @param state Appended to the number of matches
+  */
+static void show_SearchStatus(SearchJob_t *job, const char *state) {
+  pthread_mutex_lock(&(job->progress.lock));
+  const unsigned count = job->progress.count;
+  const bool truncated = job->progress.truncated;
+  pthread_mutex_unlock(&(job->progress.lock));
+  gchar *text = g_strdup_printf("%u matches%s%s", count, truncated ? ", stopped at the limit" : "", state);
+  gtk_label_set_text(GTK_LABEL(searchWindow->SearchStatus), text);
+  g_free(text);
+}
+
+/**
+  *   @brief Show the index buttons of searchWindow
+  */
+static void show_IndexButtons() {
+  const bool remote = searchWindow->remote;
+  gtk_widget_set_sensitive(searchWindow->SearchIndexButton, remote && session && remoteIndexFile);
+  gtk_button_set_label(GTK_BUTTON(searchWindow->SearchIndexButton), index_job ? "Stop indexing" : "Update index");
+  gtk_widget_set_sensitive(searchWindow->SearchUseIndex, remote && remoteIndex);
+  gtk_widget_set_sensitive(searchWindow->SearchContents, remote);
+}
+
+/**
+  *   @brief Show the freshness of the index computed by an indexer thread
+  *   @param job Finished INDEX_FRESHNESS job
+  */
+static void show_IndexFreshness(const IndexJob_t *job) {
+  const IndexFreshness *freshness = &(job->freshness);
+  if (!job->found) {
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchIndexStatus), "Folder not indexed");
+    return;
+  }
+  char oldest[32] = "never";
+  struct tm lt;
+  const time_t t = (time_t) (freshness->oldest / G_USEC_PER_SEC);
+  if (freshness->oldest && localtime_r(&t, &lt)) strftime(oldest, sizeof(oldest), "%Y-%m-%d %H:%M", &lt);
+  gchar *unlisted = freshness->unlisted ? g_strdup_printf(", %u never listed", freshness->unlisted) : g_strdup("");
+  gchar *text = g_strdup_printf("Index: %u folders, oldest listing %s%s", freshness->folders, oldest, unlisted);
+  gtk_label_set_text(GTK_LABEL(searchWindow->SearchIndexStatus), text);
+  g_free(unlisted);
+  g_free(text);
+}
+
+/**
+  *   @brief Start an indexer thread computing the freshness of the index of the folder of searchWindow
+  *   @return true if the thread was started
+  */
+static bool start_IndexFreshness() {
+  // A check still running is ignored when it finishes
+  freshness_job = NULL;
+  IndexJob_t *job = calloc(1, sizeof(IndexJob_t));
+  if (!job) return false;
+  job->action = INDEX_FRESHNESS;
+  job->root = malloc(strlen(searchWindow->root) + 1);
+  if (!job->root) {
+    free_IndexJob_t(job);
+    return false;
+  }
+  strcpy(job->root, searchWindow->root);
+  pthread_t indexer;
+  if (pthread_create(&indexer, &list_tattr, init_indexer, (void *) job) != 0) {
+    free_IndexJob_t(job);
+    return false;
+  }
+  g_atomic_int_inc(&pending_indexers);
+  freshness_job = job;
+  if (!index_source_id) {
+    index_source_id = g_timeout_add(SEARCH_INTERVAL, (GSourceFunc) check_indexQueue, indexQueue);
+  }
+  return true;
+}
+
+/**
+  *   @brief Show how up to date the index of the folder of searchWindow is
+  *   @details The subtree is visited by an indexer thread, the status is
+  *   shown when it finishes
+  */
+static void show_IndexStatus() {
+  show_IndexButtons();
+  gchar *text;
+  if (!searchWindow->remote) text = g_strdup("");
+  else if (index_job) text = g_strdup_printf("Indexing… %d folders", g_atomic_int_get(&(index_job->folders)));
+  else if (remoteIndex && searchWindow->root && start_IndexFreshness()) text = g_strdup("Checking the index…");
+  else text = g_strdup("Folder not indexed");
+  gtk_label_set_text(GTK_LABEL(searchWindow->SearchIndexStatus), text);
+  g_free(text);
+}
+
+void start_Search() {
+  cancel_Search();
+  gtk_list_store_clear(searchWindow->results);
+  if (!searchWindow->root) return;
+  SearchJob_t *job = calloc(1, sizeof(SearchJob_t));
+  if (!job) return;
+  SearchProgress_init(&(job->progress));
+  job->remote = searchWindow->remote;
+  // The index has no file contents
+  job->contents = job->remote && gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(searchWindow->SearchContents));
+  job->indexed = job->remote && !job->contents && remoteIndex &&
+                 gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(searchWindow->SearchUseIndex));
+  job->root = malloc(strlen(searchWindow->root) + 1);
+  if (!job->root) {
+    free_SearchJob_t(job);
+    return;
+  }
+  strcpy(job->root, searchWindow->root);
+  const char *text = gtk_entry_get_text(GTK_ENTRY(searchWindow->SearchEntry));
+  job->query.regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(searchWindow->SearchRegex));
+  if (job->contents && text[0] == '\0') {
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchStatus), "Enter the text to search for");
+    free_SearchJob_t(job);
+    return;
+  }
+  // Content patterns are matched as such, only names are globbed
+  if (!job->query.regex && !job->contents) job->query.pattern = search_glob(text);
+  else if (text[0] != '\0' && (job->query.pattern = malloc(strlen(text) + 1))) strcpy(job->query.pattern, text);
+  job->query.ignore_case = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(searchWindow->SearchIgnoreCase));
+  regex_t regex;
+  if (SearchQuery_compile(&(job->query), &regex) != 0) {
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchStatus), "Invalid regular expression");
+    free_SearchJob_t(job);
+    return;
+  }
+  if (job->query.regex && job->query.pattern) regfree(&regex);
+  job->query.min_size = (uint64_t) gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(searchWindow->SearchMinSize)) * 1024;
+  job->query.max_size = (uint64_t) gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(searchWindow->SearchMaxSize)) * 1024;
+  job->query.max_age = (unsigned) gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(searchWindow->SearchMaxAge));
+  pthread_t searcher;
+  if (pthread_create(&searcher, &list_tattr, init_searcher, (void *) job) != 0) {
+    free_SearchJob_t(job);
+    return;
+  }
+  g_atomic_int_inc(&pending_searches);
+  search_job = job;
+  show_SearchColumns(job->contents);
+  show_SearchStatus(job, "…");
+  gtk_widget_set_sensitive(searchWindow->SearchStopButton, TRUE);
+  if (!search_source_id) {
+    search_source_id = g_timeout_add(SEARCH_INTERVAL, (GSourceFunc) check_searchQueue, searchQueue);
+  }
+}
+
+void cancel_Search() {
+  if (search_job) {
+    // The job is freed when its thread delivers it
+    add_SearchResults(SearchProgress_take(&(search_job->progress)), search_job->contents);
+    show_SearchStatus(search_job, ", stopped");
+    g_atomic_int_set(&(search_job->progress.cancel), 1);
+    search_job = NULL;
+  }
+  gtk_widget_set_sensitive(searchWindow->SearchStopButton, FALSE);
+}
+
+void *init_searcher(void *ptr) {
+  SearchJob_t *job = (SearchJob_t *) ptr;
+  if (job->indexed) job->status = RemoteIndex_find(remoteIndex, job->root, &(job->query), &(job->progress));
+  else if (job->contents) job->status = sftp_session_grep(session, job->root, &(job->query), &(job->progress));
+  else if (job->remote) job->status = sftp_session_find(session, job->root, &(job->query), &(job->progress));
+  else job->status = fs_find(job->root, &(job->query), &(job->progress), g_get_num_processors());
+  g_async_queue_push(searchQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_searchQueue(gpointer user_data) {
+  SearchJob_t *job;
+  while ((job = (SearchJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_searches);
+    if (job == search_job) {
+      add_SearchResults(SearchProgress_take(&(job->progress)), job->contents);
+      show_SearchStatus(job, job->status == 0 ? "" : job->status == SEARCH_UNSUPPORTED ?
+                             ", grep is not available on the server" : ", search failed");
+      search_job = NULL;
+      gtk_widget_set_sensitive(searchWindow->SearchStopButton, FALSE);
+    }
+    free_SearchJob_t(job);
+  }
+  if (search_job) {
+    add_SearchResults(SearchProgress_take(&(search_job->progress)), search_job->contents);
+    show_SearchStatus(search_job, g_atomic_int_get(&(search_job->progress.fallback)) ?
+                                  ", find not available, listing folders…" : "…");
+  }
+  if (g_atomic_int_get(&pending_searches) == 0) {
+    search_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void SearchResults_activated(GtkTreeView *view, GtkTreePath *path, __attribute__((unused)) GtkTreeViewColumn *column,
+                             __attribute__((unused)) gpointer ptr) {
+  GtkTreeModel *model = gtk_tree_view_get_model(view);
+  GtkTreeIter it;
+  gchar *file_path;
+  guint type;
+  if (!gtk_tree_model_get_iter(model, &it, path)) return;
+  gtk_tree_model_get(model, &it, SEARCH_PATH_COLUMN, &file_path, SEARCH_TYPE_COLUMN, &type, -1);
+  gchar *folder = is_folder(type, searchWindow->remote) ? g_strdup(file_path) : g_path_get_dirname(file_path);
+  if (searchWindow->remote && (!worker_running || !working_on_remote)) {
+    remote_pwd = change_pwd(remote_pwd, folder);
+    update_FileView(true);
+  } else if (!searchWindow->remote) {
+    local_pwd = change_pwd(local_pwd, folder);
+    update_FileView(false);
+  }
+  g_free(folder);
+  g_free(file_path);
+}
+
+void start_Indexer() {
+  if (index_job || !session || !remoteIndexFile || !searchWindow->remote || !searchWindow->root) return;
+  if (!remoteIndex && !(remoteIndex = new_RemoteIndex(remoteIndexFile))) return;
+  IndexJob_t *job = calloc(1, sizeof(IndexJob_t));
+  if (!job) return;
+  job->root = malloc(strlen(searchWindow->root) + 1);
+  if (!job->root) {
+    free_IndexJob_t(job);
+    return;
+  }
+  strcpy(job->root, searchWindow->root);
+  pthread_t indexer;
+  if (pthread_create(&indexer, &list_tattr, init_indexer, (void *) job) != 0) {
+    free_IndexJob_t(job);
+    return;
+  }
+  g_atomic_int_inc(&pending_indexers);
+  index_job = job;
+  show_IndexStatus();
+  if (!index_source_id) {
+    index_source_id = g_timeout_add(SEARCH_INTERVAL, (GSourceFunc) check_indexQueue, indexQueue);
+  }
+}
+
+void cancel_Indexer() {
+  if (index_job) {
+    // The job is freed when its thread delivers it
+    g_atomic_int_set(&(index_job->cancel), 1);
+    index_job = NULL;
+  }
+}
+
+void *init_indexer(void *ptr) {
+  IndexJob_t *job = (IndexJob_t *) ptr;
+  if (job->action == INDEX_FRESHNESS) job->found = RemoteIndex_freshness(remoteIndex, job->root, &(job->freshness));
+  else job->status = sftp_session_index(session, remoteIndex, job->root, &(job->cancel), &(job->folders));
+  g_async_queue_push(indexQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_indexQueue(gpointer user_data) {
+  IndexJob_t *job;
+  bool failed = false;
+  bool finished = false;
+  while ((job = (IndexJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_indexers);
+    if (job == index_job) {
+      failed = job->status != 0;
+      finished = true;
+      index_job = NULL;
+    } else if (job == freshness_job) {
+      if (!index_job) show_IndexFreshness(job);
+      freshness_job = NULL;
+    }
+    free_IndexJob_t(job);
+  }
+  if (failed) {
+    show_IndexButtons();
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchIndexStatus), "Indexing failed, the folders listed were kept");
+  } else if (index_job || finished) show_IndexStatus();
+  if (g_atomic_int_get(&pending_indexers) == 0) {
+    index_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/* Viewing */
+
+/**
+  *   @brief Show the position in viewerWindow->file and the bytes transferred
+  *   @param state Appended to the status, e.g. ", following"
+  */
+static void show_ViewerStatus(const char *state) {
+  PagedFile *file = viewerWindow->file;
+  if (!file) {
+    gtk_label_set_text(GTK_LABEL(viewerWindow->ViewerStatus), state);
+    return;
+  }
+  gchar *start = g_format_size(viewerWindow->start);
+  gchar *end = g_format_size(viewerWindow->end);
+  gchar *size = g_format_size(file->size);
+  gchar *transferred = g_format_size(file->transferred);
+  gchar *text = g_strdup_printf("%s – %s of %s, %s read%s", start, end, size, transferred, state);
+  gtk_label_set_text(GTK_LABEL(viewerWindow->ViewerStatus), text);
+  g_free(start);
+  g_free(end);
+  g_free(size);
+  g_free(transferred);
+  g_free(text);
+}
+
+/**
+  *   @brief Show read lines in viewerWindow
+  *   @param text Lines, may contain invalid UTF-8 and NUL bytes
+  *   @param append Whether to append to the page instead of replacing it
+  */
+static void show_ViewerText(GString *text, const bool append) {
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(viewerWindow->ViewerText));
+  for (gsize i = 0; i < text->len; i++) {
+    if (text->str[i] == '\0') text->str[i] = ' '; // Binary files are shown anyway
+  }
+  gchar *valid = g_utf8_make_valid(text->str, (gssize) text->len);
+  GtkTextIter it;
+  if (append) {
+    gtk_text_buffer_get_end_iter(buffer, &it);
+    gtk_text_buffer_insert(buffer, &it, valid, -1);
+  } else gtk_text_buffer_set_text(buffer, valid, -1);
+  g_free(valid);
+  // Follow the end like tail -f, other pages are shown from the top
+  if (append || gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(viewerWindow->ViewerFollow))) {
+    gtk_text_buffer_get_end_iter(buffer, &it);
+  } else gtk_text_buffer_get_start_iter(buffer, &it);
+  gtk_text_buffer_place_cursor(buffer, &it);
+  gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(viewerWindow->ViewerText), gtk_text_buffer_get_insert(buffer), 0.0, FALSE, 0.0, 0.0);
+}
+
+/**
+  *   @brief Start a viewer thread
+  *   @param job ViewerJob_t, freed on error
+  */
+static void start_ViewerJob(ViewerJob_t *job) {
+  pthread_t viewer;
+  if (!(job->text = g_string_new(NULL)) || pthread_create(&viewer, &list_tattr, init_viewer, (void *) job) != 0) {
+    free_ViewerJob_t(job);
+    return;
+  }
+  g_atomic_int_inc(&pending_viewers);
+  viewer_job = job;
+  // Following checks the file every second, the status is updated only when lines arrive
+  if (job->action == VIEWER_OPEN) show_ViewerStatus("Opening…");
+  else if (job->action != VIEWER_FOLLOW) show_ViewerStatus(", reading…");
+  if (!viewer_source_id) {
+    viewer_source_id = g_timeout_add(VIEWER_INTERVAL, (GSourceFunc) check_viewerQueue, viewerQueue);
+  }
+}
+
+void start_Viewer(const enum ViewerAction action, const uint64_t offset) {
+  if (viewer_job || !viewerWindow->file) return;
+  ViewerJob_t *job = calloc(1, sizeof(ViewerJob_t));
+  if (!job) return;
+  job->action = action;
+  job->file = viewerWindow->file;
+  job->remote = viewerWindow->remote;
+  job->offset = offset;
+  start_ViewerJob(job);
+}
+
+void close_Viewer() {
+  if (follow_source) {
+    g_source_remove(follow_source);
+    follow_source = 0;
+  }
+  // A file still being read is closed by check_viewerQueue
+  if (!viewer_job) free_PagedFile(viewerWindow->file);
+  viewerWindow->file = NULL;
+  viewer_job = NULL;
+}
+
+/**
+  *   @brief Read the page ending at an offset
+  *   @param job ViewerJob_t whose text is filled
+  *   @param end End of the page
+  *   @return 0 on success, -1 on error
+  */
+static int read_ViewerPage_before(ViewerJob_t *job, const uint64_t end) {
+  uint64_t start;
+  if (PagedFile_lines_before(job->file, end, VIEWER_PAGE_LINES, &start) != 0) return -1;
+  if (end - start > VIEWER_PAGE_BYTES) start = end - VIEWER_PAGE_BYTES;
+  job->start = start;
+  job->replace = true;
+  return PagedFile_lines(job->file, start, VIEWER_PAGE_LINES, end - start, job->text, &(job->end));
+}
+
+void *init_viewer(void *ptr) {
+  ViewerJob_t *job = (ViewerJob_t *) ptr;
+  uint64_t appended;
+  int refreshed;
+  switch (job->action) {
+    case VIEWER_OPEN:
+      job->file = job->remote ? open_remote_PagedFile(session, job->path) : open_local_PagedFile(job->path);
+      job->replace = true;
+      job->status = job->file ? PagedFile_lines(job->file, 0, VIEWER_PAGE_LINES, VIEWER_PAGE_BYTES, job->text, &(job->end)) : -1;
+      break;
+    case VIEWER_PAGE:
+      job->start = job->offset;
+      job->replace = true;
+      job->status = PagedFile_lines(job->file, job->offset, VIEWER_PAGE_LINES, VIEWER_PAGE_BYTES, job->text, &(job->end));
+      break;
+    case VIEWER_PREVIOUS:
+      job->status = read_ViewerPage_before(job, job->offset);
+      break;
+    case VIEWER_END:
+      job->status = PagedFile_refresh(job->file, &appended) >= 0 ? read_ViewerPage_before(job, job->file->size) : -1;
+      break;
+    case VIEWER_FOLLOW:
+      // Costs a few stats while nothing is appended
+      refreshed = PagedFile_refresh(job->file, &appended);
+      if (refreshed < 0) job->status = -1;
+      else if (refreshed > 0 || job->file->size < job->offset || job->file->size - job->offset > VIEWER_PAGE_BYTES) {
+        // Rewritten, or more appended than a page: show the last page instead
+        job->status = read_ViewerPage_before(job, job->file->size);
+      } else {
+        job->start = job->offset;
+        job->status = PagedFile_lines(job->file, job->offset, UINT_MAX, job->file->size - job->offset, job->text, &(job->end));
+      }
+      break;
+  }
+  g_async_queue_push(viewerQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_viewerQueue(gpointer user_data) {
+  ViewerJob_t *job;
+  while ((job = (ViewerJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_viewers);
+    if (job == viewer_job) {
+      viewer_job = NULL;
+      if (job->action == VIEWER_OPEN) viewerWindow->file = job->file;
+      if (job->status != 0) {
+        show_ViewerStatus(viewerWindow->file ? ", reading failed" : "Could not open the file");
+      } else {
+        if (job->replace) viewerWindow->start = job->start;
+        viewerWindow->end = job->end;
+        if (job->replace || job->text->len > 0) show_ViewerText(job->text, !job->replace);
+        show_ViewerStatus(gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(viewerWindow->ViewerFollow)) ? ", following" : "");
+      }
+    } else if (job->file && job->file != viewerWindow->file) {
+      // The file was closed while this thread read it
+      free_PagedFile(job->file);
+    }
+    free_ViewerJob_t(job);
+  }
+  if (g_atomic_int_get(&pending_viewers) == 0) {
+    viewer_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean follow_Viewer(__attribute__((unused)) gpointer user_data) {
+  if (!viewerWindow->file) {
+    follow_source = 0;
+    return FALSE;
+  }
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(viewerWindow->ViewerText));
+  // Appended lines would grow the page without bounds, the last page is read again instead (from the cache)
+  if (gtk_text_buffer_get_line_count(buffer) > 2 * VIEWER_PAGE_LINES) start_Viewer(VIEWER_END, 0);
+  else start_Viewer(VIEWER_FOLLOW, viewerWindow->end);
+  return TRUE;
+}
+
+void ViewerButton_action(GtkButton *button) {
+  GtkWidget *widget = (GtkWidget *) button;
+  if (widget != viewerWindow->ViewerEndButton) {
+    // Following shows the end of the file
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(viewerWindow->ViewerFollow), FALSE);
+  }
+  if (widget == viewerWindow->ViewerStartButton) start_Viewer(VIEWER_PAGE, 0);
+  else if (widget == viewerWindow->ViewerPreviousButton) start_Viewer(VIEWER_PREVIOUS, viewerWindow->start);
+  else if (widget == viewerWindow->ViewerNextButton) {
+    if (viewerWindow->file && viewerWindow->end < viewerWindow->file->size) start_Viewer(VIEWER_PAGE, viewerWindow->end);
+  } else if (widget == viewerWindow->ViewerEndButton) start_Viewer(VIEWER_END, 0);
+}
+
+void toggle_ViewerFollow(GtkToggleButton *button, __attribute__((unused)) gpointer ptr) {
+  if (gtk_toggle_button_get_active(button)) {
+    start_Viewer(VIEWER_END, 0);
+    if (!follow_source) follow_source = g_timeout_add(VIEWER_FOLLOW_INTERVAL, (GSourceFunc) follow_Viewer, NULL);
+  } else {
+    if (follow_source) g_source_remove(follow_source);
+    follow_source = 0;
+    if (!viewer_job) show_ViewerStatus("");
+  }
+}
+
+/* Editing */
+
+/**
+  *   @brief Start an editor thread
+  *   @param action What to transfer, @see EditAction
+  *   @param edit EditFile in editFiles, busy until the job is delivered
+  *   @return 0 on success, -1 on error
+  */
+static int start_EditJob(const enum EditAction action, EditFile *edit) {
+  pthread_t editor;
+  EditJob_t *job = calloc(1, sizeof(EditJob_t));
+  if (!job) return -1;
+  job->action = action;
+  job->edit = edit;
+  if (pthread_create(&editor, &list_tattr, init_editor, (void *) job) != 0) {
+    free(job);
+    return -1;
+  }
+  g_atomic_int_inc(&pending_editors);
+  edit->busy = true;
+  if (!edit_source_id) {
+    edit_source_id = g_timeout_add(EDIT_INTERVAL, (GSourceFunc) check_editQueue, editQueue);
+  }
+  return 0;
+}
+
+/**
+  *   @brief Ask whether to overwrite a remote file which changed while it was edited
+  *   @param edit EditFile in conflict
+  */
+static void ask_EditConflict(EditFile *edit) {
+  free(conflict_path);
+  conflict_path = malloc(strlen(edit->remote_path) + 1);
+  if (conflict_path) strcpy(conflict_path, edit->remote_path);
+  transition_MessageWindow(conflict_path ? ASK_EDIT_CONFLICT : MESSAGETYPE_ERROR, get_error(ERROR_EDIT_CONFLICT));
+}
+
+void overwrite_EditConflict() {
+  EditFile *edit = conflict_path ? (EditFile *) g_hash_table_lookup(editFiles, conflict_path) : NULL;
+  free(conflict_path);
+  conflict_path = NULL;
+  if (!edit || edit->busy || !edit->conflict || !session) return;
+  edit->conflict = false;
+  if (start_EditJob(EDIT_OVERWRITE, edit) != 0) {
+    edit->conflict = true;
+    transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_WRITING_TO_FILE));
+  }
+}
+
+void transition_Editor(const char *filename, const bool remote) {
+  if (remote && !session) return;
+  char *path = construct_filepath(remote ? remote_pwd : local_pwd, filename);
+  if (!path) return;
+  if (!remote) {
+    // Local files are edited in place
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR) && !launch_editor(path)) {
+      transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_LAUNCHING_EDITOR));
+    }
+    free(path);
+    return;
+  }
+  EditFile *edit = (EditFile *) g_hash_table_lookup(editFiles, path);
+  if (edit) {
+    free(path);
+    // Still being downloaded when nothing has been synced yet
+    if (edit->busy && edit->local_mtime == 0) return;
+    if (edit->conflict) ask_EditConflict(edit);
+    else if (!launch_editor(edit->local_path)) transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_LAUNCHING_EDITOR));
+    return;
+  }
+  gchar *host = g_strdup_printf("%s@%s", gtk_entry_get_text((GtkEntry*) connectWindow->SetUsernameEntry),
+                                gtk_entry_get_text((GtkEntry*) connectWindow->SetIPEntry));
+  char *local_path = edit_local_path(host, path);
+  g_free(host);
+  edit = local_path ? new_EditFile(path, local_path) : NULL;
+  free(local_path);
+  free(path);
+  if (!edit) return;
+  g_hash_table_insert(editFiles, edit->remote_path, edit);
+  if (start_EditJob(EDIT_OPEN, edit) != 0) g_hash_table_remove(editFiles, edit->remote_path);
+}
+
+void *init_editor(void *ptr) {
+  EditJob_t *job = (EditJob_t *) ptr;
+  if (job->action == EDIT_OPEN) job->status = sftp_session_edit_open(session, job->edit);
+  else if (job->action == EDIT_OVERWRITE) job->status = sftp_session_edit_overwrite(session, job->edit);
+  else job->status = sftp_session_edit_save(session, job->edit);
+  g_async_queue_push(editQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_editQueue(gpointer user_data) {
+  EditJob_t *job;
+  while ((job = (EditJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_editors);
+    EditFile *edit = job->edit;
+    edit->busy = false;
+    if (job->action == EDIT_OPEN) {
+      if (job->status != 0) {
+        EditFile_remove_copy(edit);
+        g_hash_table_remove(editFiles, edit->remote_path);
+        transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_OPENING_FILE));
+      } else if (!launch_editor(edit->local_path)) {
+        transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_LAUNCHING_EDITOR));
+      }
+      if (!edit_poll_source && g_hash_table_size(editFiles) > 0) {
+        edit_poll_source = g_timeout_add(EDIT_POLL_INTERVAL, (GSourceFunc) poll_EditFiles, NULL);
+      }
+    } else if (job->status == EDIT_CONFLICT) {
+      // Writing blocks over someone else's changes would corrupt the file
+      edit->conflict = true;
+      ask_EditConflict(edit);
+    } else if (job->status != 0) {
+      // Tried again at the next save
+      EditFile_seen(edit);
+      transition_MessageWindow(MESSAGETYPE_ERROR, get_error(ERROR_WRITING_TO_FILE));
+    } else invalidate_remote_path(edit->remote_path);
+    free(job);
+  }
+  if (g_atomic_int_get(&pending_editors) == 0) {
+    edit_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean poll_EditFiles(__attribute__((unused)) gpointer user_data) {
+  if (!session || g_hash_table_size(editFiles) == 0) {
+    edit_poll_source = 0;
+    return FALSE;
+  }
+  GHashTableIter it;
+  gpointer value;
+  g_hash_table_iter_init(&it, editFiles);
+  while (g_hash_table_iter_next(&it, NULL, &value)) {
+    EditFile *edit = (EditFile *) value;
+    // Only a stat of the local copy while it is not saved
+    if (!edit->busy && !edit->conflict && EditFile_modified(edit)) start_EditJob(EDIT_SAVE, edit);
+  }
+  return TRUE;
+}
+
+/* File views */
+
+/**
+  *   @brief Get the entry of a DetailsView row
+  *   @remark Local metadata is filled here, so only the displayed rows are stat'ed
+  *   @param model Model of the DetailsView
+  *   @param it Row in model
+  *   @param remote Whether the view displays remote files
+  *   @return Entry of the row, NULL if the row has no entry
+  */
+static const File_t *get_DetailsView_file(GtkTreeModel *model, GtkTreeIter *it, const bool remote) {
+  FileRow *row;
+  gtk_tree_model_get(model, it, ROW_COLUMN, &row, -1);
+  if (!row) return NULL;
+  if (!remote && !row->file->has_metadata) fs_fill_File(row->file, local_pwd);
+  return row->file;
+}
+
+/**
+  *   @brief Get the icon of an entry of a FileStore
+  *   @param row FileRow of the entry, caches the content type, may be NULL
+  *   @param file Entry
+  *   @param remote Whether the entry is on the remote
+  *   @param size Icon size in pixels
+  *   @return Thumbnail of the row for ICON_SIZE if there is one, otherwise shared icon, @see get_Icon_content_type
+  */
+static const GdkPixbuf *get_FileRow_icon(FileRow *row, const File_t *file, const bool remote, const int size) {
+  if (row && row->thumbnail && size == ICON_SIZE) return row->thumbnail;
+  const char *content_type = row ? row->content_type : NULL;
+  if (!content_type) {
+    content_type = get_content_type(file->name, file->type, remote);
+    if (row) row->content_type = content_type;
+  }
+  return get_Icon_content_type(content_type, size);
+}
+
+/**
+  *   @brief Forget the thumbnail of an entry whose name or content has changed
+  *   @param row FileRow of the entry
+  */
+static void drop_FileRow_thumbnail(FileRow *row) {
+  if (row->thumbnail) g_object_unref(row->thumbnail);
+  row->thumbnail = NULL;
+  row->thumb_requested = 0;
+  row->thumb_failed = false;
+}
+
+/**
+  *   @brief Cell data function of the DetailsView icon renderer
+  *   @remark The icons of the GtkListStore are too large for list rows
+  */
+static void DetailsView_icon_data(__attribute__((unused)) GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                  GtkTreeModel *model, GtkTreeIter *it, gpointer remote) {
+  FileRow *row;
+  gtk_tree_model_get(model, it, ROW_COLUMN, &row, -1);
+  const GdkPixbuf *icon = row ? get_FileRow_icon(row, row->file, GPOINTER_TO_INT(remote), DETAILS_ICON_SIZE) : NULL;
+  g_object_set(renderer, "pixbuf", icon, NULL);
+}
+
+/**
+  *   @brief Cell data function of the DetailsView size column
+  */
+static void DetailsView_size_data(__attribute__((unused)) GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                  GtkTreeModel *model, GtkTreeIter *it, gpointer remote) {
+  const File_t *file = get_DetailsView_file(model, it, GPOINTER_TO_INT(remote));
+  if (file && file->has_metadata && !is_folder(file->type, GPOINTER_TO_INT(remote))) {
+    gchar *size = g_format_size(file->size);
+    g_object_set(renderer, "text", size, NULL);
+    g_free(size);
+  } else g_object_set(renderer, "text", "", NULL);
+}
+
+/**
+  *   @brief Cell data function of the DetailsView modified column
+  */
+static void DetailsView_mtime_data(__attribute__((unused)) GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                                   GtkTreeModel *model, GtkTreeIter *it, gpointer remote) {
+  const File_t *file = get_DetailsView_file(model, it, GPOINTER_TO_INT(remote));
+  char mtime[32] = "";
+  if (file && file->has_metadata) {
+    struct tm lt;
+    const time_t t = (time_t) file->mtime;
+    if (localtime_r(&t, &lt)) strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M", &lt);
+  }
+  g_object_set(renderer, "text", mtime, NULL);
+}
+
+/**
+  *   @brief Create a fixed width DetailsView column
+  *   @param title Column header
+  *   @param width Fixed width
+  *   @param sort SortColumn selected by clicking the header
+  *   @return GtkTreeViewColumn
+  */
+static GtkTreeViewColumn *new_DetailsColumn(const char *title, const gint width, const enum SortColumn sort) {
+  GtkTreeViewColumn *column = gtk_tree_view_column_new();
+  gtk_tree_view_column_set_title(column, title);
+  // Required by the fixed height mode
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, width);
+  gtk_tree_view_column_set_resizable(column, TRUE);
+  gtk_tree_view_column_set_clickable(column, TRUE);
+  g_signal_connect(column, "clicked", G_CALLBACK(DetailsColumn_clicked), GINT_TO_POINTER(sort));
+  return column;
+}
+
+GtkWidget *new_DetailsView(const bool remote) {
+  GtkWidget *view = gtk_tree_view_new();
+  g_object_ref_sink(view); // Kept while the GtkViewport is displayed instead
+  GtkTreeViewColumn *column = new_DetailsColumn(get_SortColumn_name(SORT_BY_NAME), DETAILS_NAME_WIDTH, SORT_BY_NAME);
+  gtk_tree_view_column_set_expand(column, TRUE);
+  GtkCellRenderer *renderer = gtk_cell_renderer_pixbuf_new();
+  gtk_tree_view_column_pack_start(column, renderer, FALSE);
+  gtk_tree_view_column_set_cell_data_func(column, renderer, DetailsView_icon_data, GINT_TO_POINTER(remote), NULL);
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_add_attribute(column, renderer, "text", STRING_COLUMN);
+  gtk_tree_view_append_column((GtkTreeView *) view, column);
+  column = new_DetailsColumn(get_SortColumn_name(SORT_BY_SIZE), DETAILS_SIZE_WIDTH, SORT_BY_SIZE);
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "xalign", 1.0f, NULL);
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func(column, renderer, DetailsView_size_data, GINT_TO_POINTER(remote), NULL);
+  gtk_tree_view_append_column((GtkTreeView *) view, column);
+  column = new_DetailsColumn(get_SortColumn_name(SORT_BY_MTIME), DETAILS_MTIME_WIDTH, SORT_BY_MTIME);
+  renderer = gtk_cell_renderer_text_new();
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func(column, renderer, DetailsView_mtime_data, GINT_TO_POINTER(remote), NULL);
+  gtk_tree_view_append_column((GtkTreeView *) view, column);
+  // Row heights are measured once instead of per row
+  gtk_tree_view_set_fixed_height_mode((GtkTreeView *) view, TRUE);
+  // Typing is handled by the FilterEntries
+  gtk_tree_view_set_enable_search((GtkTreeView *) view, FALSE);
+  gtk_widget_set_can_focus(view, TRUE);
+  gtk_widget_show(view);
+  return view;
+}
+
+void set_FileView_details(const bool remote, const bool details) {
+  GtkWidget *current = remote ? mainWindow->RightFileView : mainWindow->LeftFileView;
+  GtkWidget *next = remote ? (details ? mainWindow->RightDetailsView : mainWindow->RightIconView) :
+                             (details ? mainWindow->LeftDetailsView : mainWindow->LeftIconView);
+  if (current == next) return;
+  GtkWidget *scrollWindow = remote ? mainWindow->RightFileScrollWindow : mainWindow->LeftFileScrollWindow;
+  GtkWidget *viewPort = remote ? mainWindow->RightScrollWindowViewPort : mainWindow->LeftScrollWindowViewPort;
+  FileStore *fileStore = remote ? remoteFileStore : localFileStore;
+  // The hidden view would otherwise keep doing layout work for every change
+  if (fileStore) FileView_set_model(current, NULL);
+  gtk_container_remove((GtkContainer *) scrollWindow, details ? viewPort : current);
+  gtk_container_add((GtkContainer *) scrollWindow, details ? next : viewPort);
+  if (remote) mainWindow->RightFileView = next;
+  else mainWindow->LeftFileView = next;
+  if (mainWindow->contextMenu->ContextMenuEmitter == current) mainWindow->contextMenu->ContextMenuEmitter = next;
+  if (fileStore) {
+    fileStore->fileView = next;
+    FileView_set_model(next, fileStore->filter);
+  }
+  gtk_widget_grab_focus(next);
+  if (!details) schedule_thumbnails();
+}
+
+void toggle_DetailsView(GtkCheckMenuItem *item, __attribute__((unused)) gpointer ptr) {
+  set_FileView_details(mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView,
+                       gtk_check_menu_item_get_active(item));
+}
+
+void DetailsColumn_clicked(__attribute__((unused)) GtkTreeViewColumn *column, gpointer sort) {
+  // The sort submenu items keep their state and sort the listings
+  const enum SortColumn clicked = (enum SortColumn) GPOINTER_TO_INT(sort);
+  if (clicked == sort_column) {
+    gtk_check_menu_item_set_active((GtkCheckMenuItem *) mainWindow->contextMenu->sort_descending, !sort_descending);
+  } else {
+    gtk_check_menu_item_set_active((GtkCheckMenuItem *) mainWindow->contextMenu->sort_columns[clicked], TRUE);
+  }
+}
+
+void update_DetailsView_headers() {
+  GtkWidget *views[] = { mainWindow->LeftDetailsView, mainWindow->RightDetailsView };
+  for (unsigned i = 0; i < 2; i++) {
+    // Columns are in SortColumn order, type has no column
+    for (int sort = SORT_BY_NAME; sort < SORT_BY_TYPE; sort++) {
+      GtkTreeViewColumn *column = gtk_tree_view_get_column((GtkTreeView *) views[i], sort);
+      gtk_tree_view_column_set_sort_indicator(column, sort == (int) sort_column);
+      gtk_tree_view_column_set_sort_order(column, sort_descending ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING);
+    }
+  }
+}
+
+GtkTreePath *FileView_get_path_at_pos(GtkWidget *fileView, const gint x, const gint y) {
+  if (GTK_IS_ICON_VIEW(fileView)) return gtk_icon_view_get_path_at_pos((GtkIconView *) fileView, x, y);
+  GtkTreePath *path = NULL;
+  if (!gtk_tree_view_get_path_at_pos((GtkTreeView *) fileView, x, y, &path, NULL, NULL, NULL)) return NULL;
+  return path;
+}
+
+GList *FileView_get_selected_items(GtkWidget *fileView) {
+  if (GTK_IS_ICON_VIEW(fileView)) return gtk_icon_view_get_selected_items((GtkIconView *) fileView);
+  return gtk_tree_selection_get_selected_rows(gtk_tree_view_get_selection((GtkTreeView *) fileView), NULL);
+}
+
+void FileView_select_only(GtkWidget *fileView, GtkTreePath *path) {
+  if (GTK_IS_ICON_VIEW(fileView)) {
+    gtk_icon_view_unselect_all((GtkIconView *) fileView);
+    if (path) gtk_icon_view_select_path((GtkIconView *) fileView, path);
+  } else {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection((GtkTreeView *) fileView);
+    gtk_tree_selection_unselect_all(selection);
+    if (path) gtk_tree_selection_select_path(selection, path);
+  }
+}
+
+gboolean FileView_get_cursor(GtkWidget *fileView, GtkTreePath **path) {
+  if (GTK_IS_ICON_VIEW(fileView)) return gtk_icon_view_get_cursor((GtkIconView *) fileView, path, NULL);
+  gtk_tree_view_get_cursor((GtkTreeView *) fileView, path, NULL);
+  return *path != NULL;
+}
+
+void FileView_set_model(GtkWidget *fileView, GtkTreeModel *model) {
+  if (GTK_IS_ICON_VIEW(fileView)) gtk_icon_view_set_model((GtkIconView *) fileView, model);
+  else gtk_tree_view_set_model((GtkTreeView *) fileView, model);
+}
+
 /* UI initializations */
 void initUI(int argc, char *argv[]) {
   gtk_init(&argc, &argv);
   if (!init_assets()) return; // Fatal error, quit
   session = NULL;
+  remoteCache = NULL;
+  localSizes = new_SizeCache(FOLDER_SIZE_TTL);
+  remoteSizes = NULL;
   remoteFileStore = NULL;
   localFileStore = NULL;
   fileCopies = NULL;
   worker_running = 0;
   working_on_remote = 0;
   show_hidden_files = false;
+  watch_remote = false;
+  shell_delete = false;
+  sort_column = SORT_BY_NAME;
+  sort_descending = false;
+  pending_listers = 0;
+  pending_filters = 0;
+  pending_sorts = 0;
+  pending_folder_sizes = 0;
+  pending_searches = 0;
+  pending_indexers = 0;
+  pending_viewers = 0;
+  pending_editors = 0;
+  remoteIndex = NULL;
+  remoteIndexFile = NULL;
+  prefetch_running = 0;
+  prefetch_generation = 0;
   pthread_attr_init(&tattr);
+  pthread_attr_init(&list_tattr);
+  pthread_attr_setdetachstate(&list_tattr, PTHREAD_CREATE_DETACHED);
+  thumbnailer = new_Thumbnailer(THUMB_THREADS); // Images show their icons if this fails
+  uint64_t download_limit;
+  bool download_links;
+  downloadCache = NULL;
+  if (download_cache_config(&download_limit, &download_links)) {
+    gchar *download_dir = g_build_filename(g_get_user_cache_dir(), DOWNLOAD_FOLDER, NULL);
+    downloadCache = new_DownloadCache(download_dir, download_limit, download_links); // Files are transferred if this fails
+    g_free(download_dir);
+  }
 
   builder = gtk_builder_new_from_file(LAYOUT_PATH);
 
@@ -109,11 +1813,23 @@ void initUI(int argc, char *argv[]) {
   init_MessageWindow();
   init_PopOverDialog();
   init_FilePropertiesDialog();
+  init_SearchWindow();
+  init_ViewerWindow();
   load_css_styles();
   gtk_builder_connect_signals(builder, NULL);
   gtk_widget_show_all(connectWindow->ConnectDialog);
 
   asyncQueue = g_async_queue_new();
+  listQueue = g_async_queue_new();
+  filterQueue = g_async_queue_new();
+  sortQueue = g_async_queue_new();
+  folderSizeQueue = g_async_queue_new();
+  searchQueue = g_async_queue_new();
+  indexQueue = g_async_queue_new();
+  viewerQueue = g_async_queue_new();
+  editQueue = g_async_queue_new();
+  editFiles = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) free_EditFile);
+  init_LocalWatch();
 
   // Start main event loop
   gtk_main();
@@ -124,11 +1840,68 @@ void quitUI() {
   // Quit gtk event loop
   gtk_main_quit();
   pthread_join(tid, NULL);
-  if (session) {
-    end_session(session);
+  // Sizers, searchers and indexers stop at their next read, but remote ones may be blocked on the network
+  cancel_FolderSize();
+  cancel_Search();
+  cancel_Indexer();
+  close_Viewer();
+  // The worker, the only thread downloading files, has been joined
+  if (downloadCache) {
+    if (session) session->downloads = NULL;
+    free_DownloadCache(downloadCache);
+  }
+  if (thumb_source) g_source_remove(thumb_source);
+  if (thumb_source_id) g_source_remove(thumb_source_id);
+  if (edit_source_id) g_source_remove(edit_source_id);
+  if (edit_poll_source) g_source_remove(edit_poll_source);
+  free(conflict_path);
+  conflict_path = NULL;
+  if (g_atomic_int_get(&pending_editors) == 0) {
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, editFiles);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+      EditFile *edit = (EditFile *) value;
+      // Saves made after the last poll are written back before the session ends
+      if (session && !edit->conflict && EditFile_modified(edit)) sftp_session_edit_save(session, edit);
+      // Copies with changes not written back are kept
+      if (!edit->conflict && !EditFile_modified(edit)) EditFile_remove_copy(edit);
+    }
+    g_hash_table_destroy(editFiles);
+    g_async_queue_unref(editQueue);
+  }
+  // Lister and prefetcher threads cannot be interrupted: if some are still
+  // blocked on the network, leave the session and their queue to be reclaimed at exit
+  if (g_atomic_int_get(&pending_listers) == 0 && !g_atomic_int_get(&prefetch_running) &&
+      g_atomic_int_get(&pending_folder_sizes) == 0 && g_atomic_int_get(&pending_searches) == 0 &&
+      g_atomic_int_get(&pending_indexers) == 0 && g_atomic_int_get(&pending_viewers) == 0 &&
+      g_atomic_int_get(&pending_editors) == 0) {
+    // Thumbnailers finish their current image, the remote ones do not wait for the session
+    free_Thumbnailer(thumbnailer);
+    if (session) {
+      end_session(session);
+    }
+    free_ListingCache(remoteCache);
+    g_async_queue_unref(listQueue);
+    // Keep the folders browsed during the session
+    if (remoteIndex && RemoteIndex_is_dirty(remoteIndex)) RemoteIndex_save(remoteIndex);
+    free_RemoteIndex(remoteIndex);
+    free(remoteIndexFile);
+  }
+  if (g_atomic_int_get(&pending_folder_sizes) == 0) {
+    free_SizeCache(localSizes);
+    free_SizeCache(remoteSizes);
+    g_async_queue_unref(folderSizeQueue);
   }
+  if (g_atomic_int_get(&pending_searches) == 0) g_async_queue_unref(searchQueue);
+  if (g_atomic_int_get(&pending_indexers) == 0) g_async_queue_unref(indexQueue);
+  if (g_atomic_int_get(&pending_viewers) == 0) g_async_queue_unref(viewerQueue);
+  if (g_atomic_int_get(&pending_filters) == 0) g_async_queue_unref(filterQueue);
+  if (g_atomic_int_get(&pending_sorts) == 0) g_async_queue_unref(sortQueue);
 
   g_async_queue_unref(asyncQueue);
+  if (watch_changes) g_hash_table_destroy(watch_changes);
+  if (inotify_fd >= 0) close(inotify_fd);
   //g_object_unref(builder);
   // Free allocated memory
   clear_FileStore(remoteFileStore);
@@ -140,6 +1913,10 @@ void quitUI() {
   free(messageWindow);
   free(popOverDialog);
   free(filePropertiesDialog);
+  free(searchWindow->root);
+  free(searchWindow);
+  free(viewerWindow->path);
+  free(viewerWindow);
 }
 
 void init_MainWindow() {
@@ -160,11 +1937,14 @@ void init_MainWindow() {
   mainWindow->LeftFileSelectFrameAlignment = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileSelectFrameAlignment"));
   mainWindow->LeftFileScrollWindow = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileScrollWindow"));
   mainWindow->LeftScrollWindowViewPort = GTK_WIDGET(gtk_builder_get_object(builder, "LeftScrollWindowViewPort"));
-  mainWindow->LeftFileView = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileView"));
+  mainWindow->LeftIconView = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileView"));
+  mainWindow->LeftFileView = mainWindow->LeftIconView;
+  mainWindow->LeftDetailsView = new_DetailsView(false);
   mainWindow->LeftFileSelectGrid = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileSelectGrid"));
   mainWindow->LeftFileHomeButton = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileHomeButton"));
   mainWindow->LeftFileBackButton = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFileBackButton"));
   mainWindow->LeftNewFolderButton = GTK_WIDGET(gtk_builder_get_object(builder, "LeftNewFolderButton"));
+  mainWindow->LeftFilterEntry = GTK_WIDGET(gtk_builder_get_object(builder, "LeftFilterEntry"));
   // right-hand side
   mainWindow->RightTopFrame = GTK_WIDGET(gtk_builder_get_object(builder, "RightTopFrame"));
   mainWindow->RightTopFrameBox = GTK_WIDGET(gtk_builder_get_object(builder, "RightTopFrameBox"));
@@ -179,21 +1959,46 @@ void init_MainWindow() {
   mainWindow->RightFileSelectFrameAlignment = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileSelectFrameAlignment"));
   mainWindow->RightFileScrollWindow = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileScrollWindow"));
   mainWindow->RightScrollWindowViewPort = GTK_WIDGET(gtk_builder_get_object(builder, "RightScrollWindowViewPort"));
-  mainWindow->RightFileView = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileView"));
+  mainWindow->RightIconView = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileView"));
+  mainWindow->RightFileView = mainWindow->RightIconView;
+  mainWindow->RightDetailsView = new_DetailsView(true);
   mainWindow->RightFileSelectGrid = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileSelectGrid"));
   mainWindow->RightFileHomeButton = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileHomeButton"));
   mainWindow->RightFileBackButton = GTK_WIDGET(gtk_builder_get_object(builder, "RightFileBackButton"));
   mainWindow->RightNewFolderButton = GTK_WIDGET(gtk_builder_get_object(builder, "RightNewFolderButton"));
+  mainWindow->RightFilterEntry = GTK_WIDGET(gtk_builder_get_object(builder, "RightFilterEntry"));
   init_ContextMenu();
 
   g_signal_connect(mainWindow->TopWindow, "destroy", G_CALLBACK(quitUI), NULL);
   g_signal_connect(G_OBJECT(mainWindow->TopWindow), "key_press_event", G_CALLBACK(MainWindow_keypress_handler), NULL);
-  g_signal_connect_swapped(mainWindow->LeftFileView, "button_press_event", G_CALLBACK(transition_ContextMenu), mainWindow->LeftFileView);
-  g_signal_connect_swapped(mainWindow->RightFileView, "button_press_event", G_CALLBACK(transition_ContextMenu), mainWindow->RightFileView);
-  gtk_widget_add_events(mainWindow->LeftFileView, GDK_KEY_PRESS_MASK);
-  gtk_widget_add_events(mainWindow->RightFileView, GDK_KEY_PRESS_MASK);
-  g_signal_connect(G_OBJECT(mainWindow->LeftFileView), "key_press_event", G_CALLBACK(keypress_handler), NULL);
-  g_signal_connect(G_OBJECT(mainWindow->RightFileView), "key_press_event", G_CALLBACK(keypress_handler), NULL);
+  gtk_icon_view_set_text_column((GtkIconView *) mainWindow->LeftIconView, STRING_COLUMN);
+  gtk_icon_view_set_pixbuf_column((GtkIconView *) mainWindow->LeftIconView, PIXBUF_COLUMN);
+  gtk_icon_view_set_text_column((GtkIconView *) mainWindow->RightIconView, STRING_COLUMN);
+  gtk_icon_view_set_pixbuf_column((GtkIconView *) mainWindow->RightIconView, PIXBUF_COLUMN);
+  // The viewports are kept while the DetailsViews are displayed instead
+  g_object_ref(mainWindow->LeftScrollWindowViewPort);
+  g_object_ref(mainWindow->RightScrollWindowViewPort);
+  GtkWidget *views[] = { mainWindow->LeftIconView, mainWindow->LeftDetailsView,
+                         mainWindow->RightIconView, mainWindow->RightDetailsView };
+  for (unsigned i = 0; i < 4; i++) {
+    g_signal_connect_swapped(views[i], "button_press_event", G_CALLBACK(transition_ContextMenu), views[i]);
+    gtk_widget_add_events(views[i], GDK_KEY_PRESS_MASK);
+    g_signal_connect(G_OBJECT(views[i]), "key_press_event", G_CALLBACK(keypress_handler), NULL);
+  }
+  // FileView_OnButtonPress is connected to the GtkIconViews in the glade file
+  g_signal_connect(mainWindow->LeftDetailsView, "button_press_event", G_CALLBACK(FileView_OnButtonPress), NULL);
+  g_signal_connect(mainWindow->RightDetailsView, "button_press_event", G_CALLBACK(FileView_OnButtonPress), NULL);
+  g_signal_connect_swapped(mainWindow->RightIconView, "selection-changed", G_CALLBACK(schedule_prefetch), NULL);
+  g_signal_connect_swapped(gtk_tree_view_get_selection((GtkTreeView *) mainWindow->RightDetailsView), "changed",
+                           G_CALLBACK(schedule_prefetch), NULL);
+  // Scrolling, resizing and filling the IconViews bring other images into view
+  GtkWidget *viewPorts[] = { mainWindow->LeftScrollWindowViewPort, mainWindow->RightScrollWindowViewPort };
+  for (unsigned i = 0; i < 2; i++) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment((GtkScrollable *) viewPorts[i]);
+    g_signal_connect_swapped(adjustment, "value-changed", G_CALLBACK(schedule_thumbnails), NULL);
+    g_signal_connect_swapped(adjustment, "changed", G_CALLBACK(schedule_thumbnails), NULL);
+  }
+  update_DetailsView_headers();
 }
 
 void init_ContextMenu() {
@@ -220,9 +2025,45 @@ void init_ContextMenu() {
   mainWindow->contextMenu->show_hidden_files = (GtkMenuItem *) gtk_check_menu_item_new_with_label(get_ContextMenuAction_name(SHOW_HIDDEN_FILES));
   g_signal_connect((GtkCheckMenuItem *) mainWindow->contextMenu->show_hidden_files, "toggled", G_CALLBACK(toggle_HiddenFiles), NULL);
   gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->show_hidden_files, 0, 1, 5, 6);
+  mainWindow->contextMenu->watch_remote = (GtkMenuItem *) gtk_check_menu_item_new_with_label(get_ContextMenuAction_name(WATCH_REMOTE));
+  g_signal_connect((GtkCheckMenuItem *) mainWindow->contextMenu->watch_remote, "toggled", G_CALLBACK(toggle_RemoteWatch), NULL);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->watch_remote, 0, 1, 6, 7);
+  mainWindow->contextMenu->sort = (GtkMenuItem *) gtk_menu_item_new_with_label(get_ContextMenuAction_name(SORT_BY));
+  GtkWidget *sortMenu = gtk_menu_new();
+  GSList *sortGroup = NULL;
+  for (int column = SORT_BY_NAME; column <= SORT_BY_TYPE; column++) {
+    GtkWidget *item = gtk_radio_menu_item_new_with_label(sortGroup, get_SortColumn_name(column));
+    sortGroup = gtk_radio_menu_item_get_group((GtkRadioMenuItem *) item);
+    gtk_check_menu_item_set_active((GtkCheckMenuItem *) item, column == (int) sort_column);
+    g_signal_connect((GtkCheckMenuItem *) item, "toggled", G_CALLBACK(SortMenuItem_toggled), GINT_TO_POINTER(column));
+    gtk_menu_shell_append((GtkMenuShell *) sortMenu, item);
+    mainWindow->contextMenu->sort_columns[column] = (GtkMenuItem *) item;
+  }
+  gtk_menu_shell_append((GtkMenuShell *) sortMenu, gtk_separator_menu_item_new());
+  mainWindow->contextMenu->sort_descending = (GtkMenuItem *) gtk_check_menu_item_new_with_label(get_ContextMenuAction_name(SORT_DESCENDING));
+  g_signal_connect((GtkCheckMenuItem *) mainWindow->contextMenu->sort_descending, "toggled", G_CALLBACK(toggle_SortDescending), NULL);
+  gtk_menu_shell_append((GtkMenuShell *) sortMenu, (GtkWidget *) mainWindow->contextMenu->sort_descending);
+  gtk_menu_item_set_submenu(mainWindow->contextMenu->sort, sortMenu);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->sort, 0, 1, 7, 8);
+  mainWindow->contextMenu->details_view = (GtkMenuItem *) gtk_check_menu_item_new_with_label(get_ContextMenuAction_name(DETAILS_VIEW));
+  mainWindow->contextMenu->details_view_toggled = g_signal_connect((GtkCheckMenuItem *) mainWindow->contextMenu->details_view,
+                                                                   "toggled", G_CALLBACK(toggle_DetailsView), NULL);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->details_view, 0, 1, 8, 9);
+  mainWindow->contextMenu->search = (GtkMenuItem *) gtk_menu_item_new_with_label(get_ContextMenuAction_name(SEARCH));
+  g_signal_connect(mainWindow->contextMenu->search, "button_press_event", G_CALLBACK(ContextMenuItem_action), mainWindow->contextMenu->search);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->search, 0, 1, 9, 10);
   mainWindow->contextMenu->properties = (GtkMenuItem *) gtk_menu_item_new_with_label(get_ContextMenuAction_name(FILE_PROPERTIES));
-  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->properties, 0, 1, 6, 7);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->properties, 0, 1, 10, 11);
   g_signal_connect(mainWindow->contextMenu->properties, "button_press_event", G_CALLBACK(ContextMenuItem_action), mainWindow->contextMenu->properties);
+  mainWindow->contextMenu->view = (GtkMenuItem *) gtk_menu_item_new_with_label(get_ContextMenuAction_name(VIEW_FILE));
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->view, 0, 1, 11, 12);
+  g_signal_connect(mainWindow->contextMenu->view, "button_press_event", G_CALLBACK(ContextMenuItem_action), mainWindow->contextMenu->view);
+  mainWindow->contextMenu->edit = (GtkMenuItem *) gtk_menu_item_new_with_label(get_ContextMenuAction_name(EDIT_FILE));
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->edit, 0, 1, 12, 13);
+  g_signal_connect(mainWindow->contextMenu->edit, "button_press_event", G_CALLBACK(ContextMenuItem_action), mainWindow->contextMenu->edit);
+  mainWindow->contextMenu->shell_delete = (GtkMenuItem *) gtk_check_menu_item_new_with_label(get_ContextMenuAction_name(SHELL_DELETE));
+  g_signal_connect((GtkCheckMenuItem *) mainWindow->contextMenu->shell_delete, "toggled", G_CALLBACK(toggle_ShellDelete), NULL);
+  gtk_menu_attach(mainWindow->contextMenu->Menu, (GtkWidget *) mainWindow->contextMenu->shell_delete, 0, 1, 13, 14);
 }
 
 void init_ConnectWindow() {
@@ -305,14 +2146,206 @@ void init_FilePropertiesDialog() {
   filePropertiesDialog->FilePropertiesGroup = GTK_WIDGET(gtk_builder_get_object(builder, "FilePropertiesGroup"));
   filePropertiesDialog->FilePropertiesGroupPermissions = GTK_WIDGET(gtk_builder_get_object(builder, "FilePropertiesGroupPermissions"));
   filePropertiesDialog->FilePropertiesOthersPermissions = GTK_WIDGET(gtk_builder_get_object(builder, "FilePropertiesOthersPermissions"));
+  filePropertiesDialog->FilePropertiesDownloadCache = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(filePropertiesDialog->FilePropertiesDownloadCache), 0.0f);
+  gtk_label_set_line_wrap(GTK_LABEL(filePropertiesDialog->FilePropertiesDownloadCache), TRUE);
+  GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(filePropertiesDialog->FilePropertiesDialog));
+  gtk_box_pack_end(GTK_BOX(content), filePropertiesDialog->FilePropertiesDownloadCache, FALSE, FALSE, 0);
   g_signal_connect(filePropertiesDialog->FilePropertiesDialog, "delete-event", G_CALLBACK(close_FilePropertiesDialog), NULL);
 }
 
 gboolean close_FilePropertiesDialog() {
+  cancel_FolderSize();
   gtk_widget_hide(filePropertiesDialog->FilePropertiesDialog);
   return TRUE;
 }
 
+/**
+  *   @brief Create a spin button for a searchWindow limit
+  *   @param grid GtkGrid the label and the button are attached to
+  *   @param title Label shown before the button
+  *   @param column Column of the label in grid
+  *   @param max Largest value
+  *   @return GtkSpinButton
+  */
+static GtkWidget *new_SearchLimit(GtkWidget *grid, const char *title, const gint column, const gdouble max) {
+  GtkWidget *label = gtk_label_new(title);
+  gtk_label_set_xalign(GTK_LABEL(label), 1.0f);
+  gtk_grid_attach(GTK_GRID(grid), label, column, 2, 1, 1);
+  GtkWidget *button = gtk_spin_button_new_with_range(0, max, 1);
+  gtk_grid_attach(GTK_GRID(grid), button, column + 1, 2, 1, 1);
+  return button;
+}
+
+void init_SearchWindow() {
+  searchWindow = malloc(sizeof(SearchWindow));
+  searchWindow->root = NULL;
+  searchWindow->remote = true;
+  searchWindow->SearchWindow = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title(GTK_WINDOW(searchWindow->SearchWindow), get_ContextMenuAction_name(SEARCH));
+  gtk_window_set_transient_for(GTK_WINDOW(searchWindow->SearchWindow), GTK_WINDOW(mainWindow->TopWindow));
+  gtk_window_set_default_size(GTK_WINDOW(searchWindow->SearchWindow), 760, 480);
+  gtk_container_set_border_width(GTK_CONTAINER(searchWindow->SearchWindow), 8);
+  GtkWidget *grid = gtk_grid_new();
+  gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+  gtk_grid_set_column_spacing(GTK_GRID(grid), 6);
+  gtk_container_add(GTK_CONTAINER(searchWindow->SearchWindow), grid);
+
+  searchWindow->SearchFolder = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(searchWindow->SearchFolder), 0.0f);
+  gtk_label_set_ellipsize(GTK_LABEL(searchWindow->SearchFolder), PANGO_ELLIPSIZE_MIDDLE);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchFolder, 0, 0, 8, 1);
+  searchWindow->SearchEntry = gtk_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(searchWindow->SearchEntry), "Name or pattern, e.g. *.c");
+  gtk_widget_set_hexpand(searchWindow->SearchEntry, TRUE);
+  g_signal_connect(searchWindow->SearchEntry, "activate", G_CALLBACK(SearchButton_action), NULL);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchEntry, 0, 1, 4, 1);
+  searchWindow->SearchRegex = gtk_check_button_new_with_label("Regular expression");
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchRegex, 4, 1, 1, 1);
+  searchWindow->SearchIgnoreCase = gtk_check_button_new_with_label("Ignore case");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(searchWindow->SearchIgnoreCase), TRUE);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchIgnoreCase, 5, 1, 1, 1);
+  searchWindow->SearchButton = gtk_button_new_with_label(get_ContextMenuAction_name(SEARCH));
+  g_signal_connect(searchWindow->SearchButton, "clicked", G_CALLBACK(SearchButton_action), NULL);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchButton, 6, 1, 1, 1);
+  searchWindow->SearchStopButton = gtk_button_new_with_label("Stop");
+  gtk_widget_set_sensitive(searchWindow->SearchStopButton, FALSE);
+  g_signal_connect(searchWindow->SearchStopButton, "clicked", G_CALLBACK(SearchStopButton_action), NULL);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchStopButton, 7, 1, 1, 1);
+  searchWindow->SearchMinSize = new_SearchLimit(grid, "Size from (KiB)", 0, 1e9);
+  searchWindow->SearchMaxSize = new_SearchLimit(grid, "to", 2, 1e9);
+  searchWindow->SearchMaxAge = new_SearchLimit(grid, "Modified within (days)", 4, 36500);
+  searchWindow->SearchContents = gtk_check_button_new_with_label("Search file contents");
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchContents, 6, 2, 2, 1);
+
+  searchWindow->results = gtk_list_store_new(SEARCH_N_COLUMNS, G_TYPE_STRING, G_TYPE_UINT64, G_TYPE_UINT64, G_TYPE_UINT,
+                                             G_TYPE_UINT, G_TYPE_STRING);
+  searchWindow->SearchResults = gtk_tree_view_new_with_model(GTK_TREE_MODEL(searchWindow->results));
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_START, NULL);
+  GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes("Path", renderer, "text", SEARCH_PATH_COLUMN, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, SEARCH_PATH_WIDTH);
+  gtk_tree_view_column_set_resizable(column, TRUE);
+  gtk_tree_view_column_set_expand(column, TRUE);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(searchWindow->SearchResults), column);
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "xalign", 1.0f, NULL);
+  column = gtk_tree_view_column_new();
+  gtk_tree_view_column_set_title(column, get_SortColumn_name(SORT_BY_SIZE));
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func(column, renderer, SearchResults_size_data, NULL, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, DETAILS_SIZE_WIDTH);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(searchWindow->SearchResults), column);
+  searchWindow->SizeColumn = column;
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new();
+  gtk_tree_view_column_set_title(column, get_SortColumn_name(SORT_BY_MTIME));
+  gtk_tree_view_column_pack_start(column, renderer, TRUE);
+  gtk_tree_view_column_set_cell_data_func(column, renderer, SearchResults_mtime_data, NULL, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, DETAILS_MTIME_WIDTH);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(searchWindow->SearchResults), column);
+  searchWindow->MtimeColumn = column;
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "xalign", 1.0f, NULL);
+  column = gtk_tree_view_column_new_with_attributes("Line", renderer, "text", SEARCH_LINE_COLUMN, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, SEARCH_LINE_WIDTH);
+  gtk_tree_view_column_set_visible(column, FALSE);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(searchWindow->SearchResults), column);
+  searchWindow->LineColumn = column;
+  renderer = gtk_cell_renderer_text_new();
+  g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+  column = gtk_tree_view_column_new_with_attributes("Text", renderer, "text", SEARCH_TEXT_COLUMN, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, SEARCH_PATH_WIDTH);
+  gtk_tree_view_column_set_resizable(column, TRUE);
+  gtk_tree_view_column_set_visible(column, FALSE);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(searchWindow->SearchResults), column);
+  searchWindow->TextColumn = column;
+  // Matches are appended while the view is shown, rows are measured once
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(searchWindow->SearchResults), TRUE);
+  g_signal_connect(searchWindow->SearchResults, "row-activated", G_CALLBACK(SearchResults_activated), NULL);
+  GtkWidget *scrollWindow = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_vexpand(scrollWindow, TRUE);
+  gtk_container_add(GTK_CONTAINER(scrollWindow), searchWindow->SearchResults);
+  gtk_grid_attach(GTK_GRID(grid), scrollWindow, 0, 3, 8, 1);
+  searchWindow->SearchStatus = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(searchWindow->SearchStatus), 0.0f);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchStatus, 0, 4, 8, 1);
+  searchWindow->SearchUseIndex = gtk_check_button_new_with_label("Use index");
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchUseIndex, 0, 5, 1, 1);
+  searchWindow->SearchIndexStatus = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(searchWindow->SearchIndexStatus), 0.0f);
+  gtk_label_set_ellipsize(GTK_LABEL(searchWindow->SearchIndexStatus), PANGO_ELLIPSIZE_END);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchIndexStatus, 1, 5, 6, 1);
+  searchWindow->SearchIndexButton = gtk_button_new_with_label("Update index");
+  g_signal_connect(searchWindow->SearchIndexButton, "clicked", G_CALLBACK(SearchIndexButton_action), NULL);
+  gtk_grid_attach(GTK_GRID(grid), searchWindow->SearchIndexButton, 7, 5, 1, 1);
+  g_signal_connect(searchWindow->SearchWindow, "delete-event", G_CALLBACK(close_SearchWindow), NULL);
+}
+
+gboolean close_SearchWindow() {
+  cancel_Search();
+  gtk_widget_hide(searchWindow->SearchWindow);
+  return TRUE;
+}
+
+void init_ViewerWindow() {
+  viewerWindow = malloc(sizeof(ViewerWindow));
+  viewerWindow->file = NULL;
+  viewerWindow->path = NULL;
+  viewerWindow->remote = false;
+  viewerWindow->start = 0;
+  viewerWindow->end = 0;
+  viewerWindow->ViewerWindow = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title(GTK_WINDOW(viewerWindow->ViewerWindow), get_ContextMenuAction_name(VIEW_FILE));
+  gtk_window_set_transient_for(GTK_WINDOW(viewerWindow->ViewerWindow), GTK_WINDOW(mainWindow->TopWindow));
+  gtk_window_set_default_size(GTK_WINDOW(viewerWindow->ViewerWindow), 800, 560);
+  gtk_container_set_border_width(GTK_CONTAINER(viewerWindow->ViewerWindow), 8);
+  GtkWidget *grid = gtk_grid_new();
+  gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+  gtk_grid_set_column_spacing(GTK_GRID(grid), 6);
+  gtk_container_add(GTK_CONTAINER(viewerWindow->ViewerWindow), grid);
+
+  viewerWindow->ViewerPath = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(viewerWindow->ViewerPath), 0.0f);
+  gtk_label_set_ellipsize(GTK_LABEL(viewerWindow->ViewerPath), PANGO_ELLIPSIZE_MIDDLE);
+  gtk_widget_set_hexpand(viewerWindow->ViewerPath, TRUE);
+  gtk_grid_attach(GTK_GRID(grid), viewerWindow->ViewerPath, 0, 0, 5, 1);
+  viewerWindow->ViewerText = gtk_text_view_new();
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(viewerWindow->ViewerText), FALSE);
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(viewerWindow->ViewerText), TRUE);
+  GtkWidget *scrollWindow = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_vexpand(scrollWindow, TRUE);
+  gtk_container_add(GTK_CONTAINER(scrollWindow), viewerWindow->ViewerText);
+  gtk_grid_attach(GTK_GRID(grid), scrollWindow, 0, 1, 5, 1);
+  GtkWidget **buttons[] = { &(viewerWindow->ViewerStartButton), &(viewerWindow->ViewerPreviousButton),
+                            &(viewerWindow->ViewerNextButton), &(viewerWindow->ViewerEndButton) };
+  const char *labels[] = { "Start", "Previous page", "Next page", "End" };
+  for (unsigned i = 0; i < 4; i++) {
+    *buttons[i] = gtk_button_new_with_label(labels[i]);
+    g_signal_connect(*buttons[i], "clicked", G_CALLBACK(ViewerButton_action), NULL);
+    gtk_grid_attach(GTK_GRID(grid), *buttons[i], i, 2, 1, 1);
+  }
+  viewerWindow->ViewerFollow = gtk_check_button_new_with_label("Follow");
+  g_signal_connect(viewerWindow->ViewerFollow, "toggled", G_CALLBACK(toggle_ViewerFollow), NULL);
+  gtk_grid_attach(GTK_GRID(grid), viewerWindow->ViewerFollow, 4, 2, 1, 1);
+  viewerWindow->ViewerStatus = gtk_label_new("");
+  gtk_label_set_xalign(GTK_LABEL(viewerWindow->ViewerStatus), 0.0f);
+  gtk_grid_attach(GTK_GRID(grid), viewerWindow->ViewerStatus, 0, 3, 5, 1);
+  g_signal_connect(viewerWindow->ViewerWindow, "delete-event", G_CALLBACK(close_ViewerWindow), NULL);
+}
+
+gboolean close_ViewerWindow() {
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(viewerWindow->ViewerFollow), FALSE);
+  close_Viewer();
+  gtk_widget_hide(viewerWindow->ViewerWindow);
+  return TRUE;
+}
+
 void clear_ContextMenu() {
   if (mainWindow->contextMenu) {
     if (mainWindow->contextMenu->ContextMenuRect) free(mainWindow->contextMenu->ContextMenuRect);
@@ -345,10 +2378,26 @@ void transition_MainWindow() {
       local_pwd = change_pwd(local_pwd, "/");
     }
     remote_pwd = session->home_dir ? change_pwd(remote_pwd, session->home_dir) : change_pwd(remote_pwd, "/");
+    if (!localFileStore) localFileStore = new_FileStore(mainWindow->LeftFileView, false);
+    if (!remoteFileStore) remoteFileStore = new_FileStore(mainWindow->RightFileView, true);
+    if (!remoteCache) remoteCache = new_ListingCache(REMOTE_CACHE_TTL, REMOTE_CACHE_MAX_ENTRIES);
+    if (!remoteSizes) remoteSizes = new_SizeCache(FOLDER_SIZE_TTL);
+    if (!remoteIndexFile) {
+      remoteIndexFile = index_filename(gtk_entry_get_text((GtkEntry*) connectWindow->SetUsernameEntry),
+                                       gtk_entry_get_text((GtkEntry*) connectWindow->SetIPEntry));
+      // Indexing is opt-in: listings update the index once the server has been indexed
+      if (remoteIndexFile && g_file_test(remoteIndexFile, G_FILE_TEST_EXISTS)) remoteIndex = new_RemoteIndex(remoteIndexFile);
+    }
+    session->downloads = downloadCache;
+    g_atomic_int_set(&session->shell_delete, shell_delete);
+    if (thumbnailer && !thumbnailer->session) {
+      char *prefix = g_strdup_printf("sftp://%s@%s", gtk_entry_get_text((GtkEntry*) connectWindow->SetUsernameEntry),
+                                     gtk_entry_get_text((GtkEntry*) connectWindow->SetIPEntry));
+      Thumbnailer_set_session(thumbnailer, session, prefix);
+      g_free(prefix);
+    }
     if (show_FileStore(local_pwd, false) != 0) return;
-    gtk_label_set_text((GtkLabel *) mainWindow->LeftInnerFrameLabel, local_pwd);
-    if (show_FileStore(remote_pwd, true) != 0) return;
-    gtk_label_set_text((GtkLabel *) mainWindow->RightInnerFrameLabel, remote_pwd);
+    show_FileStore(remote_pwd, true);
   } else {
     // Some error happened
     transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
@@ -364,16 +2413,14 @@ gboolean transition_ContextMenu(GtkWidget *widget, GdkEvent *event) {
     if (button->button == GDK_BUTTON_SECONDARY) {
       // Update selection
       // TODO multi-select support
-      if ((path = gtk_icon_view_get_path_at_pos(GTK_ICON_VIEW(widget), button->x, button->y))) {
-        gtk_icon_view_unselect_all(GTK_ICON_VIEW(widget));
-        gtk_icon_view_select_path(GTK_ICON_VIEW(widget), path);
+      path = FileView_get_path_at_pos(widget, button->x, button->y);
+      FileView_select_only(widget, path);
+      if (path) {
         gtk_tree_path_free(path);
         selected = true;
-      } else {
-        gtk_icon_view_unselect_all(GTK_ICON_VIEW(widget));
       }
-      show_ContextMenu_buttons(selected);
       mainWindow->contextMenu->ContextMenuEmitter = widget; // Store for further use
+      show_ContextMenu_buttons(selected);
       gtk_widget_show_all((GtkWidget *) mainWindow->contextMenu->Menu);
       int width, height;
       int scroll_compensation_x, scroll_compensation_y;
@@ -381,20 +2428,27 @@ gboolean transition_ContextMenu(GtkWidget *widget, GdkEvent *event) {
       gtk_window_get_size((GtkWindow *) mainWindow->TopWindow, &width, &height);
       if (mainWindow->contextMenu->ContextMenuRect) free(mainWindow->contextMenu->ContextMenuRect);
       GdkRectangle *rect = malloc(sizeof(GdkRectangle));
-      // The event contains coordinates in FileView viewport and the ContextMenu has to be set to TopWindow coordinates
-      rect->x = widget == mainWindow->LeftFileView ? button->x : (int) ((float)button->x + 0.5f * (float)width);
-      if (widget == mainWindow->LeftFileView) {
-        adj_x = gtk_scrolled_window_get_hadjustment((GtkScrolledWindow *) mainWindow->LeftFileScrollWindow);
-        adj_y = gtk_scrolled_window_get_vadjustment((GtkScrolledWindow *) mainWindow->LeftFileScrollWindow);
+      if (GTK_IS_TREE_VIEW(widget)) {
+        // DetailsViews scroll natively, the event is in the coordinates of the visible rows
+        int widget_x, widget_y;
+        gtk_tree_view_convert_bin_window_to_widget_coords((GtkTreeView *) widget, button->x, button->y, &widget_x, &widget_y);
+        gtk_widget_translate_coordinates(widget, mainWindow->TopWindow, widget_x, widget_y, &(rect->x), &(rect->y));
       } else {
-        adj_x = gtk_scrolled_window_get_hadjustment((GtkScrolledWindow *) mainWindow->RightFileScrollWindow);
-        adj_y = gtk_scrolled_window_get_vadjustment((GtkScrolledWindow *) mainWindow->RightFileScrollWindow);
+        // The event contains coordinates in FileView viewport and the ContextMenu has to be set to TopWindow coordinates
+        rect->x = widget == mainWindow->LeftFileView ? button->x : (int) ((float)button->x + 0.5f * (float)width);
+        if (widget == mainWindow->LeftFileView) {
+          adj_x = gtk_scrolled_window_get_hadjustment((GtkScrolledWindow *) mainWindow->LeftFileScrollWindow);
+          adj_y = gtk_scrolled_window_get_vadjustment((GtkScrolledWindow *) mainWindow->LeftFileScrollWindow);
+        } else {
+          adj_x = gtk_scrolled_window_get_hadjustment((GtkScrolledWindow *) mainWindow->RightFileScrollWindow);
+          adj_y = gtk_scrolled_window_get_vadjustment((GtkScrolledWindow *) mainWindow->RightFileScrollWindow);
+        }
+        scroll_compensation_x = (int) gtk_adjustment_get_value(adj_x);
+        scroll_compensation_y = (int) gtk_adjustment_get_value(adj_y);
+        rect->x -= scroll_compensation_x; // This takes account the amount of horizontal view scrolling
+        rect->y = button->y;
+        rect->y -= scroll_compensation_y; // This takes account the amount of vertical view scrolling
       }
-      scroll_compensation_x = (int) gtk_adjustment_get_value(adj_x);
-      scroll_compensation_y = (int) gtk_adjustment_get_value(adj_y);
-      rect->x -= scroll_compensation_x; // This takes account the amount of horizontal view scrolling
-      rect->y = button->y;
-      rect->y -= scroll_compensation_y; // This takes account the amount of vertical view scrolling
       rect->width = 50;
       rect->height = 80;
       gtk_menu_popup_at_rect(mainWindow->contextMenu->Menu, gtk_widget_get_window(mainWindow->TopWindow), rect, 0, 0, event);
@@ -412,29 +2466,98 @@ void transition_FilePropertiesDialog() {
     const char *parent_folder = remote_file ? remote_pwd : local_pwd;
     const GSList *item = g_slist_find_custom(files, filename, compare_File_GSLists);
     if (item) {
-      const File_t *file = (const File_t *) item->data;
+      File_t *file = (File_t *) item->data;
+      if (!file->has_metadata && !remote_file) fs_fill_File(file, parent_folder);
       char *local_time = seconds_to_time(file->mtime);
       char *size = get_size_str(file->size);
       char *permissions = get_file_permissions_str(file->permissions);
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesFilename), filename);
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesType), is_folder(file->type, remote_file) ? "Folder" : "File");
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesParentFolder), parent_folder);
-      gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesFileSize), size);
+      if (is_folder(file->type, remote_file)) {
+        // The inode size of a folder says nothing about its contents
+        char *path = construct_filepath(parent_folder, filename);
+        if (path) start_FolderSize(path, remote_file);
+        free(path);
+      } else {
+        cancel_FolderSize();
+        gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesFileSize), size);
+      }
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesLastModified), local_time);
-      gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesOwner), file->owner);
+      gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesOwner), file->owner ? file->owner : "");
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesOwnerPermissions), get_permission_description(permissions, USER_PERMISSIONS));
-      gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesGroup), file->group);
+      gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesGroup), file->group ? file->group : "");
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesGroupPermissions), get_permission_description(permissions, GROUP_PERMISSIONS));
       gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesOthersPermissions), get_permission_description(permissions, OTHERS_PERMISSIONS));
       free(local_time);
       free(size);
       free(permissions);
       gtk_widget_show_all(filePropertiesDialog->FilePropertiesDialog);
+      if (remote_file && downloadCache) {
+        gchar *summary = DownloadCache_summary(downloadCache);
+        gtk_label_set_text(GTK_LABEL(filePropertiesDialog->FilePropertiesDownloadCache), summary);
+        g_free(summary);
+      } else {
+        gtk_widget_hide(filePropertiesDialog->FilePropertiesDownloadCache);
+      }
     }
     free(filename);
   }
 }
 
+void transition_ViewerWindow(const char *filename, const bool remote) {
+  if (remote && !session) return;
+  char *path = construct_filepath(remote ? remote_pwd : local_pwd, filename);
+  if (!path) return;
+  ViewerJob_t *job = calloc(1, sizeof(ViewerJob_t));
+  char *job_path = malloc(strlen(path) + 1);
+  if (!job || !job_path) {
+    free(job);
+    free(job_path);
+    free(path);
+    return;
+  }
+  strcpy(job_path, path);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(viewerWindow->ViewerFollow), FALSE);
+  close_Viewer();
+  free(viewerWindow->path);
+  viewerWindow->path = path;
+  viewerWindow->remote = remote;
+  viewerWindow->start = 0;
+  viewerWindow->end = 0;
+  gtk_label_set_text(GTK_LABEL(viewerWindow->ViewerPath), path);
+  gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(viewerWindow->ViewerText)), "", -1);
+  job->action = VIEWER_OPEN;
+  job->path = job_path;
+  job->remote = remote;
+  start_ViewerJob(job);
+  gtk_widget_show_all(viewerWindow->ViewerWindow);
+  gtk_window_present(GTK_WINDOW(viewerWindow->ViewerWindow));
+}
+
+void transition_SearchWindow() {
+  const bool remote = mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView;
+  const char *pwd = remote ? remote_pwd : local_pwd;
+  if (!searchWindow->root || searchWindow->remote != remote || strcmp(searchWindow->root, pwd) != 0) {
+    char *root = malloc(strlen(pwd) + 1);
+    if (!root) return;
+    strcpy(root, pwd);
+    cancel_Search();
+    gtk_list_store_clear(searchWindow->results);
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchStatus), "");
+    free(searchWindow->root);
+    searchWindow->root = root;
+    searchWindow->remote = remote;
+    gchar *text = g_strdup_printf("Search in %s", root);
+    gtk_label_set_text(GTK_LABEL(searchWindow->SearchFolder), text);
+    g_free(text);
+  }
+  gtk_widget_show_all(searchWindow->SearchWindow);
+  show_IndexStatus();
+  gtk_window_present(GTK_WINDOW(searchWindow->SearchWindow));
+  gtk_widget_grab_focus(searchWindow->SearchEntry);
+}
+
 void show_ContextMenu_buttons(bool file_selected) {
   gboolean selected = (gboolean) file_selected;
   gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->copy), selected && !worker_running);
@@ -442,8 +2565,18 @@ void show_ContextMenu_buttons(bool file_selected) {
   gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->rename), selected && !worker_running);
   gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->create_folder), !selected && !worker_running);
   gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->delete), selected && !worker_running);
-  gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->show_hidden_files), !worker_running);
+  gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->watch_remote),
+                           mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView);
+  gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->shell_delete),
+                           mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView && !worker_running);
   gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->properties), selected);
+  gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->view), selected);
+  gtk_widget_set_sensitive(GTK_WIDGET(mainWindow->contextMenu->edit), selected);
+  // Show the mode of the emitting pane without switching it
+  g_signal_handler_block(mainWindow->contextMenu->details_view, mainWindow->contextMenu->details_view_toggled);
+  gtk_check_menu_item_set_active((GtkCheckMenuItem *) mainWindow->contextMenu->details_view,
+                                 GTK_IS_TREE_VIEW(mainWindow->contextMenu->ContextMenuEmitter));
+  g_signal_handler_unblock(mainWindow->contextMenu->details_view, mainWindow->contextMenu->details_view_toggled);
 }
 
 
@@ -565,6 +2698,9 @@ void OkButton_action(__attribute__((unused)) GtkButton *OkButton) {
   } else if (messageWindow->messageType == ASK_OVERWRITE) {
     close_MessageWindow();
     paste_files_threaded(true);
+  } else if (messageWindow->messageType == ASK_EDIT_CONFLICT) {
+    close_MessageWindow();
+    overwrite_EditConflict();
   }
   else {
     close_MessageWindow();
@@ -574,14 +2710,14 @@ void OkButton_action(__attribute__((unused)) GtkButton *OkButton) {
 gboolean FileView_OnButtonPress(GtkWidget *widget, GdkEvent *event, __attribute__((unused)) gpointer user_data) {
   if (event->type == GDK_2BUTTON_PRESS) {
     GdkEventButton *press = (GdkEventButton *) event;
-    GtkTreePath *path = gtk_icon_view_get_path_at_pos((GtkIconView *) widget, press->x, press->y);
+    GtkTreePath *path = FileView_get_path_at_pos(widget, press->x, press->y);
     if (path) {
       gchar *filename;
       unsigned filetype;
       GtkTreeIter it;
       if (widget == mainWindow->LeftFileView) {
-        gtk_tree_model_get_iter((GtkTreeModel *) localFileStore->listStore, &it, path);
-        gtk_tree_model_get((GtkTreeModel *) localFileStore->listStore, &it,
+        gtk_tree_model_get_iter(localFileStore->filter, &it, path);
+        gtk_tree_model_get(localFileStore->filter, &it,
                                             STRING_COLUMN, &filename,
                                             UINT_COLUMN, &filetype,
                                             -1);
@@ -589,12 +2725,12 @@ gboolean FileView_OnButtonPress(GtkWidget *widget, GdkEvent *event, __attribute_
           // Change directory
           local_pwd = cd_enter_pwd(local_pwd, filename);
           update_FileView(false);
-        }
+        } else transition_ViewerWindow(filename, false);
 
       } else {
         if (worker_running && working_on_remote) return FALSE;
-        gtk_tree_model_get_iter((GtkTreeModel *) remoteFileStore->listStore, &it, path);
-        gtk_tree_model_get((GtkTreeModel *) remoteFileStore->listStore, &it,
+        gtk_tree_model_get_iter(remoteFileStore->filter, &it, path);
+        gtk_tree_model_get(remoteFileStore->filter, &it,
                                             STRING_COLUMN, &filename,
                                             UINT_COLUMN, &filetype,
                                             -1);
@@ -602,7 +2738,7 @@ gboolean FileView_OnButtonPress(GtkWidget *widget, GdkEvent *event, __attribute_
           // Change directory
           remote_pwd = cd_enter_pwd(remote_pwd, filename);
           update_FileView(true);
-        }
+        } else transition_ViewerWindow(filename, true);
       }
 
       g_free(filename);
@@ -623,11 +2759,36 @@ void ContextMenuItem_action(GtkMenuItem *menuItem, __attribute__((unused)) gpoin
     create_folder();
   } else if (menuItem == mainWindow->contextMenu->delete) {
     delete_file_threaded(false);
+  } else if (menuItem == mainWindow->contextMenu->search) {
+    transition_SearchWindow();
   } else if (menuItem == mainWindow->contextMenu->properties) {
     transition_FilePropertiesDialog();
+  } else if (menuItem == mainWindow->contextMenu->view) {
+    gchar *filename = get_selected_filename();
+    if (filename) transition_ViewerWindow(filename, mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView);
+    g_free(filename);
+  } else if (menuItem == mainWindow->contextMenu->edit) {
+    gchar *filename = get_selected_filename();
+    if (filename) transition_Editor(filename, mainWindow->contextMenu->ContextMenuEmitter == mainWindow->RightFileView);
+    g_free(filename);
   }
 }
 
+void SearchButton_action(__attribute__((unused)) GtkButton *SearchButton) {
+  start_Search();
+}
+
+void SearchStopButton_action(__attribute__((unused)) GtkButton *SearchStopButton) {
+  cancel_Search();
+}
+
+void SearchIndexButton_action(__attribute__((unused)) GtkButton *SearchIndexButton) {
+  if (index_job) {
+    cancel_Indexer();
+    show_IndexStatus();
+  } else start_Indexer();
+}
+
 void PopOverDialogCancelButton_action(__attribute__((unused)) GtkButton *PopOverDialogCancelButton) {
   close_PopOverDialog();
 }
@@ -641,12 +2802,13 @@ void PopOverDialogOkButton_action(__attribute__((unused)) GtkButton *PopOverDial
       new_path = construct_filepath(local_pwd, new_name);
       old_path = construct_filepath(local_pwd, popOverDialog->filename);
       result = fs_rename(old_path, new_path);
-      show_FileStore(local_pwd, false);
+      if (result >= 0) FileStore_rename_File(localFileStore, popOverDialog->filename, new_name);
     } else {
+      // The worker reports the result, the session may be busy for a while
       new_path = construct_filepath(remote_pwd, new_name);
       old_path = construct_filepath(remote_pwd, popOverDialog->filename);
-      result = sftp_session_rename_file(session, old_path, new_path);
-      show_FileStore(remote_pwd, true);
+      result = start_remote_worker(RENAME_FILE, old_path, new_path) ? FILE_WRITTEN_SUCCESSFULLY : FILE_WRITE_FAILED;
+      old_path = new_path = NULL;
     }
     free(new_path);
     free(old_path);
@@ -660,11 +2822,12 @@ void PopOverDialogOkButton_action(__attribute__((unused)) GtkButton *PopOverDial
     if (mainWindow->contextMenu->ContextMenuEmitter == mainWindow->LeftFileView) {
       dir_path = construct_filepath(local_pwd, new_name);
       result = fs_mkdir(dir_path, 0);
-      show_FileStore(local_pwd, false);
+      File_t *dir = result >= 0 ? fs_new_File(local_pwd, new_name) : NULL;
+      if (dir) FileStore_put_File(localFileStore, dir);
     } else {
       dir_path = construct_filepath(remote_pwd, new_name);
-      result = sftp_session_mkdir(session, dir_path, 0);
-      show_FileStore(remote_pwd, true);
+      result = start_remote_worker(MAKE_FOLDER, dir_path, NULL) ? FILE_WRITTEN_SUCCESSFULLY : MKDIR_FAILED;
+      dir_path = NULL;
     }
     free(dir_path);
     if (result < 0) {
@@ -695,17 +2858,23 @@ gboolean keypress_handler(GtkWidget *widget, GdkEventKey *event, __attribute__((
     if (widget == mainWindow->LeftFileView) LeftNewFolderButton_action(NULL);
     else RightNewFolderButton_action(NULL);
   }
+  else if ((event->keyval == GDK_KEY_f || event->keyval == GDK_KEY_F) && (event->state & GDK_CONTROL_MASK)) {
+    gtk_widget_grab_focus(widget == mainWindow->LeftFileView ? mainWindow->LeftFilterEntry : mainWindow->RightFilterEntry);
+  }
   else if (event->keyval == GDK_KEY_Return) {
     mainWindow->contextMenu->ContextMenuEmitter = widget;
     char *filename = get_selected_filename();
     if (filename) {
+        // The listed type is enough, no need to stat (remote) files on the UI thread
         if (widget == mainWindow->LeftFileView) {
-          if (fs_is_filename_folder(filename, local_pwd)) {
+          File_t *file = get_FileStore_file(localFileStore, filename);
+          if (file && is_folder(file->type, false)) {
             local_pwd = cd_enter_pwd(local_pwd, filename);
             update_FileView(false);
           }
-        } else if (!worker_running) {
-          if (sftp_session_is_filename_folder(session, filename, remote_pwd)) {
+        } else if (!(worker_running && working_on_remote)) {
+          File_t *file = get_FileStore_file(remoteFileStore, filename);
+          if (file && is_folder(file->type, true)) {
             remote_pwd = cd_enter_pwd(remote_pwd, filename);
             update_FileView(true);
           }
@@ -728,7 +2897,7 @@ gboolean keypress_handler(GtkWidget *widget, GdkEventKey *event, __attribute__((
       }
       return TRUE;
     }
-    else if ((!worker_running) && (event->keyval == GDK_KEY_h || event->keyval == GDK_KEY_H) && (event->state & GDK_CONTROL_MASK)) {
+    else if ((event->keyval == GDK_KEY_h || event->keyval == GDK_KEY_H) && (event->state & GDK_CONTROL_MASK)) {
       // This needs to be done twice to correctly activate the button, WHY?
       for (int i = 0; i < 2; i++) {
         gtk_check_menu_item_toggled((GtkCheckMenuItem *) mainWindow->contextMenu->show_hidden_files);
@@ -754,103 +2923,717 @@ gboolean MainWindow_keypress_handler(GtkWidget *widget, GdkEventKey *event, __at
 }
 
 void toggle_HiddenFiles(__attribute__((unused)) gpointer ptr) {
-  if (!worker_running) {
-    show_hidden_files = !show_hidden_files;
-    show_FileStore(local_pwd, false);
-    show_FileStore(remote_pwd, true);
+  show_hidden_files = !show_hidden_files;
+  gtk_tree_model_filter_refilter((GtkTreeModelFilter *) localFileStore->filter);
+  gtk_tree_model_filter_refilter((GtkTreeModelFilter *) remoteFileStore->filter);
+}
+
+void toggle_RemoteWatch(GtkCheckMenuItem *item, __attribute__((unused)) gpointer ptr) {
+  watch_remote = gtk_check_menu_item_get_active(item) ? true : false;
+  if (watch_remote && !remote_watch_source) {
+    remote_watch_source = g_timeout_add(REMOTE_WATCH_INTERVAL, (GSourceFunc) poll_RemoteWatch, NULL);
+  } else if (!watch_remote && remote_watch_source) {
+    g_source_remove(remote_watch_source);
+    remote_watch_source = 0;
+  }
+}
+
+void toggle_ShellDelete(GtkCheckMenuItem *item, __attribute__((unused)) gpointer ptr) {
+  shell_delete = gtk_check_menu_item_get_active(item) ? true : false;
+  // Atomic, the worker may be holding the session lock
+  if (session) g_atomic_int_set(&session->shell_delete, shell_delete);
+}
+
+gboolean poll_RemoteWatch(__attribute__((unused)) gpointer data) {
+  if (!watch_remote) {
+    remote_watch_source = 0;
+    return FALSE;
+  }
+  // Skip this round if the previous poll or a user request is still running
+  if (remote_watch_polling || !remoteFileStore || remoteFileStore->loading || (worker_running && working_on_remote)) {
+    return TRUE;
   }
+  ListerJob_t *job = calloc(1, sizeof(ListerJob_t));
+  if (!job) return TRUE;
+  job->pwd = malloc(strlen(remote_pwd) + 1);
+  if (!job->pwd) {
+    free_ListerJob_t(job);
+    return TRUE;
+  }
+  strcpy(job->pwd, remote_pwd);
+  job->remote = true;
+  job->watch = true;
+  job->generation = remoteFileStore->generation;
+  job->sort = sort_column;
+  job->descending = sort_descending;
+  if (remote_watch_generation == job->generation) {
+    job->mtime = remote_watch_settled ? remote_watch_mtime : 0;
+  } else {
+    // First poll of this folder, compare against the mtime of the listing
+    File_t *dot = get_FileStore_file(remoteFileStore, ".");
+    job->mtime = dot && dot->has_metadata ? dot->mtime : 0;
+  }
+  pthread_t lister;
+  if (pthread_create(&lister, &list_tattr, init_lister, (void *) job) != 0) {
+    free_ListerJob_t(job);
+    return TRUE;
+  }
+  g_atomic_int_inc(&pending_listers);
+  remote_watch_polling = true;
+  if (!list_source_id) {
+    list_source_id = g_timeout_add(LIST_QUEUE_INTERVAL, (GSourceFunc) check_listQueue, listQueue);
+  }
+  return TRUE;
 }
 
 /*  File handling */
 
-FileStore *update_FileStore(FileStore *fileStore, const char *dir_name, bool remote) {
-  if (!fileStore) {
-    // Create new FileStore
-    fileStore = malloc(sizeof(FileStore));
-    fileStore->listStore = gtk_list_store_new(N_COLUMNS, G_TYPE_STRING, GDK_TYPE_PIXBUF, G_TYPE_UINT);
+/**
+  *   @brief GtkTreeModelFilterVisibleFunc deciding which FileStore rows are displayed
+  *   @param model Child model of the filter, the GtkListStore of the FileStore
+  *   @param it Row to be checked
+  *   @param ptr Pointer to the FileStore
+  *   @return TRUE if the row is displayed
+  */
+static gboolean FileStore_visible(GtkTreeModel *model, GtkTreeIter *it, gpointer ptr) {
+  FileStore *fileStore = (FileStore *) ptr;
+  FileRow *row = NULL;
+  gtk_tree_model_get(model, it, ROW_COLUMN, &row, -1);
+  if (!row || !is_File_displayed(row->file)) return FALSE;
+  return !fileStore->filter_pattern || row->matched == fileStore->filter_applied;
+}
+
+void drop_FileStore_names(FileStore *fileStore) {
+  NameTable_unref(fileStore->names);
+  fileStore->names = NULL;
+  g_hash_table_remove_all(fileStore->added);
+}
+
+void add_FileStore_name(FileStore *fileStore, const char *name) {
+  if (!fileStore->names) return; // The next snapshot will contain it
+  char *copy = malloc(strlen(name) + 1);
+  if (!copy) {
+    drop_FileStore_names(fileStore);
+    return;
+  }
+  strcpy(copy, name);
+  g_hash_table_add(fileStore->added, copy);
+}
+
+/**
+  *   @brief Drop the cached folder sizes an entry change in the displayed folder affects
+  *   @param fileStore FileStore whose entries were added, removed or renamed
+  */
+static void invalidate_FolderSizes(FileStore *fileStore) {
+  SizeCache *sizes = fileStore->remote ? remoteSizes : localSizes;
+  if (sizes) SizeCache_invalidate(sizes, fileStore->remote ? remote_pwd : local_pwd);
+}
+
+FileStore *new_FileStore(GtkWidget *fileView, const bool remote) {
+  FileStore *fileStore = malloc(sizeof(FileStore));
+  if (fileStore) {
+    fileStore->listStore = gtk_list_store_new(N_COLUMNS, G_TYPE_STRING, GDK_TYPE_PIXBUF, G_TYPE_UINT, G_TYPE_POINTER);
     fileStore->files = NULL;
+    fileStore->index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_FileRow);
+    fileStore->generation = 0;
+    fileStore->loading = false;
+    fileStore->fileView = fileView;
+    fileStore->remote = remote;
+    fileStore->pending = NULL;
+    fileStore->fill_source = 0;
+    fileStore->requested = 0;
+    fileStore->names = NULL;
+    fileStore->added = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    fileStore->filter_pattern = NULL;
+    fileStore->filter_fuzzy = false;
+    fileStore->filter_generation = 0;
+    fileStore->filter_applied = 0;
+    fileStore->modified = 0;
+    fileStore->sort_source = 0;
+    // Hidden files keep their rows, the filter only changes which ones are displayed
+    fileStore->filter = gtk_tree_model_filter_new((GtkTreeModel *) fileStore->listStore, NULL);
+    gtk_tree_model_filter_set_visible_func((GtkTreeModelFilter *) fileStore->filter, FileStore_visible,
+                                           (gpointer) fileStore, NULL);
+    FileView_set_model(fileView, fileStore->filter);
+  }
+  return fileStore;
+}
+
+#ifdef FILESTORE_TIMING
+/**
+  *   @brief Log the time since the listing of a FileStore was requested
+  *   @param fileStore FileStore being filled
+  *   @param rows Which rows have been inserted
+  */
+static void log_FileStore_time(const FileStore *fileStore, const char *rows) {
+  g_message("%s listing of %u entries: %s after %.1f ms", fileStore->remote ? "remote" : "local",
+            g_slist_length(fileStore->files), rows, (g_get_monotonic_time() - fileStore->requested) / 1000.0);
+}
+#endif
+
+/**
+  *   @brief Insert at most max entries from fileStore->pending
+  *   @param fileStore FileStore to be filled
+  *   @param max Maximum number of entries to insert
+  */
+static void insert_FileStore_batch(FileStore *fileStore, unsigned max) {
+  for (; fileStore->pending && max > 0; max--) {
+    add_FileStore((File_t *) fileStore->pending->data, (void *) fileStore, fileStore->remote);
+    fileStore->pending = fileStore->pending->next;
+  }
+}
+
+/**
+  *   @brief Insert all entries of fileStore->files to an emptied GtkListStore
+  *   @remark The first batch is inserted at once, the rest in idle callbacks
+  *   @param fileStore FileStore whose files and index are up to date
+  */
+static void refill_FileStore(FileStore *fileStore) {
+  if (fileStore->fill_source) {
+    g_source_remove(fileStore->fill_source);
+    fileStore->fill_source = 0;
   }
+  // Detach the model so that the first batch does not relayout the view per row
+  GtkTreeModel *model = fileStore->filter;
+  g_object_ref(model);
+  FileView_set_model(fileStore->fileView, NULL);
   gtk_list_store_clear(fileStore->listStore);
-  // List all the files
-  fileStore->files = remote ? sftp_session_ls_dir(session, fileStore->files, dir_name)
-                            : ls_dir(fileStore->files, dir_name);
-  if (!fileStore->files) {
-    // Some error happened
-    clear_FileStore(fileStore);
-    return NULL;
+  GHashTableIter it;
+  gpointer row;
+  g_hash_table_iter_init(&it, fileStore->index);
+  while (g_hash_table_iter_next(&it, NULL, &row)) ((FileRow *) row)->shown = false;
+  fileStore->pending = fileStore->files;
+  insert_FileStore_batch(fileStore, FILESTORE_FIRST_BATCH);
+  FileView_set_model(fileStore->fileView, model);
+  g_object_unref(model);
+#ifdef FILESTORE_TIMING
+  log_FileStore_time(fileStore, "first rows");
+  if (!fileStore->pending) log_FileStore_time(fileStore, "last row");
+#endif
+  if (fileStore->pending) fileStore->fill_source = g_idle_add(fill_FileStore, (gpointer) fileStore);
+  schedule_thumbnails();
+}
+
+/* Sorting */
+
+/**
+  *   @brief Move the entries and rows of a FileStore to a sorted order
+  *   @param fileStore FileStore the job was created for, not modified since
+  *   @param job SortJob_t with sorted keys
+  */
+static void apply_FileStore_order(FileStore *fileStore, SortJob_t *job) {
+  unsigned i = 0;
+  while (i < job->count && job->keys[i].position == i) i++;
+  if (i == job->count) return; // Already in order
+  File_t **entries = malloc(job->count * sizeof(File_t *));
+  gint *new_order = malloc(job->count * sizeof(gint));
+  if (!entries || !new_order) goto end;
+  i = 0;
+  for (GSList *node = fileStore->files; node; node = node->next) entries[i++] = (File_t *) node->data;
+  GSList *node = fileStore->files;
+  for (i = 0; i < job->count; i++, node = node->next) {
+    node->data = entries[job->keys[i].position];
+    new_order[i] = (gint) job->keys[i].position;
   }
-  // Append all entries
-  iterate_FileList(fileStore->files, add_FileStore, (void *) fileStore, remote);
-  return fileStore;
+  fileStore->modified++;
+  if (fileStore->pending) {
+    // Rows inserted so far are in the old order
+    refill_FileStore(fileStore);
+  } else {
+    // Rows keep their selection and the filter follows the reorder
+    gtk_list_store_reorder(fileStore->listStore, new_order);
+    schedule_thumbnails(); // Other images may have moved into view
+  }
+
+  end:
+    free(entries);
+    free(new_order);
 }
 
-void add_FileStore(struct File *file, void *ptr, const bool remote) {
-    FileStore *fileStore = (FileStore *) ptr;
-    if ((strcmp(file->name, ".") != 0) && (strcmp(file->name, "..") != 0)) {
-      if (show_hidden_files || (file->name[0] != '.')) {
-        gtk_list_store_append(fileStore->listStore, &(fileStore->it));
-        gtk_list_store_set( fileStore->listStore, &(fileStore->it),
-                            STRING_COLUMN, (GValue *) file->name,
-                            PIXBUF_COLUMN, (GValue *) get_Icon_filetype(file->type, remote),
-                            UINT_COLUMN, file->type,
-                            -1);
-      }
+/**
+  *   @brief Timeout source of schedule_sort
+  *   @param ptr Pointer to the FileStore
+  *   @return FALSE, runs once
+  */
+static gboolean sort_FileStore_source(gpointer ptr) {
+  FileStore *fileStore = (FileStore *) ptr;
+  fileStore->sort_source = 0;
+  sort_FileStore(fileStore);
+  return FALSE;
+}
+
+void sort_FileStore(FileStore *fileStore) {
+  if (fileStore->sort_source) {
+    g_source_remove(fileStore->sort_source);
+    fileStore->sort_source = 0;
+  }
+  const unsigned count = g_slist_length(fileStore->files);
+  if (count < 2) return;
+  if (!fileStore->remote && sort_needs_metadata(sort_column)) {
+    unsigned missing = 0;
+    for (GSList *node = fileStore->files; node; node = node->next) {
+      if (!((File_t *) node->data)->has_metadata) missing++;
+    }
+    if (missing > SORT_FILL_MAX) {
+      // The lister fills the metadata and sorts
+      show_FileStore(local_pwd, false);
+      return;
     }
+    for (GSList *node = fileStore->files; node; node = node->next) {
+      File_t *file = (File_t *) node->data;
+      if (!file->has_metadata) fs_fill_File(file, local_pwd);
+    }
+  }
+  SortJob_t *job = calloc(1, sizeof(SortJob_t));
+  if (!job) return;
+  size_t len = 0;
+  for (GSList *node = fileStore->files; node; node = node->next) {
+    File_t *file = (File_t *) node->data;
+    fs_collate_File(file);
+    len += strlen(file->name) + strlen(file->collate_key) + 2;
+  }
+  // The thread sorts copies, entries may change meanwhile
+  job->keys = malloc(count * sizeof(SortKey));
+  job->strings = malloc(len);
+  if (!job->keys || !job->strings) goto error;
+  char *pos = job->strings;
+  unsigned i = 0;
+  for (GSList *node = fileStore->files; node; node = node->next, i++) {
+    const File_t *file = (const File_t *) node->data;
+    SortKey *key = &(job->keys[i]);
+    key->name = strcpy(pos, file->name);
+    pos += strlen(file->name) + 1;
+    key->collate_key = strcpy(pos, file->collate_key);
+    pos += strlen(file->collate_key) + 1;
+    key->size = file->size;
+    key->mtime = file->mtime;
+    key->folder = is_folder(file->type, fileStore->remote);
+    key->position = i;
+  }
+  job->count = count;
+  job->column = sort_column;
+  job->descending = sort_descending;
+  job->remote = fileStore->remote;
+  job->modified = fileStore->modified;
+  if (count < SORT_THREAD_MIN) {
+    sort_SortKeys(job->keys, job->count, job->column, job->descending);
+    apply_FileStore_order(fileStore, job);
+    free_SortJob_t(job);
+    return;
+  }
+  pthread_t sorter;
+  if (pthread_create(&sorter, &list_tattr, init_sorter, (void *) job) != 0) goto error;
+  g_atomic_int_inc(&pending_sorts);
+  if (!sort_source_id) {
+    sort_source_id = g_timeout_add(LIST_QUEUE_INTERVAL, (GSourceFunc) check_sortQueue, sortQueue);
+  }
+  return;
+
+  error:
+    free_SortJob_t(job);
+}
+
+void schedule_sort(FileStore *fileStore) {
+  if (fileStore->sort_source) g_source_remove(fileStore->sort_source);
+  fileStore->sort_source = g_timeout_add(SORT_DELAY, sort_FileStore_source, (gpointer) fileStore);
+}
+
+void *init_sorter(void *ptr) {
+  SortJob_t *job = (SortJob_t *) ptr;
+  sort_SortKeys(job->keys, job->count, job->column, job->descending);
+  g_async_queue_push(sortQueue, job);
+  pthread_exit(NULL);
+}
+
+gboolean check_sortQueue(gpointer user_data) {
+  SortJob_t *job;
+  while ((job = (SortJob_t *) g_async_queue_try_pop((GAsyncQueue *) user_data))) {
+    g_atomic_int_dec_and_test(&pending_sorts);
+    FileStore *fileStore = job->remote ? remoteFileStore : localFileStore;
+    // A newer request for the current order is already running
+    if (!fileStore || job->column != sort_column || job->descending != sort_descending) {
+      free_SortJob_t(job);
+      continue;
+    }
+    if (job->modified != fileStore->modified) {
+      // Entries changed while sorting, the positions are outdated
+      schedule_sort(fileStore);
+    } else {
+      apply_FileStore_order(fileStore, job);
+    }
+    free_SortJob_t(job);
+  }
+  if (g_atomic_int_get(&pending_sorts) == 0) {
+    sort_source_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void SortMenuItem_toggled(GtkCheckMenuItem *item, gpointer column) {
+  // The item which was deactivated emits too
+  if (!gtk_check_menu_item_get_active(item)) return;
+  sort_column = (enum SortColumn) GPOINTER_TO_INT(column);
+  update_DetailsView_headers();
+  if (localFileStore) sort_FileStore(localFileStore);
+  if (remoteFileStore) sort_FileStore(remoteFileStore);
+}
+
+void toggle_SortDescending(GtkCheckMenuItem *item, __attribute__((unused)) gpointer ptr) {
+  sort_descending = gtk_check_menu_item_get_active(item) ? true : false;
+  update_DetailsView_headers();
+  if (localFileStore) sort_FileStore(localFileStore);
+  if (remoteFileStore) sort_FileStore(remoteFileStore);
+}
+
+/* Listing updates */
+
+void update_FileStore(FileStore *fileStore, GSList *files) {
+  // Rows still reference the old entries, but nothing reads them before refill_FileStore clears them
+  g_hash_table_remove_all(fileStore->index); // Keys are owned by the Files
+  clear_Filelist(fileStore->files);
+  // Local metadata is filled on demand (@see transition_FilePropertiesDialog)
+  fileStore->files = files;
+  fileStore->modified++;
+  for (GSList *node = files; node; node = node->next) {
+    FileRow *row = calloc(1, sizeof(FileRow));
+    if (!row) continue;
+    row->file = (File_t *) node->data;
+    g_hash_table_insert(fileStore->index, row->file->name, row);
+  }
+  refill_FileStore(fileStore);
+  drop_FileStore_names(fileStore);
+  // The same directory was listed again, keep it filtered
+  if (fileStore->filter_pattern) filter_FileStore(fileStore, fileStore->filter_pattern);
+}
+
+gboolean fill_FileStore(gpointer ptr) {
+  FileStore *fileStore = (FileStore *) ptr;
+  insert_FileStore_batch(fileStore, FILESTORE_BATCH);
+  if (fileStore->pending) return TRUE;
+  fileStore->fill_source = 0;
+#ifdef FILESTORE_TIMING
+  log_FileStore_time(fileStore, "last row");
+#endif
+  return FALSE;
+}
+
+/**
+  *   @brief Insert a row for an entry of FileStore files
+  *   @param fileStore FileStore containing the entry
+  *   @param file Entry
+  *   @param position Position of the row, -1 appends
+  */
+static void insert_FileStore_row(FileStore *fileStore, File_t *file, const gint position) {
+  FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, file->name);
+  GtkTreeIter *it = row ? &(row->it) : &(fileStore->it);
+  gtk_list_store_insert_with_values(fileStore->listStore, it, position,
+                                    STRING_COLUMN, (GValue *) file->name,
+                                    PIXBUF_COLUMN, (GValue *) get_FileRow_icon(row, file, fileStore->remote, ICON_SIZE),
+                                    UINT_COLUMN, file->type,
+                                    ROW_COLUMN, (gpointer) row,
+                                    -1);
+  if (row) row->shown = true;
+}
+
+void add_FileStore(struct File *file, void *ptr, __attribute__((unused)) const bool remote) {
+  insert_FileStore_row((FileStore *) ptr, file, -1);
+}
+
+void complete_FileStore_fill(FileStore *fileStore) {
+  if (fileStore->fill_source) {
+    g_source_remove(fileStore->fill_source);
+    fileStore->fill_source = 0;
+    insert_FileStore_batch(fileStore, G_MAXUINT);
+  }
+}
+
+void FileStore_add_File(FileStore *fileStore, File_t *file) {
+  FileRow *row = calloc(1, sizeof(FileRow));
+  if (!row) {
+    free_File(file);
+    return;
+  }
+  row->file = file;
+  if (fileStore->filter_pattern && name_matches(file->name, fileStore->filter_pattern, fileStore->filter_fuzzy)) {
+    row->matched = fileStore->filter_applied;
+  }
+  fs_collate_File(file);
+  // Rows stay in the order of files, the entry is moved to its place by schedule_sort
+  fileStore->files = g_slist_prepend(fileStore->files, file);
+  g_hash_table_insert(fileStore->index, file->name, row);
+  fileStore->modified++;
+  add_FileStore_name(fileStore, file->name);
+  invalidate_FolderSizes(fileStore);
+  insert_FileStore_row(fileStore, file, 0);
+  schedule_sort(fileStore);
+}
+
+void FileStore_remove_Files(FileStore *fileStore, GHashTable *names) {
+  const unsigned modified = fileStore->modified;
+  GSList **link = &(fileStore->files);
+  while (*link) {
+    GSList *node = *link;
+    File_t *file = (File_t *) node->data;
+    if (g_hash_table_contains(names, file->name)) {
+      FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, file->name);
+      if (row && row->shown) gtk_list_store_remove(fileStore->listStore, &(row->it));
+      g_hash_table_remove(fileStore->index, file->name);
+      *link = node->next;
+      g_slist_free_1(node);
+      free_File(file);
+      fileStore->modified++;
+    } else {
+      link = &(node->next);
+    }
+  }
+  if (fileStore->modified != modified) invalidate_FolderSizes(fileStore);
+}
+
+void FileStore_update_row(FileStore *fileStore, FileRow *row) {
+  row->content_type = NULL; // The type may have changed
+  drop_FileRow_thumbnail(row);
+  if (row->shown) {
+    gtk_list_store_set(fileStore->listStore, &(row->it),
+                       PIXBUF_COLUMN, (GValue *) get_FileRow_icon(row, row->file, fileStore->remote, ICON_SIZE),
+                       UINT_COLUMN, row->file->type,
+                       -1);
+  }
 }
 
 void clear_FileStore(FileStore *fileStore) {
   if (fileStore) {
+    if (fileStore->fill_source) g_source_remove(fileStore->fill_source);
+    if (fileStore->sort_source) g_source_remove(fileStore->sort_source);
+    if (fileStore->names) g_atomic_int_inc(&fileStore->names->generation);
+    drop_FileStore_names(fileStore);
+    g_hash_table_destroy(fileStore->added);
+    if (fileStore->filter_pattern) free(fileStore->filter_pattern);
+    g_hash_table_destroy(fileStore->index);
     gtk_list_store_clear(fileStore->listStore);
+    g_object_unref(fileStore->filter);
     clear_Filelist(fileStore->files);
     free(fileStore);
   }
 }
 
 int show_FileStore(const char *pwd, const bool remote) {
-  if (remote) {
-    if ((remoteFileStore = update_FileStore(remoteFileStore, pwd, true)) != NULL) {
-      gtk_icon_view_set_model((GtkIconView *) mainWindow->RightFileView, (GtkTreeModel *) remoteFileStore->listStore);
-      gtk_icon_view_set_text_column((GtkIconView *) mainWindow->RightFileView, STRING_COLUMN);
-      gtk_icon_view_set_pixbuf_column((GtkIconView *) mainWindow->RightFileView, PIXBUF_COLUMN);
-      gtk_widget_show_all(mainWindow->TopWindow);
-      gtk_widget_hide(mainWindow->LeftStopButton);
-      gtk_widget_hide(mainWindow->RightStopButton);
-    } else {
-      Session_message(session, get_error(ERROR_DISPLAYING_REMOTE_FILES));
-      transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
-      return -1;
-    }
-  } else {
-    if ((localFileStore = update_FileStore(localFileStore, pwd, false)) != NULL) {
-      gtk_icon_view_set_model((GtkIconView *) mainWindow->LeftFileView, (GtkTreeModel *) localFileStore->listStore);
-      gtk_icon_view_set_text_column((GtkIconView *) mainWindow->LeftFileView, STRING_COLUMN);
-      gtk_icon_view_set_pixbuf_column((GtkIconView *) mainWindow->LeftFileView, PIXBUF_COLUMN);
-      gtk_widget_show_all(mainWindow->TopWindow);
-      gtk_widget_hide(mainWindow->LeftStopButton);
-      gtk_widget_hide(mainWindow->RightStopButton);
-    } else {
-      Session_message(session, get_error(ERROR_DISPLAYING_LOCAL_FILES));
-      transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
-      return -1;
+  FileStore *fileStore = remote ? remoteFileStore : localFileStore;
+  ListerJob_t *job = fileStore ? calloc(1, sizeof(ListerJob_t)) : NULL;
+  if (!job) goto error;
+  job->pwd = malloc(strlen(pwd) + 1);
+  if (!job->pwd) goto error;
+  strcpy(job->pwd, pwd);
+  job->remote = remote;
+  job->generation = ++fileStore->generation;
+  job->sort = sort_column;
+  job->descending = sort_descending;
+  fileStore->requested = g_get_monotonic_time();
+  if (remote) g_atomic_int_set(&prefetch_generation, fileStore->generation);
+  else watch_local_dir(pwd);
+  if (remote && remoteCache) {
+    // Show a cached listing at once, fresh ones need no round trip at all
+    enum CacheState state = ListingCache_lookup(remoteCache, pwd, &job->files);
+    if (state != CACHE_MISS) {
+      display_FileStore(job);
+      if (state == CACHE_FRESH) {
+        free_ListerJob_t(job);
+        fileStore->loading = false;
+        if (!worker_running) gtk_spinner_stop(GTK_SPINNER(mainWindow->RightSpinner));
+        return 0;
+      }
+      job->validate = true;
     }
   }
+  pthread_t lister;
+  if (pthread_create(&lister, &list_tattr, init_lister, (void *) job) != 0) goto error;
+  g_atomic_int_inc(&pending_listers);
+  fileStore->loading = true;
+  gtk_spinner_start(GTK_SPINNER(remote ? mainWindow->RightSpinner : mainWindow->LeftSpinner));
+  if (!list_source_id) {
+    list_source_id = g_timeout_add(LIST_QUEUE_INTERVAL, (GSourceFunc) check_listQueue, listQueue);
+  }
   return 0;
+
+  error:
+    free_ListerJob_t(job);
+    Session_message(session, get_error(remote ? ERROR_DISPLAYING_REMOTE_FILES : ERROR_DISPLAYING_LOCAL_FILES));
+    transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
+    return -1;
+}
+
+void display_FileStore(ListerJob_t *job) {
+  FileStore *fileStore = job->remote ? remoteFileStore : localFileStore;
+  GtkWidget *label = job->remote ? mainWindow->RightInnerFrameLabel : mainWindow->LeftInnerFrameLabel;
+  if (fileStore->filter_pattern && strcmp(gtk_label_get_text((GtkLabel *) label), job->pwd) != 0) {
+    // A filter applies only to the directory it was typed in
+    filter_FileStore(fileStore, NULL);
+    gtk_entry_set_text((GtkEntry *) (job->remote ? mainWindow->RightFilterEntry : mainWindow->LeftFilterEntry), "");
+  }
+  gtk_label_set_text((GtkLabel *) label, job->pwd);
+  update_FileStore(fileStore, job->files);
+  if (!job->files) {
+    Session_message(session, get_error(job->remote ? ERROR_DISPLAYING_REMOTE_FILES : ERROR_DISPLAYING_LOCAL_FILES));
+    transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
+    return;
+  }
+  job->files = NULL; // Owned by fileStore
+  // Cached listings may be in another order
+  if (!job->sorted || job->sort != sort_column || job->descending != sort_descending) sort_FileStore(fileStore);
+  if (job->remote) schedule_prefetch();
+  gtk_widget_show_all(mainWindow->TopWindow);
+  gtk_widget_hide(mainWindow->LeftStopButton);
+  gtk_widget_hide(mainWindow->RightStopButton);
 }
 
 void update_FileView(bool remote) {
-  if (remote) {
-    if (show_FileStore(remote_pwd, true) == 0) {
-      gtk_label_set_text((GtkLabel *) mainWindow->RightInnerFrameLabel, remote_pwd);
+  show_FileStore(remote ? remote_pwd : local_pwd, remote);
+}
+
+void invalidate_remote_path(const char *path) {
+  if (!remoteCache) return;
+  char *parent = malloc(strlen(path) + 1);
+  if (parent) {
+    strcpy(parent, path);
+    ListingCache_invalidate(remoteCache, cd_back_pwd(parent), false);
+    free(parent);
+  }
+  ListingCache_invalidate(remoteCache, path, true);
+}
+
+/**
+  *   @brief Move metadata of a newer listing entry to an existing entry
+  *   @param file Existing entry, keeps its name
+  *   @param update Newer entry of the same name, its owner and group are taken
+  */
+static void update_File_metadata(File_t *file, File_t *update) {
+  file->size = update->size;
+  file->uid = update->uid;
+  file->gid = update->gid;
+  file->permissions = update->permissions;
+  file->mtime = update->mtime;
+  file->has_metadata = update->has_metadata;
+  char *owner = file->owner, *group = file->group;
+  file->owner = update->owner;
+  file->group = update->group;
+  update->owner = owner;
+  update->group = group;
+}
+
+unsigned apply_FileStore_diff(FileStore *fileStore, GSList *files) {
+  unsigned changes = 0;
+  bool resort = false; // Whether a size or mtime the rows are sorted by changed
+  complete_FileStore_fill(fileStore);
+  GHashTable *listed = g_hash_table_new(g_str_hash, g_str_equal);
+  for (GSList *node = files; node; node = node->next) {
+    File_t *file = (File_t *) node->data;
+    g_hash_table_add(listed, file->name);
+    FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, file->name);
+    if (row) {
+      const bool modified = row->file->mtime != file->mtime;
+      if (modified || row->file->size != file->size) resort = true;
+      update_File_metadata(row->file, file);
+      if (row->file->type != file->type) {
+        row->file->type = file->type;
+        FileStore_update_row(fileStore, row);
+        changes++;
+      } else if (modified && (row->thumbnail || row->thumb_failed)) {
+        FileStore_update_row(fileStore, row); // Outdated thumbnail
+      }
     } else {
-      transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
+      FileStore_add_File(fileStore, file);
+      node->data = NULL; // Owned by fileStore
+      changes++;
     }
-  } else {
-    if (show_FileStore(local_pwd, false) == 0) {
-      gtk_label_set_text((GtkLabel *) mainWindow->LeftInnerFrameLabel, local_pwd);
-    } else {
-      transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
+  }
+  GHashTable *removed = g_hash_table_new(g_str_hash, g_str_equal);
+  for (GSList *node = fileStore->files; node; node = node->next) {
+    const char *name = ((File_t *) node->data)->name;
+    if (!g_hash_table_contains(listed, name)) {
+      g_hash_table_add(removed, (gpointer) name);
+      changes++;
     }
   }
+  FileStore_remove_Files(fileStore, removed);
+  g_hash_table_destroy(removed);
+  g_hash_table_destroy(listed);
+  clear_Filelist(files);
+  // Updated metadata or types may move entries, an unchanged listing moves none
+  if (changes || (resort && sort_needs_metadata(sort_column))) schedule_sort(fileStore);
+  return changes;
+}
+
+void FileStore_put_File(FileStore *fileStore, File_t *file) {
+  complete_FileStore_fill(fileStore);
+  FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, file->name);
+  if (!row) {
+    FileStore_add_File(fileStore, file);
+    return;
+  }
+  update_File_metadata(row->file, file);
+  if (row->file->type != file->type) {
+    row->file->type = file->type;
+    FileStore_update_row(fileStore, row);
+    schedule_sort(fileStore);
+  } else {
+    // Entries are put when they are written, a thumbnail would be outdated
+    if (row->thumbnail || row->thumb_failed) FileStore_update_row(fileStore, row);
+    if (sort_needs_metadata(sort_column)) schedule_sort(fileStore);
+  }
+  free_File(file);
+}
+
+void FileStore_remove_File(FileStore *fileStore, const char *name) {
+  complete_FileStore_fill(fileStore);
+  GHashTable *names = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_add(names, (gpointer) name);
+  FileStore_remove_Files(fileStore, names);
+  g_hash_table_destroy(names);
+}
+
+void FileStore_rename_File(FileStore *fileStore, const char *old_name, const char *new_name) {
+  complete_FileStore_fill(fileStore);
+  FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, old_name);
+  if (!row || strcmp(old_name, new_name) == 0) return;
+  char *name = malloc(strlen(new_name) + 1);
+  if (!name) return;
+  strcpy(name, new_name);
+  FileStore_remove_File(fileStore, new_name); // Replaced entry
+  // The index key is the name of the File
+  g_hash_table_steal(fileStore->index, old_name);
+  free(row->file->name);
+  row->file->name = name;
+  g_free(row->file->collate_key);
+  row->file->collate_key = NULL;
+  fs_collate_File(row->file);
+  g_hash_table_insert(fileStore->index, name, row);
+  fileStore->modified++;
+  add_FileStore_name(fileStore, name);
+  invalidate_FolderSizes(fileStore);
+  if (fileStore->filter_pattern) {
+    row->matched = name_matches(name, fileStore->filter_pattern, fileStore->filter_fuzzy) ? fileStore->filter_applied : 0;
+  }
+  row->content_type = NULL; // The extension may have changed
+  drop_FileRow_thumbnail(row); // Thumbnails are cached by path
+  // The filter re-evaluates the row, a rename may hide or reveal it
+  if (row->shown) {
+    gtk_list_store_set(fileStore->listStore, &(row->it), STRING_COLUMN, (GValue *) name,
+                       PIXBUF_COLUMN, (GValue *) get_FileRow_icon(row, row->file, fileStore->remote, ICON_SIZE), -1);
+  }
+  schedule_sort(fileStore);
+}
+
+FileStore *get_pwd_FileStore(const char *pwd, const bool remote) {
+  FileStore *fileStore = remote ? remoteFileStore : localFileStore;
+  const char *pane_pwd = remote ? remote_pwd : local_pwd;
+  if (!fileStore || !pane_pwd || strcmp(pane_pwd, pwd) != 0) return NULL;
+  return fileStore;
+}
+
+File_t *get_FileStore_file(FileStore *fileStore, const char *filename) {
+  if (!fileStore) return NULL;
+  FileRow *row = (FileRow *) g_hash_table_lookup(fileStore->index, filename);
+  return row ? row->file : NULL;
 }
 
 void rename_file() {
@@ -863,7 +3646,7 @@ void rename_file() {
     strcat(popOverDialog->message, (const char *) filename);
     gtk_label_set_text(GTK_LABEL(popOverDialog->PopOverDialogLabel), popOverDialog->message);
   }
-  popOverDialog->filename = malloc(strlen((const char *) filename));
+  popOverDialog->filename = malloc(strlen((const char *) filename) + 1);
   strcpy(popOverDialog->filename, (const char *) filename);
   g_free(filename);
   gtk_widget_show_all(popOverDialog->PopOverDialog);
@@ -892,7 +3675,7 @@ void delete_file_threaded(bool finalize) {
       g_free(filename);
       return;
     }
-     worker_data = malloc(sizeof(WorkerThread_t));
+    worker_data = calloc(1, sizeof(WorkerThread_t));
     if (!worker_data) goto error;
     const char *pwd;
     if (mainWindow->contextMenu->ContextMenuEmitter == mainWindow->LeftFileView) {
@@ -904,10 +3687,10 @@ void delete_file_threaded(bool finalize) {
     }
     char *path = construct_filepath(pwd, filename);
     if (!path) goto error;
+    worker_data->filepath = path;
     worker_data->pwd = malloc(strlen(pwd) + 1);
     if (!worker_data->pwd) goto error;
     strcpy(worker_data->pwd, pwd);
-    worker_data->filepath = path;
     worker_data->workType = DELETE_FILES;
     worker_data->fileCopies = NULL;
     worker_data->overwrite = false;
@@ -936,35 +3719,8 @@ void delete_file_threaded(bool finalize) {
 }
 
 void delete_file(bool finalize) {
-  gchar *filename = get_selected_filename();
-  if (finalize) {
-    // Delete files permanently
-    char *path;
-    if (mainWindow->contextMenu->ContextMenuEmitter == mainWindow->LeftFileView) {
-      path = construct_filepath(local_pwd, filename);
-      if (remove_completely(path) < 0) {
-        Session_message(session, get_error(ERROR_DELETE_FILE));
-        transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
-      }
-      show_FileStore(local_pwd, false);
-    } else {
-      path = construct_filepath(remote_pwd, filename);
-      if (sftp_session_remove_completely_file(session, path) < 0) {
-        transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
-      }
-      show_FileStore(remote_pwd, true);
-    }
-    free(path);
-  } else {
-    // Just show a prompt whether to delete files
-    char *msg = malloc(strlen(DELETE_PROMPT_MSG) + strlen((const char *) filename) + 1);
-    strcpy(msg, DELETE_PROMPT_MSG);
-    strcat(msg, (const char *) filename);
-    Session_message(session, msg);
-    free(msg);
-    transition_MessageWindow(ASK_DELETE, session->message);
-  }
-  g_free(filename);
+  // Removing a tree may take long, so it is never done on the main thread
+  delete_file_threaded(finalize);
 }
 
 // Currently works only for a single file
@@ -1004,7 +3760,7 @@ void paste_files_threaded(const bool overwrite) {
   WorkerThread_t *worker_data = NULL;
   const char *pwd;
   if (fileCopies) {
-    worker_data = malloc(sizeof(WorkerThread_t));
+    worker_data = calloc(1, sizeof(WorkerThread_t));
     if (worker_data) {
       if (mainWindow->contextMenu->ContextMenuEmitter == mainWindow->LeftFileView) {
         pwd = local_pwd;
@@ -1034,7 +3790,7 @@ void paste_files_threaded(const bool overwrite) {
       if (worker_data->pwd) free(worker_data->pwd);
       if (worker_data->fileCopies) clear_FileCopyList(worker_data->fileCopies);
       free(worker_data);
-      Session_message(session, get_error(FILE_COPY_FAILED));
+      Session_message(session, get_error(ERROR_FILE_COPY_FAILED));
       transition_MessageWindow(MESSAGETYPE_ERROR, session->message);
     }
 }
@@ -1103,15 +3859,15 @@ int paste_file( const FileCopy_t *fileCopy,
 
 gchar *get_selected_filename() {
   gchar *filename = NULL;
-  GList *selected = gtk_icon_view_get_selected_items(GTK_ICON_VIEW(mainWindow->contextMenu->ContextMenuEmitter));
+  GList *selected = FileView_get_selected_items(mainWindow->contextMenu->ContextMenuEmitter);
   if (!selected) return NULL;
   if (mainWindow->contextMenu->ContextMenuEmitter == mainWindow->LeftFileView) {
-    gtk_tree_model_get_iter(GTK_TREE_MODEL(localFileStore->listStore), &(localFileStore->it), selected->data);
-    gtk_tree_model_get(GTK_TREE_MODEL(localFileStore->listStore), &(localFileStore->it), STRING_COLUMN, &filename, -1);
+    gtk_tree_model_get_iter(localFileStore->filter, &(localFileStore->it), selected->data);
+    gtk_tree_model_get(localFileStore->filter, &(localFileStore->it), STRING_COLUMN, &filename, -1);
 
   } else {
-    gtk_tree_model_get_iter(GTK_TREE_MODEL(remoteFileStore->listStore), &(remoteFileStore->it), selected->data);
-    gtk_tree_model_get(GTK_TREE_MODEL(remoteFileStore->listStore), &(remoteFileStore->it), STRING_COLUMN, &filename, -1);
+    gtk_tree_model_get_iter(remoteFileStore->filter, &(remoteFileStore->it), selected->data);
+    gtk_tree_model_get(remoteFileStore->filter, &(remoteFileStore->it), STRING_COLUMN, &filename, -1);
   }
   g_list_free_full(selected, (GDestroyNotify) gtk_tree_path_free);
   return filename;
@@ -11,18 +11,53 @@ GdkPixbuf* iconImages[2] = {0};
 char *local_pwd = NULL;
 char *remote_pwd = NULL;
 volatile sig_atomic_t stop = 0;
+static GHashTable *contentTypes = NULL; /**< Extension -> interned content type */
+static GHashTable *iconCache = NULL; /**< IconKey -> GdkPixbuf, loaded on demand */
+
+/**
+  *   @struct IconKey
+  *   @brief Key of iconCache
+  */
+typedef struct {
+  const char *content_type; /**< Interned content type */
+  int size; /**< Icon size in pixels */
+} IconKey;
+
+/**
+  *   @brief Hash IconKey, content types are interned
+  */
+static guint IconKey_hash(gconstpointer key) {
+  const IconKey *icon = (const IconKey *) key;
+  return g_direct_hash(icon->content_type) ^ (guint) icon->size;
+}
+
+/**
+  *   @brief Compare IconKeys
+  */
+static gboolean IconKey_equal(gconstpointer a, gconstpointer b) {
+  const IconKey *icon_a = (const IconKey *) a;
+  const IconKey *icon_b = (const IconKey *) b;
+  return icon_a->content_type == icon_b->content_type && icon_a->size == icon_b->size;
+}
+
+/**
+  *   @brief Release a cached icon
+  */
+static void unref_icon(gpointer icon) {
+  if (icon) g_object_unref(icon);
+}
 
 bool init_assets() {
   GError *error = NULL;
   GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-  iconImages[FILE_ICON] = gtk_icon_theme_load_icon(icon_theme, "text-x-generic", 48, 0, &error);
+  iconImages[FILE_ICON] = gtk_icon_theme_load_icon(icon_theme, "text-x-generic", ICON_SIZE, 0, &error);
   if (!iconImages[FILE_ICON]) {
     iconImages[FILE_ICON] = NULL;
     fprintf(stderr, "Asset loading error: %s\n", error->message);
     g_error_free(error);
     return false;
   }
-  iconImages[FOLDER_ICON] = gtk_icon_theme_load_icon(icon_theme, "folder", 48, 0, &error);
+  iconImages[FOLDER_ICON] = gtk_icon_theme_load_icon(icon_theme, "folder", ICON_SIZE, 0, &error);
   if (!iconImages[FOLDER_ICON]) {
     fprintf(stderr, "Asset loading error: %s\n", error->message);
     g_error_free(error);
@@ -38,6 +73,67 @@ void clear_assets() {
   if (remote_pwd) free(remote_pwd);
   if (iconImages[FILE_ICON]) g_object_unref(iconImages[FILE_ICON]);
   if (iconImages[FOLDER_ICON]) g_object_unref(iconImages[FOLDER_ICON]);
+  if (contentTypes) g_hash_table_destroy(contentTypes);
+  if (iconCache) g_hash_table_destroy(iconCache);
+  contentTypes = NULL;
+  iconCache = NULL;
+}
+
+const char *get_content_type(const char *name, const uint8_t file_type, const bool remote) {
+  if (is_folder(file_type, remote)) return FOLDER_CONTENT_TYPE;
+  const char *base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  const char *extension = strrchr(base, '.');
+  // Names without an extension (Makefile, README) are matched as a whole and not cached, neither are names
+  // with more dots (b.tar.gz) whose type may come from a longer suffix than the one the cache is keyed by
+  const bool cached = extension && extension != base && strchr(base + 1, '.') == extension &&
+                      strlen(extension) <= CONTENT_TYPE_MAX_EXTENSION;
+  if (cached && contentTypes) {
+    const char *content_type = (const char *) g_hash_table_lookup(contentTypes, extension);
+    if (content_type) return content_type;
+  }
+  gchar *guess = g_content_type_guess(base, NULL, 0, NULL);
+  const char *content_type = g_intern_string(guess ? guess : UNKNOWN_CONTENT_TYPE);
+  g_free(guess);
+  if (cached) {
+    if (!contentTypes) contentTypes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_insert(contentTypes, g_strdup(extension), (gpointer) content_type);
+  }
+  return content_type;
+}
+
+const GdkPixbuf *get_Icon_content_type(const char *content_type, const int size) {
+  IconKey key = { content_type, size };
+  gpointer icon = NULL;
+  if (iconCache && g_hash_table_lookup_extended(iconCache, &key, NULL, &icon)) return (const GdkPixbuf *) icon;
+  GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+  GIcon *gicon = g_content_type_get_icon(content_type);
+  if (gicon) {
+    // The GIcon lists the specific icon name first and generic ones after it
+    GtkIconInfo *info = gtk_icon_theme_lookup_by_gicon(icon_theme, gicon, size,
+                                                       GTK_ICON_LOOKUP_FORCE_SIZE | GTK_ICON_LOOKUP_GENERIC_FALLBACK);
+    if (info) {
+      icon = gtk_icon_info_load_icon(info, NULL);
+      g_object_unref(info);
+    }
+    g_object_unref(gicon);
+  }
+  if (!icon) {
+    const bool folder = strcmp(content_type, FOLDER_CONTENT_TYPE) == 0;
+    icon = gtk_icon_theme_load_icon(icon_theme, folder ? "folder" : "text-x-generic", size, GTK_ICON_LOOKUP_FORCE_SIZE,
+                                    NULL);
+  }
+  // Failures are cached too, the theme is not searched again for the same icon
+  if (!iconCache) iconCache = g_hash_table_new_full(IconKey_hash, IconKey_equal, free, unref_icon);
+  IconKey *cached = malloc(sizeof(IconKey));
+  if (cached) {
+    *cached = key;
+    g_hash_table_insert(iconCache, cached, icon);
+  } else if (icon) {
+    g_object_unref(icon);
+    icon = NULL;
+  }
+  return (const GdkPixbuf *) icon;
 }
 
 void load_css_styles() {
@@ -0,0 +1,292 @@
+/**
+  *   @file cache.c
+  *   @author Lauri Westerholm
+  *   @brief Cache for remote directory listings
+  */
+
+#include "../include/cache.h"
+
+/**
+  *   @struct CacheEntry
+  *   @brief One cached listing
+  */
+typedef struct {
+  GSList *files; /**< Cached listing */
+  uint64_t mtime; /**< Directory mtime from the "." entry when fetched, 0 if unknown */
+  gint64 fetched; /**< Monotonic time (us) when the listing was fetched or revalidated */
+  gint64 listed; /**< Monotonic time (us) when the listing was fetched */
+} CacheEntry;
+
+/**
+  *   @brief Free CacheEntry, used as the GHashTable value destroy function
+  *   @param ptr Pointer to a CacheEntry
+  */
+static void free_CacheEntry(gpointer ptr) {
+  CacheEntry *entry = (CacheEntry *) ptr;
+  clear_Filelist(entry->files);
+  free(entry);
+}
+
+/**
+  *   @brief Create a cache key from a path
+  *   @param path Directory path, with or without a trailing '/'
+  *   @return Dynamically allocated path without a trailing '/' (except "/"),
+  *   NULL on error
+  *   @remark cd_back_pwd leaves a trailing '/' while cd_enter_pwd does not
+  */
+static char *cache_key(const char *path) {
+  size_t len = strlen(path);
+  while (len > 1 && path[len - 1] == '/') len--;
+  char *key = malloc(len + 1);
+  if (key) {
+    memcpy(key, path, len);
+    key[len] = '\0';
+  }
+  return key;
+}
+
+/**
+  *   @brief Check whether a path is below a folder
+  *   @param path Cache key
+  *   @param folder Cache key of the folder
+  *   @return true if path is a descendant of folder
+  */
+static bool is_below(const char *path, const char *folder) {
+  size_t len = strlen(folder);
+  // "/" is the prefix of everything, otherwise match folder + '/'
+  if (len > 0 && folder[len - 1] == '/') len--;
+  return strncmp(path, folder, len) == 0 && path[len] == '/';
+}
+
+/**
+  *   @brief Evict the least recently fetched entry
+  *   @param cache ListingCache, must be locked
+  */
+static void evict_oldest(ListingCache *cache) {
+  GHashTableIter it;
+  gpointer key, value;
+  gpointer oldest = NULL;
+  gint64 oldest_fetched = G_MAXINT64;
+  g_hash_table_iter_init(&it, cache->entries);
+  while (g_hash_table_iter_next(&it, &key, &value)) {
+    if (((CacheEntry *) value)->fetched < oldest_fetched) {
+      oldest_fetched = ((CacheEntry *) value)->fetched;
+      oldest = key;
+    }
+  }
+  if (oldest) g_hash_table_remove(cache->entries, oldest);
+}
+
+ListingCache *new_ListingCache(const gint64 ttl, const unsigned max_entries) {
+  ListingCache *cache = malloc(sizeof(ListingCache));
+  if (cache) {
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, free, free_CacheEntry);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->ttl = ttl;
+    cache->max_entries = max_entries;
+    cache->invalidations = 0;
+  }
+  return cache;
+}
+
+void free_ListingCache(ListingCache *cache) {
+  if (cache) {
+    g_hash_table_destroy(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+  }
+}
+
+enum CacheState ListingCache_lookup(ListingCache *cache, const char *path, GSList **files) {
+  enum CacheState state = CACHE_MISS;
+  *files = NULL;
+  char *key = cache_key(path);
+  if (!key) return state;
+  pthread_mutex_lock(&cache->lock);
+  CacheEntry *entry = (CacheEntry *) g_hash_table_lookup(cache->entries, key);
+  if (entry && (*files = copy_Filelist(entry->files))) {
+    state = g_get_monotonic_time() - entry->fetched < cache->ttl ? CACHE_FRESH : CACHE_STALE;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+  return state;
+}
+
+bool ListingCache_contains(ListingCache *cache, const char *path) {
+  char *key = cache_key(path);
+  if (!key) return false;
+  pthread_mutex_lock(&cache->lock);
+  bool found = g_hash_table_contains(cache->entries, key);
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+  return found;
+}
+
+/**
+  *   @brief Store a listing to the cache
+  *   @param cache ListingCache
+  *   @param path Directory path
+  *   @param files Listing, copied
+  *   @param check Whether to store only if no invalidation has happened
+  *   @param invalidations Expected invalidation count when check is set
+  *   @return true if the listing was stored
+  */
+static bool store_listing(ListingCache *cache, const char *path, const GSList *files, const bool check,
+                          const unsigned invalidations)
+{
+  CacheEntry *entry = malloc(sizeof(CacheEntry));
+  char *key = cache_key(path);
+  if (!entry || !key || !(entry->files = copy_Filelist(files))) {
+    free(entry);
+    free(key);
+    return false;
+  }
+  entry->mtime = 0;
+  GSList *dot = g_slist_find_custom((GSList *) files, ".", compare_File_GSLists);
+  if (dot && ((File_t *) dot->data)->has_metadata) entry->mtime = ((File_t *) dot->data)->mtime;
+  entry->fetched = entry->listed = g_get_monotonic_time();
+
+  pthread_mutex_lock(&cache->lock);
+  const bool store = !check || cache->invalidations == invalidations;
+  if (store) {
+    if (!g_hash_table_contains(cache->entries, key) &&
+        g_hash_table_size(cache->entries) >= cache->max_entries) {
+      evict_oldest(cache);
+    }
+    g_hash_table_replace(cache->entries, key, entry);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  if (!store) {
+    free(key);
+    free_CacheEntry(entry);
+  }
+  return store;
+}
+
+void ListingCache_store(ListingCache *cache, const char *path, const GSList *files) {
+  store_listing(cache, path, files, false, 0);
+}
+
+unsigned ListingCache_invalidations(ListingCache *cache) {
+  pthread_mutex_lock(&cache->lock);
+  const unsigned invalidations = cache->invalidations;
+  pthread_mutex_unlock(&cache->lock);
+  return invalidations;
+}
+
+bool ListingCache_store_since(ListingCache *cache, const char *path, const GSList *files, const unsigned invalidations) {
+  return store_listing(cache, path, files, true, invalidations);
+}
+
+bool ListingCache_revalidate(ListingCache *cache, const char *path, const uint64_t mtime) {
+  bool valid = false;
+  char *key = cache_key(path);
+  if (!key) return valid;
+  pthread_mutex_lock(&cache->lock);
+  CacheEntry *entry = (CacheEntry *) g_hash_table_lookup(cache->entries, key);
+  if (entry) {
+    const gint64 now = g_get_monotonic_time();
+    // The server clock is unknown, so a change within the same second as the
+    // fetch keeps the same mtime: such a listing lives at most a few ttls
+    valid = entry->mtime != 0 && entry->mtime == mtime &&
+            now - entry->listed < cache->ttl * REMOTE_CACHE_REVALIDATIONS;
+    if (valid) entry->fetched = now;
+    else g_hash_table_remove(cache->entries, key);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+  return valid;
+}
+
+void ListingCache_invalidate(ListingCache *cache, const char *path, const bool recursive) {
+  char *key = cache_key(path);
+  if (!key) return;
+  pthread_mutex_lock(&cache->lock);
+  cache->invalidations++;
+  g_hash_table_remove(cache->entries, key);
+  if (recursive) {
+    GHashTableIter it;
+    gpointer cached;
+    g_hash_table_iter_init(&it, cache->entries);
+    while (g_hash_table_iter_next(&it, &cached, NULL)) {
+      if (is_below((const char *) cached, key)) g_hash_table_iter_remove(&it);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+}
+
+/**
+  *   @struct SizeEntry
+  *   @brief One cached folder size
+  */
+typedef struct {
+  DirSize size; /**< Totals of the folder */
+  gint64 computed; /**< Monotonic time (us) when the size was computed */
+} SizeEntry;
+
+SizeCache *new_SizeCache(const gint64 ttl) {
+  SizeCache *cache = malloc(sizeof(SizeCache));
+  if (cache) {
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->ttl = ttl;
+  }
+  return cache;
+}
+
+void free_SizeCache(SizeCache *cache) {
+  if (cache) {
+    g_hash_table_destroy(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+  }
+}
+
+bool SizeCache_lookup(SizeCache *cache, const char *path, DirSize *size) {
+  bool found = false;
+  char *key = cache_key(path);
+  if (!key) return found;
+  pthread_mutex_lock(&cache->lock);
+  SizeEntry *entry = (SizeEntry *) g_hash_table_lookup(cache->entries, key);
+  if (entry && g_get_monotonic_time() - entry->computed < cache->ttl) {
+    *size = entry->size;
+    found = true;
+  } else if (entry) g_hash_table_remove(cache->entries, key);
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+  return found;
+}
+
+void SizeCache_store(SizeCache *cache, const char *path, const DirSize *size) {
+  SizeEntry *entry = malloc(sizeof(SizeEntry));
+  char *key = cache_key(path);
+  if (!entry || !key) {
+    free(entry);
+    free(key);
+    return;
+  }
+  entry->size = *size;
+  entry->computed = g_get_monotonic_time();
+  pthread_mutex_lock(&cache->lock);
+  g_hash_table_replace(cache->entries, key, entry);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void SizeCache_invalidate(SizeCache *cache, const char *path) {
+  char *key = cache_key(path);
+  if (!key) return;
+  pthread_mutex_lock(&cache->lock);
+  GHashTableIter it;
+  gpointer cached;
+  g_hash_table_iter_init(&it, cache->entries);
+  while (g_hash_table_iter_next(&it, &cached, NULL)) {
+    // A change below a folder changes the sizes of all folders above it
+    if (strcmp((const char *) cached, key) == 0 || is_below(key, (const char *) cached) ||
+        is_below((const char *) cached, key)) {
+      g_hash_table_iter_remove(&it);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+  free(key);
+}
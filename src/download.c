@@ -0,0 +1,406 @@
+/**
+  *   @file download.c
+  *   @author Lauri Westerholm
+  *   @brief Content addressed local cache of downloaded remote files
+  */
+
+#include "../include/download.h"
+
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+static volatile gint tmp_counter = 0; /**< Makes temporary file names unique within the process */
+
+
+/**
+  *   @brief Get a temporary path next to a file
+  *   @param path Path of the file
+  *   @return String, free with g_free
+  */
+static gchar *tmp_path(const char *path) {
+  return g_strdup_printf("%s.%d.%d.tmp", path, (int) getpid(), g_atomic_int_add(&tmp_counter, 1));
+}
+
+/**
+  *   @brief Copy a file, sharing its blocks with a reflink when the file system supports it
+  *   @param src File copied
+  *   @param dst New file
+  *   @param mode Permissions of dst
+  *   @return 0 on success, -1 on error
+  */
+static int clone_file(const char *src, const char *dst, const mode_t mode) {
+  const int src_fd = open(src, O_RDONLY);
+  if (src_fd < 0) return -1;
+  const int dst_fd = open(dst, O_CREAT | O_WRONLY | O_EXCL, mode);
+  if (dst_fd < 0) {
+    close(src_fd);
+    return -1;
+  }
+  int ret = 0;
+#ifdef FICLONE
+  if (ioctl(dst_fd, FICLONE, src_fd) != 0)
+#endif
+  {
+    // Different file systems, or no reflinks
+    ssize_t count;
+    while ((count = sendfile(dst_fd, src_fd, NULL, DOWNLOAD_COPY_SIZE)) > 0);
+    if (count < 0) ret = -1;
+  }
+  close(src_fd);
+  if (close(dst_fd) != 0) ret = -1;
+  if (ret != 0) unlink(dst);
+  return ret;
+}
+
+/**
+  *   @brief Compute the SHA-256 of a file
+  *   @param path Path of the file
+  *   @return Hex string, free with g_free. NULL on error
+  */
+static gchar *hash_file(const char *path) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  char *buff = malloc(DOWNLOAD_COPY_SIZE);
+  ssize_t nread = buff ? 0 : -1;
+  while (buff && (nread = read(fd, buff, DOWNLOAD_COPY_SIZE)) > 0) {
+    g_checksum_update(checksum, (const guchar *) buff, nread);
+  }
+  close(fd);
+  free(buff);
+  gchar *hash = nread == 0 ? g_strdup(g_checksum_get_string(checksum)) : NULL;
+  g_checksum_free(checksum);
+  return hash;
+}
+
+/**
+  *   @brief Get the path of a cached content
+  *   @return String, free with g_free
+  */
+static gchar *blob_path(DownloadCache *cache, const char *hash) {
+  return g_build_filename(cache->dir, DOWNLOAD_OBJECTS, hash, NULL);
+}
+
+/**
+  *   @brief Free DownloadEntry, used as the GHashTable value destroy function
+  */
+static void free_DownloadEntry(gpointer ptr) {
+  DownloadEntry *entry = (DownloadEntry *) ptr;
+  free(entry->key);
+  free(entry);
+}
+
+/**
+  *   @brief Free DownloadBlob, used as the GHashTable value destroy function
+  */
+static void free_DownloadBlob(gpointer ptr) {
+  DownloadBlob *blob = (DownloadBlob *) ptr;
+  free(blob->hash);
+  free(blob);
+}
+
+/**
+  *   @brief Add an entry to the cache
+  *   @param cache DownloadCache, locked
+  *   @param key Key of the entry, copied
+  *   @param hash Content of the entry, which has to be in cache->blobs or on disk
+  *   @param blob_size Size of the content if it is not in cache->blobs
+  *   @param recent Whether the entry is the most recently used one, otherwise the least
+  *   @return The new entry, NULL on error
+  */
+static DownloadEntry *add_entry(DownloadCache *cache, const char *key, const char *hash, const uint64_t blob_size,
+                                const bool recent) {
+  DownloadBlob *blob = (DownloadBlob *) g_hash_table_lookup(cache->blobs, hash);
+  if (!blob) {
+    blob = calloc(1, sizeof(DownloadBlob));
+    if (!blob) return NULL;
+    if (!(blob->hash = malloc(strlen(hash) + 1))) {
+      free(blob);
+      return NULL;
+    }
+    strcpy(blob->hash, hash);
+    blob->size = blob_size;
+    g_hash_table_insert(cache->blobs, blob->hash, blob);
+    cache->bytes += blob_size;
+  }
+  DownloadEntry *entry = calloc(1, sizeof(DownloadEntry));
+  if (entry && (entry->key = malloc(strlen(key) + 1))) {
+    strcpy(entry->key, key);
+    entry->blob = blob;
+    blob->refs++;
+    if (recent) {
+      g_queue_push_head(&(cache->lru), entry);
+      entry->link = cache->lru.head;
+    } else {
+      g_queue_push_tail(&(cache->lru), entry);
+      entry->link = cache->lru.tail;
+    }
+    g_hash_table_insert(cache->entries, entry->key, entry);
+    return entry;
+  }
+  free(entry);
+  if (blob->refs == 0) {
+    cache->bytes -= blob->size;
+    g_hash_table_remove(cache->blobs, hash);
+  }
+  return NULL;
+}
+
+/**
+  *   @brief Remove an entry, and its content if no other entry has it
+  *   @param cache DownloadCache, locked
+  *   @param entry DownloadEntry in the cache
+  */
+static void remove_entry(DownloadCache *cache, DownloadEntry *entry) {
+  DownloadBlob *blob = entry->blob;
+  g_queue_delete_link(&(cache->lru), entry->link);
+  g_hash_table_remove(cache->entries, entry->key);
+  if (--(blob->refs) == 0) {
+    gchar *path = blob_path(cache, blob->hash);
+    unlink(path);
+    g_free(path);
+    cache->bytes -= blob->size;
+    g_hash_table_remove(cache->blobs, blob->hash);
+  }
+  cache->dirty = true;
+}
+
+/**
+  *   @brief Parse a line of the index
+  *   @param cache DownloadCache, locked
+  *   @param line Line without the line break
+  */
+static void load_line(DownloadCache *cache, const char *line) {
+  gchar **fields = g_strsplit(line, "\t", 0);
+  const guint count = g_strv_length(fields);
+  if (count == 5 && strcmp(fields[0], "stats") == 0) {
+    cache->total.hits = g_ascii_strtoull(fields[1], NULL, 10);
+    cache->total.misses = g_ascii_strtoull(fields[2], NULL, 10);
+    cache->total.saved = g_ascii_strtoull(fields[3], NULL, 10);
+    cache->total.evictions = g_ascii_strtoull(fields[4], NULL, 10);
+  } else if (count == 5 && strlen(fields[0]) == DOWNLOAD_HASH_LEN && !strchr(fields[0], '/')) {
+    gchar *key = g_strcompress(fields[4]);
+    DownloadBlob *blob = (DownloadBlob *) g_hash_table_lookup(cache->blobs, fields[0]);
+    struct stat st;
+    gchar *path = blob_path(cache, fields[0]);
+    // Contents removed behind the back of the cache are dropped
+    const bool exists = blob || stat(path, &st) == 0;
+    g_free(path);
+    if (exists && !g_hash_table_contains(cache->entries, key)) {
+      DownloadEntry *entry = add_entry(cache, key, fields[0], blob ? blob->size : (uint64_t) st.st_size, false);
+      if (entry) {
+        entry->size = g_ascii_strtoull(fields[1], NULL, 10);
+        entry->mtime = g_ascii_strtoull(fields[2], NULL, 10);
+        entry->last_used = g_ascii_strtoll(fields[3], NULL, 10);
+      }
+    } else cache->dirty = true;
+    g_free(key);
+  }
+  g_strfreev(fields);
+}
+
+/**
+  *   @brief Evict the least recently used entries until the cache fits its limit
+  *   @param cache DownloadCache, locked
+  *   @param keep Entry not evicted, may be NULL
+  */
+static void evict(DownloadCache *cache, DownloadEntry *keep) {
+  while (cache->bytes > cache->max_bytes && cache->lru.tail && cache->lru.tail->data != keep) {
+    remove_entry(cache, (DownloadEntry *) cache->lru.tail->data);
+    cache->stats.evictions++;
+    cache->total.evictions++;
+  }
+}
+
+/**
+  *   @brief Build the key of a remote file
+  *   @return String, free with g_free
+  */
+static gchar *entry_key(const char *host, const char *path) {
+  return g_strconcat(host, ":", path, NULL);
+}
+
+
+bool download_cache_config(uint64_t *max_bytes, bool *hard_links) {
+  const gchar *size = g_getenv(DOWNLOAD_CACHE_ENV);
+  const gchar *links = g_getenv(DOWNLOAD_LINKS_ENV);
+  *max_bytes = (uint64_t) (size && *size ? g_ascii_strtoull(size, NULL, 10) : DOWNLOAD_CACHE_SIZE) * 1024 * 1024;
+  *hard_links = links && strcmp(links, "1") == 0;
+  return *max_bytes > 0;
+}
+
+DownloadCache *new_DownloadCache(const char *dir, const uint64_t max_bytes, const bool hard_links) {
+  gchar *objects = g_build_filename(dir, DOWNLOAD_OBJECTS, NULL);
+  const int ret = g_mkdir_with_parents(objects, S_IRWXU);
+  g_free(objects);
+  if (ret != 0) return NULL;
+  DownloadCache *cache = calloc(1, sizeof(DownloadCache));
+  if (!cache) return NULL;
+  if (!(cache->dir = malloc(strlen(dir) + 1))) {
+    free(cache);
+    return NULL;
+  }
+  strcpy(cache->dir, dir);
+  cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_DownloadEntry);
+  cache->blobs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_DownloadBlob);
+  g_queue_init(&(cache->lru));
+  cache->max_bytes = max_bytes;
+  cache->hard_links = hard_links;
+  pthread_mutex_init(&(cache->lock), NULL);
+  gchar *index = g_build_filename(dir, DOWNLOAD_INDEX, NULL);
+  gchar *contents = NULL;
+  if (g_file_get_contents(index, &contents, NULL, NULL)) {
+    // Entries are saved the most recently used first
+    gchar **lines = g_strsplit(contents, "\n", 0);
+    for (gchar **line = lines; *line; line++) {
+      if (**line) load_line(cache, *line);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+  }
+  g_free(index);
+  // The limit may have been lowered since the previous run
+  evict(cache, NULL);
+  return cache;
+}
+
+void free_DownloadCache(DownloadCache *cache) {
+  if (!cache) return;
+  if (cache->dirty) DownloadCache_save(cache);
+  g_queue_clear(&(cache->lru));
+  g_hash_table_destroy(cache->entries);
+  g_hash_table_destroy(cache->blobs);
+  pthread_mutex_destroy(&(cache->lock));
+  free(cache->dir);
+  free(cache);
+}
+
+int DownloadCache_save(DownloadCache *cache) {
+  pthread_mutex_lock(&(cache->lock));
+  GString *contents = g_string_new(NULL);
+  g_string_append_printf(contents, "stats\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                         "\t%" G_GUINT64_FORMAT "\n", cache->total.hits, cache->total.misses, cache->total.saved,
+                         cache->total.evictions);
+  for (GList *node = cache->lru.head; node; node = node->next) {
+    DownloadEntry *entry = (DownloadEntry *) node->data;
+    // Paths may contain tabs and line breaks
+    gchar *key = g_strescape(entry->key, NULL);
+    g_string_append_printf(contents, "%s\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\n",
+                           entry->blob->hash, entry->size, entry->mtime, entry->last_used, key);
+    g_free(key);
+  }
+  gchar *index = g_build_filename(cache->dir, DOWNLOAD_INDEX, NULL);
+  const bool ok = g_file_set_contents(index, contents->str, (gssize) contents->len, NULL);
+  if (ok) cache->dirty = false;
+  g_free(index);
+  g_string_free(contents, TRUE);
+  pthread_mutex_unlock(&(cache->lock));
+  return ok ? 0 : -1;
+}
+
+int DownloadCache_fetch(DownloadCache *cache, const char *host, const char *path, const uint64_t size,
+                        const uint64_t mtime, const char *dst, const bool overwrite, const mode_t permissions) {
+  struct stat st;
+  // The caller reports the existing file
+  if (!overwrite && lstat(dst, &st) == 0) return -1;
+  gchar *key = entry_key(host, path);
+  pthread_mutex_lock(&(cache->lock));
+  DownloadEntry *entry = (DownloadEntry *) g_hash_table_lookup(cache->entries, key);
+  g_free(key);
+  gchar *blob = entry ? blob_path(cache, entry->blob->hash) : NULL;
+  if (entry && (entry->size != size || entry->mtime != mtime || stat(blob, &st) != 0 ||
+                (uint64_t) st.st_size != entry->blob->size)) {
+    // The remote file has changed, or the content was removed behind the back of the cache
+    remove_entry(cache, entry);
+    entry = NULL;
+  }
+  int ret = -1;
+  if (entry) {
+    gchar *tmp = tmp_path(dst);
+    // A link has the mode of the content, so only read-only downloads with that mode are linked
+    const bool same_mode = (st.st_mode & DOWNLOAD_MODE_MASK) == (permissions & DOWNLOAD_MODE_MASK);
+    if (cache->hard_links && same_mode && link(blob, tmp) == 0) ret = 0;
+    else ret = clone_file(blob, tmp, permissions);
+    if (ret == 0 && rename(tmp, dst) != 0) {
+      unlink(tmp);
+      ret = -1;
+    }
+    g_free(tmp);
+  }
+  if (ret == 0) {
+    g_queue_unlink(&(cache->lru), entry->link);
+    g_queue_push_head_link(&(cache->lru), entry->link);
+    entry->last_used = g_get_real_time();
+    cache->stats.hits++;
+    cache->stats.saved += size;
+    cache->total.hits++;
+    cache->total.saved += size;
+  } else {
+    cache->stats.misses++;
+    cache->total.misses++;
+  }
+  cache->dirty = true;
+  g_free(blob);
+  pthread_mutex_unlock(&(cache->lock));
+  return ret;
+}
+
+int DownloadCache_store(DownloadCache *cache, const char *host, const char *path, const uint64_t size,
+                        const uint64_t mtime, const char *src, const char *hash) {
+  if (size > cache->max_bytes) return -1;
+  gchar *computed = hash ? NULL : hash_file(src);
+  if (!hash && !(hash = computed)) return -1;
+  gchar *key = entry_key(host, path);
+  pthread_mutex_lock(&(cache->lock));
+  DownloadEntry *entry = (DownloadEntry *) g_hash_table_lookup(cache->entries, key);
+  if (entry) remove_entry(cache, entry);
+  int ret = 0;
+  if (!g_hash_table_contains(cache->blobs, hash)) {
+    // Contents are read-only, a hard linked hit must not be changed in place. The
+    // download is copied rather than linked, so its own mode is left as it is
+    struct stat st;
+    const mode_t read_only = DOWNLOAD_MODE_MASK & ~(S_IWUSR | S_IWGRP | S_IWOTH);
+    const mode_t mode = stat(src, &st) == 0 ? (st.st_mode & read_only) | S_IRUSR : S_IRUSR;
+    gchar *blob = blob_path(cache, hash);
+    gchar *tmp = tmp_path(blob);
+    ret = clone_file(src, tmp, mode);
+    if (ret == 0) ret = rename(tmp, blob);
+    if (ret != 0) unlink(tmp);
+    g_free(tmp);
+    g_free(blob);
+  }
+  entry = ret == 0 ? add_entry(cache, key, hash, size, true) : NULL;
+  if (entry) {
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->last_used = g_get_real_time();
+    cache->dirty = true;
+    evict(cache, entry);
+  } else ret = -1;
+  pthread_mutex_unlock(&(cache->lock));
+  g_free(key);
+  g_free(computed);
+  return ret;
+}
+
+gchar *DownloadCache_summary(DownloadCache *cache) {
+  pthread_mutex_lock(&(cache->lock));
+  gchar *used = g_format_size(cache->bytes);
+  gchar *limit = g_format_size(cache->max_bytes);
+  gchar *saved = g_format_size(cache->stats.saved);
+  gchar *total_saved = g_format_size(cache->total.saved);
+  gchar *summary = g_strdup_printf("Download cache: %s of %s used by %u files, "
+                                   "%" G_GUINT64_FORMAT " hits (%s not transferred), %" G_GUINT64_FORMAT " misses, "
+                                   "%" G_GUINT64_FORMAT " evictions; "
+                                   "%" G_GUINT64_FORMAT " hits (%s) and %" G_GUINT64_FORMAT " misses in total",
+                                   used, limit, g_hash_table_size(cache->entries),
+                                   cache->stats.hits, saved, cache->stats.misses, cache->stats.evictions,
+                                   cache->total.hits, total_saved, cache->total.misses);
+  g_free(used);
+  g_free(limit);
+  g_free(saved);
+  g_free(total_saved);
+  pthread_mutex_unlock(&(cache->lock));
+  return summary;
+}
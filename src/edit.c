@@ -0,0 +1,363 @@
+/**
+  *   @file edit.c
+  *   @author Lauri Westerholm
+  *   @brief Local editing of remote files with block level write-back
+  */
+
+#include "../include/edit.h"
+
+
+/**
+  *   @struct RemoteTarget
+  *   @brief Target of a remote write-back
+  */
+typedef struct {
+  Session *session; /**< Session the file was opened on, locked by the caller */
+  sftp_file file; /**< Remote file opened for writing */
+  const char *path; /**< Path of the remote file */
+} RemoteTarget;
+
+
+/**
+  *   @brief Copy a string with malloc
+  *   @param str String to copy
+  *   @return Valid pointer, NULL on error
+  */
+static char *copy_string(const char *str) {
+  char *ret = malloc(strlen(str) + 1);
+  if (ret) strcpy(ret, str);
+  return ret;
+}
+
+/**
+  *   @brief Get the modification time and size of a local file
+  *   @param path Path of the file
+  *   @param mtime Set to the modification time in nanoseconds
+  *   @param size Set to the size in bytes
+  *   @return 0 on success, -1 on error
+  */
+static int local_stat(const char *path, gint64 *mtime, uint64_t *size) {
+  struct stat st;
+  if (stat(path, &st) != 0) return -1;
+  *mtime = (gint64) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  *size = (uint64_t) st.st_size;
+  return 0;
+}
+
+/**
+  *   @brief Read until the buffer is full or the file ends
+  *   @return Bytes read, -1 on error
+  */
+static long read_block(int fd, char *buff, const size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t nread = read(fd, buff + done, len - done);
+    if (nread < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (nread == 0) break;
+    done += (size_t) nread;
+  }
+  return (long) done;
+}
+
+/**
+  *   @brief Compute the MD5 digest of a block
+  *   @param data Block
+  *   @param len Length of the block
+  *   @param digest EDIT_HASH_LEN bytes
+  */
+static void hash_block(const char *data, const size_t len, guint8 *digest) {
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  gsize digest_len = EDIT_HASH_LEN;
+  g_checksum_update(checksum, (const guchar *) data, (gssize) len);
+  g_checksum_get_digest(checksum, digest, &digest_len);
+  g_checksum_free(checksum);
+}
+
+/**
+  *   @brief Check whether a block of the local copy differs from the synced content
+  *   @param edit EditFile
+  *   @param index Block number
+  *   @param len Length of the block in the local copy
+  *   @param digest Digest of the block in the local copy
+  *   @return true if the block has to be written back
+  */
+static bool block_changed(EditFile *edit, const uint64_t index, const size_t len, const guint8 *digest) {
+  const uint64_t offset = index * EDIT_BLOCK_SIZE;
+  if (offset >= edit->size || index >= edit->stale_from) return true;
+  const uint64_t synced_len = edit->size - offset < EDIT_BLOCK_SIZE ? edit->size - offset : EDIT_BLOCK_SIZE;
+  if (synced_len != len) return true;
+  return memcmp(edit->hashes->data + index * EDIT_HASH_LEN, digest, EDIT_HASH_LEN) != 0;
+}
+
+/**
+  *   @brief Hash the local copy and write the changed blocks
+  *   @param edit EditFile, synced to the local copy on success. After a failed
+  *   write the blocks before it are synced and the rest are stale
+  *   @param write Positioned write to the target, NULL only hashes
+  *   @param target Target passed to write
+  *   @param size Set to the size of the local copy
+  *   @return 0 on success, -1 on error
+  */
+static int EditFile_scan(EditFile *edit, EditWrite write, void *target, uint64_t *size) {
+  gint64 mtime;
+  uint64_t stat_size;
+  const int fd = open(edit->local_path, O_RDONLY);
+  if (fd < 0) return -1;
+  // Stat before reading so a save during the scan is noticed as a new modification
+  if (local_stat(edit->local_path, &mtime, &stat_size) != 0) {
+    close(fd);
+    return -1;
+  }
+  char *buff = malloc(EDIT_BLOCK_SIZE);
+  GByteArray *hashes = g_byte_array_new();
+  uint64_t written = 0;
+  uint64_t failed = UINT64_MAX;
+  *size = 0;
+  int ret = buff ? 0 : -1;
+  for (uint64_t index = 0; ret == 0; index++) {
+    const long nread = read_block(fd, buff, EDIT_BLOCK_SIZE);
+    if (nread < 0) {
+      if (write) failed = index;
+      ret = -1;
+    }
+    if (nread <= 0) break;
+    guint8 digest[EDIT_HASH_LEN];
+    hash_block(buff, (size_t) nread, digest);
+    g_byte_array_append(hashes, digest, EDIT_HASH_LEN);
+    if (write && block_changed(edit, index, (size_t) nread, digest)) {
+      if (write(target, buff, (size_t) nread, *size) != 0) {
+        failed = index;
+        ret = -1;
+      } else written += (uint64_t) nread;
+    }
+    *size += (uint64_t) nread;
+    if (nread < EDIT_BLOCK_SIZE) break;
+  }
+  free(buff);
+  close(fd);
+  if (failed != UINT64_MAX) {
+    // The target has the blocks before the failed one, it may be partly written
+    g_byte_array_set_size(hashes, (guint) (failed * EDIT_HASH_LEN));
+    g_byte_array_free(edit->hashes, TRUE);
+    edit->hashes = hashes;
+    edit->written = written;
+    edit->stale_from = failed;
+    if (edit->size < failed * EDIT_BLOCK_SIZE) edit->size = failed * EDIT_BLOCK_SIZE;
+    return -1;
+  }
+  if (ret != 0) {
+    g_byte_array_free(hashes, TRUE);
+    return -1;
+  }
+  g_byte_array_free(edit->hashes, TRUE);
+  edit->hashes = hashes;
+  edit->written = written;
+  edit->stale_from = UINT64_MAX;
+  edit->local_mtime = mtime;
+  edit->local_size = stat_size;
+  return 0;
+}
+
+
+EditFile *new_EditFile(const char *remote_path, const char *local_path) {
+  EditFile *edit = calloc(1, sizeof(EditFile));
+  if (!edit) return NULL;
+  edit->remote_path = copy_string(remote_path);
+  edit->local_path = copy_string(local_path);
+  edit->hashes = g_byte_array_new();
+  edit->stale_from = UINT64_MAX;
+  if (!edit->remote_path || !edit->local_path) {
+    free_EditFile(edit);
+    return NULL;
+  }
+  return edit;
+}
+
+void free_EditFile(EditFile *edit) {
+  if (!edit) return;
+  free(edit->remote_path);
+  free(edit->local_path);
+  g_byte_array_free(edit->hashes, TRUE);
+  free(edit);
+}
+
+char *edit_local_path(const char *host, const char *remote_path) {
+  gchar *key = g_strconcat(host, ":", remote_path, NULL);
+  gchar *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
+  gchar *name = g_path_get_basename(remote_path);
+  gchar *path = md5 ? g_build_filename(g_get_user_cache_dir(), EDIT_FOLDER, md5, name, NULL) : NULL;
+  g_free(key);
+  g_free(md5);
+  g_free(name);
+  if (!path) return NULL;
+  char *ret = copy_string(path);
+  g_free(path);
+  return ret;
+}
+
+void EditFile_remove_copy(EditFile *edit) {
+  unlink(edit->local_path);
+  gchar *folder = g_path_get_dirname(edit->local_path);
+  rmdir(folder);
+  g_free(folder);
+}
+
+bool EditFile_modified(EditFile *edit) {
+  gint64 mtime;
+  uint64_t size;
+  if (local_stat(edit->local_path, &mtime, &size) != 0) return false;
+  return mtime != edit->local_mtime || size != edit->local_size;
+}
+
+void EditFile_seen(EditFile *edit) {
+  local_stat(edit->local_path, &(edit->local_mtime), &(edit->local_size));
+}
+
+void EditFile_forget(EditFile *edit, const uint64_t size) {
+  edit->size = size;
+  edit->stale_from = 0;
+}
+
+int EditFile_sync(EditFile *edit) {
+  uint64_t size;
+  if (EditFile_scan(edit, NULL, NULL, &size) != 0) return -1;
+  edit->size = size;
+  return 0;
+}
+
+int EditFile_write_back(EditFile *edit, EditWrite write, EditTruncate truncate, void *target) {
+  uint64_t size;
+  if (EditFile_scan(edit, write, target, &size) != 0) return -1;
+  if (size < edit->size && truncate(target, size) != 0) {
+    // Every block was written, only the old tail remains after the new end
+    edit->stale_from = size / EDIT_BLOCK_SIZE;
+    return -1;
+  }
+  edit->size = size;
+  return 0;
+}
+
+
+/**
+  *   @brief EditWrite of remote files
+  *   @param target Pointer to a RemoteTarget
+  */
+static int remote_write(void *target, const char *buff, const size_t len, const uint64_t offset) {
+  RemoteTarget *remote = (RemoteTarget *) target;
+  if (sftp_seek64(remote->file, offset) < 0) return -1;
+  size_t done = 0;
+  while (done < len) {
+    const size_t chunk = len - done < WRITE_CHUNK_SIZE ? len - done : WRITE_CHUNK_SIZE;
+    const ssize_t count = sftp_write(remote->file, buff + done, chunk);
+    if (count <= 0) return -1;
+    done += (size_t) count;
+  }
+  return 0;
+}
+
+/**
+  *   @brief EditTruncate of remote files
+  *   @param target Pointer to a RemoteTarget
+  */
+static int remote_truncate(void *target, const uint64_t size) {
+  RemoteTarget *remote = (RemoteTarget *) target;
+  struct sftp_attributes_struct attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.flags = SSH_FILEXFER_ATTR_SIZE;
+  attr.size = size;
+  return sftp_setstat(remote->session->sftp, remote->path, &attr) == 0 ? 0 : -1;
+}
+
+int sftp_session_edit_open(Session *session, EditFile *edit) {
+  char buffer[MAX_BUF_SIZE];
+  gchar *folder = g_path_get_dirname(edit->local_path);
+  int ret = g_mkdir_with_parents(folder, S_IRWXU);
+  g_free(folder);
+  if (ret != 0) return -1;
+  const int fd = open(edit->local_path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0) return -1;
+  session_lock(session);
+  sftp_file file = sftp_open(session->sftp, edit->remote_path, O_RDONLY, 0);
+  sftp_attributes attr = file ? sftp_fstat(file) : NULL;
+  ret = attr ? 0 : -1;
+  if (attr) {
+    // Stat before reading, a change during the download makes the first save a conflict
+    edit->remote_mtime = attr->mtime;
+    sftp_attributes_free(attr);
+  }
+  while (ret == 0) {
+    const ssize_t nread = sftp_read(file, buffer, sizeof(buffer));
+    if (nread == 0) break;
+    if (nread < 0 || write(fd, buffer, (size_t) nread) != nread) ret = -1;
+  }
+  if (file) sftp_close(file);
+  session_unlock(session);
+  if (close(fd) != 0) ret = -1;
+  if (ret == 0) ret = EditFile_sync(edit);
+  return ret;
+}
+
+int sftp_session_edit_save(Session *session, EditFile *edit) {
+  session_lock(session);
+  sftp_attributes attr = sftp_stat(session->sftp, edit->remote_path);
+  if (!attr) {
+    session_unlock(session);
+    return -1;
+  }
+  const bool changed = attr->size != edit->size || attr->mtime != edit->remote_mtime;
+  sftp_attributes_free(attr);
+  if (changed) {
+    session_unlock(session);
+    return EDIT_CONFLICT;
+  }
+  RemoteTarget target = { session, sftp_open(session->sftp, edit->remote_path, O_WRONLY, 0), edit->remote_path };
+  int ret = target.file ? EditFile_write_back(edit, remote_write, remote_truncate, &target) : -1;
+  if (target.file && sftp_close(target.file) != 0) ret = -1;
+  // Also after a failure, the blocks written changed the file
+  attr = sftp_stat(session->sftp, edit->remote_path);
+  if (attr) {
+    edit->remote_mtime = attr->mtime;
+    if (ret != 0) edit->size = attr->size;
+    sftp_attributes_free(attr);
+  } else ret = -1;
+  session_unlock(session);
+  return ret;
+}
+
+int sftp_session_edit_overwrite(Session *session, EditFile *edit) {
+  session_lock(session);
+  sftp_attributes attr = sftp_stat(session->sftp, edit->remote_path);
+  if (!attr) {
+    session_unlock(session);
+    return -1;
+  }
+  EditFile_forget(edit, attr->size);
+  edit->remote_mtime = attr->mtime;
+  sftp_attributes_free(attr);
+  session_unlock(session);
+  return sftp_session_edit_save(session, edit);
+}
+
+bool launch_editor(const char *path) {
+  const gchar *command = g_getenv(EDITOR_ENV);
+  if (!command || !*command) command = g_getenv("VISUAL");
+  if (command && *command) {
+    gint argc;
+    gchar **argv;
+    if (!g_shell_parse_argv(command, &argc, &argv, NULL)) return false;
+    gchar **args = g_new0(gchar *, argc + 2);
+    for (gint i = 0; i < argc; i++) args[i] = argv[i];
+    args[argc] = (gchar *) path;
+    const gboolean ret = g_spawn_async(NULL, args, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, NULL);
+    g_free(args);
+    g_strfreev(argv);
+    return ret ? true : false;
+  }
+  gchar *uri = g_filename_to_uri(path, NULL, NULL);
+  const gboolean ret = uri && g_app_info_launch_default_for_uri(uri, NULL, NULL);
+  g_free(uri);
+  return ret ? true : false;
+}
@@ -133,57 +133,491 @@ enum FileStatus fs_rmdir(const char *dir_name, const bool recursive) {
   return rmdir(dir_name);
 }
 
-GSList* ls_dir(GSList *files, const char *dir_name) {
-  DIR *dir = NULL;
+/**
+  *   @struct linux_dirent64
+  *   @brief Directory entry format returned by the getdents64 syscall
+  */
+struct linux_dirent64 {
+  uint64_t d_ino; /**< Inode number */
+  int64_t d_off; /**< Offset to the next entry */
+  unsigned short d_reclen; /**< Length of this entry */
+  unsigned char d_type; /**< File type */
+  char d_name[]; /**< Null-terminated filename */
+};
+
+/**
+  *   @brief Resolve file type for filesystems which do not fill d_type
+  *   @param dir_fd File descriptor of the parent directory
+  *   @param name Filename in the directory
+  *   @return Matching d_type value, DT_UNKNOWN on error
+  */
+static uint8_t get_d_type(int dir_fd, const char *name) {
   struct stat st = {0};
-  struct dirent *dt = NULL;
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return DT_UNKNOWN;
+  return IFTODT(st.st_mode);
+}
+
+/**
+  *   @brief Get user name matching the uid
+  *   @param uid User id
+  *   @return Dynamically allocated name or NULL if not found
+  *   @remark Uses getpwuid_r so this can be called from worker threads
+  */
+static char *get_user_name(uid_t uid) {
+  struct passwd pw, *result = NULL;
+  char buff[4096];
+  if (getpwuid_r(uid, &pw, buff, sizeof(buff), &result) != 0 || !result) return NULL;
+  char *name = malloc(strlen(result->pw_name) + 1);
+  if (name) strcpy(name, result->pw_name);
+  return name;
+}
+
+/**
+  *   @brief Get group name matching the gid
+  *   @param gid Group id
+  *   @return Dynamically allocated name or NULL if not found
+  *   @remark Uses getgrgid_r so this can be called from worker threads
+  */
+static char *get_group_name(gid_t gid) {
+  struct group gr, *result = NULL;
+  char buff[4096];
+  if (getgrgid_r(gid, &gr, buff, sizeof(buff), &result) != 0 || !result) return NULL;
+  char *name = malloc(strlen(result->gr_name) + 1);
+  if (name) strcpy(name, result->gr_name);
+  return name;
+}
+
+GSList *ls_dir_names(GSList *files, const char *dir_name) {
+  long nread;
   clear_Filelist(files);
   files = NULL;
 
-  dir = opendir(dir_name);
-  if (!dir) {
+  int fd = open(dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  char *buff = malloc(LS_DIR_BUF_SIZE);
+  if (!buff) {
+    close(fd);
     return NULL;
   }
-  while ((dt = readdir(dir)) != NULL) {
-    struct File *file = malloc(sizeof(struct File));
-    file->name = malloc(strlen(dt->d_name) + 1);
-    strcpy(file->name, dt->d_name);
-    file->type = dt->d_type;
-
-    char *filepath = construct_filepath(dir_name, file->name);
-    if (!filepath) {
-      free(file);
-      clear_Filelist(files);
-      return NULL;
+  while ((nread = syscall(SYS_getdents64, fd, buff, LS_DIR_BUF_SIZE)) > 0) {
+    for (long pos = 0; pos < nread; ) {
+      struct linux_dirent64 *dt = (struct linux_dirent64 *) (buff + pos);
+      pos += dt->d_reclen;
+      struct File *file = new_File(dt->d_name, dt->d_type);
+      if (!file) {
+        nread = -1;
+        break;
+      }
+      if (file->type == DT_UNKNOWN) file->type = get_d_type(fd, file->name);
+      // Prepend and reverse once at the end, appending is O(n) per entry
+      files = g_slist_prepend(files, file);
     }
+    if (nread < 0) break;
+  }
+  free(buff);
+  close(fd);
+  if (nread < 0) {
+    clear_Filelist(files);
+    return NULL;
+  }
+  return g_slist_reverse(files);
+}
+
+File_t *fs_new_File(const char *dir_name, const char *name) {
+  int fd = open(dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+  const uint8_t type = get_d_type(fd, name);
+  close(fd);
+  return type == DT_UNKNOWN ? NULL : new_File(name, type);
+}
+
+bool fs_fill_File(File_t *file, const char *dir_name) {
+  struct stat st = {0};
+  char *filepath = construct_filepath(dir_name, file->name);
+  if (!filepath) return false;
+  int ret = stat(filepath, &st);
+  free(filepath);
+  if (ret != 0) return false;
+  file->size = st.st_size;
+  file->uid = st.st_uid;
+  file->gid = st.st_gid;
+  file->permissions = st.st_mode;
+  file->mtime = st.st_mtim.tv_sec;
+  if (file->owner) free(file->owner);
+  if (file->group) free(file->group);
+  file->owner = get_user_name(st.st_uid);
+  file->group = get_group_name(st.st_gid);
+  file->has_metadata = true;
+  return true;
+}
+
+GSList* ls_dir(GSList *files, const char *dir_name) {
+  files = ls_dir_names(files, dir_name);
+  for (GSList *nxt = files; nxt; nxt = nxt->next) {
+    // Entries which cannot be stat'd (e.g. dangling symlinks) are still listed
+    fs_fill_File((File_t *) nxt->data, dir_name);
+  }
+  return files;
+}
+
+void fs_collate_File(File_t *file) {
+  if (!file->collate_key) file->collate_key = g_utf8_collate_key_for_filename(file->name, -1);
+}
+
+/**
+  *   @brief Break a tie between two SortKeys by name
+  *   @param a SortKey
+  *   @param b SortKey
+  *   @return Comparison result, entries are never equal
+  */
+static int compare_SortKeys_tie(const SortKey *a, const SortKey *b) {
+  int ret = strcmp(a->collate_key ? a->collate_key : a->name, b->collate_key ? b->collate_key : b->name);
+  if (ret) return ret;
+  return a->position < b->position ? -1 : a->position > b->position;
+}
+
+/**
+  *   @brief Get the extension of a filename for sorting by type
+  *   @param name Filename
+  *   @return Extension without the '.', "" if there is none
+  */
+static const char *sort_extension(const char *name) {
+  // Leading '.' of hidden files does not start an extension
+  const char *ext = name[0] ? strrchr(name + 1, '.') : NULL;
+  return ext ? ext + 1 : "";
+}
+
+/**
+  *   @brief qsort comparison of SortKeys by name
+  *   @param a Pointer to a SortKey
+  *   @param b Pointer to a SortKey
+  *   @return Comparison result
+  */
+static int compare_SortKeys_name(const void *a, const void *b) {
+  const SortKey *x = (const SortKey *) a;
+  const SortKey *y = (const SortKey *) b;
+  if (x->folder != y->folder) return x->folder ? -1 : 1;
+  return compare_SortKeys_tie(x, y);
+}
+
+/**
+  *   @brief qsort comparison of SortKeys by size
+  *   @param a Pointer to a SortKey
+  *   @param b Pointer to a SortKey
+  *   @return Comparison result
+  */
+static int compare_SortKeys_size(const void *a, const void *b) {
+  const SortKey *x = (const SortKey *) a;
+  const SortKey *y = (const SortKey *) b;
+  if (x->folder != y->folder) return x->folder ? -1 : 1;
+  if (x->size != y->size) return x->size < y->size ? -1 : 1;
+  return compare_SortKeys_tie(x, y);
+}
+
+/**
+  *   @brief qsort comparison of SortKeys by modification time
+  *   @param a Pointer to a SortKey
+  *   @param b Pointer to a SortKey
+  *   @return Comparison result
+  */
+static int compare_SortKeys_mtime(const void *a, const void *b) {
+  const SortKey *x = (const SortKey *) a;
+  const SortKey *y = (const SortKey *) b;
+  if (x->folder != y->folder) return x->folder ? -1 : 1;
+  if (x->mtime != y->mtime) return x->mtime < y->mtime ? -1 : 1;
+  return compare_SortKeys_tie(x, y);
+}
+
+/**
+  *   @brief qsort comparison of SortKeys by filename extension
+  *   @param a Pointer to a SortKey
+  *   @param b Pointer to a SortKey
+  *   @return Comparison result
+  */
+static int compare_SortKeys_type(const void *a, const void *b) {
+  const SortKey *x = (const SortKey *) a;
+  const SortKey *y = (const SortKey *) b;
+  if (x->folder != y->folder) return x->folder ? -1 : 1;
+  int ret = g_ascii_strcasecmp(sort_extension(x->name), sort_extension(y->name));
+  if (ret) return ret;
+  return compare_SortKeys_tie(x, y);
+}
 
-    if (stat(filepath, &st) != 0) {
-      free(file);
-      free(filepath);
-      clear_Filelist(files);
-      return NULL;
+/**
+  *   @brief Reverse a range of SortKeys
+  *   @param keys First key of the range
+  *   @param count Number of keys in the range
+  */
+static void reverse_SortKeys(SortKey *keys, const unsigned count) {
+  for (unsigned i = 0; i < count / 2; i++) {
+    SortKey tmp = keys[i];
+    keys[i] = keys[count - 1 - i];
+    keys[count - 1 - i] = tmp;
+  }
+}
+
+void sort_SortKeys(SortKey *keys, const unsigned count, const enum SortColumn column, const bool descending) {
+  int (*compare)(const void *, const void *) = compare_SortKeys_name;
+  if (column == SORT_BY_SIZE) compare = compare_SortKeys_size;
+  else if (column == SORT_BY_MTIME) compare = compare_SortKeys_mtime;
+  else if (column == SORT_BY_TYPE) compare = compare_SortKeys_type;
+  qsort(keys, count, sizeof(SortKey), compare);
+  if (descending) {
+    // Directories stay first, both groups are reversed
+    unsigned folders = 0;
+    while (folders < count && keys[folders].folder) folders++;
+    reverse_SortKeys(keys, folders);
+    reverse_SortKeys(keys + folders, count - folders);
+  }
+}
+
+GSList *sort_Filelist(GSList *files, const enum SortColumn column, const bool descending, const bool remote) {
+  const unsigned count = g_slist_length(files);
+  SortKey *keys = malloc(count * sizeof(SortKey));
+  File_t **entries = malloc(count * sizeof(File_t *));
+  if (!keys || !entries) {
+    free(keys);
+    free(entries);
+    return files;
+  }
+  unsigned i = 0;
+  for (GSList *node = files; node; node = node->next, i++) {
+    File_t *file = (File_t *) node->data;
+    fs_collate_File(file);
+    entries[i] = file;
+    keys[i] = (SortKey) { file->name, file->collate_key, file->size, file->mtime, is_folder(file->type, remote), i };
+  }
+  sort_SortKeys(keys, count, column, descending);
+  // Relink the existing nodes in the sorted order
+  GSList *node = files;
+  for (i = 0; i < count; i++, node = node->next) node->data = entries[keys[i].position];
+  free(keys);
+  free(entries);
+  return files;
+}
+
+/**
+  *   @struct FsWalkDeque
+  *   @brief Folders found by one fs_walk thread
+  */
+typedef struct {
+  GQueue folders; /**< Paths, the owner takes from the head and thieves from the tail */
+  pthread_mutex_t lock; /**< Protects folders */
+} FsWalkDeque;
+
+/**
+  *   @struct FsWalk
+  *   @brief State shared by the fs_walk threads
+  */
+typedef struct {
+  FsWalkDeque *deques; /**< One deque per thread */
+  unsigned threads; /**< Number of threads */
+  volatile gint pending; /**< Folders queued or being read, the walk ends at 0 */
+  volatile gint queued; /**< Folders in the deques */
+  volatile gint idle; /**< Threads waiting for folders */
+  pthread_mutex_t idle_lock; /**< Used with idle_cond */
+  pthread_cond_t idle_cond; /**< Signalled when folders are queued, a thread stops or the walk ends */
+  volatile gint *cancel; /**< Cancel flag */
+  FsWalkVisit visit; /**< Visitor */
+  void *data; /**< Passed to visit */
+} FsWalk;
+
+/**
+  *   @struct FsWalkWorker
+  *   @brief Argument of a fs_walk thread
+  */
+typedef struct {
+  FsWalk *walk; /**< Shared state */
+  unsigned thread; /**< Index of the thread and its deque */
+} FsWalkWorker;
+
+bool FsWalkDir_next(FsWalkDir *dir, const char **name, unsigned char *type) {
+  if (dir->fd < 0) return false;
+  while (true) {
+    if (dir->pos >= dir->nread) {
+      if (g_atomic_int_get(dir->cancel)) return false;
+      dir->nread = syscall(SYS_getdents64, dir->fd, dir->buff, LS_DIR_BUF_SIZE);
+      dir->pos = 0;
+      if (dir->nread < 0) dir->failed = true;
+      if (dir->nread <= 0) {
+        dir->nread = 0;
+        return false;
+      }
     }
-    free(filepath);
-    file->size = st.st_size;
-    file->uid = st.st_uid;
-    file->gid = st.st_gid;
-    file->owner = NULL;
-    file->group = NULL;
-    file->permissions = st.st_mode;
-    file->mtime = st.st_mtim.tv_sec;
-    struct passwd *pw = getpwuid(st.st_uid);
-    if (pw) {
-      file->owner = malloc(strlen(pw->pw_name) + 1);
-      strcpy(file->owner, pw->pw_name);
+    struct linux_dirent64 *dt = (struct linux_dirent64 *) (dir->buff + dir->pos);
+    dir->pos += dt->d_reclen;
+    if (strcmp(dt->d_name, ".") == 0 || strcmp(dt->d_name, "..") == 0) continue;
+    *type = dt->d_type == DT_UNKNOWN ? get_d_type(dir->fd, dt->d_name) : dt->d_type;
+    if (*type == DT_UNKNOWN) continue; // Removed meanwhile
+    *name = dt->d_name;
+    return true;
+  }
+}
+
+void FsWalkDir_descend(FsWalkDir *dir, const char *name) {
+  char *path = construct_filepath(dir->path, name);
+  if (path) dir->found = g_slist_prepend(dir->found, path);
+}
+
+/**
+  *   @brief Take a folder for a fs_walk thread
+  *   @param walk FsWalk
+  *   @param thread Index of the thread
+  *   @return Path of the folder, NULL if no thread has queued folders
+  */
+static char *FsWalk_take(FsWalk *walk, const unsigned thread) {
+  FsWalkDeque *own = &(walk->deques[thread]);
+  pthread_mutex_lock(&(own->lock));
+  char *path = (char *) g_queue_pop_head(&(own->folders));
+  pthread_mutex_unlock(&(own->lock));
+  for (unsigned i = 1; !path && i < walk->threads; i++) {
+    FsWalkDeque *victim = &(walk->deques[(thread + i) % walk->threads]);
+    pthread_mutex_lock(&(victim->lock));
+    path = (char *) g_queue_pop_tail(&(victim->folders));
+    pthread_mutex_unlock(&(victim->lock));
+  }
+  if (path) g_atomic_int_add(&(walk->queued), -1);
+  return path;
+}
+
+/**
+  *   @brief Wake the idle fs_walk threads
+  *   @param walk FsWalk
+  *   @remark Called after changing what the idle threads wait for, taking
+  *   idle_lock here ensures that no waiting thread misses the change
+  */
+static void FsWalk_wake(FsWalk *walk) {
+  pthread_mutex_lock(&(walk->idle_lock));
+  pthread_cond_broadcast(&(walk->idle_cond));
+  pthread_mutex_unlock(&(walk->idle_lock));
+}
+
+/**
+  *   @brief Read folders until the walk ends
+  *   @param ptr Pointer to the FsWalkWorker
+  *   @return NULL
+  */
+static void *FsWalk_worker(void *ptr) {
+  FsWalkWorker *worker = (FsWalkWorker *) ptr;
+  FsWalk *walk = worker->walk;
+  char *buff = malloc(LS_DIR_BUF_SIZE);
+  if (!buff) return NULL; // The other threads steal the work
+  while (!g_atomic_int_get(walk->cancel)) {
+    char *path = FsWalk_take(walk, worker->thread);
+    if (!path) {
+      // Folders may still be found by the threads which are busy
+      pthread_mutex_lock(&(walk->idle_lock));
+      g_atomic_int_inc(&(walk->idle));
+      while (g_atomic_int_get(&(walk->queued)) == 0 && g_atomic_int_get(&(walk->pending)) > 0 &&
+             !g_atomic_int_get(walk->cancel)) {
+        pthread_cond_wait(&(walk->idle_cond), &(walk->idle_lock));
+      }
+      g_atomic_int_add(&(walk->idle), -1);
+      pthread_mutex_unlock(&(walk->idle_lock));
+      if (g_atomic_int_get(&(walk->pending)) == 0) break;
+      continue;
     }
-    struct group *gr = getgrgid(st.st_gid);
-    if (gr) {
-      file->group = malloc(strlen(gr->gr_name) + 1);
-      strcpy(file->group, gr->gr_name);
+    FsWalkDir dir = { path, open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC), worker->thread, false,
+                      buff, 0, 0, NULL, walk->cancel };
+    if (dir.fd < 0) dir.failed = true;
+    walk->visit(&dir, walk->data);
+    if (dir.fd >= 0) close(dir.fd);
+    if (dir.found) {
+      FsWalkDeque *own = &(walk->deques[worker->thread]);
+      const guint found = g_slist_length(dir.found);
+      g_atomic_int_add(&(walk->pending), found);
+      pthread_mutex_lock(&(own->lock));
+      for (GSList *node = dir.found; node; node = node->next) g_queue_push_head(&(own->folders), node->data);
+      pthread_mutex_unlock(&(own->lock));
+      g_atomic_int_add(&(walk->queued), found);
+      g_slist_free(dir.found);
+      if (g_atomic_int_get(&(walk->idle))) FsWalk_wake(walk);
     }
-    files = append_FileList(files, file);
+    free(path);
+    if (g_atomic_int_dec_and_test(&(walk->pending))) FsWalk_wake(walk);
   }
-  return files;
+  // Cancel is not signalled, threads still waiting learn of it from the ones stopping
+  FsWalk_wake(walk);
+  free(buff);
+  return NULL;
+}
+
+int fs_walk(const char *root, const unsigned threads, volatile gint *cancel, FsWalkVisit visit, void *data) {
+  FsWalk walk = { .threads = threads > 0 ? threads : 1, .pending = 1, .queued = 1, .idle = 0,
+                  .cancel = cancel, .visit = visit, .data = data };
+  walk.deques = calloc(walk.threads, sizeof(FsWalkDeque));
+  FsWalkWorker *workers = calloc(walk.threads, sizeof(FsWalkWorker));
+  pthread_t *tids = malloc(walk.threads * sizeof(pthread_t));
+  char *path = malloc(strlen(root) + 1);
+  if (!walk.deques || !workers || !tids || !path) {
+    free(walk.deques);
+    free(workers);
+    free(tids);
+    free(path);
+    return -1;
+  }
+  strcpy(path, root);
+  for (unsigned i = 0; i < walk.threads; i++) {
+    g_queue_init(&(walk.deques[i].folders));
+    pthread_mutex_init(&(walk.deques[i].lock), NULL);
+    workers[i].walk = &walk;
+    workers[i].thread = i;
+  }
+  g_queue_push_head(&(walk.deques[0].folders), path);
+  pthread_mutex_init(&(walk.idle_lock), NULL);
+  pthread_cond_init(&(walk.idle_cond), NULL);
+  unsigned started = 0;
+  while (started + 1 < walk.threads && pthread_create(&tids[started], NULL, FsWalk_worker, &workers[started + 1]) == 0) {
+    started++;
+  }
+  FsWalk_worker(&workers[0]);
+  for (unsigned i = 0; i < started; i++) pthread_join(tids[i], NULL);
+  // Folders are left only if the walk was cancelled or no thread could run
+  int ret = g_atomic_int_get(cancel) ? -1 : 0;
+  for (unsigned i = 0; i < walk.threads; i++) {
+    while ((path = (char *) g_queue_pop_head(&(walk.deques[i].folders)))) {
+      free(path);
+      ret = -1;
+    }
+    pthread_mutex_destroy(&(walk.deques[i].lock));
+  }
+  pthread_cond_destroy(&(walk.idle_cond));
+  pthread_mutex_destroy(&(walk.idle_lock));
+  free(walk.deques);
+  free(workers);
+  free(tids);
+  return ret;
+}
+
+/**
+  *   @brief Count the entries of a folder, FsWalkVisit of fs_dir_size
+  *   @param dir Folder being read
+  *   @param data DirSizeProgress
+  */
+static void dir_size_visit(FsWalkDir *dir, void *data) {
+  DirSize delta = {0};
+  const char *name;
+  unsigned char type;
+  while (FsWalkDir_next(dir, &name, &type)) {
+    if (type == DT_DIR) {
+      FsWalkDir_descend(dir, name);
+      delta.folders++;
+      continue;
+    }
+    if (type == DT_REG) {
+      struct stat st;
+      // Entry may have been removed meanwhile
+      if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+      delta.size += st.st_size;
+    }
+    delta.files++;
+  }
+  if (dir->failed) delta.unreadable++;
+  DirSizeProgress_add((DirSizeProgress *) data, &delta);
+}
+
+int fs_dir_size(const char *path, DirSizeProgress *progress, const unsigned threads) {
+  return fs_walk(path, threads, &(progress->cancel), dir_size_visit, progress);
 }
 
 char *get_home_dir() {
@@ -0,0 +1,915 @@
+/**
+  *   @file index.c
+  *   @author Lauri Westerholm
+  *   @brief Persistent index of remote directory trees
+  */
+
+#include "../include/index.h"
+
+/**
+  *   @struct IndexEntry
+  *   @brief Entry of a folder listed after the index file was saved
+  */
+typedef struct {
+  char *name; /**< Filename */
+  uint64_t size; /**< File size */
+  uint64_t mtime; /**< Time when the file was modified */
+  uint32_t type; /**< SSH_FILEXFER_TYPE */
+} IndexEntry;
+
+/**
+  *   @struct IndexFolder
+  *   @brief Folder listed after the index file was saved
+  */
+typedef struct {
+  IndexEntry *entries; /**< Entries sorted by name */
+  unsigned count; /**< Number of entries */
+  int64_t listed; /**< Real time (us) when the folder was listed, 0 if only its path is known */
+} IndexFolder;
+
+/**
+  *   @struct IndexUpdate
+  *   @brief Listing stored by RemoteIndex_update while the index was locked
+  */
+typedef struct {
+  char *key; /**< Index key of the folder */
+  IndexFolder *folder; /**< Listing */
+} IndexUpdate;
+
+/**
+  *   @struct IndexChild
+  *   @brief Entry of a folder, from the file or from a newer listing
+  */
+typedef struct {
+  const char *name; /**< Filename */
+  uint64_t size; /**< File size */
+  uint64_t mtime; /**< Time when the file was modified */
+  uint32_t type; /**< SSH_FILEXFER_TYPE */
+  uint32_t node; /**< Node of the entry in the file, INDEX_NONE if it is not there */
+} IndexChild;
+
+/**
+  *   @struct ChildIter
+  *   @brief Iterates the entries of a folder
+  */
+typedef struct {
+  RemoteIndex *index; /**< RemoteIndex */
+  const IndexFolder *folder; /**< Newer listing of the folder, used instead of node if set */
+  uint32_t node; /**< Node of the folder in the file, INDEX_NONE if it is not there */
+  unsigned pos; /**< Next entry */
+} ChildIter;
+
+/**
+  *   @brief Called for every entry of a subtree
+  *   @param path Full path of the entry
+  *   @param child Entry
+  *   @param listed Real time (us) when the entry was listed if it is a folder, otherwise 0
+  *   @param data Data passed to visit_tree
+  *   @return false to stop
+  */
+typedef bool (*IndexVisit)(const char *path, const IndexChild *child, const int64_t listed, void *data);
+
+/**
+  *   @struct IndexSearch
+  *   @brief State of RemoteIndex_find
+  */
+typedef struct {
+  const SearchQuery *query; /**< SearchQuery */
+  const regex_t *regex; /**< Compiled pattern, NULL for globs */
+  SearchProgress *progress; /**< Where matches are added */
+  time_t now; /**< Time the search started */
+} IndexSearch;
+
+/**
+  *   @struct IndexWalk
+  *   @brief State of sftp_session_index
+  */
+typedef struct {
+  RemoteIndex *index; /**< RemoteIndex */
+  GHashTable *listings; /**< Folder path -> GSList of the File_t listed so far */
+  unsigned added; /**< Entries stored since the index was last saved */
+  unsigned save_at; /**< Entries stored before the next save */
+  volatile gint *cancel; /**< Cancel flag */
+  volatile gint *folders; /**< Folders indexed */
+} IndexWalk;
+
+/**
+  *   @struct SaveItem
+  *   @brief Folder whose children are written next by RemoteIndex_save
+  */
+typedef struct {
+  char *path; /**< Path of the folder */
+  uint32_t old_node; /**< Node in the current file, INDEX_NONE if it is not there */
+  uint32_t new_node; /**< Node in the new file */
+} SaveItem;
+
+
+/* Helpers */
+
+/**
+  *   @brief Free IndexFolder, used as the GHashTable value destroy function
+  *   @param ptr Pointer to an IndexFolder
+  */
+static void free_IndexFolder(gpointer ptr) {
+  IndexFolder *folder = (IndexFolder *) ptr;
+  for (unsigned i = 0; i < folder->count; i++) free(folder->entries[i].name);
+  free(folder->entries);
+  free(folder);
+}
+
+/**
+  *   @brief Copy IndexFolder
+  *   @param folder IndexFolder to be copied
+  *   @return Valid pointer, NULL on error
+  */
+static IndexFolder *copy_IndexFolder(const IndexFolder *folder) {
+  IndexFolder *copy = calloc(1, sizeof(IndexFolder));
+  IndexEntry *entries = folder->count ? calloc(folder->count, sizeof(IndexEntry)) : NULL;
+  if (!copy || (folder->count && !entries)) {
+    free(copy);
+    free(entries);
+    return NULL;
+  }
+  copy->entries = entries;
+  copy->listed = folder->listed;
+  for (; copy->count < folder->count; copy->count++) {
+    entries[copy->count] = folder->entries[copy->count];
+    if (!(entries[copy->count].name = strdup(folder->entries[copy->count].name))) {
+      free_IndexFolder(copy);
+      return NULL;
+    }
+  }
+  return copy;
+}
+
+/**
+  *   @brief Compare IndexEntries by name, qsort and bsearch function
+  */
+static int compare_IndexEntries(const void *a, const void *b) {
+  return strcmp(((const IndexEntry *) a)->name, ((const IndexEntry *) b)->name);
+}
+
+/**
+  *   @brief Find an entry of a newer listing
+  *   @param folder IndexFolder
+  *   @param name Filename
+  *   @return Position of the entry, or where it should be inserted if found is false
+  */
+static unsigned IndexFolder_find(const IndexFolder *folder, const char *name, bool *found) {
+  unsigned low = 0;
+  unsigned high = folder->count;
+  while (low < high) {
+    const unsigned mid = low + (high - low) / 2;
+    const int cmp = strcmp(folder->entries[mid].name, name);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    }
+    if (cmp < 0) low = mid + 1;
+    else high = mid;
+  }
+  *found = false;
+  return low;
+}
+
+/**
+  *   @brief Create an index key from a path
+  *   @param path Absolute path, with or without a trailing '/'
+  *   @return Dynamically allocated path without a trailing '/' (except "/"),
+  *   NULL if the path is not absolute or on error
+  */
+static char *index_key(const char *path) {
+  if (path[0] != '/') return NULL;
+  size_t len = strlen(path);
+  while (len > 1 && path[len - 1] == '/') len--;
+  char *key = malloc(len + 1);
+  if (key) {
+    memcpy(key, path, len);
+    key[len] = '\0';
+  }
+  return key;
+}
+
+/**
+  *   @brief Compare a node name to a path component
+  *   @param name '\0' terminated name
+  *   @param component Path component, not terminated
+  *   @param len Length of component
+  *   @return strcmp style result
+  */
+static int compare_component(const char *name, const char *component, const size_t len) {
+  const int cmp = strncmp(name, component, len);
+  if (cmp != 0) return cmp;
+  return name[len] != '\0' ? 1 : 0;
+}
+
+/**
+  *   @brief Find a child of a node in the file
+  *   @param index RemoteIndex, locked
+  *   @param node Folder node
+  *   @param name Filename, not necessarily terminated
+  *   @param len Length of name
+  *   @return Child node, INDEX_NONE if not found
+  */
+static uint32_t find_child(const RemoteIndex *index, const uint32_t node, const char *name, const size_t len) {
+  if (node == INDEX_NONE) return INDEX_NONE;
+  uint32_t low = index->nodes[node].first_child;
+  uint32_t high = low + index->nodes[node].child_count;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const int cmp = compare_component(index->names + index->nodes[mid].name, name, len);
+    if (cmp == 0) return mid;
+    if (cmp < 0) low = mid + 1;
+    else high = mid;
+  }
+  return INDEX_NONE;
+}
+
+/**
+  *   @brief Find the node of a path in the file
+  *   @param index RemoteIndex, locked
+  *   @param key Index key
+  *   @return Node, INDEX_NONE if not found
+  */
+static uint32_t resolve(const RemoteIndex *index, const char *key) {
+  if (index->node_count == 0) return INDEX_NONE;
+  uint32_t node = 0;
+  const char *component = key;
+  while (node != INDEX_NONE && *component) {
+    while (*component == '/') component++;
+    if (!*component) break;
+    const char *end = strchr(component, '/');
+    const size_t len = end ? (size_t) (end - component) : strlen(component);
+    node = find_child(index, node, component, len);
+    component += len;
+  }
+  return node;
+}
+
+/**
+  *   @brief Find the newest listing of a folder kept in memory
+  *   @param index RemoteIndex, locked
+  *   @param key Index key of the folder
+  *   @return IndexFolder, NULL if the folder is only in the file or not known
+  */
+static const IndexFolder *lookup_folder(const RemoteIndex *index, const char *key) {
+  const IndexFolder *folder = (const IndexFolder *) g_hash_table_lookup(index->folders, key);
+  if (!folder && index->saving) folder = (const IndexFolder *) g_hash_table_lookup(index->saving, key);
+  return folder;
+}
+
+/**
+  *   @brief Get when a folder was listed
+  *   @param index RemoteIndex
+  *   @param folder Listing of the folder kept in memory, NULL if none
+  *   @param node Node of the folder in the file, INDEX_NONE if it is not there
+  *   @return Real time (us), 0 if never
+  */
+static int64_t folder_listed(const RemoteIndex *index, const IndexFolder *folder, const uint32_t node) {
+  if (folder) return folder->listed;
+  return node != INDEX_NONE ? index->nodes[node].listed : 0;
+}
+
+/**
+  *   @brief Get the next entry of a folder
+  *   @param it ChildIter
+  *   @param child Filled with the entry
+  *   @return false after the last entry
+  */
+static bool ChildIter_next(ChildIter *it, IndexChild *child) {
+  const RemoteIndex *index = it->index;
+  if (it->folder) {
+    if (it->pos >= it->folder->count) return false;
+    const IndexEntry *entry = &(it->folder->entries[it->pos++]);
+    child->name = entry->name;
+    child->size = entry->size;
+    child->mtime = entry->mtime;
+    child->type = entry->type;
+    child->node = find_child(index, it->node, entry->name, strlen(entry->name));
+    return true;
+  }
+  if (it->node == INDEX_NONE || it->pos >= index->nodes[it->node].child_count) return false;
+  child->node = index->nodes[it->node].first_child + it->pos++;
+  const IndexNode *node = &(index->nodes[child->node]);
+  child->name = index->names + node->name;
+  child->size = node->size;
+  child->mtime = node->mtime;
+  child->type = node->type;
+  return true;
+}
+
+/**
+  *   @brief Visit the entries below a folder depth first
+  *   @param index RemoteIndex, locked
+  *   @param path Path of the folder, restored before returning
+  *   @param node Node of the folder in the file, INDEX_NONE if it is not there
+  *   @param visit Visitor
+  *   @param data Passed to visit
+  *   @return false if visit stopped the traversal
+  */
+static bool visit_tree(RemoteIndex *index, GString *path, const uint32_t node, IndexVisit visit, void *data) {
+  ChildIter it = { index, lookup_folder(index, path->str), node, 0 };
+  const gsize len = path->len;
+  IndexChild child;
+  bool ret = true;
+  while (ret && ChildIter_next(&it, &child)) {
+    if (len > 1) g_string_append_c(path, '/');
+    g_string_append(path, child.name);
+    const bool folder = child.type == SSH_FILEXFER_TYPE_DIRECTORY;
+    const int64_t listed = folder ? folder_listed(index, lookup_folder(index, path->str), child.node) : 0;
+    ret = visit(path->str, &child, listed, data);
+    if (ret && folder) ret = visit_tree(index, path, child.node, visit, data);
+    g_string_truncate(path, len);
+  }
+  return ret;
+}
+
+/**
+  *   @brief Make the ancestors of a folder list it
+  *   @details Ancestors missing from the index are added with listed 0, so
+  *   the folder is reachable from "/" when the index is saved
+  *   @param index RemoteIndex, locked
+  *   @param key Index key of the folder
+  *   @return true on success, false on error
+  */
+static bool add_ancestors(RemoteIndex *index, const char *key) {
+  char *child = malloc(strlen(key) + 1);
+  if (!child) return false;
+  strcpy(child, key);
+  bool ret = true;
+  while (ret && strcmp(child, "/") != 0) {
+    char *slash = strrchr(child, '/');
+    const char *name = slash + 1;
+    char *parent = slash == child ? strdup("/") : strndup(child, slash - child);
+    if (!parent) {
+      ret = false;
+      break;
+    }
+    IndexFolder *folder = (IndexFolder *) g_hash_table_lookup(index->folders, parent);
+    const IndexFolder *saved = !folder && index->saving ? g_hash_table_lookup(index->saving, parent) : NULL;
+    if (saved) {
+      // RemoteIndex_save reads its listings without the lock
+      if (!(folder = copy_IndexFolder(saved))) {
+        free(parent);
+        ret = false;
+        break;
+      }
+      index->entries += folder->count;
+      g_hash_table_replace(index->folders, strdup(parent), folder);
+    }
+    const uint32_t node = folder ? INDEX_NONE : resolve(index, parent);
+    bool found = false;
+    unsigned pos = 0;
+    bool done = false;
+    if (folder) {
+      // Listings of the index were made reachable when they were added
+      pos = IndexFolder_find(folder, name, &found);
+      done = true;
+    } else if (node != INDEX_NONE) {
+      if (find_child(index, node, name, strlen(name)) != INDEX_NONE) found = true;
+      else {
+        // Copy the listing of the file to add the folder to it
+        folder = calloc(1, sizeof(IndexFolder));
+        const unsigned count = index->nodes[node].child_count;
+        IndexEntry *entries = count ? calloc(count, sizeof(IndexEntry)) : NULL;
+        if (!folder || (count && !entries)) {
+          free(folder);
+          free(entries);
+          free(parent);
+          ret = false;
+          break;
+        }
+        folder->entries = entries;
+        folder->listed = index->nodes[node].listed;
+        ChildIter it = { index, NULL, node, 0 };
+        IndexChild c;
+        while (ChildIter_next(&it, &c) && (entries[folder->count].name = strdup(c.name))) {
+          entries[folder->count].size = c.size;
+          entries[folder->count].mtime = c.mtime;
+          entries[folder->count].type = c.type;
+          folder->count++;
+        }
+        index->entries += folder->count;
+        g_hash_table_replace(index->folders, strdup(parent), folder);
+        pos = IndexFolder_find(folder, name, &found);
+      }
+      done = true;
+    } else {
+      // Known only through its descendant
+      folder = calloc(1, sizeof(IndexFolder));
+      if (!folder) {
+        free(parent);
+        ret = false;
+        break;
+      }
+      g_hash_table_replace(index->folders, strdup(parent), folder);
+    }
+    if (folder && found) folder->entries[pos].type = SSH_FILEXFER_TYPE_DIRECTORY;
+    else if (folder) {
+      IndexEntry *entries = realloc(folder->entries, (folder->count + 1) * sizeof(IndexEntry));
+      char *copy = strdup(name);
+      if (entries) folder->entries = entries;
+      if (!entries || !copy) {
+        free(copy);
+        free(parent);
+        ret = false;
+        break;
+      }
+      memmove(&(entries[pos + 1]), &(entries[pos]), (folder->count - pos) * sizeof(IndexEntry));
+      entries[pos] = (IndexEntry) { copy, 0, 0, SSH_FILEXFER_TYPE_DIRECTORY };
+      folder->count++;
+      index->entries++;
+    }
+    free(child);
+    child = parent;
+    if (done) break;
+  }
+  free(child);
+  return ret;
+}
+
+/**
+  *   @brief Map the index file
+  *   @param index RemoteIndex, locked and not mapped
+  *   @return true if a valid file was mapped
+  */
+static bool RemoteIndex_map(RemoteIndex *index) {
+  int fd = open(index->filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(IndexHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  const IndexHeader *header = (const IndexHeader *) map;
+  const IndexNode *nodes = (const IndexNode *) (header + 1);
+  const char *names = (const char *) (nodes + header->node_count);
+  bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == INDEX_VERSION && header->node_count > 0 && header->names_size > 0 &&
+               (uint64_t) st.st_size == sizeof(IndexHeader) + (uint64_t) header->node_count * sizeof(IndexNode) +
+                                        header->names_size &&
+               names[header->names_size - 1] == '\0' && nodes[0].parent == INDEX_NONE;
+  // Children are stored after their parent, so walking the nodes always ends
+  for (uint32_t i = 0; valid && i < header->node_count; i++) {
+    valid = nodes[i].name < header->names_size &&
+            (nodes[i].child_count == 0 ||
+             (nodes[i].first_child > i &&
+              (uint64_t) nodes[i].first_child + nodes[i].child_count <= header->node_count));
+  }
+  if (!valid) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  index->map = map;
+  index->map_size = st.st_size;
+  index->nodes = nodes;
+  index->node_count = header->node_count;
+  index->names = names;
+  index->names_size = header->names_size;
+  return true;
+}
+
+/**
+  *   @brief Unmap the index file
+  *   @param index RemoteIndex, locked
+  */
+static void RemoteIndex_unmap(RemoteIndex *index) {
+  if (index->map) munmap(index->map, index->map_size);
+  index->map = NULL;
+  index->map_size = 0;
+  index->nodes = NULL;
+  index->node_count = 0;
+  index->names = NULL;
+  index->names_size = 0;
+}
+
+/**
+  *   @brief Store a folder listing
+  *   @param index RemoteIndex, locked
+  *   @param key Index key of the folder, freed or kept by the index
+  *   @param folder Listing, freed or kept by the index
+  *   @return true on success, false on error
+  */
+static bool store_folder(RemoteIndex *index, char *key, IndexFolder *folder) {
+  if (!add_ancestors(index, key)) {
+    free_IndexFolder(folder);
+    free(key);
+    return false;
+  }
+  const IndexFolder *old = (const IndexFolder *) g_hash_table_lookup(index->folders, key);
+  if (old) index->entries -= old->count;
+  index->entries += folder->count;
+  g_hash_table_replace(index->folders, key, folder);
+  return true;
+}
+
+/**
+  *   @brief Store the listings queued while the index was locked
+  *   @param index RemoteIndex, locked
+  */
+static void merge_pending(RemoteIndex *index) {
+  pthread_mutex_lock(&(index->pending_lock));
+  GSList *pending = g_slist_reverse(index->pending);
+  index->pending = NULL;
+  pthread_mutex_unlock(&(index->pending_lock));
+  for (GSList *node = pending; node; node = node->next) {
+    IndexUpdate *update = (IndexUpdate *) node->data;
+    store_folder(index, update->key, update->folder);
+    free(update);
+  }
+  g_slist_free(pending);
+}
+
+/**
+  *   @brief Lock the index and store the queued listings
+  *   @param index RemoteIndex
+  */
+static void RemoteIndex_lock(RemoteIndex *index) {
+  pthread_mutex_lock(&(index->lock));
+  merge_pending(index);
+}
+
+/**
+  *   @brief Store the listings queued while the index was locked and unlock it
+  *   @param index RemoteIndex, locked
+  */
+static void RemoteIndex_unlock(RemoteIndex *index) {
+  merge_pending(index);
+  pthread_mutex_unlock(&(index->lock));
+}
+
+/**
+  *   @brief Get the number of nodes in the index file
+  *   @param index RemoteIndex
+  *   @return Number of nodes, 0 if there is no file
+  */
+static uint32_t RemoteIndex_nodes(RemoteIndex *index) {
+  pthread_mutex_lock(&(index->lock));
+  const uint32_t count = index->node_count;
+  pthread_mutex_unlock(&(index->lock));
+  return count;
+}
+
+
+/* RemoteIndex */
+
+char *index_filename(const char *user, const char *host) {
+  gchar *name = g_strdup_printf("%s@%s.index", user, host);
+  // The address may contain a port but never a folder
+  for (gchar *c = name; *c; c++) {
+    if (*c == '/') *c = '_';
+  }
+  gchar *path = g_build_filename(g_get_user_cache_dir(), INDEX_FOLDER, name, NULL);
+  g_free(name);
+  char *ret = malloc(strlen(path) + 1);
+  if (ret) strcpy(ret, path);
+  g_free(path);
+  return ret;
+}
+
+RemoteIndex *new_RemoteIndex(const char *filename) {
+  RemoteIndex *index = calloc(1, sizeof(RemoteIndex));
+  if (!index) return NULL;
+  index->filename = malloc(strlen(filename) + 1);
+  if (!index->filename) {
+    free(index);
+    return NULL;
+  }
+  strcpy(index->filename, filename);
+  index->folders = g_hash_table_new_full(g_str_hash, g_str_equal, free, free_IndexFolder);
+  pthread_mutex_init(&(index->lock), NULL);
+  pthread_mutex_init(&(index->pending_lock), NULL);
+  pthread_mutex_init(&(index->save_lock), NULL);
+  RemoteIndex_map(index);
+  return index;
+}
+
+void free_RemoteIndex(RemoteIndex *index) {
+  if (index) {
+    RemoteIndex_unmap(index);
+    g_hash_table_destroy(index->folders);
+    for (GSList *node = index->pending; node; node = node->next) {
+      IndexUpdate *update = (IndexUpdate *) node->data;
+      free_IndexFolder(update->folder);
+      free(update->key);
+      free(update);
+    }
+    g_slist_free(index->pending);
+    pthread_mutex_destroy(&(index->lock));
+    pthread_mutex_destroy(&(index->pending_lock));
+    pthread_mutex_destroy(&(index->save_lock));
+    free(index->filename);
+    free(index);
+  }
+}
+
+bool RemoteIndex_update(RemoteIndex *index, const char *path, const GSList *files, const int64_t listed) {
+  char *key = index_key(path);
+  IndexFolder *folder = calloc(1, sizeof(IndexFolder));
+  const unsigned len = g_slist_length((GSList *) files);
+  IndexEntry *entries = len ? calloc(len, sizeof(IndexEntry)) : NULL;
+  if (!key || !folder || (len && !entries)) {
+    free(key);
+    free(folder);
+    free(entries);
+    return false;
+  }
+  folder->entries = entries;
+  folder->listed = listed;
+  for (const GSList *node = files; node; node = node->next) {
+    const File_t *file = (const File_t *) node->data;
+    if (strcmp(file->name, ".") == 0 || strcmp(file->name, "..") == 0) continue;
+    if (!(entries[folder->count].name = strdup(file->name))) {
+      free_IndexFolder(folder);
+      free(key);
+      return false;
+    }
+    entries[folder->count].size = file->size;
+    entries[folder->count].mtime = file->mtime;
+    entries[folder->count].type = file->type;
+    folder->count++;
+  }
+  qsort(entries, folder->count, sizeof(IndexEntry), compare_IndexEntries);
+  if (pthread_mutex_trylock(&(index->lock)) == 0) {
+    const bool ret = store_folder(index, key, folder);
+    RemoteIndex_unlock(index);
+    return ret;
+  }
+  // Listers do not wait for a search, whoever holds the lock stores this
+  IndexUpdate *update = malloc(sizeof(IndexUpdate));
+  if (!update) {
+    free_IndexFolder(folder);
+    free(key);
+    return false;
+  }
+  *update = (IndexUpdate) { key, folder };
+  pthread_mutex_lock(&(index->pending_lock));
+  index->pending = g_slist_prepend(index->pending, update);
+  pthread_mutex_unlock(&(index->pending_lock));
+  return true;
+}
+
+bool RemoteIndex_is_dirty(RemoteIndex *index) {
+  RemoteIndex_lock(index);
+  const bool dirty = g_hash_table_size(index->folders) > 0;
+  RemoteIndex_unlock(index);
+  return dirty;
+}
+
+int RemoteIndex_save(RemoteIndex *index) {
+  pthread_mutex_lock(&(index->save_lock));
+  RemoteIndex_lock(index);
+  // Listings stored from now on go to a new table, the mapping is kept until the rename
+  GHashTable *saving = index->folders;
+  index->saving = saving;
+  index->folders = g_hash_table_new_full(g_str_hash, g_str_equal, free, free_IndexFolder);
+  index->entries = 0;
+  RemoteIndex_unlock(index);
+  // Only a save changes the mapping, so it is read without the lock
+  GArray *nodes = g_array_new(FALSE, TRUE, sizeof(IndexNode));
+  GByteArray *names = g_byte_array_new();
+  g_byte_array_append(names, (const guint8 *) "", 1);
+  const uint32_t old_root = index->node_count ? 0 : INDEX_NONE;
+  IndexNode root = { 0, INDEX_NONE, 0, 0, 0, 0, folder_listed(index, g_hash_table_lookup(saving, "/"), old_root),
+                     SSH_FILEXFER_TYPE_DIRECTORY, 0 };
+  g_array_append_val(nodes, root);
+  GQueue queue = G_QUEUE_INIT;
+  SaveItem *item = malloc(sizeof(SaveItem));
+  bool ok = item && (item->path = strdup("/"));
+  if (ok) {
+    item->old_node = old_root;
+    item->new_node = 0;
+    g_queue_push_tail(&queue, item);
+  } else free(item);
+  // Breadth first, so the children of each folder are consecutive
+  while (ok && (item = (SaveItem *) g_queue_pop_head(&queue))) {
+    ChildIter it = { index, (const IndexFolder *) g_hash_table_lookup(saving, item->path), item->old_node, 0 };
+    const uint32_t first = nodes->len;
+    IndexChild child;
+    while (ok && ChildIter_next(&it, &child)) {
+      const size_t len = strlen(child.name) + 1;
+      if (names->len + len > UINT32_MAX || nodes->len == INDEX_NONE) {
+        ok = false;
+        break;
+      }
+      const bool folder = child.type == SSH_FILEXFER_TYPE_DIRECTORY;
+      char *path = folder ? construct_filepath(item->path, child.name) : NULL;
+      if (folder && !path) {
+        ok = false;
+        break;
+      }
+      IndexNode node = { names->len, item->new_node, 0, 0, child.size, child.mtime,
+                         folder ? folder_listed(index, g_hash_table_lookup(saving, path), child.node) : 0,
+                         child.type, 0 };
+      g_byte_array_append(names, (const guint8 *) child.name, len);
+      if (folder) {
+        SaveItem *next = malloc(sizeof(SaveItem));
+        if (!next) {
+          free(path);
+          ok = false;
+          break;
+        }
+        *next = (SaveItem) { path, child.node, nodes->len };
+        g_queue_push_tail(&queue, next);
+      }
+      g_array_append_val(nodes, node);
+    }
+    g_array_index(nodes, IndexNode, item->new_node).first_child = first;
+    g_array_index(nodes, IndexNode, item->new_node).child_count = nodes->len - first;
+    free(item->path);
+    free(item);
+  }
+  while ((item = (SaveItem *) g_queue_pop_head(&queue))) {
+    free(item->path);
+    free(item);
+  }
+
+  char *tmp = ok ? g_strdup_printf("%s.tmp", index->filename) : NULL;
+  if (ok) {
+    gchar *folder = g_path_get_dirname(index->filename);
+    g_mkdir_with_parents(folder, S_IRWXU);
+    g_free(folder);
+    IndexHeader header = { INDEX_MAGIC, INDEX_VERSION, nodes->len, names->len, g_get_real_time() };
+    FILE *fp = fopen(tmp, "wb");
+    ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(nodes->data, sizeof(IndexNode), nodes->len, fp) == nodes->len &&
+         fwrite(names->data, 1, names->len, fp) == names->len;
+    if (fp && fclose(fp) != 0) ok = false;
+  }
+  RemoteIndex_lock(index);
+  if (ok) {
+    // Names of the old mapping are not used after this
+    RemoteIndex_unmap(index);
+    ok = rename(tmp, index->filename) == 0 && RemoteIndex_map(index);
+  }
+  if (!ok) {
+    if (tmp) unlink(tmp);
+    if (!index->map) RemoteIndex_map(index);
+    // Listings stored during the save are newer than the ones taken for it
+    GHashTableIter iter;
+    gpointer key;
+    gpointer folder;
+    g_hash_table_iter_init(&iter, saving);
+    while (g_hash_table_iter_next(&iter, &key, &folder)) {
+      if (g_hash_table_contains(index->folders, key)) continue;
+      g_hash_table_iter_steal(&iter);
+      index->entries += ((IndexFolder *) folder)->count;
+      g_hash_table_insert(index->folders, key, folder);
+    }
+  }
+  index->saving = NULL;
+  RemoteIndex_unlock(index);
+  g_hash_table_destroy(saving);
+  g_free(tmp);
+  g_array_free(nodes, TRUE);
+  g_byte_array_free(names, TRUE);
+  pthread_mutex_unlock(&(index->save_lock));
+  return ok ? 0 : -1;
+}
+
+/**
+  *   @brief Count the folders of a subtree, IndexVisit of RemoteIndex_freshness
+  */
+static bool freshness_visit(__attribute__((unused)) const char *path, const IndexChild *child, const int64_t listed,
+                            void *data) {
+  if (child->type != SSH_FILEXFER_TYPE_DIRECTORY) return true;
+  IndexFreshness *freshness = (IndexFreshness *) data;
+  freshness->folders++;
+  if (listed == 0) freshness->unlisted++;
+  else {
+    if (freshness->oldest == 0 || listed < freshness->oldest) freshness->oldest = listed;
+    if (listed > freshness->newest) freshness->newest = listed;
+  }
+  return true;
+}
+
+bool RemoteIndex_freshness(RemoteIndex *index, const char *root, IndexFreshness *freshness) {
+  memset(freshness, 0, sizeof(IndexFreshness));
+  char *key = index_key(root);
+  if (!key) return false;
+  RemoteIndex_lock(index);
+  const uint32_t node = resolve(index, key);
+  const IndexFolder *folder = lookup_folder(index, key);
+  const bool found = node != INDEX_NONE || folder;
+  if (found) {
+    const IndexChild self = { key, 0, 0, SSH_FILEXFER_TYPE_DIRECTORY, node };
+    freshness_visit(key, &self, folder_listed(index, folder, node), freshness);
+    GString *path = g_string_new(key);
+    visit_tree(index, path, node, freshness_visit, freshness);
+    g_string_free(path, TRUE);
+  }
+  RemoteIndex_unlock(index);
+  free(key);
+  return found;
+}
+
+/**
+  *   @brief Match an entry, IndexVisit of RemoteIndex_find
+  */
+static bool find_visit(const char *path, const IndexChild *child, __attribute__((unused)) const int64_t listed,
+                       void *data) {
+  IndexSearch *search = (IndexSearch *) data;
+  if (g_atomic_int_get(&(search->progress->cancel))) return false;
+  if (!SearchQuery_matches_name(search->query, search->regex, child->name)) return true;
+  File_t *file = new_File(child->name, child->type);
+  if (!file) return true;
+  file->size = child->size;
+  file->mtime = child->mtime;
+  char *name = SearchQuery_matches(search->query, search->regex, file, search->now) ? strdup(path) : NULL;
+  if (!name) {
+    free_File(file);
+    return true;
+  }
+  free(file->name);
+  file->name = name;
+  return SearchProgress_add(search->progress, file);
+}
+
+int RemoteIndex_find(RemoteIndex *index, const char *root, const SearchQuery *query, SearchProgress *progress) {
+  char *key = index_key(root);
+  regex_t compiled;
+  if (!key) return -1;
+  if (SearchQuery_compile(query, &compiled) != 0) {
+    free(key);
+    return -1;
+  }
+  IndexSearch search = { query, query->regex && query->pattern ? &compiled : NULL, progress, time(NULL) };
+  int ret = -1;
+  RemoteIndex_lock(index);
+  const uint32_t node = resolve(index, key);
+  if (node != INDEX_NONE || lookup_folder(index, key)) {
+    GString *path = g_string_new(key);
+    ret = visit_tree(index, path, node, find_visit, &search) ? 0 : -1;
+    g_string_free(path, TRUE);
+  }
+  RemoteIndex_unlock(index);
+  if (search.regex) regfree(&compiled);
+  free(key);
+  pthread_mutex_lock(&(progress->lock));
+  if (progress->truncated) ret = 0;
+  pthread_mutex_unlock(&(progress->lock));
+  return ret;
+}
+
+/**
+  *   @brief Collect an entry to its folder, RemoteWalk entry callback of sftp_session_index
+  */
+static enum WalkAction index_entry(const char *parent, const File_t *file, void *data) {
+  IndexWalk *walk = (IndexWalk *) data;
+  File_t *copy = copy_File(file);
+  if (!copy) return WALK_CONTINUE;
+  gpointer key = NULL;
+  gpointer files = NULL;
+  if (g_hash_table_lookup_extended(walk->listings, parent, &key, &files)) g_hash_table_steal(walk->listings, parent);
+  else if (!(key = strdup(parent))) {
+    free_File(copy);
+    return WALK_STOP;
+  }
+  g_hash_table_insert(walk->listings, key, g_slist_prepend((GSList *) files, copy));
+  return WALK_CONTINUE;
+}
+
+/**
+  *   @brief Store a folder whose listing is complete, RemoteWalk leave callback of sftp_session_index
+  */
+static enum WalkAction index_leave(const char *path, const bool readable, void *data) {
+  IndexWalk *walk = (IndexWalk *) data;
+  gpointer key = NULL;
+  gpointer files = NULL;
+  if (g_hash_table_lookup_extended(walk->listings, path, &key, &files)) g_hash_table_steal(walk->listings, path);
+  // Folders which could not be listed keep what was known of them
+  if (readable && RemoteIndex_update(walk->index, path, (GSList *) files, g_get_real_time())) {
+    walk->added += g_slist_length((GSList *) files);
+    g_atomic_int_inc(walk->folders);
+  }
+  free(key);
+  clear_Filelist((GSList *) files);
+  // Saving when the listings would double the file keeps the rewrites linear in its final size
+  if (walk->added >= walk->save_at) {
+    RemoteIndex_save(walk->index);
+    walk->added = 0;
+    walk->save_at = MAX(INDEX_SAVE_ENTRIES, RemoteIndex_nodes(walk->index));
+  }
+  return g_atomic_int_get(walk->cancel) ? WALK_STOP : WALK_CONTINUE;
+}
+
+/**
+  *   @brief Free a listing collected by index_entry, used as the GHashTable value destroy function
+  */
+static void free_listing(gpointer ptr) {
+  clear_Filelist((GSList *) ptr);
+}
+
+int sftp_session_index(Session *session, RemoteIndex *index, const char *root, volatile gint *cancel,
+                       volatile gint *folders) {
+  IndexWalk index_walk = { index, g_hash_table_new_full(g_str_hash, g_str_equal, free, free_listing), 0,
+                           MAX(INDEX_SAVE_ENTRIES, RemoteIndex_nodes(index)), cancel, folders };
+  RemoteWalk walk = { .entry = index_entry, .leave = index_leave, .data = &index_walk, .lock_session = true,
+                      .cancel = cancel };
+  int ret = sftp_session_walk(session, root, &walk);
+  g_hash_table_destroy(index_walk.listings);
+  if (RemoteIndex_is_dirty(index) && RemoteIndex_save(index) != 0) ret = -1;
+  return ret;
+}
@@ -0,0 +1,144 @@
+/**
+  *   @file match.c
+  *   @author Lauri Westerholm
+  *   @brief Filename matching for filtering large listings
+  */
+
+#define _GNU_SOURCE // memmem
+#include "../include/match.h"
+
+/**
+  *   @brief Fold ASCII letters to lower case
+  *   @param dst Destination, may be the same as src
+  *   @param src Source
+  *   @param len Number of bytes
+  */
+static void fold_bytes(char *dst, const char *src, const size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    const char c = src[i];
+    dst[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+  }
+}
+
+/**
+  *   @brief Find the name containing a position of the NameTable buffer
+  *   @param table NameTable
+  *   @param pos Offset in table->folded
+  *   @return Index of the name
+  */
+static unsigned NameTable_index_at(const NameTable *table, const size_t pos) {
+  unsigned low = 0;
+  unsigned high = table->count;
+  while (high - low > 1) {
+    const unsigned mid = low + (high - low) / 2;
+    if (table->offsets[mid] <= pos) low = mid;
+    else high = mid;
+  }
+  return low;
+}
+
+/**
+  *   @brief Subsequence match of a pattern
+  *   @param name Case folded name
+  *   @param len Length of name
+  *   @param pattern Case folded pattern
+  *   @return true if the characters of pattern appear in name in order
+  */
+static bool fuzzy_match(const char *name, const size_t len, const char *pattern) {
+  const char *end = name + len;
+  for (; *pattern; pattern++) {
+    name = memchr(name, *pattern, end - name);
+    if (!name) return false;
+    name++;
+  }
+  return true;
+}
+
+NameTable *new_NameTable(GSList *files) {
+  NameTable *table = calloc(1, sizeof(NameTable));
+  if (!table) return NULL;
+  table->count = g_slist_length(files);
+  for (GSList *node = files; node; node = node->next) {
+    table->len += strlen(((File_t *) node->data)->name) + 1;
+  }
+  table->names = malloc(table->len + 1);
+  table->folded = malloc(table->len + 1);
+  table->offsets = malloc((table->count + 1) * sizeof(unsigned));
+  if (!table->names || !table->folded || !table->offsets) {
+    table->refs = 1;
+    NameTable_unref(table);
+    return NULL;
+  }
+  size_t pos = 0;
+  unsigned i = 0;
+  for (GSList *node = files; node; node = node->next) {
+    const char *name = ((File_t *) node->data)->name;
+    const size_t len = strlen(name) + 1;
+    table->offsets[i++] = pos;
+    memcpy(table->names + pos, name, len);
+    pos += len;
+  }
+  table->offsets[i] = pos;
+  fold_bytes(table->folded, table->names, table->len);
+  table->refs = 1;
+  return table;
+}
+
+NameTable *NameTable_ref(NameTable *table) {
+  g_atomic_int_inc(&table->refs);
+  return table;
+}
+
+void NameTable_unref(NameTable *table) {
+  if (table && g_atomic_int_dec_and_test(&table->refs)) {
+    free(table->names);
+    free(table->folded);
+    free(table->offsets);
+    free(table);
+  }
+}
+
+int NameTable_match(NameTable *table, const char *pattern, const bool fuzzy, const gint generation, GArray *matches) {
+  const size_t pattern_len = strlen(pattern);
+  unsigned found = 0;
+  if (fuzzy) {
+    for (unsigned i = 0; i < table->count; i++) {
+      if ((i % MATCH_CANCEL_INTERVAL == 0) && (g_atomic_int_get(&table->generation) != generation)) return -1;
+      const char *name = table->folded + table->offsets[i];
+      if (fuzzy_match(name, table->offsets[i + 1] - table->offsets[i] - 1, pattern)) {
+        g_array_append_val(matches, i);
+        found++;
+      }
+    }
+    return (int) found;
+  }
+  // Pattern has no '\0', so a hit never spans two names
+  const char *pos = table->folded;
+  const char *end = table->folded + table->len;
+  const char *hit;
+  while (pos < end && (hit = memmem(pos, end - pos, pattern, pattern_len))) {
+    if ((found % MATCH_CANCEL_INTERVAL == 0) && (g_atomic_int_get(&table->generation) != generation)) return -1;
+    const unsigned i = NameTable_index_at(table, hit - table->folded);
+    g_array_append_val(matches, i);
+    found++;
+    pos = table->folded + table->offsets[i + 1];
+  }
+  return g_atomic_int_get(&table->generation) == generation ? (int) found : -1;
+}
+
+bool name_matches(const char *name, const char *pattern, const bool fuzzy) {
+  const size_t len = strlen(name);
+  char *folded = malloc(len + 1);
+  if (!folded) return false;
+  fold_bytes(folded, name, len + 1);
+  bool ret = fuzzy ? fuzzy_match(folded, len, pattern) : (strstr(folded, pattern) != NULL);
+  free(folded);
+  return ret;
+}
+
+char *fold_pattern(const char *pattern) {
+  const size_t len = strlen(pattern);
+  char *folded = malloc(len + 1);
+  if (folded) fold_bytes(folded, pattern, len + 1);
+  return folded;
+}
@@ -0,0 +1,596 @@
+/**
+  *   @file search.c
+  *   @author Lauri Westerholm
+  *   @brief Recursive filename and content search
+  */
+
+#define _GNU_SOURCE // FNM_CASEFOLD
+#include <fnmatch.h>
+#include <limits.h>
+
+#include "../include/search.h"
+
+/**
+  *   @struct SearchWalk
+  *   @brief State of the sftp fallback of sftp_session_find
+  */
+typedef struct {
+  const SearchQuery *query; /**< SearchQuery */
+  const regex_t *regex; /**< Compiled pattern, NULL for globs */
+  SearchProgress *progress; /**< Where matches are added */
+  time_t now; /**< Time the search started */
+} SearchWalk;
+
+/**
+  *   @brief Parse a chunk of search command output
+  *   @param data Output, NULL at the end of the output
+  *   @param len Length of data
+  *   @param parser Parser of the command
+  *   @return OutputAction
+  */
+typedef enum OutputAction (*OutputParse)(const char *data, const size_t len, void *parser);
+
+/**
+  *   @struct LocalSearch
+  *   @brief State shared by the fs_walk threads of fs_find
+  */
+typedef struct {
+  const SearchQuery *query; /**< SearchQuery */
+  regex_t *regexes; /**< Compiled pattern of each thread, NULL for globs */
+  SearchProgress *progress; /**< Where matches are added */
+  time_t now; /**< Time the search started */
+} LocalSearch;
+
+
+/* Search progress */
+
+void SearchProgress_init(SearchProgress *progress) {
+  memset(progress, 0, sizeof(SearchProgress));
+  progress->free_match = free_File;
+  pthread_mutex_init(&(progress->lock), NULL);
+}
+
+void SearchProgress_destroy(SearchProgress *progress) {
+  g_slist_free_full(progress->matches, progress->free_match);
+  progress->matches = NULL;
+  pthread_mutex_destroy(&(progress->lock));
+}
+
+bool SearchProgress_add(SearchProgress *progress, gpointer match) {
+  bool ret = true;
+  pthread_mutex_lock(&(progress->lock));
+  if (progress->count >= SEARCH_MAX_RESULTS) {
+    progress->truncated = true;
+    ret = false;
+  } else {
+    progress->matches = g_slist_prepend(progress->matches, match);
+    progress->count++;
+  }
+  pthread_mutex_unlock(&(progress->lock));
+  if (!ret) progress->free_match(match);
+  return ret;
+}
+
+GSList *SearchProgress_take(SearchProgress *progress) {
+  pthread_mutex_lock(&(progress->lock));
+  GSList *matches = progress->matches;
+  progress->matches = NULL;
+  pthread_mutex_unlock(&(progress->lock));
+  return g_slist_reverse(matches);
+}
+
+
+/* Queries */
+
+char *search_glob(const char *text) {
+  const size_t len = strlen(text);
+  if (len == 0) return NULL;
+  const bool glob = strpbrk(text, "*?[") != NULL;
+  char *pattern = malloc(len + 3);
+  if (!pattern) return NULL;
+  if (glob) strcpy(pattern, text);
+  else sprintf(pattern, "*%s*", text);
+  return pattern;
+}
+
+int SearchQuery_compile(const SearchQuery *query, regex_t *regex) {
+  if (!query->regex || !query->pattern) return 0;
+  const int flags = REG_EXTENDED | REG_NOSUB | (query->ignore_case ? REG_ICASE : 0);
+  return regcomp(regex, query->pattern, flags) == 0 ? 0 : -1;
+}
+
+bool SearchQuery_matches_name(const SearchQuery *query, const regex_t *regex, const char *name) {
+  if (!query->pattern) return true;
+  if (regex) return regexec(regex, name, 0, NULL, 0) == 0;
+  return fnmatch(query->pattern, name, query->ignore_case ? FNM_CASEFOLD : 0) == 0;
+}
+
+/**
+  *   @brief Check the size and age predicates of a query
+  *   @param query SearchQuery
+  *   @param file Entry
+  *   @param now Current time
+  *   @return true if the predicates match
+  */
+static bool SearchQuery_matches_metadata(const SearchQuery *query, const File_t *file, const time_t now) {
+  if (query->min_size && file->size < query->min_size) return false;
+  if (query->max_size && file->size > query->max_size) return false;
+  if (query->max_age && (uint64_t) now >= file->mtime + (uint64_t) query->max_age * 24 * 60 * 60) return false;
+  return true;
+}
+
+bool SearchQuery_matches(const SearchQuery *query, const regex_t *regex, const File_t *file, const time_t now) {
+  return SearchQuery_matches_name(query, regex, file->name) && SearchQuery_matches_metadata(query, file, now);
+}
+
+/**
+  *   @brief Append the size and age predicates of a query to a find command
+  *   @param cmd Command
+  *   @param query SearchQuery
+  */
+static void append_find_predicates(GString *cmd, const SearchQuery *query) {
+  // -size +Nc matches sizes larger than N, -size -Nc smaller than N
+  if (query->min_size) g_string_append_printf(cmd, " -size +%" G_GUINT64_FORMAT "c", query->min_size - 1);
+  if (query->max_size) g_string_append_printf(cmd, " -size -%" G_GUINT64_FORMAT "c", query->max_size + 1);
+  if (query->max_age) g_string_append_printf(cmd, " -mtime -%u", query->max_age);
+}
+
+/**
+  *   @brief Rewrite a regular expression matching a name for find, which matches the whole path
+  *   @param pattern Extended regular expression
+  *   @return Dynamically allocated expression matching paths whose last
+  *   component has a match, NULL if anchors in the pattern cannot be rewritten
+  *   @remark The expression may also match other paths, the names are checked again
+  */
+static gchar *find_path_regex(const char *pattern) {
+  const size_t len = strlen(pattern);
+  const bool start = pattern[0] == '^';
+  // A '$' escaped by an odd number of backslashes is a literal
+  size_t escapes = 0;
+  while (escapes + 1 < len && pattern[len - 2 - escapes] == '\\') escapes++;
+  const bool end = len > (size_t) start && pattern[len - 1] == '$' && escapes % 2 == 0;
+  gchar *inner = g_strndup(pattern + start, len - start - end);
+  // Anchors elsewhere, or alternatives the stripped anchors would not apply to
+  if (strpbrk(inner, "^$") || ((start || end) && strchr(inner, '|'))) {
+    g_free(inner);
+    return NULL;
+  }
+  gchar *regex = g_strdup_printf(".*/%s(%s)%s", start ? "" : "[^/]*", inner, end ? "" : "[^/]*");
+  g_free(inner);
+  return regex;
+}
+
+char *find_command(const char *root, const SearchQuery *query) {
+  gchar *quoted = g_shell_quote(root);
+  GString *cmd = g_string_new("find / -prune -printf '" FIND_SENTINEL "\\0' 2>/dev/null && find ");
+  g_string_append(cmd, quoted);
+  g_string_append(cmd, " -mindepth 1");
+  g_free(quoted);
+  if (query->pattern && !query->regex) {
+    quoted = g_shell_quote(query->pattern);
+    g_string_append_printf(cmd, " %s %s", query->ignore_case ? "-iname" : "-name", quoted);
+    g_free(quoted);
+  } else if (query->pattern) {
+    // find matches the whole path, without -regex all entries are checked by name
+    gchar *regex = find_path_regex(query->pattern);
+    if (regex) {
+      quoted = g_shell_quote(regex);
+      g_string_append_printf(cmd, " -regextype posix-extended %s %s", query->ignore_case ? "-iregex" : "-regex", quoted);
+      g_free(quoted);
+      g_free(regex);
+    }
+  }
+  append_find_predicates(cmd, query);
+  g_string_append(cmd, " -printf '%y %s %T@ %p\\0' 2>/dev/null");
+  char *ret = malloc(cmd->len + 1);
+  if (ret) strcpy(ret, cmd->str);
+  g_string_free(cmd, TRUE);
+  return ret;
+}
+
+/**
+  *   @brief Get the file type of a find %y type letter
+  *   @param type Type letter
+  *   @return SSH_FILEXFER_TYPE
+  */
+static uint8_t find_type(const char type) {
+  switch (type) {
+    case 'f':
+      return SSH_FILEXFER_TYPE_REGULAR;
+    case 'd':
+      return SSH_FILEXFER_TYPE_DIRECTORY;
+    case 'l':
+      return SSH_FILEXFER_TYPE_SYMLINK;
+    default:
+      return SSH_FILEXFER_TYPE_SPECIAL;
+  }
+}
+
+File_t *parse_find_record(const char *record) {
+  char *end;
+  if (record[0] == '\0' || record[1] != ' ') return NULL;
+  const uint64_t size = strtoull(record + 2, &end, 10);
+  if (end == record + 2 || *end != ' ') return NULL;
+  const char *mtime_start = end + 1;
+  const uint64_t mtime = strtoull(mtime_start, &end, 10);
+  if (end == mtime_start) return NULL;
+  if (*end == '.') {
+    end++;
+    while (*end >= '0' && *end <= '9') end++;
+  }
+  if (*end != ' ' || end[1] == '\0') return NULL;
+  File_t *file = new_File(end + 1, find_type(record[0]));
+  if (file) {
+    file->size = size;
+    file->mtime = mtime;
+  }
+  return file;
+}
+
+
+/* Content search */
+
+void free_GrepMatch(gpointer match) {
+  GrepMatch *grep_match = (GrepMatch *) match;
+  if (grep_match) {
+    free(grep_match->path);
+    free(grep_match->text);
+    free(grep_match);
+  }
+}
+
+void GrepParser_init(GrepParser *parser, SearchProgress *progress) {
+  memset(parser, 0, sizeof(GrepParser));
+  parser->field = GREP_FIELD_SENTINEL;
+  parser->path = g_string_new("");
+  parser->text = g_string_new("");
+  parser->progress = progress;
+  progress->free_match = free_GrepMatch;
+}
+
+void GrepParser_destroy(GrepParser *parser) {
+  g_string_free(parser->path, TRUE);
+  g_string_free(parser->text, TRUE);
+}
+
+/**
+  *   @brief Add the parsed match and start parsing the next one
+  *   @param parser GrepParser
+  *   @return false if the search should stop
+  */
+static bool GrepParser_emit(GrepParser *parser) {
+  bool ret = true;
+  if (!parser->invalid && parser->line > 0) {
+    if (parser->text->len > 0 && parser->text->str[parser->text->len - 1] == '\r') {
+      g_string_truncate(parser->text, parser->text->len - 1);
+    }
+    // A cut may split a multibyte character, it is replaced like invalid bytes
+    gchar *valid = g_utf8_make_valid(parser->text->str, parser->text->len);
+    GrepMatch *match = malloc(sizeof(GrepMatch));
+    char *path = malloc(parser->path->len + 1);
+    char *text = malloc(strlen(valid) + (parser->cut ? strlen("…") : 0) + 1);
+    if (match && path && text) {
+      strcpy(path, parser->path->str);
+      strcpy(text, valid);
+      if (parser->cut) strcat(text, "…");
+      *match = (GrepMatch) { path, parser->line, text };
+      ret = SearchProgress_add(parser->progress, match);
+    } else {
+      free(match);
+      free(path);
+      free(text);
+    }
+    g_free(valid);
+  }
+  g_string_truncate(parser->path, 0);
+  g_string_truncate(parser->text, 0);
+  parser->line = 0;
+  parser->invalid = false;
+  parser->cut = false;
+  parser->field = GREP_FIELD_PATH;
+  return ret;
+}
+
+enum OutputAction GrepParser_feed(GrepParser *parser, const char *data, const size_t len) {
+  if (!data) return parser->field == GREP_FIELD_SENTINEL ? OUTPUT_UNSUPPORTED : OUTPUT_CONTINUE;
+  const char *pos = data;
+  const char *end = data + len;
+  while (pos < end) {
+    if (parser->field == GREP_FIELD_SENTINEL || parser->field == GREP_FIELD_PATH) {
+      const char *stop = memchr(pos, '\0', end - pos);
+      const size_t chunk = (stop ? stop : end) - pos;
+      if (parser->path->len + chunk <= GREP_MAX_PATH) g_string_append_len(parser->path, pos, chunk);
+      else parser->invalid = true;
+      pos += chunk;
+      if (!stop) break;
+      pos++;
+      if (parser->field == GREP_FIELD_SENTINEL) {
+        if (parser->invalid || strcmp(parser->path->str, GREP_SENTINEL) != 0) return OUTPUT_UNSUPPORTED;
+        g_string_truncate(parser->path, 0);
+        parser->field = GREP_FIELD_PATH;
+      } else parser->field = GREP_FIELD_LINE;
+    } else if (parser->field == GREP_FIELD_LINE) {
+      const char c = *pos++;
+      if (c >= '0' && c <= '9' && parser->line < UINT_MAX / 10) parser->line = parser->line * 10 + (c - '0');
+      else if (c == ':') parser->field = GREP_FIELD_TEXT;
+      else if (c == '\n') {
+        parser->invalid = true;
+        if (!GrepParser_emit(parser)) return OUTPUT_STOP;
+      } else parser->invalid = true;
+    } else {
+      const char *stop = memchr(pos, '\n', end - pos);
+      const size_t chunk = (stop ? stop : end) - pos;
+      const size_t room = parser->text->len < GREP_MAX_TEXT ? GREP_MAX_TEXT - parser->text->len : 0;
+      g_string_append_len(parser->text, pos, chunk < room ? chunk : room);
+      if (chunk > room) parser->cut = true;
+      pos += chunk;
+      if (!stop) break;
+      pos++;
+      if (!GrepParser_emit(parser)) return OUTPUT_STOP;
+    }
+  }
+  return OUTPUT_CONTINUE;
+}
+
+char *grep_command(const char *root, const SearchQuery *query) {
+  if (!query->pattern) return NULL;
+  gchar *quoted = g_shell_quote(root);
+  GString *cmd = g_string_new("command -v grep >/dev/null 2>&1 && printf '" GREP_SENTINEL "\\0' && find ");
+  g_string_append(cmd, quoted);
+  g_string_append(cmd, " -type f");
+  g_free(quoted);
+  append_find_predicates(cmd, query);
+  // --null separates the path, which may contain ':', from the line number
+  g_string_append_printf(cmd, " -exec grep -nIH --null%s %s -e ", query->ignore_case ? " -i" : "",
+                         query->regex ? "-E" : "-F");
+  quoted = g_shell_quote(query->pattern);
+  g_string_append(cmd, quoted);
+  g_free(quoted);
+  g_string_append(cmd, " -- {} + 2>/dev/null");
+  char *ret = malloc(cmd->len + 1);
+  if (ret) strcpy(ret, cmd->str);
+  g_string_free(cmd, TRUE);
+  return ret;
+}
+
+/**
+  *   @brief Parse a chunk of grep output, OutputParse of sftp_session_grep
+  */
+static enum OutputAction grep_parse(const char *data, const size_t len, void *parser) {
+  return GrepParser_feed((GrepParser *) parser, data, len);
+}
+
+
+/* Remote search */
+
+/**
+  *   @brief Parse the complete records of find output
+  *   @param parser FindParser, parsed records are removed from its output
+  *   @return OutputAction
+  */
+static enum OutputAction parse_find_output(FindParser *parser) {
+  GByteArray *output = parser->output;
+  const char *start = (const char *) output->data;
+  const char *end = start + output->len;
+  const char *record_end;
+  enum OutputAction ret = OUTPUT_CONTINUE;
+  while (ret == OUTPUT_CONTINUE && (record_end = memchr(start, '\0', end - start))) {
+    if (!parser->sentinel) {
+      if (strcmp(start, FIND_SENTINEL) != 0) return OUTPUT_UNSUPPORTED;
+      parser->sentinel = true;
+    } else {
+      File_t *file = parse_find_record(start);
+      if (file && parser->regex) {
+        // find matched the regular expression against the whole path
+        const char *name = strrchr(file->name, '/');
+        if (!SearchQuery_matches_name(parser->query, parser->regex, name ? name + 1 : file->name)) {
+          free_File(file);
+          file = NULL;
+        }
+      }
+      if (file && !SearchProgress_add(parser->progress, file)) ret = OUTPUT_STOP;
+    }
+    start = record_end + 1;
+  }
+  g_byte_array_remove_range(output, 0, start - (const char *) output->data);
+  return ret;
+}
+
+void FindParser_init(FindParser *parser, const SearchQuery *query, const regex_t *regex, SearchProgress *progress) {
+  parser->output = g_byte_array_new();
+  parser->sentinel = false;
+  parser->query = query;
+  parser->regex = regex;
+  parser->progress = progress;
+}
+
+void FindParser_destroy(FindParser *parser) {
+  g_byte_array_free(parser->output, TRUE);
+}
+
+enum OutputAction FindParser_feed(FindParser *parser, const char *data, const size_t len) {
+  if (!data) return parser->sentinel ? OUTPUT_CONTINUE : OUTPUT_UNSUPPORTED;
+  g_byte_array_append(parser->output, (const guint8 *) data, len);
+  return parse_find_output(parser);
+}
+
+/**
+  *   @brief Parse a chunk of find output, OutputParse of find_exec
+  */
+static enum OutputAction find_parse(const char *data, const size_t len, void *parser) {
+  return FindParser_feed((FindParser *) parser, data, len);
+}
+
+int search_exec_status(const enum ExecStatus status, const enum OutputAction action) {
+  switch (status) {
+    case EXEC_FINISHED:
+    case EXEC_STOPPED:
+      // Stopped at SEARCH_MAX_RESULTS, or the output (also empty output) had no sentinel
+      return action == OUTPUT_UNSUPPORTED ? SEARCH_UNSUPPORTED : 0;
+    case EXEC_NOT_STARTED:
+      // A restricted account may refuse exec or run sftp-server instead, neither prints the sentinel
+      return SEARCH_UNSUPPORTED;
+    default:
+      return -1;
+  }
+}
+
+/**
+  *   @struct SearchExec
+  *   @brief Output parser of a search command run by search_exec
+  */
+typedef struct {
+  OutputParse parse; /**< Parser of the output */
+  void *parser; /**< Passed to parse */
+  enum OutputAction action; /**< Last result of parse */
+} SearchExec;
+
+/**
+  *   @brief Pass a chunk of output to the parser, ExecOutput of search_exec
+  */
+static bool search_output(const char *data, const size_t len, void *user_data) {
+  SearchExec *search = (SearchExec *) user_data;
+  search->action = search->parse(data, len, search->parser);
+  return search->action == OUTPUT_CONTINUE;
+}
+
+/**
+  *   @brief Run a search command on the server and parse its output as it arrives
+  *   @param session Session struct, not locked
+  *   @param cmd Shell command
+  *   @param progress SearchProgress, the command stops when it is cancelled
+  *   @param parse Parser of the output
+  *   @param parser Passed to parse
+  *   @return 0 on success, -1 on error or if cancelled, SEARCH_UNSUPPORTED if
+  *   the command could not be started or its output did not start with its sentinel
+  */
+static int search_exec(Session *session, const char *cmd, SearchProgress *progress, OutputParse parse, void *parser) {
+  SearchExec search = { parse, parser, OUTPUT_CONTINUE };
+  // Shared: other threads use the session while the command is busy on the server
+  RemoteExec exec = { .out = search_output, .user_data = &search, .cancel = &(progress->cancel), .shared = true,
+                      .exit_status = -1 };
+  const enum ExecStatus status = remote_exec(session, cmd, &exec);
+  if (status == EXEC_FINISHED) search.action = parse(NULL, 0, parser);
+  return search_exec_status(status, search.action);
+}
+
+/**
+  *   @brief Search with find on the server
+  *   @param session Session struct, not locked
+  *   @param root Folder to be searched
+  *   @param query SearchQuery
+  *   @param regex Compiled pattern, NULL for globs
+  *   @param progress Where matches are added
+  *   @return 0 on success, -1 on error or if cancelled, SEARCH_UNSUPPORTED if
+  *   the server cannot run find
+  */
+static int find_exec(Session *session, const char *root, const SearchQuery *query, const regex_t *regex,
+                     SearchProgress *progress) {
+  char *cmd = find_command(root, query);
+  if (!cmd) return -1;
+  FindParser parser;
+  FindParser_init(&parser, query, regex, progress);
+  const int ret = search_exec(session, cmd, progress, find_parse, &parser);
+  FindParser_destroy(&parser);
+  free(cmd);
+  return ret;
+}
+
+int sftp_session_grep(Session *session, const char *root, const SearchQuery *query, SearchProgress *progress) {
+  char *cmd = grep_command(root, query);
+  if (!cmd) return -1;
+  GrepParser parser;
+  GrepParser_init(&parser, progress);
+  int ret = search_exec(session, cmd, progress, grep_parse, &parser);
+  GrepParser_destroy(&parser);
+  free(cmd);
+  pthread_mutex_lock(&(progress->lock));
+  if (progress->truncated) ret = 0;
+  pthread_mutex_unlock(&(progress->lock));
+  return ret;
+}
+
+/**
+  *   @brief Match an entry, RemoteWalk entry callback of the sftp fallback
+  */
+static enum WalkAction search_entry(const char *parent, const File_t *file, void *data) {
+  SearchWalk *walk = (SearchWalk *) data;
+  if (!SearchQuery_matches(walk->query, walk->regex, file, walk->now)) return WALK_CONTINUE;
+  File_t *match = copy_File(file);
+  if (!match) return WALK_CONTINUE;
+  char *path = construct_filepath(parent, file->name);
+  if (!path) {
+    free_File(match);
+    return WALK_CONTINUE;
+  }
+  free(match->name);
+  match->name = path;
+  return SearchProgress_add(walk->progress, match) ? WALK_CONTINUE : WALK_STOP;
+}
+
+/**
+  *   @brief Match the entries of a folder, FsWalkVisit of fs_find
+  *   @param dir Folder being read
+  *   @param data LocalSearch
+  */
+static void local_search_visit(FsWalkDir *dir, void *data) {
+  LocalSearch *search = (LocalSearch *) data;
+  const regex_t *regex = search->regexes ? &(search->regexes[dir->thread]) : NULL;
+  const char *name;
+  unsigned char type;
+  while (FsWalkDir_next(dir, &name, &type)) {
+    if (type == DT_DIR) FsWalkDir_descend(dir, name);
+    if (!SearchQuery_matches_name(search->query, regex, name)) continue;
+    struct stat st;
+    if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue; // Removed meanwhile
+    char *path = construct_filepath(dir->path, name);
+    File_t *file = path ? new_File(path, type) : NULL;
+    free(path);
+    if (!file) continue;
+    file->size = st.st_size;
+    file->mtime = st.st_mtime;
+    if (!SearchQuery_matches_metadata(search->query, file, search->now)) free_File(file);
+    else if (!SearchProgress_add(search->progress, file)) {
+      g_atomic_int_set(&(search->progress->cancel), 1);
+      return;
+    }
+  }
+}
+
+int fs_find(const char *root, const SearchQuery *query, SearchProgress *progress, const unsigned threads) {
+  const unsigned count = threads > 0 ? threads : 1;
+  LocalSearch search = { query, NULL, progress, time(NULL) };
+  unsigned compiled = 0;
+  if (query->regex && query->pattern) {
+    // regexec serializes the threads sharing a compiled pattern
+    search.regexes = calloc(count, sizeof(regex_t));
+    if (!search.regexes) return -1;
+    while (compiled < count && SearchQuery_compile(query, &(search.regexes[compiled])) == 0) compiled++;
+  }
+  int ret = -1;
+  if (!search.regexes || compiled == count) ret = fs_walk(root, count, &(progress->cancel), local_search_visit, &search);
+  for (unsigned i = 0; i < compiled; i++) regfree(&(search.regexes[i]));
+  free(search.regexes);
+  pthread_mutex_lock(&(progress->lock));
+  if (progress->truncated) ret = 0;
+  pthread_mutex_unlock(&(progress->lock));
+  return ret;
+}
+
+int sftp_session_find(Session *session, const char *root, const SearchQuery *query, SearchProgress *progress) {
+  regex_t compiled;
+  if (SearchQuery_compile(query, &compiled) != 0) return -1;
+  const regex_t *regex = query->regex && query->pattern ? &compiled : NULL;
+  int ret = find_exec(session, root, query, regex, progress);
+  if (ret == SEARCH_UNSUPPORTED) {
+    g_atomic_int_set(&(progress->fallback), 1);
+    SearchWalk search = { query, regex, progress, time(NULL) };
+    RemoteWalk walk = { .entry = search_entry, .data = &search, .lock_session = true, .cancel = &(progress->cancel) };
+    ret = sftp_session_walk(session, root, &walk);
+  }
+  if (regex) regfree(&compiled);
+  pthread_mutex_lock(&(progress->lock));
+  if (progress->truncated) ret = 0;
+  pthread_mutex_unlock(&(progress->lock));
+  return ret;
+}
@@ -5,6 +5,7 @@
   */
 
 #include "../include/ssh.h"
+#include "../include/walk.h"
 #include <libssh/libssh.h>
 
 // Session struct related
@@ -27,9 +28,16 @@ Session *create_session(const char *username, const char *remote) {
     session->hash = NULL;
     session->sftp = NULL;
     session->home_dir = NULL;
+    session->downloads = NULL;
+    session->shell_delete = 0;
+    session->name = malloc(strlen(username) + strlen(remote) + 2);
+    if (session->name) sprintf(session->name, "%s@%s", username, remote);
+    pthread_mutex_init(&session->lock, NULL);
     session->session = ssh_new();
     if (!session->session) {
+      free(session->name);
       perror(get_error(SSH_CREATE_ERROR));
+      pthread_mutex_destroy(&session->lock);
       free(session);
       return NULL;
     }
@@ -41,6 +49,8 @@ Session *create_session(const char *username, const char *remote) {
     perror(get_error(SSH_CONNECT_ERROR));
     perror(ssh_get_error(session->session));
     ssh_free(session->session);
+    free(session->name);
+    pthread_mutex_destroy(&session->lock);
     free(session);
   }
   return NULL;
@@ -59,6 +69,8 @@ int end_session(Session *session) {
     if (session->home_dir) {
       free(session->home_dir);
     }
+    free(session->name);
+    pthread_mutex_destroy(&session->lock);
     free(session);
     return 0;
   }
@@ -208,55 +220,171 @@ enum AuthenticationAction authenticate_password(Session *session, const char *pa
 
 // Executing remote commands
 
-int execute_remote_command( Session *session,
-                            const char *cmd,
-                            char **res,
-                            const unsigned res_len)
-{
-  if (! *res) return -1;
-  int nread, tot = 0;
-  ssh_channel channel;
-  channel = ssh_channel_new(session->session);
-  if (!channel) {
-    Session_message(session, get_error(SSH_CHANNEL_ERROR));
-    return -1;
+RemoteCommand *start_RemoteCommand(Session *session, const char *cmd) {
+  RemoteCommand *command = malloc(sizeof(RemoteCommand));
+  if (!command) return NULL;
+  command->session = session;
+  command->eof = false;
+  command->channel = ssh_channel_new(session->session);
+  if (!command->channel) {
+    free(command);
+    return NULL;
   }
-  if (ssh_channel_open_session(channel) != SSH_OK) {
-    Session_message(session, get_error(SSH_CHANNEL_ERROR));
-    ssh_channel_free(channel);
-    return -1;
+  if (ssh_channel_open_session(command->channel) != SSH_OK) {
+    ssh_channel_free(command->channel);
+    free(command);
+    return NULL;
   }
-  if (ssh_channel_request_exec(channel, cmd) != SSH_OK) {
-    ssh_channel_close(channel);
-    ssh_channel_free(channel);
-    Session_message(session, get_error(SSH_REMOTE_COMMAND_ERROR));
-    return -1;
+  if (ssh_channel_request_exec(command->channel, cmd) != SSH_OK) {
+    ssh_channel_close(command->channel);
+    ssh_channel_free(command->channel);
+    free(command);
+    return NULL;
   }
-  do {
-    nread = ssh_channel_read(channel, res[tot], res_len - tot, 0);
-    tot += nread;
-  } while (nread > 0);
-  (*res)[tot - 1] = '\0'; // The last char is EOF/EOT, overwrite it with a null byte
-  if (nread < 0) {
-    ssh_channel_close(channel);
-    ssh_channel_free(channel);
+  ssh_channel_send_eof(command->channel);
+  return command;
+}
+
+int RemoteCommand_read(RemoteCommand *command, char *buff, const unsigned len, const bool is_stderr, const int timeout) {
+  if (command->eof && !is_stderr) return 0;
+  const int nread = ssh_channel_read_timeout(command->channel, buff, len, is_stderr, timeout);
+  if (nread == 0 && !is_stderr && ssh_channel_is_eof(command->channel)) command->eof = true;
+  return nread < 0 ? -1 : nread;
+}
+
+int RemoteCommand_exit_status(RemoteCommand *command) {
+  return ssh_channel_get_exit_status(command->channel);
+}
+
+void end_RemoteCommand(RemoteCommand *command) {
+  if (command) {
+    if (ssh_channel_is_open(command->channel)) ssh_channel_close(command->channel);
+    ssh_channel_free(command->channel);
+    free(command);
+  }
+}
+
+enum ExecStatus ExecChannel_run(ExecChannel *channel, RemoteExec *exec) {
+  exec->exit_status = -1;
+  char *buff = malloc(EXEC_READ_SIZE);
+  if (!buff) return EXEC_FAILED;
+  const gint64 deadline = exec->timeout ? g_get_monotonic_time() + (gint64) exec->timeout * 1000 : 0;
+  enum ExecStatus ret = EXEC_FINISHED;
+  while (ret == EXEC_FINISHED) {
+    if (exec->cancel && g_atomic_int_get(exec->cancel)) {
+      ret = EXEC_CANCELLED;
+      break;
+    }
+    if (deadline && g_get_monotonic_time() >= deadline) {
+      ret = EXEC_TIMED_OUT;
+      break;
+    }
+    // stderr is buffered apart from stdout, take what has arrived before waiting for stdout
+    const int nerr = channel->read(channel->target, buff, EXEC_READ_SIZE, true, 0);
+    if (nerr < 0) ret = EXEC_FAILED;
+    else if (nerr > 0) {
+      if (exec->err && !exec->err(buff, nerr, exec->user_data)) ret = EXEC_STOPPED;
+    } else if (channel->eof(channel->target)) break;
+    else {
+      // Timeout releases a shared session while the command is busy on the server
+      const int nout = channel->read(channel->target, buff, EXEC_READ_SIZE, false, EXEC_POLL_TIMEOUT);
+      if (nout < 0) ret = EXEC_FAILED;
+      else if (nout > 0 && exec->out && !exec->out(buff, nout, exec->user_data)) ret = EXEC_STOPPED;
+    }
+  }
+  free(buff);
+  if (ret == EXEC_FINISHED) exec->exit_status = channel->exit_status(channel->target);
+  return ret;
+}
+
+/**
+  *   @struct SessionCommand
+  *   @brief Target of the ExecChannel of remote_exec
+  */
+typedef struct {
+  Session *session; /**< Session the command runs on */
+  RemoteCommand *command; /**< Running command */
+  bool shared; /**< Whether the session is locked around each call */
+} SessionCommand;
+
+/**
+  *   @brief Read a chunk of output, ExecRead of remote_exec
+  */
+static int session_command_read(void *target, char *buff, const unsigned len, const bool is_stderr, const int timeout) {
+  SessionCommand *command = (SessionCommand *) target;
+  if (command->shared) session_lock(command->session);
+  const int nread = RemoteCommand_read(command->command, buff, len, is_stderr, timeout);
+  if (command->shared) session_unlock(command->session);
+  return nread;
+}
+
+/**
+  *   @brief Check whether stdout has ended, ExecChannel eof of remote_exec
+  */
+static bool session_command_eof(void *target) {
+  return ((SessionCommand *) target)->command->eof;
+}
+
+/**
+  *   @brief Get the exit status, ExecChannel exit_status of remote_exec
+  */
+static int session_command_exit_status(void *target) {
+  SessionCommand *command = (SessionCommand *) target;
+  if (command->shared) session_lock(command->session);
+  const int status = RemoteCommand_exit_status(command->command);
+  if (command->shared) session_unlock(command->session);
+  return status;
+}
+
+enum ExecStatus remote_exec(Session *session, const char *cmd, RemoteExec *exec) {
+  exec->exit_status = -1;
+  if (exec->shared) session_lock(session);
+  RemoteCommand *command = start_RemoteCommand(session, cmd);
+  if (exec->shared) session_unlock(session);
+  if (!command) return EXEC_NOT_STARTED;
+  SessionCommand target = { session, command, exec->shared };
+  ExecChannel channel = { session_command_read, session_command_eof, session_command_exit_status, &target };
+  const enum ExecStatus ret = ExecChannel_run(&channel, exec);
+  if (exec->shared) session_lock(session);
+  end_RemoteCommand(command);
+  if (exec->shared) session_unlock(session);
+  return ret;
+}
+
+/**
+  *   @brief Append a chunk of output to a GString, ExecOutput of execute_remote_command
+  */
+static bool append_output(const char *data, const size_t len, void *user_data) {
+  g_string_append_len((GString *) user_data, data, len);
+  return true;
+}
+
+char *execute_remote_command(Session *session, const char *cmd, int *exit_status) {
+  GString *output = g_string_new("");
+  RemoteExec exec = { .out = append_output, .user_data = output, .exit_status = -1 };
+  const enum ExecStatus status = remote_exec(session, cmd, &exec);
+  if (exit_status) *exit_status = exec.exit_status;
+  if (status != EXEC_FINISHED) {
+    g_string_free(output, TRUE);
     Session_message(session, get_error(SSH_REMOTE_COMMAND_ERROR));
-    return -1;
+    return NULL;
   }
-  return 0;
+  if (output->len > 0 && output->str[output->len - 1] == '\n') g_string_truncate(output, output->len - 1);
+  char *res = malloc(output->len + 1);
+  if (res) memcpy(res, output->str, output->len + 1);
+  g_string_free(output, TRUE);
+  return res;
 }
 
 int get_remote_home_dir(Session *session) {
-  const unsigned len = 250;
-  char *buffer = malloc(len);
-  if (execute_remote_command(session, "echo $HOME", &buffer, len) != 0) {
-    free(buffer);
-    return -1;
-  }
+  int exit_status;
+  char *home = execute_remote_command(session, "echo $HOME", &exit_status);
+  if (!home) return -1;
   if (session->home_dir) free(session->home_dir);
-  session->home_dir = malloc(strlen(buffer) + 1);
-  strcpy(session->home_dir, buffer);
-  free(buffer);
+  session->home_dir = NULL;
+  // Without a usable home folder the remote view starts from "/"
+  if (exit_status == 0 && home[0] == '/') session->home_dir = home;
+  else free(home);
   return 0;
 }
 
@@ -292,6 +420,14 @@ bool sftp_session_is_filename_folder(Session *session, const char *filename, con
   return ret;
 }
 
+int sftp_session_dir_mtime(Session *session, const char *path, uint64_t *mtime) {
+  sftp_attributes attr = sftp_stat(session->sftp, path);
+  if (!attr) return -1;
+  *mtime = attr->mtime;
+  sftp_attributes_free(attr);
+  return 0;
+}
+
 enum FileStatus sftp_session_mkdir(Session *session, const char *dir_name, mode_t permissions) {
   if (permissions == 0) permissions = S_IRWXU | S_IRGRP | S_IXGRP | S_IXOTH;
   if (sftp_mkdir(session->sftp, dir_name, permissions) != SSH_OK) {
@@ -304,9 +440,55 @@ enum FileStatus sftp_session_mkdir(Session *session, const char *dir_name, mode_
   return FILE_WRITTEN_SUCCESSFULLY;
 }
 
+/**
+  *   @brief Create a File from sftp attributes
+  *   @param attr Attributes from sftp_readdir or sftp_lstat
+  *   @param name Filename, copied
+  *   @return Dynamically allocated File with metadata, NULL on error
+  */
+static struct File *new_File_attributes(const sftp_attributes attr, const char *name) {
+  struct File *file = new_File(name, attr->type);
+  if (file) {
+    file->size = attr->size;
+    file->uid = attr->uid;
+    file->gid = attr->gid;
+    if (attr->owner) {
+      file->owner = malloc(strlen(attr->owner) + 1);
+      if (file->owner) strcpy(file->owner, attr->owner);
+    }
+    if (attr->group) {
+      file->group = malloc(strlen(attr->group) + 1);
+      if (file->group) strcpy(file->group, attr->group);
+    }
+    file->permissions = attr->permissions;
+    file->mtime = attr->mtime;
+    file->has_metadata = true;
+  }
+  return file;
+}
+
+File_t *sftp_session_new_File(Session *session, const char *dir_name, const char *name) {
+  struct File *file = NULL;
+  char *path = construct_filepath(dir_name, name);
+  if (path) {
+    sftp_attributes attr = sftp_lstat(session->sftp, path);
+    if (attr) {
+      file = new_File_attributes(attr, name);
+      sftp_attributes_free(attr);
+    }
+    free(path);
+  }
+  return file;
+}
+
 GSList *sftp_session_ls_dir(Session *session, GSList *files, const char *dir_name) {
+  return sftp_session_ls_dir_limit(session, files, dir_name, 0);
+}
+
+GSList *sftp_session_ls_dir_limit(Session *session, GSList *files, const char *dir_name, const unsigned max_entries) {
   sftp_dir dir;
   sftp_attributes attr;
+  unsigned count = 0;
 
   // Clear old content
   clear_Filelist(files);
@@ -318,33 +500,86 @@ GSList *sftp_session_ls_dir(Session *session, GSList *files, const char *dir_nam
     return NULL;
   }
   while ((attr = sftp_readdir(session->sftp, dir)) != NULL) {
-    // malloc should not fail
-    struct File *file = malloc(sizeof(struct File));
-    file->name = malloc(strlen(attr->name) + 1);
-    strcpy(file->name, attr->name);
-    file->type = attr->type;
-    file->size = attr->size;
-    file->uid = attr->uid;
-    file->gid = attr->gid;
-    file->owner = malloc(strlen(attr->owner) + 1);
-    strcpy(file->owner, attr->owner);
-    file->group = malloc(strlen(attr->group) + 1);
-    strcpy(file->group, attr->group);
-    file->permissions = attr->permissions;
-    file->mtime = attr->mtime;
+    // The attributes arrive in the same READDIR reply as the name, so copy them right away
+    struct File *file = new_File_attributes(attr, attr->name);
+    if (!file) {
+      sftp_attributes_free(attr);
+      sftp_closedir(dir);
+      clear_Filelist(files);
+      return NULL;
+    }
 
-    files = append_FileList(files, file);
+    // Prepend and reverse once at the end, appending is O(n) per entry
+    files = g_slist_prepend(files, file);
     sftp_attributes_free(attr);
-
+    if (max_entries && ++count > max_entries) {
+      // Stop before the next READDIR round trip
+      sftp_closedir(dir);
+      clear_Filelist(files);
+      return NULL;
+    }
   }
 
   if (!sftp_dir_eof(dir)) {
     Session_message(session, get_error(ERROR_LISTING_DIRECTORY));
+    sftp_closedir(dir);
     clear_Filelist(files);
     return NULL;
   }
   sftp_closedir(dir); // No error checking because if this fails there is very little that can be done
-  return files;
+  return g_slist_reverse(files);
+}
+
+/**
+  *   @struct DirSizeWalk
+  *   @brief Totals of sftp_session_dir_size not yet added to the progress
+  */
+typedef struct {
+  DirSizeProgress *progress; /**< Shared progress */
+  DirSize delta; /**< Counted since the last flush */
+  unsigned entries; /**< Entries in delta */
+} DirSizeWalk;
+
+/**
+  *   @brief Add the counted totals to the progress
+  *   @param walk DirSizeWalk
+  */
+static void DirSizeWalk_flush(DirSizeWalk *walk) {
+  DirSizeProgress_add(walk->progress, &(walk->delta));
+  memset(&(walk->delta), 0, sizeof(DirSize));
+  walk->entries = 0;
+}
+
+/**
+  *   @brief Count an entry, RemoteWalk entry callback
+  */
+static enum WalkAction dir_size_entry(__attribute__((unused)) const char *parent, const File_t *file, void *data) {
+  DirSizeWalk *walk = (DirSizeWalk *) data;
+  if (file->type == SSH_FILEXFER_TYPE_DIRECTORY) walk->delta.folders++;
+  else {
+    walk->delta.files++;
+    if (file->type == SSH_FILEXFER_TYPE_REGULAR) walk->delta.size += file->size;
+  }
+  if (++(walk->entries) >= DIR_SIZE_BATCH) DirSizeWalk_flush(walk);
+  return WALK_CONTINUE;
+}
+
+/**
+  *   @brief Count an unreadable folder, RemoteWalk leave callback
+  */
+static enum WalkAction dir_size_leave(__attribute__((unused)) const char *path, const bool readable, void *data) {
+  DirSizeWalk *walk = (DirSizeWalk *) data;
+  if (!readable) walk->delta.unreadable++;
+  return WALK_CONTINUE;
+}
+
+int sftp_session_dir_size(Session *session, const char *path, DirSizeProgress *progress) {
+  DirSizeWalk totals = { progress, { 0 }, 0 };
+  RemoteWalk walk = { .entry = dir_size_entry, .leave = dir_size_leave, .data = &totals, .lock_session = true,
+                      .cancel = &(progress->cancel) };
+  const int ret = sftp_session_walk(session, path, &walk);
+  DirSizeWalk_flush(&totals);
+  return ret;
 }
 
 enum FileStatus sftp_session_write_file(  Session *session,
@@ -400,7 +635,14 @@ enum FileStatus sftp_session_read_file( Session *session,
   sftp_attributes attr = sftp_stat(session->sftp, remote_filename);
   if (!attr) return FILE_WRITE_FAILED;
   permissions = attr->permissions;
+  const uint64_t size = attr->size;
+  const uint64_t mtime = attr->mtime;
   sftp_attributes_free(attr);
+  DownloadCache *cache = session->name ? session->downloads : NULL;
+  if (cache && DownloadCache_fetch(cache, session->name, remote_filename, size, mtime, local_filename,
+                                   overwrite, permissions) == 0) {
+    return FILE_WRITTEN_SUCCESSFULLY;
+  }
   file = sftp_open(session->sftp, remote_filename, O_RDONLY, 0);
   if (!file) {
     Session_message(session, get_error(ERROR_OPENING_FILE));
@@ -415,12 +657,16 @@ enum FileStatus sftp_session_read_file( Session *session,
     Session_message(session, get_error(ERROR_OPENING_FILE));
     return FILE_WRITE_FAILED;
   }
+  // Hashed while transferred, so the cache does not read the file again
+  GChecksum *checksum = cache ? g_checksum_new(G_CHECKSUM_SHA256) : NULL;
+  uint64_t transferred = 0;
   while(1) {
     nread = sftp_read(file, buffer, sizeof(buffer));
     if (nread == 0) break;
     else if (nread < 0) {
       close(fd);
       sftp_close(file);
+      if (checksum) g_checksum_free(checksum);
       Session_message(session, get_error(ERROR_READING_FILE));
       return FILE_READ_FAILED;
     }
@@ -428,12 +674,23 @@ enum FileStatus sftp_session_read_file( Session *session,
     if (nwritten != nread) {
       close(fd);
       sftp_close(file);
+      if (checksum) g_checksum_free(checksum);
       Session_message(session, get_error(ERROR_WRITING_TO_FILE));
       return FILE_WRITE_FAILED;
     }
+    if (checksum) g_checksum_update(checksum, (const guchar *) buffer, nread);
+    transferred += (uint64_t) nread;
   }
   close(fd); // No error checking because if this fails there is very little that can be done
   sftp_close(file);
+  if (checksum) {
+    // A file changed during the transfer is not cached
+    if (transferred == size) {
+      DownloadCache_store(cache, session->name, remote_filename, size, mtime, local_filename,
+                          g_checksum_get_string(checksum));
+    }
+    g_checksum_free(checksum);
+  }
   return FILE_WRITTEN_SUCCESSFULLY;
 }
 
@@ -442,51 +699,93 @@ enum FileStatus sftp_session_rename_file(Session *session, const char *path, con
   return FILE_WRITTEN_SUCCESSFULLY;
 }
 
-enum FileStatus sftp_session_rmdir(Session *session, const char *dir_name, bool recursive) {
+/**
+  *   @brief Remove a remote folder recursively one entry at a time
+  *   @param session Session struct, locked
+  *   @param dir_name Path of the folder
+  *   @return 0 on success, FILE_REMOVE_FAILED or STOP_FILE_OPERATIONS
+  */
+static enum FileStatus rmdir_serial(Session *session, const char *dir_name) {
   sftp_dir dir;
   sftp_attributes attr;
   int ret;
 
-  if (recursive) {
-    dir = sftp_opendir(session->sftp, dir_name);
-    if (!dir) return FILE_REMOVE_FAILED;
+  dir = sftp_opendir(session->sftp, dir_name);
+  if (!dir) return FILE_REMOVE_FAILED;
 
-    while ((attr = sftp_readdir(session->sftp, dir)) != NULL) {
-      if ((strcmp(attr->name, ".") != 0) && (strcmp(attr->name, "..") != 0)) {
-        if (stop) {
-          sftp_attributes_free(attr);
-          sftp_closedir(dir);
-          return STOP_FILE_OPERATIONS;
-        }
-        char *filepath = construct_filepath(dir_name, attr->name);
-        if (!filepath) {
-          sftp_attributes_free(attr);
-          sftp_closedir(dir);
-          return FILE_REMOVE_FAILED;
-        }
+  while ((attr = sftp_readdir(session->sftp, dir)) != NULL) {
+    if ((strcmp(attr->name, ".") != 0) && (strcmp(attr->name, "..") != 0)) {
+      if (stop) {
+        sftp_attributes_free(attr);
+        sftp_closedir(dir);
+        return STOP_FILE_OPERATIONS;
+      }
+      char *filepath = construct_filepath(dir_name, attr->name);
+      if (!filepath) {
+        sftp_attributes_free(attr);
+        sftp_closedir(dir);
+        return FILE_REMOVE_FAILED;
+      }
 
-        if (is_folder(attr->type, true)) {
-          ret = sftp_session_rmdir(session, filepath, true);
-        } else {
-          if (sftp_unlink(session->sftp, filepath) != 0) ret = FILE_REMOVE_FAILED;
-          else ret = 0;
-        }
-        if (ret < 0) {
-          sftp_attributes_free(attr);
-          sftp_closedir(dir);
-          return ret;
-        }
+      if (is_folder(attr->type, true)) {
+        ret = rmdir_serial(session, filepath);
+      } else {
+        if (sftp_unlink(session->sftp, filepath) != 0) ret = FILE_REMOVE_FAILED;
+        else ret = 0;
+      }
+      free(filepath);
+      if (ret < 0) {
+        sftp_attributes_free(attr);
+        sftp_closedir(dir);
+        return ret;
       }
-      sftp_attributes_free(attr);
     }
+    sftp_attributes_free(attr);
+  }
 
-    if (!sftp_dir_eof(dir)) return FILE_REMOVE_FAILED;
-    sftp_closedir(dir);
+  const bool eof = sftp_dir_eof(dir);
+  sftp_closedir(dir);
+  if (!eof) return FILE_REMOVE_FAILED;
+  return sftp_rmdir(session->sftp, dir_name) == 0 ? 0 : FILE_REMOVE_FAILED;
+}
+
+/**
+  *   @brief RemoteWalk entry of sftp_session_rmdir, stops the removal on stop
+  */
+static enum WalkAction rmdir_entry( __attribute__((unused)) const char *parent,
+                                    __attribute__((unused)) const File_t *file,
+                                    __attribute__((unused)) void *data)
+{
+  return stop ? WALK_STOP : WALK_CONTINUE;
+}
 
+enum FileStatus sftp_session_rmdir(Session *session, const char *dir_name, bool recursive) {
+  if (recursive) {
+    RemoteWalk walk = { .entry = rmdir_entry, .remove = true };
+    if (sftp_session_walk(session, dir_name, &walk) == 0) return 0;
+    if (stop) return STOP_FILE_OPERATIONS;
+    // The own channel may be refused, and what failed is retried to report the first error
+    return rmdir_serial(session, dir_name);
   }
   return sftp_rmdir(session->sftp, dir_name);
 }
 
+/**
+  *   @brief Remove a remote folder with rm -rf over an exec channel
+  *   @param session Session struct, locked
+  *   @param dir_name Path of the folder
+  *   @return true if the command succeeded
+  */
+static bool rmdir_shell(Session *session, const char *dir_name) {
+  gchar *path = g_shell_quote(dir_name);
+  gchar *cmd = g_strdup_printf("rm -rf -- %s", path);
+  g_free(path);
+  RemoteExec exec = { .exit_status = -1 };
+  const enum ExecStatus status = remote_exec(session, cmd, &exec);
+  g_free(cmd);
+  return status == EXEC_FINISHED && exec.exit_status == 0;
+}
+
 enum FileStatus sftp_session_remove_completely_file(Session *session, const char *filepath) {
   sftp_attributes attr;
   attr = sftp_stat(session->sftp, filepath);
@@ -494,7 +793,8 @@ enum FileStatus sftp_session_remove_completely_file(Session *session, const char
   if (attr) {
     if (is_folder(attr->type, true)) {
       sftp_attributes_free(attr);
-      if ((ret = sftp_session_rmdir(session, filepath, true)) != 0) {
+      if (g_atomic_int_get(&session->shell_delete) && rmdir_shell(session, filepath)) ret = 0;
+      else if ((ret = sftp_session_rmdir(session, filepath, true)) != 0) {
         Session_message(session, get_error(ERROR_DELETE_REMOTE_DIR));
       }
     } else {
@@ -590,6 +890,81 @@ enum FileStatus sftp_session_copy_to_remote(  Session *session,
   return FILE_COPY_FAILED;
 }
 
+/**
+  *   @struct CopyFromRemote
+  *   @brief State of sftp_session_copy_from_remote while walking a remote folder
+  */
+typedef struct {
+  Session *session; /**< Session struct, locked by the caller */
+  const char *remote_root; /**< Remote folder being copied */
+  const char *local_root; /**< Local copy of remote_root */
+  bool overwrite; /**< Whether to overwrite existing local files */
+  int ret; /**< First error, 0 while there is none */
+} CopyFromRemote;
+
+/**
+  *   @brief Copy an entry, RemoteWalk entry callback
+  *   @remark Folders are created when they are reported, so before their contents
+  */
+static enum WalkAction copy_from_remote_entry(const char *parent, const File_t *file, void *data) {
+  CopyFromRemote *copy = (CopyFromRemote *) data;
+  if (stop) {
+    copy->ret = STOP_FILE_OPERATIONS;
+    return WALK_STOP;
+  }
+  // parent is remote_root or below it, the same folder is created below local_root
+  const char *relative = parent + strlen(copy->remote_root);
+  char *local_parent = malloc(strlen(copy->local_root) + strlen(relative) + 1);
+  if (local_parent) {
+    strcpy(local_parent, copy->local_root);
+    strcat(local_parent, relative);
+  }
+  char *remote_path = construct_filepath(parent, file->name);
+  char *local_path = local_parent ? construct_filepath(local_parent, file->name) : NULL;
+  free(local_parent);
+  if (!remote_path || !local_path) {
+    free(remote_path);
+    free(local_path);
+    copy->ret = FILE_COPY_FAILED;
+    return WALK_STOP;
+  }
+  uint32_t permissions = file->permissions;
+  bool folder = is_folder(file->type, true);
+  int ret = 0;
+  if (file->type == SSH_FILEXFER_TYPE_SYMLINK) {
+    // Links are copied as their targets, the walker follows links to folders
+    sftp_attributes attr = sftp_stat(copy->session->sftp, remote_path);
+    if (attr) {
+      permissions = attr->permissions;
+      folder = is_folder(attr->type, true);
+      sftp_attributes_free(attr);
+    } else ret = FILE_COPY_FAILED;
+  }
+  if (ret == 0 && folder) {
+    ret = fs_mkdir(local_path, permissions);
+    if (ret == DIR_ALREADY_EXISTS && copy->overwrite) ret = 0;
+  } else if (ret == 0) {
+    ret = sftp_session_read_file(copy->session, remote_path, local_path, copy->overwrite);
+  }
+  free(remote_path);
+  free(local_path);
+  if (ret < 0) {
+    copy->ret = ret;
+    return WALK_STOP;
+  }
+  return WALK_CONTINUE;
+}
+
+/**
+  *   @brief Fail the copy on an unreadable folder, RemoteWalk leave callback
+  */
+static enum WalkAction copy_from_remote_leave(__attribute__((unused)) const char *path, const bool readable, void *data) {
+  CopyFromRemote *copy = (CopyFromRemote *) data;
+  if (readable) return WALK_CONTINUE;
+  copy->ret = FILE_COPY_FAILED;
+  return WALK_STOP;
+}
+
 enum FileStatus sftp_session_copy_from_remote(  Session *session,
                                                 const char *local_dir,
                                                 const char *remote_filepath,
@@ -609,48 +984,16 @@ enum FileStatus sftp_session_copy_from_remote(  Session *session,
   bool folder = is_folder(attr->type, true);
   sftp_attributes_free(attr);
   if (folder) {
-    // Copy folder recursively from remote
-    sftp_dir dir = sftp_opendir(session->sftp, remote_filepath);
-    if (!dir) {
-      free(local_filepath);
-      return FILE_COPY_FAILED;
-    }
-    // Create the local folder
+    // Create the local folder, its contents are copied while walking the remote one
     ret = fs_mkdir(local_filepath, permissions);
     if (ret < 0 && !(overwrite && ret == DIR_ALREADY_EXISTS)) {
       free(local_filepath);
       return ret;
     }
-    ret = 0; // reset
-    while ((attr = sftp_readdir(session->sftp, dir)) != NULL) {
-      if (stop) {
-        free(local_filepath);
-        sftp_attributes_free(attr);
-        sftp_closedir(dir);
-        return STOP_FILE_OPERATIONS;
-      }
-      if ((strcmp(attr->name, ".") != 0) && (strcmp(attr->name, "..") != 0)) {
-        char *new_remote_path = construct_filepath(remote_filepath, attr->name);
-        if (!new_remote_path) {
-          //fs_rmdir(local_filepath, false); // can do very little to errors
-          free(local_filepath);
-          sftp_attributes_free(attr);
-          sftp_closedir(dir);
-          return FILE_COPY_FAILED;
-        }
-        ret = sftp_session_copy_from_remote(session, local_filepath, new_remote_path, attr->name, overwrite);
-        if (ret < 0) {
-          free(new_remote_path);
-          free(local_filepath);
-          sftp_attributes_free(attr);
-          sftp_closedir(dir);
-          return ret;
-        }
-        free(new_remote_path);
-      }
-      sftp_attributes_free(attr);
-    }
-    sftp_closedir(dir);
+    CopyFromRemote copy = { session, remote_filepath, local_filepath, overwrite, 0 };
+    RemoteWalk walk = { .entry = copy_from_remote_entry, .leave = copy_from_remote_leave, .data = &copy,
+                        .follow_links = true };
+    ret = sftp_session_walk(session, remote_filepath, &walk) == 0 ? 0 : (copy.ret ? copy.ret : FILE_COPY_FAILED);
   } else {
     // Copy single file from remote
     ret = sftp_session_read_file(session, remote_filepath, local_filepath, overwrite);
@@ -659,43 +1002,44 @@ enum FileStatus sftp_session_copy_from_remote(  Session *session,
   return ret;
 }
 
+char *copy_command(const char *src_filepath, const char *dst_dir, const bool folder) {
+  gchar *src = g_shell_quote(src_filepath);
+  gchar *dst = g_shell_quote(dst_dir);
+  char *cmd = g_strdup_printf("cp %s-- %s %s", folder ? "-r " : "", src, dst);
+  g_free(src);
+  g_free(dst);
+  return cmd;
+}
+
 enum FileStatus sftp_session_copy_on_remote(    Session *session,
                                                 const char *src_filepath,
                                                 const char *dst_dir,
                                                 const char *filename,
                                                 const bool overwrite)
 {
-  int ret;
-  char *cmd = NULL;
-  const unsigned buff_len = 500;
-  char *buffer = malloc(buff_len);
   char *dst_path = construct_filepath(dst_dir, filename);
-  if (!buffer || !dst_path) {
-    if (buffer) free(buffer);
-    if (dst_path) free(dst_path);
+  if (!dst_path) return FILE_COPY_FAILED;
+  sftp_attributes attr = sftp_stat(session->sftp, src_filepath);
+  if (!attr) {
+    free(dst_path);
     return FILE_COPY_FAILED;
   }
-  sftp_attributes attr = sftp_stat(session->sftp, src_filepath);
   bool folder = is_folder(attr->type, true);
   sftp_attributes_free(attr);
-  sftp_attributes attr2 = sftp_stat(session->sftp, dst_path);
-  if (attr2) {
-    free(attr2);
+  attr = sftp_stat(session->sftp, dst_path);
+  free(dst_path);
+  if (attr) {
+    sftp_attributes_free(attr);
     if (!overwrite) return FILE_ALREADY_EXISTS;
   } else if (sftp_get_error(session->sftp) != SSH_FX_NO_SUCH_FILE) {
-    free(buffer);
-    free(dst_path);
     return FILE_COPY_FAILED;
   }
-  if (folder) {
-    cmd = concat_three_strings_with_spaces("cp -r", src_filepath, dst_dir);
-  } else {
-    cmd = concat_three_strings_with_spaces("cp", src_filepath, dst_dir);
-  }
-  ret = execute_remote_command(session, cmd, &buffer, buff_len);
-  free(buffer);
-  free(dst_path);
-  if (cmd) free(cmd);
-  if (ret < 0) return FILE_COPY_FAILED;
+  char *cmd = copy_command(src_filepath, dst_dir, folder);
+  if (!cmd) return FILE_COPY_FAILED;
+  // The copy runs on the server, output is not needed and may be large
+  RemoteExec exec = { .exit_status = -1 };
+  const enum ExecStatus status = remote_exec(session, cmd, &exec);
+  free(cmd);
+  if (status != EXEC_FINISHED || exec.exit_status != 0) return FILE_COPY_FAILED;
   return FILE_WRITTEN_SUCCESSFULLY;
 }
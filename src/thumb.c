@@ -0,0 +1,421 @@
+/**
+  *   @file thumb.c
+  *   @author Lauri Westerholm
+  *   @brief Image thumbnails with a freedesktop compatible disk cache
+  */
+
+#include "../include/thumb.h"
+
+static volatile gint tmp_counter = 0; /**< Makes temporary thumbnail files unique within the process */
+static ThumbJob stop_job; /**< Pushed once per thread to stop the pool */
+
+
+void ThumbBudget_init(ThumbBudget *budget, const double rate, const gint64 now) {
+  budget->rate = rate;
+  budget->tokens = rate;
+  budget->updated = now;
+}
+
+bool ThumbBudget_take(ThumbBudget *budget, const size_t bytes, const gint64 now) {
+  if (now > budget->updated) {
+    budget->tokens += budget->rate * (now - budget->updated) / G_USEC_PER_SEC;
+    if (budget->tokens > budget->rate) budget->tokens = budget->rate;
+    budget->updated = now;
+  }
+  if (budget->tokens < (double) bytes) return false;
+  budget->tokens -= bytes;
+  return true;
+}
+
+char *thumbnail_uri(const char *path, const char *remote_prefix) {
+  gchar *uri;
+  if (remote_prefix) {
+    gchar *escaped = g_uri_escape_string(path, "/", FALSE);
+    uri = g_strconcat(remote_prefix, escaped, NULL);
+    g_free(escaped);
+  } else uri = g_filename_to_uri(path, NULL, NULL);
+  if (!uri) return NULL;
+  char *ret = malloc(strlen(uri) + 1);
+  if (ret) strcpy(ret, uri);
+  g_free(uri);
+  return ret;
+}
+
+char *thumbnail_path(const char *uri) {
+  gchar *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+  if (!md5) return NULL;
+  gchar *name = g_strconcat(md5, ".png", NULL);
+  gchar *path = g_build_filename(g_get_user_cache_dir(), THUMB_FOLDER, name, NULL);
+  g_free(md5);
+  g_free(name);
+  char *ret = malloc(strlen(path) + 1);
+  if (ret) strcpy(ret, path);
+  g_free(path);
+  return ret;
+}
+
+GdkPixbuf *load_thumbnail(const char *uri, const time_t mtime) {
+  char *path = thumbnail_path(uri);
+  if (!path) return NULL;
+  GdkPixbuf *thumbnail = gdk_pixbuf_new_from_file(path, NULL);
+  free(path);
+  if (!thumbnail) return NULL;
+  const gchar *thumb_uri = gdk_pixbuf_get_option(thumbnail, "tEXt::Thumb::URI");
+  const gchar *thumb_mtime = gdk_pixbuf_get_option(thumbnail, "tEXt::Thumb::MTime");
+  if (!thumb_uri || !thumb_mtime || strcmp(thumb_uri, uri) != 0 ||
+      g_ascii_strtoll(thumb_mtime, NULL, 10) != (gint64) mtime) {
+    // Outdated, the caller generates a new one
+    g_object_unref(thumbnail);
+    return NULL;
+  }
+  return thumbnail;
+}
+
+int save_thumbnail(const char *uri, const time_t mtime, const uint64_t size, GdkPixbuf *thumbnail) {
+  char *path = thumbnail_path(uri);
+  if (!path) return -1;
+  gchar *folder = g_path_get_dirname(path);
+  int ret = g_mkdir_with_parents(folder, 0700);
+  g_free(folder);
+  gchar *tmp = g_strdup_printf("%s.%d.%d.tmp", path, (int) getpid(), g_atomic_int_add(&tmp_counter, 1));
+  gchar *mtime_str = g_strdup_printf("%" G_GINT64_FORMAT, (gint64) mtime);
+  gchar *size_str = g_strdup_printf("%" G_GUINT64_FORMAT, size);
+  if (ret == 0 && gdk_pixbuf_save(thumbnail, tmp, "png", NULL, "tEXt::Thumb::URI", uri,
+                                  "tEXt::Thumb::MTime", mtime_str, "tEXt::Thumb::Size", size_str, NULL)) {
+    // Thumbnails may reveal private images, the spec requires them to be private
+    chmod(tmp, S_IRUSR | S_IWUSR);
+    ret = rename(tmp, path) == 0 ? 0 : -1;
+  } else ret = -1;
+  if (ret != 0) unlink(tmp);
+  g_free(tmp);
+  g_free(mtime_str);
+  g_free(size_str);
+  free(path);
+  return ret;
+}
+
+/**
+  *   @brief Read a 16-bit TIFF value
+  *   @param data Value
+  *   @param big_endian Byte order of the TIFF header
+  */
+static unsigned read16(const unsigned char *data, const bool big_endian) {
+  return big_endian ? (unsigned) (data[0] << 8 | data[1]) : (unsigned) (data[1] << 8 | data[0]);
+}
+
+/**
+  *   @brief Read a 32-bit TIFF value
+  *   @param data Value
+  *   @param big_endian Byte order of the TIFF header
+  */
+static uint32_t read32(const unsigned char *data, const bool big_endian) {
+  return big_endian ? (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3]
+                    : (uint32_t) data[3] << 24 | (uint32_t) data[2] << 16 | (uint32_t) data[1] << 8 | data[0];
+}
+
+bool exif_thumbnail(const unsigned char *data, const size_t len, size_t *offset, size_t *length) {
+  if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+  size_t pos = 2;
+  // Segments up to the image data, the EXIF APP1 segment is normally the first one
+  while (pos + 4 <= len && data[pos] == 0xFF && data[pos + 1] != 0xDA) {
+    const unsigned marker = data[pos + 1];
+    const size_t segment_len = (size_t) data[pos + 2] << 8 | data[pos + 3];
+    if (segment_len < 2) return false;
+    const size_t start = pos + 4;
+    const size_t end = pos + 2 + segment_len;
+    if (marker == 0xE1 && end <= len && segment_len >= 16 && memcmp(data + start, "Exif\0\0", 6) == 0) {
+      const unsigned char *tiff = data + start + 6;
+      const size_t tiff_len = end - start - 6;
+      const bool big_endian = tiff[0] == 'M';
+      if ((tiff[0] != 'I' && tiff[0] != 'M') || tiff[1] != tiff[0] || read16(tiff + 2, big_endian) != 42) return false;
+      // IFD0 describes the image, the IFD after it the thumbnail
+      uint32_t ifd = read32(tiff + 4, big_endian);
+      if (ifd > tiff_len - 2) return false;
+      const unsigned count0 = read16(tiff + ifd, big_endian);
+      if ((size_t) ifd + 2 + count0 * 12 + 4 > tiff_len) return false;
+      ifd = read32(tiff + ifd + 2 + count0 * 12, big_endian);
+      if (ifd == 0 || ifd > tiff_len - 2) return false;
+      const unsigned count1 = read16(tiff + ifd, big_endian);
+      if ((size_t) ifd + 2 + count1 * 12 > tiff_len) return false;
+      uint32_t thumb_offset = 0, thumb_length = 0;
+      for (unsigned i = 0; i < count1; i++) {
+        const unsigned char *entry = tiff + ifd + 2 + i * 12;
+        const unsigned tag = read16(entry, big_endian);
+        if (tag == 0x0201) thumb_offset = read32(entry + 8, big_endian); // JPEGInterchangeFormat
+        else if (tag == 0x0202) thumb_length = read32(entry + 8, big_endian); // JPEGInterchangeFormatLength
+      }
+      if (thumb_offset == 0 || thumb_length == 0) return false;
+      *offset = (size_t) (tiff - data) + thumb_offset;
+      *length = thumb_length;
+      return true;
+    }
+    pos = end;
+  }
+  return false;
+}
+
+GdkPixbuf *scale_thumbnail(GdkPixbuf *pixbuf, const int size) {
+  const int width = gdk_pixbuf_get_width(pixbuf);
+  const int height = gdk_pixbuf_get_height(pixbuf);
+  if (width <= size && height <= size) return g_object_ref(pixbuf);
+  const double scale = width > height ? (double) size / width : (double) size / height;
+  const int scaled_width = width * scale > 1 ? (int) (width * scale) : 1;
+  const int scaled_height = height * scale > 1 ? (int) (height * scale) : 1;
+  return gdk_pixbuf_scale_simple(pixbuf, scaled_width, scaled_height, GDK_INTERP_BILINEAR);
+}
+
+void free_ThumbJob(ThumbJob *job) {
+  if (job && job != &stop_job) {
+    free(job->path);
+    free(job->name);
+    if (job->thumbnail) g_object_unref(job->thumbnail);
+    free(job);
+  }
+}
+
+/**
+  *   @brief Check whether a request is still wanted
+  *   @param thumbnailer Thumbnailer
+  *   @param job ThumbJob
+  */
+static bool ThumbJob_is_current(Thumbnailer *thumbnailer, const ThumbJob *job) {
+  return !g_atomic_int_get(&(thumbnailer->stopping)) &&
+         job->generation == (unsigned) g_atomic_int_get(&(thumbnailer->generation));
+}
+
+/**
+  *   @brief Wait before trying again
+  *   @return false if the request was dropped meanwhile
+  */
+static bool thumb_wait(Thumbnailer *thumbnailer, const ThumbJob *job) {
+  if (!ThumbJob_is_current(thumbnailer, job)) return false;
+  g_usleep(THUMB_WAIT * 1000);
+  return ThumbJob_is_current(thumbnailer, job);
+}
+
+/**
+  *   @brief Lock the session once it is free
+  *   @details Foreground transfers hold the session for their whole
+  *   duration, thumbnails are read only between them
+  *   @return false if the request was dropped while waiting
+  */
+static bool thumb_lock(Thumbnailer *thumbnailer, const ThumbJob *job) {
+  while (pthread_mutex_trylock(&(thumbnailer->session->lock)) != 0) {
+    if (!thumb_wait(thumbnailer, job)) return false;
+  }
+  return true;
+}
+
+/**
+  *   @brief Take bytes from the budget once they are available
+  *   @return false if the request was dropped while waiting
+  */
+static bool thumb_budget(Thumbnailer *thumbnailer, const ThumbJob *job, const size_t bytes) {
+  for (;;) {
+    pthread_mutex_lock(&(thumbnailer->lock));
+    const bool ok = ThumbBudget_take(&(thumbnailer->budget), bytes, g_get_monotonic_time());
+    pthread_mutex_unlock(&(thumbnailer->lock));
+    if (ok) return true;
+    if (!thumb_wait(thumbnailer, job)) return false;
+  }
+}
+
+/**
+  *   @brief Read a range of a remote image
+  *   @param thumbnailer Thumbnailer
+  *   @param job ThumbJob
+  *   @param file Opened image
+  *   @param offset Start of the range
+  *   @param buff Buffer for the range
+  *   @param len Length of the range
+  *   @return Number of bytes read, -1 on error or if the request was dropped
+  */
+static long remote_read(Thumbnailer *thumbnailer, const ThumbJob *job, sftp_file file, const uint64_t offset,
+                        unsigned char *buff, const size_t len) {
+  size_t tot = 0;
+  while (tot < len) {
+    const size_t chunk = len - tot < THUMB_READ_CHUNK ? len - tot : THUMB_READ_CHUNK;
+    if (!thumb_budget(thumbnailer, job, chunk) || !thumb_lock(thumbnailer, job)) return -1;
+    ssize_t nread = -1;
+    if (sftp_seek64(file, offset + tot) == 0) nread = sftp_read(file, buff + tot, chunk);
+    session_unlock(thumbnailer->session);
+    if (nread < 0) return -1;
+    if (nread == 0) break;
+    tot += nread;
+  }
+  return (long) tot;
+}
+
+/**
+  *   @brief Decode an image from memory
+  *   @param data Image file
+  *   @param len Length of data
+  *   @return New GdkPixbuf, NULL on error
+  */
+static GdkPixbuf *decode_image(const unsigned char *data, const size_t len) {
+  GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+  GdkPixbuf *pixbuf = NULL;
+  const bool written = gdk_pixbuf_loader_write(loader, data, len, NULL);
+  // The loader must be closed even after an error
+  if (gdk_pixbuf_loader_close(loader, NULL) && written) {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (pixbuf) pixbuf = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+  }
+  g_object_unref(loader);
+  return pixbuf;
+}
+
+/**
+  *   @brief Generate the thumbnail of a remote image
+  *   @details Uses the EXIF thumbnail of the image when it has one, otherwise
+  *   downloads images up to THUMB_REMOTE_MAX_SIZE
+  *   @return New GdkPixbuf, NULL on error
+  */
+static GdkPixbuf *remote_thumbnail(Thumbnailer *thumbnailer, const ThumbJob *job) {
+  if (!thumb_lock(thumbnailer, job)) return NULL;
+  sftp_file file = sftp_open(thumbnailer->session->sftp, job->path, O_RDONLY, 0);
+  session_unlock(thumbnailer->session);
+  if (!file) return NULL;
+  const size_t whole = job->size <= THUMB_REMOTE_MAX_SIZE ? (size_t) job->size : 0;
+  const size_t head = job->size < THUMB_REMOTE_HEAD ? (size_t) job->size : THUMB_REMOTE_HEAD;
+  unsigned char *data = malloc(whole > head ? whole : head);
+  GdkPixbuf *image = NULL;
+  long nread = data ? remote_read(thumbnailer, job, file, 0, data, head) : -1;
+  size_t offset, length;
+  if (nread > 0 && exif_thumbnail(data, (size_t) nread, &offset, &length) && length <= THUMB_REMOTE_HEAD) {
+    if (offset + length <= (size_t) nread) image = decode_image(data + offset, length);
+    else {
+      unsigned char *embedded = malloc(length);
+      if (embedded && remote_read(thumbnailer, job, file, offset, embedded, length) == (long) length) {
+        image = decode_image(embedded, length);
+      }
+      free(embedded);
+    }
+  }
+  if (!image && nread == (long) head && whole > 0) {
+    if (whole > head) nread = remote_read(thumbnailer, job, file, head, data + head, whole - head);
+    if (nread >= 0 && (whole == head || nread == (long) (whole - head))) image = decode_image(data, whole);
+  }
+  free(data);
+  session_lock(thumbnailer->session);
+  sftp_close(file);
+  session_unlock(thumbnailer->session);
+  return image;
+}
+
+/**
+  *   @brief Generate or load the thumbnail of a job
+  *   @param thumbnailer Thumbnailer
+  *   @param job ThumbJob, local images get their size and mtime
+  *   @return New GdkPixbuf scaled to job->icon_size, NULL on error
+  */
+static GdkPixbuf *make_thumbnail(Thumbnailer *thumbnailer, ThumbJob *job) {
+  if (job->remote && !thumbnailer->session) return NULL;
+  if (!job->remote) {
+    struct stat st;
+    if (stat(job->path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > THUMB_LOCAL_MAX_SIZE) return NULL;
+    job->size = (uint64_t) st.st_size;
+    job->mtime = st.st_mtime;
+  }
+  char *uri = thumbnail_uri(job->path, job->remote ? thumbnailer->remote_prefix : NULL);
+  if (!uri) return NULL;
+  GdkPixbuf *thumbnail = load_thumbnail(uri, job->mtime);
+  if (!thumbnail) {
+    GdkPixbuf *image = NULL;
+    if (job->remote) image = remote_thumbnail(thumbnailer, job);
+    else {
+      GdkPixbuf *loaded = gdk_pixbuf_new_from_file_at_size(job->path, THUMB_SIZE, THUMB_SIZE, NULL);
+      if (loaded) {
+        image = gdk_pixbuf_apply_embedded_orientation(loaded);
+        g_object_unref(loaded);
+      }
+    }
+    if (image) {
+      thumbnail = scale_thumbnail(image, THUMB_SIZE);
+      g_object_unref(image);
+      if (thumbnail) save_thumbnail(uri, job->mtime, job->size, thumbnail);
+    }
+  }
+  free(uri);
+  if (!thumbnail) return NULL;
+  GdkPixbuf *scaled = scale_thumbnail(thumbnail, job->icon_size);
+  g_object_unref(thumbnail);
+  return scaled;
+}
+
+/**
+  *   @brief Thread of a Thumbnailer pool
+  *   @param ptr Thumbnailer
+  */
+static void *thumbnailer_thread(void *ptr) {
+  Thumbnailer *thumbnailer = (Thumbnailer *) ptr;
+  ThumbJob *job;
+  while ((job = (ThumbJob *) g_async_queue_pop(thumbnailer->requests)) != &stop_job) {
+    // Rows scrolled out of view are dropped without any I/O
+    if (ThumbJob_is_current(thumbnailer, job)) job->thumbnail = make_thumbnail(thumbnailer, job);
+    g_async_queue_push(thumbnailer->results, job);
+  }
+  return NULL;
+}
+
+Thumbnailer *new_Thumbnailer(const unsigned threads) {
+  Thumbnailer *thumbnailer = calloc(1, sizeof(Thumbnailer));
+  if (!thumbnailer) return NULL;
+  thumbnailer->threads = calloc(threads, sizeof(pthread_t));
+  if (!thumbnailer->threads) {
+    free(thumbnailer);
+    return NULL;
+  }
+  thumbnailer->requests = g_async_queue_new();
+  thumbnailer->results = g_async_queue_new();
+  thumbnailer->generation = 1;
+  pthread_mutex_init(&(thumbnailer->lock), NULL);
+  ThumbBudget_init(&(thumbnailer->budget), THUMB_REMOTE_RATE, g_get_monotonic_time());
+  for (; thumbnailer->thread_count < threads; thumbnailer->thread_count++) {
+    if (pthread_create(&(thumbnailer->threads[thumbnailer->thread_count]), NULL, thumbnailer_thread, thumbnailer) != 0) {
+      break;
+    }
+  }
+  if (thumbnailer->thread_count == 0) {
+    free_Thumbnailer(thumbnailer);
+    return NULL;
+  }
+  return thumbnailer;
+}
+
+void free_Thumbnailer(Thumbnailer *thumbnailer) {
+  if (thumbnailer) {
+    g_atomic_int_set(&(thumbnailer->stopping), 1);
+    for (unsigned i = 0; i < thumbnailer->thread_count; i++) g_async_queue_push(thumbnailer->requests, &stop_job);
+    for (unsigned i = 0; i < thumbnailer->thread_count; i++) pthread_join(thumbnailer->threads[i], NULL);
+    ThumbJob *job;
+    while ((job = (ThumbJob *) g_async_queue_try_pop(thumbnailer->requests))) free_ThumbJob(job);
+    while ((job = (ThumbJob *) g_async_queue_try_pop(thumbnailer->results))) free_ThumbJob(job);
+    g_async_queue_unref(thumbnailer->requests);
+    g_async_queue_unref(thumbnailer->results);
+    pthread_mutex_destroy(&(thumbnailer->lock));
+    free(thumbnailer->remote_prefix);
+    free(thumbnailer->threads);
+    free(thumbnailer);
+  }
+}
+
+void Thumbnailer_set_session(Thumbnailer *thumbnailer, Session *session, const char *remote_prefix) {
+  free(thumbnailer->remote_prefix);
+  thumbnailer->remote_prefix = NULL;
+  if (session && remote_prefix && (thumbnailer->remote_prefix = malloc(strlen(remote_prefix) + 1))) {
+    strcpy(thumbnailer->remote_prefix, remote_prefix);
+  }
+  thumbnailer->session = thumbnailer->remote_prefix ? session : NULL;
+  pthread_mutex_lock(&(thumbnailer->lock));
+  ThumbBudget_init(&(thumbnailer->budget), THUMB_REMOTE_RATE, g_get_monotonic_time());
+  pthread_mutex_unlock(&(thumbnailer->lock));
+}
+
+void Thumbnailer_request(Thumbnailer *thumbnailer, ThumbJob *job) {
+  g_async_queue_push(thumbnailer->requests, job);
+}
+
+unsigned Thumbnailer_cancel(Thumbnailer *thumbnailer) {
+  return (unsigned) g_atomic_int_add(&(thumbnailer->generation), 1) + 1;
+}
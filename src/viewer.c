@@ -0,0 +1,441 @@
+/**
+  *   @file viewer.c
+  *   @author Lauri Westerholm
+  *   @brief Paged reading of large files for the file viewer
+  */
+
+#include "../include/viewer.h"
+
+/**
+  *   @struct LocalSource
+  *   @brief Source of a local PagedFile
+  */
+typedef struct {
+  int fd; /**< Open file */
+  char *path; /**< Path the file was opened from */
+  dev_t dev; /**< Device of the open file */
+  ino_t ino; /**< Inode of the open file */
+} LocalSource;
+
+/**
+  *   @struct RemoteSource
+  *   @brief Source of a remote PagedFile
+  */
+typedef struct {
+  Session *session; /**< Session the file was opened on */
+  sftp_file file; /**< Open remote file */
+  char *path; /**< Path the file was opened from */
+} RemoteSource;
+
+
+/**
+  *   @brief Free PagedBlock, used as the GHashTable value destroy function
+  *   @param ptr Pointer to a PagedBlock
+  */
+static void free_PagedBlock(gpointer ptr) {
+  PagedBlock *block = (PagedBlock *) ptr;
+  free(block->data);
+  free(block);
+}
+
+/**
+  *   @brief Drop every cached block
+  *   @param file PagedFile
+  */
+static void PagedFile_drop_blocks(PagedFile *file) {
+  g_queue_clear(&(file->lru));
+  g_hash_table_remove_all(file->blocks);
+}
+
+/**
+  *   @brief Add a block to the cache as the most recently used one
+  *   @param file PagedFile
+  *   @param block PagedBlock not in the cache
+  */
+static void PagedFile_add_block(PagedFile *file, PagedBlock *block) {
+  g_queue_push_head(&(file->lru), block);
+  block->link = file->lru.head;
+  g_hash_table_insert(file->blocks, &(block->index), block);
+  while (g_hash_table_size(file->blocks) > file->max_blocks) {
+    PagedBlock *oldest = (PagedBlock *) g_queue_pop_tail(&(file->lru));
+    g_hash_table_remove(file->blocks, &(oldest->index));
+  }
+}
+
+/**
+  *   @brief Read from the source, counting the bytes transferred
+  *   @return As PagedRead
+  */
+static long PagedFile_fetch(PagedFile *file, char *buff, const size_t len, const uint64_t offset) {
+  const long ret = file->read(file->source, buff, len, offset);
+  if (ret > 0) file->transferred += (uint64_t) ret;
+  return ret;
+}
+
+/**
+  *   @brief Fetch a run of missing blocks with one ranged read
+  *   @param file PagedFile
+  *   @param first First missing block
+  *   @param last Last block needed
+  *   @return 0 on success, -1 on error
+  */
+static int PagedFile_fetch_run(PagedFile *file, const uint64_t first, const uint64_t last) {
+  uint64_t count = 1;
+  while (first + count <= last && count < VIEWER_MAX_RUN && count < file->max_blocks / 2 &&
+         !g_hash_table_contains(file->blocks, &(uint64_t) {first + count})) count++;
+  const uint64_t offset = first * VIEWER_BLOCK_SIZE;
+  uint64_t len = count * VIEWER_BLOCK_SIZE;
+  if (offset + len > file->size) len = file->size - offset;
+  char *buff = malloc(len);
+  if (!buff) return -1;
+  const long nread = PagedFile_fetch(file, buff, len, offset);
+  if (nread < 0) {
+    free(buff);
+    return -1;
+  }
+  // Blocks are cached only as far as they were read, a shorter read means the file shrank
+  for (uint64_t i = 0; i < count && i * VIEWER_BLOCK_SIZE < (uint64_t) nread; i++) {
+    PagedBlock *block = malloc(sizeof(PagedBlock));
+    char *data = malloc(VIEWER_BLOCK_SIZE);
+    if (!block || !data) {
+      free(block);
+      free(data);
+      free(buff);
+      return -1;
+    }
+    const size_t start = i * VIEWER_BLOCK_SIZE;
+    block->index = first + i;
+    block->data = data;
+    block->len = (size_t) nread - start < VIEWER_BLOCK_SIZE ? (size_t) nread - start : VIEWER_BLOCK_SIZE;
+    memcpy(data, buff + start, block->len);
+    PagedFile_add_block(file, block);
+  }
+  free(buff);
+  return 0;
+}
+
+/**
+  *   @brief Get a block, fetching it if it is not cached or is missing appended bytes
+  *   @param file PagedFile
+  *   @param index Block number within the file size
+  *   @param last Last block needed by the caller, missing blocks up to it are fetched together
+  *   @return Cached PagedBlock, NULL on error
+  */
+static PagedBlock *PagedFile_get_block(PagedFile *file, const uint64_t index, const uint64_t last) {
+  PagedBlock *block = (PagedBlock *) g_hash_table_lookup(file->blocks, &index);
+  if (!block) {
+    if (PagedFile_fetch_run(file, index, last) != 0) return NULL;
+    block = (PagedBlock *) g_hash_table_lookup(file->blocks, &index);
+    return block;
+  }
+  const uint64_t offset = index * VIEWER_BLOCK_SIZE;
+  if (block->len < VIEWER_BLOCK_SIZE && offset + block->len < file->size) {
+    // The file has grown, only the appended part of the block is read
+    size_t len = VIEWER_BLOCK_SIZE - block->len;
+    if (offset + block->len + len > file->size) len = file->size - offset - block->len;
+    const long nread = PagedFile_fetch(file, block->data + block->len, len, offset + block->len);
+    if (nread < 0) return NULL;
+    block->len += (size_t) nread;
+  }
+  g_queue_unlink(&(file->lru), block->link);
+  g_queue_push_head_link(&(file->lru), block->link);
+  return block;
+}
+
+PagedFile *new_PagedFile(PagedRead read, PagedSize get_size, PagedReopen reopen, PagedClose close, void *source,
+                         const unsigned max_blocks) {
+  PagedFile *file = calloc(1, sizeof(PagedFile));
+  if (!file) {
+    if (close) close(source);
+    return NULL;
+  }
+  file->read = read;
+  file->get_size = get_size;
+  file->reopen = reopen;
+  file->close = close;
+  file->source = source;
+  file->max_blocks = max_blocks > 2 ? max_blocks : 2;
+  g_queue_init(&(file->lru));
+  file->blocks = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free_PagedBlock);
+  if (get_size(source, &(file->size)) != 0) {
+    free_PagedFile(file);
+    return NULL;
+  }
+  return file;
+}
+
+void free_PagedFile(PagedFile *file) {
+  if (file) {
+    if (file->close) file->close(file->source);
+    PagedFile_drop_blocks(file);
+    g_hash_table_destroy(file->blocks);
+    free(file);
+  }
+}
+
+/**
+  *   @brief PagedRead of local files
+  *   @param source Pointer to a LocalSource
+  */
+static long local_read(void *source, char *buff, const size_t len, const uint64_t offset) {
+  const int fd = ((LocalSource *) source)->fd;
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t nread = pread(fd, buff + done, len - done, (off_t) (offset + done));
+    if (nread < 0) return -1;
+    if (nread == 0) break;
+    done += (size_t) nread;
+  }
+  return (long) done;
+}
+
+/**
+  *   @brief PagedSize of local files
+  *   @param source Pointer to a LocalSource
+  */
+static int local_size(void *source, uint64_t *size) {
+  struct stat st;
+  if (fstat(((LocalSource *) source)->fd, &st) != 0) return -1;
+  *size = (uint64_t) st.st_size;
+  return 0;
+}
+
+/**
+  *   @brief Open a local file and record its identity
+  *   @param local LocalSource whose path is opened
+  *   @return File descriptor, -1 on error
+  */
+static int local_open(LocalSource *local) {
+  const int fd = open(local->path, O_RDONLY);
+  struct stat st;
+  if (fd < 0) return -1;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  local->dev = st.st_dev;
+  local->ino = st.st_ino;
+  return fd;
+}
+
+/**
+  *   @brief PagedReopen of local files, compares the device and inode of the path to the open file
+  *   @param source Pointer to a LocalSource
+  */
+static int local_reopen(void *source, bool *reopened) {
+  LocalSource *local = (LocalSource *) source;
+  struct stat st;
+  *reopened = false;
+  // Between the rename and the creation of the new file the old one is still read
+  if (stat(local->path, &st) != 0) return errno == ENOENT ? 0 : -1;
+  if (st.st_dev == local->dev && st.st_ino == local->ino) return 0;
+  const int fd = local_open(local);
+  if (fd < 0) return errno == ENOENT ? 0 : -1;
+  close(local->fd);
+  local->fd = fd;
+  *reopened = true;
+  return 0;
+}
+
+/**
+  *   @brief PagedClose of local files
+  *   @param source Pointer to a LocalSource
+  */
+static void local_close(void *source) {
+  LocalSource *local = (LocalSource *) source;
+  close(local->fd);
+  free(local->path);
+  free(local);
+}
+
+PagedFile *open_local_PagedFile(const char *path) {
+  LocalSource *local = calloc(1, sizeof(LocalSource));
+  if (!local) return NULL;
+  if (!(local->path = strdup(path)) || (local->fd = local_open(local)) < 0) {
+    free(local->path);
+    free(local);
+    return NULL;
+  }
+  return new_PagedFile(local_read, local_size, local_reopen, local_close, local, VIEWER_CACHE_BLOCKS);
+}
+
+/**
+  *   @brief PagedRead of remote files, a ranged sftp read
+  *   @param source Pointer to a RemoteSource
+  */
+static long remote_read(void *source, char *buff, const size_t len, const uint64_t offset) {
+  RemoteSource *remote = (RemoteSource *) source;
+  size_t done = 0;
+  session_lock(remote->session);
+  if (sftp_seek64(remote->file, offset) < 0) {
+    session_unlock(remote->session);
+    return -1;
+  }
+  while (done < len) {
+    const ssize_t nread = sftp_read(remote->file, buff + done, len - done);
+    if (nread < 0) {
+      session_unlock(remote->session);
+      return -1;
+    }
+    if (nread == 0) break;
+    done += (size_t) nread;
+  }
+  session_unlock(remote->session);
+  return (long) done;
+}
+
+/**
+  *   @brief PagedSize of remote files, stats the open handle so appends are seen
+  *   @param source Pointer to a RemoteSource
+  */
+static int remote_size(void *source, uint64_t *size) {
+  RemoteSource *remote = (RemoteSource *) source;
+  session_lock(remote->session);
+  sftp_attributes attr = sftp_fstat(remote->file);
+  session_unlock(remote->session);
+  if (!attr) return -1;
+  *size = attr->size;
+  sftp_attributes_free(attr);
+  return 0;
+}
+
+/**
+  *   @brief PagedReopen of remote files
+  *   @details SFTP has no inode numbers. The open handle is stat'd before the
+  *   path, so appends in between make the path larger, never smaller
+  *   @param source Pointer to a RemoteSource
+  */
+static int remote_reopen(void *source, bool *reopened) {
+  RemoteSource *remote = (RemoteSource *) source;
+  *reopened = false;
+  session_lock(remote->session);
+  sftp_attributes current = sftp_fstat(remote->file);
+  sftp_attributes named = current ? sftp_stat(remote->session->sftp, remote->path) : NULL;
+  const bool replaced = named && (named->size < current->size || named->uid != current->uid ||
+                                  named->gid != current->gid || named->permissions != current->permissions);
+  sftp_file file = replaced ? sftp_open(remote->session->sftp, remote->path, O_RDONLY, 0) : NULL;
+  if (file) {
+    sftp_close(remote->file);
+    remote->file = file;
+    *reopened = true;
+  }
+  session_unlock(remote->session);
+  const int ret = !current || (replaced && !file) ? -1 : 0;
+  if (current) sftp_attributes_free(current);
+  if (named) sftp_attributes_free(named);
+  return ret;
+}
+
+/**
+  *   @brief PagedClose of remote files
+  *   @param source Pointer to a RemoteSource
+  */
+static void remote_close(void *source) {
+  RemoteSource *remote = (RemoteSource *) source;
+  session_lock(remote->session);
+  sftp_close(remote->file);
+  session_unlock(remote->session);
+  free(remote->path);
+  free(remote);
+}
+
+PagedFile *open_remote_PagedFile(Session *session, const char *path) {
+  RemoteSource *remote = malloc(sizeof(RemoteSource));
+  if (!remote) return NULL;
+  remote->session = session;
+  if (!(remote->path = strdup(path))) {
+    free(remote);
+    return NULL;
+  }
+  session_lock(session);
+  remote->file = sftp_open(session->sftp, path, O_RDONLY, 0);
+  session_unlock(session);
+  if (!remote->file) {
+    free(remote->path);
+    free(remote);
+    return NULL;
+  }
+  return new_PagedFile(remote_read, remote_size, remote_reopen, remote_close, remote, VIEWER_CACHE_BLOCKS);
+}
+
+int PagedFile_refresh(PagedFile *file, uint64_t *appended) {
+  uint64_t size;
+  bool reopened = false;
+  *appended = 0;
+  if (file->reopen && file->reopen(file->source, &reopened) != 0) return -1;
+  if (file->get_size(file->source, &size) != 0) return -1;
+  // Truncated by copytruncate, or renamed and replaced by a new file
+  const bool rewritten = reopened || size < file->size;
+  if (rewritten) PagedFile_drop_blocks(file);
+  else *appended = size - file->size;
+  file->size = size;
+  return rewritten ? 1 : 0;
+}
+
+long PagedFile_read(PagedFile *file, char *buff, const size_t len, const uint64_t offset) {
+  if (offset >= file->size || len == 0) return 0;
+  const uint64_t end = offset + len < file->size ? offset + len : file->size;
+  const uint64_t last = (end - 1) / VIEWER_BLOCK_SIZE;
+  uint64_t pos = offset;
+  while (pos < end) {
+    const uint64_t index = pos / VIEWER_BLOCK_SIZE;
+    PagedBlock *block = PagedFile_get_block(file, index, last);
+    if (!block) return -1;
+    const size_t start = (size_t) (pos - index * VIEWER_BLOCK_SIZE);
+    if (start >= block->len) break; // The file shrank since the last refresh
+    size_t count = block->len - start;
+    if (pos + count > end) count = (size_t) (end - pos);
+    memcpy(buff + (pos - offset), block->data + start, count);
+    pos += count;
+    if (block->len < VIEWER_BLOCK_SIZE) break;
+  }
+  return (long) (pos - offset);
+}
+
+int PagedFile_lines_before(PagedFile *file, const uint64_t end, const unsigned lines, uint64_t *start) {
+  char buff[VIEWER_BLOCK_SIZE];
+  unsigned found = 0;
+  uint64_t pos = end;
+  *start = 0;
+  if (lines == 0) {
+    *start = end;
+    return 0;
+  }
+  while (pos > 0) {
+    // Block aligned reads, each costs at most one block from the source
+    size_t len = pos % VIEWER_BLOCK_SIZE ? pos % VIEWER_BLOCK_SIZE : VIEWER_BLOCK_SIZE;
+    const uint64_t offset = pos - len;
+    if (PagedFile_read(file, buff, len, offset) != (long) len) return -1;
+    for (size_t i = len; i-- > 0;) {
+      if (buff[i] != '\n' || offset + i + 1 == end) continue; // A break just before end ends the last line
+      if (++found == lines) {
+        *start = offset + i + 1;
+        return 0;
+      }
+    }
+    pos = offset;
+  }
+  return 0;
+}
+
+int PagedFile_lines(PagedFile *file, const uint64_t offset, const unsigned lines, const size_t max_bytes,
+                    GString *text, uint64_t *end) {
+  char buff[VIEWER_BLOCK_SIZE];
+  unsigned found = 0;
+  uint64_t pos = offset;
+  while (found < lines && pos - offset < max_bytes) {
+    size_t len = VIEWER_BLOCK_SIZE - pos % VIEWER_BLOCK_SIZE;
+    if (pos - offset + len > max_bytes) len = max_bytes - (pos - offset);
+    const long nread = PagedFile_read(file, buff, len, pos);
+    if (nread < 0) return -1;
+    if (nread == 0) break;
+    size_t used = 0;
+    while (used < (size_t) nread && found < lines) {
+      if (buff[used++] == '\n') found++;
+    }
+    g_string_append_len(text, buff, used);
+    pos += used;
+  }
+  *end = pos;
+  return 0;
+}
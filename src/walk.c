@@ -0,0 +1,691 @@
+/**
+  *   @file walk.c
+  *   @author Lauri Westerholm
+  *   @brief Pipelined enumeration of remote directory trees
+  *   @details libssh only offers a blocking sftp_readdir, so the walker speaks
+  *   sftp version 3 over an own channel and keeps requests for many folders
+  *   in flight instead of waiting for every reply in turn. The same applies to
+  *   sftp_unlink and sftp_rmdir, so removing a tree is done by the walker too
+  */
+
+#include "../include/walk.h"
+
+/**
+  *   @struct WalkFolder
+  *   @brief Folder being enumerated
+  */
+typedef struct WalkFolder {
+  char *path; /**< Path as reached from the root */
+  char *real; /**< Canonical path, only when following links */
+  char *handle; /**< Sftp handle of the open folder, not '\0' terminated */
+  uint32_t handle_len; /**< Length of handle */
+  struct WalkFolder *parent; /**< Folder containing this one, NULL for the root */
+  unsigned pending; /**< Own listing plus unfinished subfolders and links */
+  bool unreadable; /**< Whether listing the folder failed */
+} WalkFolder;
+
+/**
+  *   @enum WalkRequestType
+  *   @brief Sftp requests sent by the walker
+  */
+enum WalkRequestType {
+  WALK_OPENDIR,
+  WALK_READDIR,
+  WALK_CLOSE,
+  WALK_STAT, /**< Is a symbolic link pointing to a folder */
+  WALK_REALPATH, /**< Canonical path of a link target */
+  WALK_REMOVE, /**< Remove an entry which is not a folder */
+  WALK_RMDIR /**< Remove a folder after everything below it */
+};
+
+/**
+  *   @struct WalkRequest
+  *   @brief Request waiting for a reply
+  */
+typedef struct {
+  enum WalkRequestType type; /**< Request type */
+  WalkFolder *folder; /**< Folder read, or containing the link or the removed entry */
+  char *link; /**< Path of the link for WALK_STAT and WALK_REALPATH, of the entry for removals */
+} WalkRequest;
+
+/**
+  *   @struct Walker
+  *   @brief State of sftp_session_walk
+  */
+typedef struct {
+  WalkChannel *channel; /**< Own sftp channel */
+  RemoteWalk *walk; /**< Callbacks and options */
+  uint32_t next_id; /**< Id of the next request */
+  GHashTable *requests; /**< Requests in flight by id */
+  GHashTable *folders; /**< All unfinished WalkFolders, owns them */
+  GHashTable *visited; /**< Canonical paths of followed links */
+  GSList *todo; /**< WalkFolders waiting to be opened */
+  unsigned open; /**< Folders with a request in flight */
+  GSList *removals; /**< WalkRequests of removals waiting to be sent */
+  unsigned removing; /**< Removals in flight */
+  unsigned failed; /**< Entries which could not be removed */
+  GByteArray *out; /**< Packets not yet written */
+  GByteArray *in; /**< Last received packet without the length */
+  bool stop; /**< Stopped by a callback or cancelled */
+} Walker;
+
+
+/* Sftp packets */
+
+GByteArray *new_SftpPacket(const uint8_t type, const uint32_t id) {
+  const uint8_t head[5] = { 0, 0, 0, 0, type };
+  GByteArray *packet = g_byte_array_sized_new(64);
+  g_byte_array_append(packet, head, sizeof(head));
+  SftpPacket_u32(packet, id);
+  return packet;
+}
+
+void SftpPacket_u32(GByteArray *packet, const uint32_t value) {
+  const uint8_t bytes[4] = { value >> 24, (value >> 16) & 0xff, (value >> 8) & 0xff, value & 0xff };
+  g_byte_array_append(packet, bytes, sizeof(bytes));
+}
+
+void SftpPacket_u64(GByteArray *packet, const uint64_t value) {
+  SftpPacket_u32(packet, value >> 32);
+  SftpPacket_u32(packet, value & 0xffffffff);
+}
+
+void SftpPacket_string(GByteArray *packet, const char *str, const uint32_t len) {
+  SftpPacket_u32(packet, len);
+  g_byte_array_append(packet, (const uint8_t *) str, len);
+}
+
+void SftpPacket_finish(GByteArray *packet) {
+  const uint32_t len = packet->len - 4;
+  packet->data[0] = len >> 24;
+  packet->data[1] = (len >> 16) & 0xff;
+  packet->data[2] = (len >> 8) & 0xff;
+  packet->data[3] = len & 0xff;
+}
+
+bool SftpReader_u32(SftpReader *reader, uint32_t *value) {
+  if (reader->end - reader->pos < 4) return false;
+  const uint8_t *p = reader->pos;
+  *value = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+  reader->pos += 4;
+  return true;
+}
+
+bool SftpReader_u64(SftpReader *reader, uint64_t *value) {
+  uint32_t high, low;
+  if (!SftpReader_u32(reader, &high) || !SftpReader_u32(reader, &low)) return false;
+  *value = ((uint64_t) high << 32) | low;
+  return true;
+}
+
+bool SftpReader_string(SftpReader *reader, const char **str, uint32_t *len) {
+  if (!SftpReader_u32(reader, len)) return false;
+  if ((uint64_t) (reader->end - reader->pos) < *len) return false;
+  *str = (const char *) reader->pos;
+  reader->pos += *len;
+  return true;
+}
+
+/**
+  *   @brief Get the file type from sftp permissions
+  *   @param permissions Permissions including the S_IFMT bits
+  *   @return SSH_FILEXFER_TYPE
+  */
+static uint8_t permissions_type(const uint32_t permissions) {
+  switch (permissions & S_IFMT) {
+    case S_IFDIR:
+      return SSH_FILEXFER_TYPE_DIRECTORY;
+    case S_IFREG:
+      return SSH_FILEXFER_TYPE_REGULAR;
+    case S_IFLNK:
+      return SSH_FILEXFER_TYPE_SYMLINK;
+    default:
+      return SSH_FILEXFER_TYPE_SPECIAL;
+  }
+}
+
+bool SftpReader_attrs(SftpReader *reader, File_t *file) {
+  uint32_t flags, value;
+  const char *str;
+  if (!SftpReader_u32(reader, &flags)) return false;
+  file->type = SSH_FILEXFER_TYPE_UNKNOWN;
+  if ((flags & SSH_FILEXFER_ATTR_SIZE) && !SftpReader_u64(reader, &(file->size))) return false;
+  if (flags & SSH_FILEXFER_ATTR_UIDGID) {
+    if (!SftpReader_u32(reader, &(file->uid)) || !SftpReader_u32(reader, &(file->gid))) return false;
+  }
+  if (flags & SSH_FILEXFER_ATTR_PERMISSIONS) {
+    if (!SftpReader_u32(reader, &(file->permissions))) return false;
+    file->type = permissions_type(file->permissions);
+  }
+  if (flags & SSH_FILEXFER_ATTR_ACMODTIME) {
+    if (!SftpReader_u32(reader, &value) || !SftpReader_u32(reader, &value)) return false; // atime, mtime
+    file->mtime = value;
+  }
+  if (flags & SSH_FILEXFER_ATTR_EXTENDED) {
+    uint32_t count;
+    if (!SftpReader_u32(reader, &count)) return false;
+    for (uint32_t i = 0; i < count; i++) {
+      if (!SftpReader_string(reader, &str, &value) || !SftpReader_string(reader, &str, &value)) return false;
+    }
+  }
+  file->has_metadata = true;
+  return true;
+}
+
+/**
+  *   @brief Get a field of a ls -l style long name
+  *   @param longname Long name, not '\0' terminated
+  *   @param len Length of longname
+  *   @param index Index of the space separated field
+  *   @return Dynamically allocated field, NULL if there is no such field
+  */
+static char *longname_field(const char *longname, const uint32_t len, unsigned index) {
+  uint32_t i = 0;
+  while (i < len) {
+    while (i < len && longname[i] == ' ') i++;
+    const uint32_t start = i;
+    while (i < len && longname[i] != ' ') i++;
+    if (i > start && index-- == 0) {
+      char *field = malloc(i - start + 1);
+      if (field) {
+        memcpy(field, longname + start, i - start);
+        field[i - start] = '\0';
+      }
+      return field;
+    }
+  }
+  return NULL;
+}
+
+File_t *SftpReader_File(SftpReader *reader) {
+  const char *name, *longname;
+  uint32_t name_len, longname_len;
+  if (!SftpReader_string(reader, &name, &name_len) || !SftpReader_string(reader, &longname, &longname_len)) {
+    return NULL;
+  }
+  char *filename = malloc(name_len + 1);
+  if (!filename) return NULL;
+  memcpy(filename, name, name_len);
+  filename[name_len] = '\0';
+  File_t *file = new_File(filename, SSH_FILEXFER_TYPE_UNKNOWN);
+  free(filename);
+  if (file && !SftpReader_attrs(reader, file)) {
+    free_File(file);
+    return NULL;
+  }
+  if (file) {
+    file->owner = longname_field(longname, longname_len, 2);
+    file->group = longname_field(longname, longname_len, 3);
+  }
+  return file;
+}
+
+
+/* Walker */
+
+/**
+  *   @brief Free WalkFolder
+  *   @param pointer WalkFolder, passed as void *
+  */
+static void free_WalkFolder(void *pointer) {
+  WalkFolder *folder = (WalkFolder *) pointer;
+  free(folder->path);
+  free(folder->real);
+  free(folder->handle);
+  free(folder);
+}
+
+/**
+  *   @brief Free WalkRequest
+  *   @param pointer WalkRequest, passed as void *
+  */
+static void free_WalkRequest(void *pointer) {
+  WalkRequest *request = (WalkRequest *) pointer;
+  free(request->link);
+  free(request);
+}
+
+/**
+  *   @brief Check whether a path is a folder or inside it
+  *   @param path Canonical path
+  *   @param folder Canonical path of the folder
+  *   @return true if path equals folder or is below it
+  */
+static bool is_within(const char *path, const char *folder) {
+  size_t len = strlen(folder);
+  while (len > 1 && folder[len - 1] == '/') len--;
+  if (strncmp(path, folder, len) != 0) return false;
+  return path[len] == '\0' || path[len] == '/' || folder[len - 1] == '/';
+}
+
+/**
+  *   @brief Add a folder to be enumerated
+  *   @param walker Walker
+  *   @param path Path of the folder, owned by the folder afterwards
+  *   @param real Canonical path or NULL, owned by the folder afterwards
+  *   @param parent Folder containing the new one, NULL for the root
+  *   @return true on success, false on allocation error
+  */
+static bool Walker_add_folder(Walker *walker, char *path, char *real, WalkFolder *parent) {
+  WalkFolder *folder = calloc(1, sizeof(WalkFolder));
+  if (!folder || !path || (walker->walk->follow_links && !real)) {
+    free(folder);
+    free(path);
+    free(real);
+    return false;
+  }
+  folder->path = path;
+  folder->real = real;
+  folder->parent = parent;
+  folder->pending = 1;
+  if (parent) parent->pending++;
+  g_hash_table_add(walker->folders, folder);
+  walker->todo = g_slist_prepend(walker->todo, folder); // Depth first keeps the queue short
+  return true;
+}
+
+/**
+  *   @brief Queue the packet of a request with a single string argument
+  *   @param walker Walker
+  *   @param type Packet type, SSH_FXP_*
+  *   @param request Request stored for the reply, owned by walker->requests afterwards
+  *   @param str Path or handle
+  *   @param len Length of str
+  */
+static void Walker_send(Walker *walker, const uint8_t type, WalkRequest *request, const char *str, const uint32_t len) {
+  const uint32_t id = walker->next_id++;
+  g_hash_table_insert(walker->requests, GUINT_TO_POINTER(id), request);
+  GByteArray *packet = new_SftpPacket(type, id);
+  SftpPacket_string(packet, str, len);
+  SftpPacket_finish(packet);
+  g_byte_array_append(walker->out, packet->data, packet->len);
+  g_byte_array_free(packet, TRUE);
+}
+
+/**
+  *   @brief Queue a request with a single string argument
+  *   @param walker Walker
+  *   @param type Packet type, SSH_FXP_*
+  *   @param kind Request type stored for the reply
+  *   @param folder Folder the request concerns
+  *   @param str Path or handle
+  *   @param len Length of str
+  *   @param link Path of a link, owned by the request afterwards, may be NULL
+  *   @return true on success, false on allocation error
+  */
+static bool Walker_request(Walker *walker, const uint8_t type, const enum WalkRequestType kind,
+                            WalkFolder *folder, const char *str, const uint32_t len, char *link)
+{
+  WalkRequest *request = malloc(sizeof(WalkRequest));
+  if (!request) {
+    free(link);
+    return false;
+  }
+  request->type = kind;
+  request->folder = folder;
+  request->link = link;
+  Walker_send(walker, type, request, str, len);
+  return true;
+}
+
+/**
+  *   @brief Queue a removal, sent once fewer than WALK_MAX_REMOVALS are in flight
+  *   @param walker Walker
+  *   @param kind WALK_REMOVE or WALK_RMDIR
+  *   @param folder Folder released when the reply arrives, NULL for the root
+  *   @param path Path of the entry, owned by the request afterwards
+  *   @return true on success, false on allocation error
+  */
+static bool Walker_remove(Walker *walker, const enum WalkRequestType kind, WalkFolder *folder, char *path) {
+  WalkRequest *request = malloc(sizeof(WalkRequest));
+  if (!request || !path) {
+    free(request);
+    free(path);
+    return false;
+  }
+  request->type = kind;
+  request->folder = folder;
+  request->link = path;
+  walker->removals = g_slist_prepend(walker->removals, request);
+  return true;
+}
+
+/**
+  *   @brief Release one pending item of a folder, leave the folders which are done
+  *   @param walker Walker
+  *   @param folder Folder
+  */
+static void Walker_release(Walker *walker, WalkFolder *folder) {
+  while (folder && --(folder->pending) == 0) {
+    RemoteWalk *walk = walker->walk;
+    if (!walker->stop && walk->leave && walk->leave(folder->path, !folder->unreadable, walk->data) == WALK_STOP) {
+      walker->stop = true;
+    }
+    WalkFolder *parent = folder->parent;
+    if (walk->remove && !walker->stop) {
+      // The parent is done only after this folder has been removed
+      if (Walker_remove(walker, WALK_RMDIR, parent, folder->path)) {
+        if (parent) parent->pending++;
+      } else walker->failed++;
+      folder->path = NULL;
+    }
+    g_hash_table_remove(walker->folders, folder);
+    folder = parent;
+  }
+}
+
+/**
+  *   @brief Finish reading a folder
+  *   @param walker Walker
+  *   @param folder Folder, handle closed if it is open
+  *   @param readable Whether the listing was complete
+  *   @return true on success, false on allocation error
+  */
+static bool Walker_close(Walker *walker, WalkFolder *folder, const bool readable) {
+  bool ret = true;
+  if (folder->handle) {
+    ret = Walker_request(walker, SSH_FXP_CLOSE, WALK_CLOSE, NULL, folder->handle, folder->handle_len, NULL);
+  }
+  if (!readable) folder->unreadable = true;
+  walker->open--;
+  Walker_release(walker, folder);
+  return ret;
+}
+
+/**
+  *   @brief Report an entry and queue what it needs
+  *   @param walker Walker
+  *   @param folder Folder containing the entry
+  *   @param file Entry
+  *   @return true on success, false on allocation error
+  */
+static bool Walker_entry(Walker *walker, WalkFolder *folder, const File_t *file) {
+  RemoteWalk *walk = walker->walk;
+  if (strcmp(file->name, ".") == 0 || strcmp(file->name, "..") == 0) return true;
+  const enum WalkAction action = walk->entry ? walk->entry(folder->path, file, walk->data) : WALK_CONTINUE;
+  if (action == WALK_STOP) walker->stop = true;
+  if (action != WALK_CONTINUE) return true;
+  if (walk->remove && file->type != SSH_FILEXFER_TYPE_DIRECTORY) {
+    if (!Walker_remove(walker, WALK_REMOVE, folder, construct_filepath(folder->path, file->name))) return false;
+    folder->pending++; // Until the entry is removed
+    return true;
+  }
+  if (file->type == SSH_FILEXFER_TYPE_DIRECTORY) {
+    char *real = walk->follow_links ? construct_filepath(folder->real, file->name) : NULL;
+    return Walker_add_folder(walker, construct_filepath(folder->path, file->name), real, folder);
+  }
+  if (file->type == SSH_FILEXFER_TYPE_SYMLINK && walk->follow_links) {
+    char *link = construct_filepath(folder->path, file->name);
+    if (!link) return false;
+    folder->pending++; // Until the link is resolved
+    return Walker_request(walker, SSH_FXP_STAT, WALK_STAT, folder, link, strlen(link), link);
+  }
+  return true;
+}
+
+/**
+  *   @brief Handle a resolved link target
+  *   @param walker Walker
+  *   @param request WALK_REALPATH request
+  *   @param reader Reply after the id
+  *   @return true on success, false on a malformed reply or allocation error
+  */
+static bool Walker_link_target(Walker *walker, WalkRequest *request, SftpReader *reader) {
+  uint32_t count;
+  if (!SftpReader_u32(reader, &count) || count < 1) return false;
+  File_t *target = SftpReader_File(reader);
+  if (!target) return false;
+  bool ret = true;
+  WalkFolder *folder = request->folder;
+  // A link to the folder itself or above it would never end
+  if (!is_within(folder->real, target->name) && !g_hash_table_contains(walker->visited, target->name)) {
+    char *visited = malloc(strlen(target->name) + 1);
+    char *real = malloc(strlen(target->name) + 1);
+    if (visited && real) {
+      strcpy(visited, target->name);
+      strcpy(real, target->name);
+      g_hash_table_add(walker->visited, visited);
+      ret = Walker_add_folder(walker, request->link, real, folder);
+      request->link = NULL;
+    } else {
+      free(visited);
+      free(real);
+      ret = false;
+    }
+  }
+  free_File(target);
+  Walker_release(walker, folder);
+  return ret;
+}
+
+/**
+  *   @brief Handle the reply in walker->in
+  *   @param walker Walker
+  *   @return true on success, false on a malformed reply or allocation error
+  */
+static bool Walker_handle(Walker *walker) {
+  SftpReader reader = { walker->in->data + 1, walker->in->data + walker->in->len };
+  uint32_t id, status;
+  const char *str;
+  uint32_t len;
+  if (walker->in->len < 1 || !SftpReader_u32(&reader, &id)) return false;
+  const uint8_t type = walker->in->data[0];
+  WalkRequest *request = g_hash_table_lookup(walker->requests, GUINT_TO_POINTER(id));
+  if (!request) return false;
+  WalkFolder *folder = request->folder;
+  bool ret = true;
+  if (type == SSH_FXP_STATUS) {
+    if (!SftpReader_u32(&reader, &status)) ret = false;
+    else if (request->type == WALK_OPENDIR || request->type == WALK_READDIR) {
+      ret = Walker_close(walker, folder, status == SSH_FX_EOF);
+    } else if (request->type == WALK_STAT || request->type == WALK_REALPATH) {
+      Walker_release(walker, folder); // Broken link, reported as an entry already
+    } else if (request->type == WALK_REMOVE || request->type == WALK_RMDIR) {
+      if (status != SSH_FX_OK) walker->failed++;
+      walker->removing--;
+      Walker_release(walker, folder);
+    }
+  } else if (type == SSH_FXP_HANDLE && request->type == WALK_OPENDIR) {
+    if ((ret = SftpReader_string(&reader, &str, &len) && (folder->handle = malloc(len + 1)))) {
+      memcpy(folder->handle, str, len);
+      folder->handle_len = len;
+      ret = Walker_request(walker, SSH_FXP_READDIR, WALK_READDIR, folder, folder->handle, len, NULL);
+    }
+  } else if (type == SSH_FXP_NAME && request->type == WALK_READDIR) {
+    uint32_t count;
+    ret = SftpReader_u32(&reader, &count);
+    for (uint32_t i = 0; ret && i < count && !walker->stop; i++) {
+      File_t *file = SftpReader_File(&reader);
+      ret = file && Walker_entry(walker, folder, file);
+      free_File(file);
+    }
+    if (ret) ret = Walker_request(walker, SSH_FXP_READDIR, WALK_READDIR, folder, folder->handle, folder->handle_len, NULL);
+  } else if (type == SSH_FXP_ATTRS && request->type == WALK_STAT) {
+    File_t attrs = { 0 };
+    ret = SftpReader_attrs(&reader, &attrs);
+    if (ret && attrs.type == SSH_FILEXFER_TYPE_DIRECTORY) {
+      ret = Walker_request(walker, SSH_FXP_REALPATH, WALK_REALPATH, folder, request->link, strlen(request->link), request->link);
+      request->link = NULL;
+    } else if (ret) Walker_release(walker, folder);
+  } else if (type == SSH_FXP_NAME && request->type == WALK_REALPATH) {
+    ret = Walker_link_target(walker, request, &reader);
+  } else ret = false;
+  g_hash_table_remove(walker->requests, GUINT_TO_POINTER(id));
+  return ret;
+}
+
+/**
+  *   @brief Write all queued packets
+  *   @param walker Walker
+  *   @return true on success, false on error
+  */
+static bool Walker_flush(Walker *walker) {
+  uint32_t written = 0;
+  while (written < walker->out->len) {
+    const int len = walker->channel->write(walker->channel->target, walker->out->data + written, walker->out->len - written);
+    if (len <= 0) return false;
+    written += len;
+  }
+  g_byte_array_set_size(walker->out, 0);
+  return true;
+}
+
+/**
+  *   @brief Read exactly len bytes from the channel
+  *   @param walker Walker
+  *   @param buff Destination
+  *   @param len Number of bytes
+  *   @return true on success, false on error, end of file or cancel
+  *   @remark Waits in WALK_POLL_TIMEOUT steps so that cancel is noticed while
+  *   the server is busy
+  */
+static bool Walker_read(Walker *walker, uint8_t *buff, const uint32_t len) {
+  uint32_t read_len = 0;
+  while (read_len < len) {
+    const int n = walker->channel->read(walker->channel->target, buff + read_len, len - read_len, WALK_POLL_TIMEOUT);
+    if (n < 0) return false;
+    if (n == 0 && walker->walk->cancel && g_atomic_int_get(walker->walk->cancel)) {
+      walker->stop = true;
+      return false;
+    }
+    read_len += n;
+  }
+  return true;
+}
+
+/**
+  *   @brief Receive one packet to walker->in
+  *   @param walker Walker
+  *   @return true on success, false on error
+  */
+static bool Walker_receive(Walker *walker) {
+  uint8_t head[4];
+  if (!Walker_read(walker, head, sizeof(head))) return false;
+  const uint32_t len = ((uint32_t) head[0] << 24) | ((uint32_t) head[1] << 16) | ((uint32_t) head[2] << 8) | head[3];
+  if (len < 1 || len > WALK_MAX_PACKET) return false;
+  g_byte_array_set_size(walker->in, len);
+  return Walker_read(walker, walker->in->data, len);
+}
+
+/**
+  *   @brief Initialize the protocol
+  *   @param walker Walker
+  *   @return true on success, false on error
+  */
+static bool Walker_connect(Walker *walker) {
+  GByteArray *packet = new_SftpPacket(SSH_FXP_INIT, WALK_SFTP_VERSION);
+  SftpPacket_finish(packet);
+  g_byte_array_append(walker->out, packet->data, packet->len);
+  g_byte_array_free(packet, TRUE);
+  return Walker_flush(walker) && Walker_receive(walker) && walker->in->data[0] == SSH_FXP_VERSION;
+}
+
+int WalkChannel_walk(WalkChannel *channel, const char *root, const char *real, RemoteWalk *walk) {
+  Walker walker = { 0 };
+  walker.channel = channel;
+  walker.walk = walk;
+  walker.requests = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_WalkRequest);
+  walker.folders = g_hash_table_new_full(g_direct_hash, g_direct_equal, free_WalkFolder, NULL);
+  walker.visited = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+  walker.out = g_byte_array_new();
+  walker.in = g_byte_array_new();
+
+  bool ok = Walker_connect(&walker);
+  if (ok) {
+    char *path = malloc(strlen(root) + 1);
+    if (path) strcpy(path, root);
+    char *real_copy = NULL;
+    if (walk->follow_links && real && (real_copy = malloc(strlen(real) + 1))) strcpy(real_copy, real);
+    ok = Walker_add_folder(&walker, path, real_copy, NULL);
+  }
+  while (ok && !walker.stop) {
+    while (ok && walker.todo && walker.open < WALK_MAX_FOLDERS) {
+      WalkFolder *folder = (WalkFolder *) walker.todo->data;
+      walker.todo = g_slist_delete_link(walker.todo, walker.todo);
+      walker.open++;
+      ok = Walker_request(&walker, SSH_FXP_OPENDIR, WALK_OPENDIR, folder, folder->path, strlen(folder->path), NULL);
+    }
+    // Bounded so that replies are read before the channel windows fill up
+    while (ok && walker.removals && walker.removing < WALK_MAX_REMOVALS) {
+      WalkRequest *request = (WalkRequest *) walker.removals->data;
+      walker.removals = g_slist_delete_link(walker.removals, walker.removals);
+      walker.removing++;
+      Walker_send(&walker, request->type == WALK_RMDIR ? SSH_FXP_RMDIR : SSH_FXP_REMOVE, request, request->link, strlen(request->link));
+    }
+    if (!ok || g_hash_table_size(walker.requests) == 0) break;
+    ok = Walker_flush(&walker) && Walker_receive(&walker) && Walker_handle(&walker);
+    if (walk->cancel && g_atomic_int_get(walk->cancel)) walker.stop = true;
+  }
+
+  g_slist_free(walker.todo);
+  g_slist_free_full(walker.removals, free_WalkRequest);
+  g_hash_table_destroy(walker.requests);
+  g_hash_table_destroy(walker.folders);
+  g_hash_table_destroy(walker.visited);
+  g_byte_array_free(walker.out, TRUE);
+  g_byte_array_free(walker.in, TRUE);
+  return (ok && !walker.stop && !walker.failed) ? 0 : -1;
+}
+
+
+/* Session channel */
+
+/**
+  *   @struct SessionChannel
+  *   @brief Target of the WalkChannel of sftp_session_walk
+  */
+typedef struct {
+  Session *session; /**< Session the channel belongs to */
+  ssh_channel channel; /**< Channel running the sftp subsystem */
+  bool lock; /**< Whether the session is locked around each read and write */
+} SessionChannel;
+
+/**
+  *   @brief Write to a SessionChannel, WalkWrite of sftp_session_walk
+  */
+static int session_channel_write(void *target, const uint8_t *buff, const uint32_t len) {
+  SessionChannel *channel = (SessionChannel *) target;
+  if (channel->lock) session_lock(channel->session);
+  const int written = ssh_channel_write(channel->channel, buff, len);
+  if (channel->lock) session_unlock(channel->session);
+  return written < 0 ? -1 : written;
+}
+
+/**
+  *   @brief Read from a SessionChannel, WalkRead of sftp_session_walk
+  */
+static int session_channel_read(void *target, uint8_t *buff, const uint32_t len, const int timeout) {
+  SessionChannel *channel = (SessionChannel *) target;
+  if (channel->lock) session_lock(channel->session);
+  int nread = ssh_channel_read_timeout(channel->channel, buff, len, 0, timeout);
+  if (nread == 0 && ssh_channel_is_eof(channel->channel)) nread = -1;
+  if (channel->lock) session_unlock(channel->session);
+  return nread < 0 ? -1 : nread;
+}
+
+int sftp_session_walk(Session *session, const char *root, RemoteWalk *walk) {
+  SessionChannel target = { session, NULL, walk->lock_session };
+  int ret = -1;
+  if (walk->lock_session) session_lock(session);
+  char *real = walk->follow_links ? sftp_canonicalize_path(session->sftp, root) : NULL;
+  target.channel = ssh_channel_new(session->session);
+  bool ok = target.channel && ssh_channel_open_session(target.channel) == SSH_OK &&
+            ssh_channel_request_subsystem(target.channel, "sftp") == SSH_OK;
+  if (walk->lock_session) session_unlock(session);
+  // The lock is taken only around reads and writes, other threads use the session in between
+  if (ok && (real || !walk->follow_links)) {
+    WalkChannel channel = { session_channel_write, session_channel_read, &target };
+    ret = WalkChannel_walk(&channel, root, real, walk);
+  }
+  if (walk->lock_session) session_lock(session);
+  if (target.channel) {
+    if (ssh_channel_is_open(target.channel)) {
+      ssh_channel_send_eof(target.channel);
+      ssh_channel_close(target.channel);
+    }
+    ssh_channel_free(target.channel);
+  }
+  if (walk->lock_session) session_unlock(session);
+  free(real);
+  return ret;
+}
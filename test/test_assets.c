@@ -10,6 +10,18 @@
 #include "../include/assets.h"
 
 
+/**
+  *   @brief Content type guessed from the name alone, without the cache
+  *   @param name File name
+  *   @return Interned content type
+  */
+static const char *guess_content_type(const char *name) {
+  gchar *guess = g_content_type_guess(name, NULL, 0, NULL);
+  const char *content_type = g_intern_string(guess);
+  g_free(guess);
+  return content_type;
+}
+
 int main(int argc, char *argv[]) {
 
   const char *path = "/home/test/";
@@ -56,6 +68,24 @@ int main(int argc, char *argv[]) {
   assert(strcmp(result, "test1 test2 test3") == 0);
   free(result);
 
+  // Content types come from the name and are shared between files of the same extension
+  const char *content_type = get_content_type("/home/test/main.c", DT_REG, false);
+  assert(content_type && content_type == get_content_type("other.c", SSH_FILEXFER_TYPE_REGULAR, true));
+  assert(strcmp(get_content_type("src.c", DT_DIR, false), FOLDER_CONTENT_TYPE) == 0);
+  assert(strcmp(get_content_type("link", SSH_FILEXFER_TYPE_SYMLINK, true), FOLDER_CONTENT_TYPE) == 0);
+  assert(get_content_type("no_extension", DT_REG, false));
+  assert(get_content_type(".hidden", DT_REG, false));
+  // A cached extension does not decide the type of a longer suffix, in either order
+  assert(get_content_type("a.gz", DT_REG, false) == guess_content_type("a.gz"));
+  assert(get_content_type("b.tar.gz", DT_REG, false) == guess_content_type("b.tar.gz"));
+  assert(get_content_type("c.tar.xz", DT_REG, false) == guess_content_type("c.tar.xz"));
+  assert(get_content_type("d.xz", DT_REG, false) == guess_content_type("d.xz"));
+  // Icons are loaded once per content type and size
+  const GdkPixbuf *icon = get_Icon_content_type(content_type, ICON_SIZE);
+  assert(icon && icon == get_Icon_content_type(content_type, ICON_SIZE));
+  assert(get_Icon_content_type(content_type, DETAILS_ICON_SIZE));
+  assert(get_Icon_content_type(get_content_type("/", DT_DIR, false), ICON_SIZE));
+
   clear_assets();
 
   printf("test_assets.c successfully finished\n");
@@ -0,0 +1,129 @@
+/**
+  *   @file test_cache.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for cache.c
+  */
+
+#include <assert.h>
+
+#include "../include/cache.h"
+#include "../include/fs.h"
+
+/**
+  *   @brief Create a listing with "." and one file
+  *   @param filename Name of the file
+  *   @param mtime Directory mtime stored to "."
+  *   @return Dynamically allocated listing
+  */
+GSList *create_listing(const char *filename, uint64_t mtime) {
+  struct File *dot = new_File(".", SSH_FILEXFER_TYPE_DIRECTORY);
+  dot->mtime = mtime;
+  dot->has_metadata = true;
+  GSList *files = g_slist_append(NULL, dot);
+  return g_slist_append(files, new_File(filename, SSH_FILEXFER_TYPE_REGULAR));
+}
+
+
+int main() {
+  ListingCache *cache = new_ListingCache(REMOTE_CACHE_TTL, 3);
+  GSList *files = create_listing("file.txt", 1000);
+  GSList *cached = NULL;
+
+  assert(ListingCache_lookup(cache, "/home/user", &cached) == CACHE_MISS);
+  assert(!cached);
+  ListingCache_store(cache, "/home/user", files);
+  // Trailing '/' is ignored, the cached listing is a copy
+  assert(ListingCache_lookup(cache, "/home/user/", &cached) == CACHE_FRESH);
+  assert(cached && cached != files && g_slist_length(cached) == 2);
+  assert(g_slist_find_custom(cached, "file.txt", compare_File_GSLists));
+  clear_Filelist(cached);
+  assert(ListingCache_contains(cache, "/home/user"));
+  assert(!ListingCache_contains(cache, "/home"));
+
+  // Only the matching mtime keeps the entry
+  assert(ListingCache_revalidate(cache, "/home/user", 1000));
+  assert(!ListingCache_revalidate(cache, "/home/user", 1001));
+  assert(ListingCache_lookup(cache, "/home/user", &cached) == CACHE_MISS);
+  // The server clock may be ahead of the local one
+  const uint64_t future = g_get_real_time() / G_USEC_PER_SEC + 3600;
+  GSList *ahead = create_listing("file.txt", future);
+  ListingCache_store(cache, "/home/user", ahead);
+  assert(ListingCache_revalidate(cache, "/home/user", future));
+  ListingCache_invalidate(cache, "/home/user", false);
+  clear_Filelist(ahead);
+
+  // Stale entries are still served
+  ListingCache *stale_cache = new_ListingCache(0, 3);
+  ListingCache_store(stale_cache, "/tmp", files);
+  assert(ListingCache_lookup(stale_cache, "/tmp", &cached) == CACHE_STALE);
+  clear_Filelist(cached);
+  // Too old to be trusted even with the same mtime
+  assert(!ListingCache_revalidate(stale_cache, "/tmp", 1000));
+  free_ListingCache(stale_cache);
+
+  // Recursive invalidation compares the cached paths with the invalidated one
+  ListingCache *tree = new_ListingCache(REMOTE_CACHE_TTL, 8);
+  ListingCache_store(tree, "/srv/a", files);
+  ListingCache_store(tree, "/srv/a/b", files);
+  ListingCache_store(tree, "/tmp/b/c", files);
+  ListingCache_invalidate(tree, "/srv/a", true);
+  assert(ListingCache_lookup(tree, "/srv/a/b", &cached) == CACHE_MISS);
+  assert(ListingCache_lookup(tree, "/tmp/b/c", &cached) == CACHE_FRESH);
+  clear_Filelist(cached);
+  // A listing read before an invalidation is not stored
+  const unsigned invalidations = ListingCache_invalidations(tree);
+  assert(ListingCache_store_since(tree, "/srv/c", files, invalidations));
+  ListingCache_invalidate(tree, "/srv/d", false);
+  assert(!ListingCache_store_since(tree, "/srv/d", files, invalidations));
+  assert(!ListingCache_contains(tree, "/srv/d"));
+  free_ListingCache(tree);
+
+  // Recursive invalidation removes subdirectories but not siblings with the same prefix
+  ListingCache_store(cache, "/a", files);
+  ListingCache_store(cache, "/a/b", files);
+  ListingCache_store(cache, "/ab", files);
+  ListingCache_store(cache, "/x/y", files);
+  ListingCache_invalidate(cache, "/a/", true);
+  assert(ListingCache_lookup(cache, "/a", &cached) == CACHE_MISS);
+  assert(ListingCache_lookup(cache, "/a/b", &cached) == CACHE_MISS);
+  assert(ListingCache_lookup(cache, "/ab", &cached) == CACHE_FRESH);
+  clear_Filelist(cached);
+  assert(ListingCache_lookup(cache, "/x/y", &cached) == CACHE_FRESH);
+  clear_Filelist(cached);
+  ListingCache_invalidate(cache, "/", true);
+  assert(ListingCache_lookup(cache, "/ab", &cached) == CACHE_MISS);
+
+  // The oldest entry is evicted once max_entries is reached
+  ListingCache_store(cache, "/1", files);
+  g_usleep(1000);
+  ListingCache_store(cache, "/2", files);
+  ListingCache_store(cache, "/3", files);
+  ListingCache_store(cache, "/4", files);
+  assert(g_hash_table_size(cache->entries) == 3);
+  assert(ListingCache_lookup(cache, "/1", &cached) == CACHE_MISS);
+
+  clear_Filelist(files);
+  free_ListingCache(cache);
+
+  // A change invalidates the sizes of the folder, its ancestors and descendants
+  SizeCache *sizes = new_SizeCache(FOLDER_SIZE_TTL);
+  DirSize size = { .size = 100, .files = 2, .folders = 1, .unreadable = 0 };
+  DirSize found;
+  SizeCache_store(sizes, "/a", &size);
+  SizeCache_store(sizes, "/a/b/", &size);
+  SizeCache_store(sizes, "/a/b/c", &size);
+  SizeCache_store(sizes, "/a/d", &size);
+  assert(SizeCache_lookup(sizes, "/a/b", &found) && found.size == 100 && found.files == 2);
+  SizeCache_invalidate(sizes, "/a/b");
+  assert(!SizeCache_lookup(sizes, "/a", &found));
+  assert(!SizeCache_lookup(sizes, "/a/b", &found));
+  assert(!SizeCache_lookup(sizes, "/a/b/c", &found));
+  assert(SizeCache_lookup(sizes, "/a/d", &found));
+  free_SizeCache(sizes);
+  sizes = new_SizeCache(0);
+  SizeCache_store(sizes, "/a", &size);
+  assert(!SizeCache_lookup(sizes, "/a", &found));
+  free_SizeCache(sizes);
+  printf("test_cache.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
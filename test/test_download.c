@@ -0,0 +1,185 @@
+/**
+  *   @file test_download.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for download.c
+  */
+
+#include <assert.h>
+
+#include "../include/download.h"
+
+#define TEST_DIR "testDOWNLOAD_cache" /**< Cache folder of the tests */
+#define TEST_HOST "user@host" /**< Server of the cached files */
+
+
+/**
+  *   @brief Write a file with len bytes of c
+  */
+static void write_file(const char *filename, const char c, const size_t len) {
+  char data[256];
+  assert(len <= sizeof(data));
+  memset(data, c, len);
+  unlink(filename);
+  assert(g_file_set_contents(filename, data, (gssize) len, NULL));
+}
+
+/**
+  *   @brief Check that a file has len bytes of c
+  */
+static void assert_file(const char *filename, const char c, const size_t len) {
+  gchar *data = NULL;
+  gsize data_len = 0;
+  assert(g_file_get_contents(filename, &data, &data_len, NULL));
+  assert(data_len == len);
+  for (gsize i = 0; i < data_len; i++) assert(data[i] == c);
+  g_free(data);
+}
+
+/**
+  *   @brief Get the path of the only cached content
+  *   @return String, free with g_free
+  */
+static gchar *first_blob(DownloadCache *cache) {
+  GHashTableIter it;
+  gpointer key;
+  g_hash_table_iter_init(&it, cache->blobs);
+  assert(g_hash_table_iter_next(&it, &key, NULL));
+  return g_build_filename(TEST_DIR, DOWNLOAD_OBJECTS, (const char *) key, NULL);
+}
+
+/**
+  *   @brief Remove the cache folder
+  */
+static void remove_cache() {
+  gchar *objects = g_build_filename(TEST_DIR, DOWNLOAD_OBJECTS, NULL);
+  GDir *dir = g_dir_open(objects, 0, NULL);
+  if (dir) {
+    const gchar *name;
+    while ((name = g_dir_read_name(dir))) {
+      gchar *path = g_build_filename(objects, name, NULL);
+      unlink(path);
+      g_free(path);
+    }
+    g_dir_close(dir);
+  }
+  rmdir(objects);
+  g_free(objects);
+  unlink(TEST_DIR "/" DOWNLOAD_INDEX);
+  rmdir(TEST_DIR);
+}
+
+
+int main() {
+  const char *src = "testDOWNLOAD_src";
+  const char *dst = "testDOWNLOAD_dst";
+  remove_cache();
+  unlink(dst);
+
+  // Configuration
+  uint64_t max_bytes;
+  bool hard_links;
+  unsetenv(DOWNLOAD_CACHE_ENV);
+  unsetenv(DOWNLOAD_LINKS_ENV);
+  assert(download_cache_config(&max_bytes, &hard_links));
+  assert(max_bytes == (uint64_t) DOWNLOAD_CACHE_SIZE * 1024 * 1024 && !hard_links);
+  setenv(DOWNLOAD_CACHE_ENV, "5", 1);
+  setenv(DOWNLOAD_LINKS_ENV, "1", 1);
+  assert(download_cache_config(&max_bytes, &hard_links));
+  assert(max_bytes == 5 * 1024 * 1024 && hard_links);
+  setenv(DOWNLOAD_CACHE_ENV, "0", 1);
+  assert(!download_cache_config(&max_bytes, &hard_links));
+
+  // Hits are served while the size and mtime match
+  DownloadCache *cache = new_DownloadCache(TEST_DIR, 100, false);
+  assert(cache);
+  write_file(src, 'a', 40);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1000, dst, false, S_IRUSR | S_IWUSR) == -1);
+  assert(DownloadCache_store(cache, TEST_HOST, "/a", 40, 1000, src, NULL) == 0);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1000, dst, false, S_IRUSR | S_IWUSR) == 0);
+  assert_file(dst, 'a', 40);
+  assert(cache->stats.hits == 1 && cache->stats.misses == 1 && cache->stats.saved == 40);
+  // Existing files are not replaced without overwrite, nor counted
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1000, dst, false, S_IRUSR | S_IWUSR) == -1);
+  assert(cache->stats.misses == 1);
+  write_file(dst, 'x', 5);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1000, dst, true, S_IRUSR | S_IWUSR) == 0);
+  assert_file(dst, 'a', 40);
+  // Not the same server
+  assert(DownloadCache_fetch(cache, "user@other", "/a", 40, 1000, dst, true, S_IRUSR | S_IWUSR) == -1);
+  // A changed remote file drops the entry
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1001, dst, true, S_IRUSR | S_IWUSR) == -1);
+  assert(g_hash_table_size(cache->entries) == 0 && g_hash_table_size(cache->blobs) == 0 && cache->bytes == 0);
+
+  // The same content is stored once
+  assert(DownloadCache_store(cache, TEST_HOST, "/a", 40, 1000, src, NULL) == 0);
+  assert(DownloadCache_store(cache, "user@other", "/b", 40, 2000, src, NULL) == 0);
+  assert(g_hash_table_size(cache->entries) == 2 && g_hash_table_size(cache->blobs) == 1 && cache->bytes == 40);
+
+  // The least recently used entries are evicted, contents when no entry has them
+  write_file(src, 'c', 40);
+  assert(DownloadCache_store(cache, TEST_HOST, "/c", 40, 3000, src, NULL) == 0);
+  assert(cache->bytes == 80);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/a", 40, 1000, dst, true, S_IRUSR | S_IWUSR) == 0);
+  write_file(src, 'd', 40);
+  assert(DownloadCache_store(cache, TEST_HOST, "/d", 40, 4000, src, NULL) == 0);
+  assert(cache->bytes == 80 && cache->stats.evictions == 2);
+  assert(g_hash_table_contains(cache->entries, TEST_HOST ":/a"));
+  assert(g_hash_table_contains(cache->entries, TEST_HOST ":/d"));
+  // Files larger than the cache are not stored
+  write_file(src, 'e', 101);
+  assert(DownloadCache_store(cache, TEST_HOST, "/e", 101, 5000, src, NULL) == -1);
+  assert(g_hash_table_size(cache->entries) == 2);
+
+  // The index keeps the entries, their order and the totals
+  free_DownloadCache(cache);
+  cache = new_DownloadCache(TEST_DIR, 100, false);
+  assert(cache && g_hash_table_size(cache->entries) == 2 && cache->bytes == 80);
+  assert(strcmp(((DownloadEntry *) cache->lru.head->data)->key, TEST_HOST ":/d") == 0);
+  assert(cache->stats.hits == 0 && cache->total.hits == 3 && cache->total.evictions == 2);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/d", 40, 4000, dst, true, S_IRUSR | S_IWUSR) == 0);
+  assert_file(dst, 'd', 40);
+  gchar *summary = DownloadCache_summary(cache);
+  assert(strstr(summary, "1 hits") && strstr(summary, "4 hits"));
+  g_free(summary);
+  // A lower limit evicts when loaded
+  free_DownloadCache(cache);
+  cache = new_DownloadCache(TEST_DIR, 50, false);
+  assert(cache && g_hash_table_size(cache->entries) == 1);
+  assert(g_hash_table_contains(cache->entries, TEST_HOST ":/d"));
+  // A content removed behind the back of the cache is a miss
+  gchar *blob = first_blob(cache);
+  assert(chmod(blob, S_IRUSR | S_IWUSR) == 0 && unlink(blob) == 0);
+  g_free(blob);
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/d", 40, 4000, dst, true, S_IRUSR | S_IWUSR) == -1);
+  assert(g_hash_table_size(cache->entries) == 0 && cache->bytes == 0);
+  free_DownloadCache(cache);
+
+  // Storing copies the download, its permissions are kept
+  cache = new_DownloadCache(TEST_DIR, 100, true);
+  assert(cache);
+  write_file(src, 'f', 40);
+  assert(chmod(src, S_IRUSR | S_IWUSR | S_IXUSR) == 0);
+  assert(DownloadCache_store(cache, TEST_HOST, "/f", 40, 6000, src, NULL) == 0);
+  blob = first_blob(cache);
+  struct stat src_st, blob_st, dst_st;
+  assert(stat(src, &src_st) == 0 && stat(blob, &blob_st) == 0);
+  assert((src_st.st_mode & DOWNLOAD_MODE_MASK) == (S_IRUSR | S_IWUSR | S_IXUSR) && src_st.st_ino != blob_st.st_ino);
+  assert((blob_st.st_mode & DOWNLOAD_MODE_MASK) == (S_IRUSR | S_IXUSR));
+  // Hits asking for other permissions are copied with them
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/f", 40, 6000, dst, true, S_IRUSR | S_IWUSR) == 0);
+  assert(stat(dst, &dst_st) == 0 && dst_st.st_ino != blob_st.st_ino);
+  assert((dst_st.st_mode & DOWNLOAD_MODE_MASK) == (S_IRUSR | S_IWUSR));
+  assert_file(dst, 'f', 40);
+  // Hard linked hits share the read-only content
+  assert(DownloadCache_fetch(cache, TEST_HOST, "/f", 40, 6000, dst, true, S_IRUSR | S_IXUSR) == 0);
+  assert(stat(dst, &dst_st) == 0 && dst_st.st_ino == blob_st.st_ino);
+  assert_file(dst, 'f', 40);
+  g_free(blob);
+  free_DownloadCache(cache);
+
+  unlink(src);
+  unlink(dst);
+  remove_cache();
+  printf("test_download.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
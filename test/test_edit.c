@@ -0,0 +1,184 @@
+/**
+  *   @file test_edit.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for edit.c
+  */
+
+#include <assert.h>
+
+#include "../include/edit.h"
+
+#define TEST_BLOCKS 10 /**< Full blocks in the test file */
+#define TEST_TAIL 1000 /**< Bytes after the full blocks */
+
+/**
+  *   @struct LocalTarget
+  *   @brief Local file standing in for the remote one
+  */
+typedef struct {
+  int fd; /**< Open file */
+  unsigned writes; /**< Number of writes */
+  unsigned truncates; /**< Number of truncates */
+  unsigned fail_write; /**< Number of the write which fails, 0 if none */
+  bool fail_truncate; /**< Whether truncates fail */
+} LocalTarget;
+
+
+/**
+  *   @brief EditWrite of a LocalTarget
+  */
+static int local_write(void *target, const char *buff, const size_t len, const uint64_t offset) {
+  LocalTarget *local = (LocalTarget *) target;
+  if (++local->writes == local->fail_write) return -1;
+  return pwrite(local->fd, buff, len, (off_t) offset) == (ssize_t) len ? 0 : -1;
+}
+
+/**
+  *   @brief EditTruncate of a LocalTarget
+  */
+static int local_truncate(void *target, const uint64_t size) {
+  LocalTarget *local = (LocalTarget *) target;
+  local->truncates++;
+  if (local->fail_truncate) return -1;
+  return ftruncate(local->fd, (off_t) size);
+}
+
+/**
+  *   @brief Read a whole file
+  *   @return Contents, free with g_free
+  */
+static gchar *contents(const char *filename, gsize *len) {
+  gchar *data = NULL;
+  assert(g_file_get_contents(filename, &data, len, NULL));
+  return data;
+}
+
+/**
+  *   @brief Check that the target has the same contents as the local copy
+  */
+static void assert_same(const char *a, const char *b) {
+  gsize len_a, len_b;
+  gchar *data_a = contents(a, &len_a);
+  gchar *data_b = contents(b, &len_b);
+  assert(len_a == len_b && memcmp(data_a, data_b, len_a) == 0);
+  g_free(data_a);
+  g_free(data_b);
+}
+
+/**
+  *   @brief Overwrite bytes of a file in place
+  */
+static void patch(const char *filename, const uint64_t offset, const char *data) {
+  const int fd = open(filename, O_WRONLY);
+  assert(fd >= 0);
+  assert(pwrite(fd, data, strlen(data), (off_t) offset) == (ssize_t) strlen(data));
+  close(fd);
+}
+
+
+int main() {
+  const char *remote = "testEDIT_remote.txt";
+  const char *local = "testEDIT_local.txt";
+  const size_t size = TEST_BLOCKS * EDIT_BLOCK_SIZE + TEST_TAIL;
+  char *data = malloc(size);
+  assert(data);
+  for (size_t i = 0; i < size; i++) data[i] = 'a' + (char) (i % 26);
+  assert(g_file_set_contents(remote, data, (gssize) size, NULL));
+  assert(g_file_set_contents(local, data, (gssize) size, NULL));
+  free(data);
+
+  // Local paths keep the name of the file and differ per host
+  char *path = edit_local_path("user@host", "/etc/app/config.yaml");
+  char *other = edit_local_path("user@other", "/etc/app/config.yaml");
+  assert(strstr(path, EDIT_FOLDER "/") && g_str_has_suffix(path, "/config.yaml"));
+  assert(strcmp(path, other) != 0);
+  free(path);
+  free(other);
+
+  EditFile *edit = new_EditFile("/remote/test.txt", local);
+  assert(edit && EditFile_sync(edit) == 0);
+  assert(edit->size == size && edit->hashes->len == (TEST_BLOCKS + 1) * EDIT_HASH_LEN);
+  assert(!EditFile_modified(edit));
+  LocalTarget target = { open(remote, O_WRONLY), 0, 0, 0, false };
+  assert(target.fd >= 0);
+
+  // Nothing changed, nothing is written
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(edit->written == 0 && target.writes == 0);
+
+  // A change inside one block writes only that block
+  patch(local, 3 * EDIT_BLOCK_SIZE + 100, "changed");
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(edit->written == EDIT_BLOCK_SIZE && target.writes == 1 && target.truncates == 0);
+  assert_same(remote, local);
+  assert(!EditFile_modified(edit));
+
+  // Appending writes the last block and the new ones
+  FILE *fp = fopen(local, "a");
+  assert(fp);
+  for (unsigned i = 0; i < EDIT_BLOCK_SIZE; i++) fputc('z', fp);
+  fclose(fp);
+  assert(EditFile_modified(edit));
+  target.writes = 0;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(edit->written == EDIT_BLOCK_SIZE + TEST_TAIL && target.writes == 2);
+  assert(edit->size == size + EDIT_BLOCK_SIZE);
+  assert_same(remote, local);
+
+  // Shrinking truncates and rewrites only the new last block
+  assert(truncate(local, 2 * EDIT_BLOCK_SIZE + 10) == 0);
+  target.writes = 0;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(edit->written == 10 && target.writes == 1 && target.truncates == 1);
+  assert(edit->size == 2 * EDIT_BLOCK_SIZE + 10 && edit->hashes->len == 3 * EDIT_HASH_LEN);
+  assert_same(remote, local);
+
+  // A failed truncate keeps the old size and marks the new last block stale
+  assert(truncate(local, EDIT_BLOCK_SIZE + 10) == 0);
+  target.fail_truncate = true;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == -1);
+  assert(edit->size == 2 * EDIT_BLOCK_SIZE + 10 && edit->stale_from == 1 && target.truncates == 2);
+  EditFile_seen(edit);
+  assert(!EditFile_modified(edit));
+  target.fail_truncate = false;
+  target.writes = 0;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(target.writes == 1 && target.truncates == 3);
+  assert(edit->stale_from == UINT64_MAX && edit->size == EDIT_BLOCK_SIZE + 10);
+  assert_same(remote, local);
+
+  // After a failed write the blocks from it on are written again
+  fp = fopen(local, "a");
+  assert(fp);
+  for (unsigned i = 0; i < 3 * EDIT_BLOCK_SIZE; i++) fputc('y', fp);
+  fclose(fp);
+  patch(local, 0, "first");
+  target.writes = 0;
+  target.fail_write = 2;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == -1);
+  assert(edit->stale_from == 1 && edit->hashes->len == EDIT_HASH_LEN);
+  target.writes = 0;
+  target.fail_write = 0;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(target.writes == 4 && edit->stale_from == UINT64_MAX && edit->size == 4 * EDIT_BLOCK_SIZE + 10);
+  assert_same(remote, local);
+
+  // A forgotten sync writes every block
+  EditFile_forget(edit, 5 * EDIT_BLOCK_SIZE);
+  target.writes = 0;
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == 0);
+  assert(target.writes == 5 && target.truncates == 4 && edit->written == 4 * EDIT_BLOCK_SIZE + 10);
+  assert_same(remote, local);
+  close(target.fd);
+
+  // A missing local copy is an error
+  EditFile_remove_copy(edit);
+  assert(access(local, F_OK) != 0);
+  assert(EditFile_write_back(edit, local_write, local_truncate, &target) == -1);
+  assert(!EditFile_modified(edit));
+  free_EditFile(edit);
+
+  assert(unlink(remote) == 0);
+  printf("test_edit.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
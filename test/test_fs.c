@@ -29,14 +29,83 @@ int main() {
   assert((files = ls_dir(files, ".")));
   printf("files length: %d\n", g_slist_length(files));
   iterate_FileList(files, print_File, NULL, false);
+  guint full_len = g_slist_length(files);
   clear_Filelist(files);
 
+  // Name-only listing contains the same entries, metadata is filled on demand
+  files = NULL;
+  assert((files = ls_dir_names(files, ".")));
+  assert(g_slist_length(files) == full_len);
+  GSList *item = g_slist_find_custom(files, dir_name, compare_File_GSLists);
+  assert(item);
+  File_t *listed = (File_t *) item->data;
+  assert(!listed->has_metadata);
+  assert(is_folder(listed->type, false));
+  assert(fs_fill_File(listed, "."));
+  assert(listed->has_metadata && S_ISDIR(listed->permissions));
+  clear_Filelist(files);
+  File_t *single = fs_new_File(".", dir_name);
+  assert(single && is_folder(single->type, false) && !single->has_metadata);
+  free_File(single);
+  assert(!fs_new_File(".", "some_random_file_name"));
+
+  // Directories first, numbers in names in natural order
+  const char *sort_names[] = { "file10.txt", "b.c", "file2.txt", "dir", "a.txt" };
+  const uint64_t sort_sizes[] = { 30, 10, 20, 0, 40 };
+  files = NULL;
+  for (unsigned i = 0; i < 5; i++) {
+    File_t *entry = new_File(sort_names[i], i == 3 ? DT_DIR : DT_REG);
+    entry->size = sort_sizes[i];
+    files = g_slist_append(files, entry);
+  }
+  files = sort_Filelist(files, SORT_BY_NAME, false, false);
+  assert(strcmp(((File_t *) files->data)->name, "dir") == 0);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 3))->name, "file2.txt") == 0);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 4))->name, "file10.txt") == 0);
+  files = sort_Filelist(files, SORT_BY_SIZE, true, false);
+  assert(strcmp(((File_t *) files->data)->name, "dir") == 0);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 1))->name, "a.txt") == 0);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 4))->name, "b.c") == 0);
+  files = sort_Filelist(files, SORT_BY_TYPE, false, false);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 1))->name, "b.c") == 0);
+  assert(strcmp(((File_t *) g_slist_nth_data(files, 2))->name, "a.txt") == 0);
+  File_t *collated = copy_File((File_t *) files->data);
+  assert(collated->collate_key && strcmp(collated->collate_key, ((File_t *) files->data)->collate_key) == 0);
+  free_File(collated);
+  clear_Filelist(files);
+
+  // Recursive size: 2 + 3 bytes in files, one nested folder
+  assert(fs_mkdir("testDIR/sub", 0) == FILE_WRITTEN_SUCCESSFULLY);
+  assert(fs_mkdir("testDIR/sub/subsub", 0) == FILE_WRITTEN_SUCCESSFULLY);
+  int size_fd = open("testDIR/sub/a", O_CREAT | O_WRONLY, S_IRWXU);
+  assert(size_fd >= 0);
+  assert(write(size_fd, "ab", 2) == 2);
+  close(size_fd);
+  size_fd = open("testDIR/sub/subsub/b", O_CREAT | O_WRONLY, S_IRWXU);
+  assert(size_fd >= 0);
+  assert(write(size_fd, "abc", 3) == 3);
+  close(size_fd);
+  DirSizeProgress progress;
+  DirSizeProgress_init(&progress);
+  assert(fs_dir_size(dir_name, &progress, DIR_SIZE_THREADS) == 0);
+  DirSize total = DirSizeProgress_get(&progress);
+  assert(total.size == 5 && total.files == 2 && total.folders == 2 && total.unreadable == 0);
+  DirSizeProgress_destroy(&progress);
+  DirSizeProgress_init(&progress);
+  g_atomic_int_set(&progress.cancel, 1);
+  assert(fs_dir_size(dir_name, &progress, 1) == -1);
+  DirSizeProgress_destroy(&progress);
+  DirSizeProgress_init(&progress);
+  assert(fs_dir_size("some_random_file_name", &progress, 2) == 0);
+  assert(DirSizeProgress_get(&progress).unreadable == 1);
+  DirSizeProgress_destroy(&progress);
+
   const char *file = "testDIR/test_file.txt";
   const char *file2 = "testDIR/test_file_updated.txt";
   int fd = open(file, O_CREAT | O_WRONLY);
   if (fd) {
     const char *buff = "Hello world\n";
-    write(fd, buff, strlen(buff));
+    assert(write(fd, buff, strlen(buff)) == (ssize_t) strlen(buff));
     close(fd);
     assert(fs_rename(file, file2) == FILE_WRITTEN_SUCCESSFULLY);
   }
@@ -53,7 +122,7 @@ int main() {
   fd = open(filepath, O_CREAT | O_WRONLY, S_IRWXU);
   if (fd) {
     const char *text = "Hello\nHello\nWhat's up?\nNothing special, I'm just testing\n....\n";
-    write(fd, text, strlen(text));
+    assert(write(fd, text, strlen(text)) == (ssize_t) strlen(text));
     close(fd);
     assert(fs_copy_file(filepath, filename, dst_dir, false) == FILE_WRITTEN_SUCCESSFULLY);
     assert(fs_copy_file(filepath, filename, dst_dir, false) == FILE_ALREADY_EXISTS);
@@ -0,0 +1,137 @@
+/**
+  *   @file test_index.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for index.c
+  */
+
+#include <assert.h>
+
+#include "../include/index.h"
+
+
+/**
+  *   @brief Create a remote listing entry
+  */
+static GSList *add_entry(GSList *files, const char *name, const uint8_t type, const uint64_t size) {
+  File_t *file = new_File(name, type);
+  file->size = size;
+  file->mtime = 1600000000;
+  return g_slist_append(files, file);
+}
+
+/**
+  *   @brief Search the index and return the number of matches
+  */
+static unsigned count_matches(RemoteIndex *index, const char *root, const char *pattern, const char *expected) {
+  SearchQuery query = { (char *) pattern, false, false, 0, 0, 0 };
+  SearchProgress progress;
+  SearchProgress_init(&progress);
+  assert(RemoteIndex_find(index, root, &query, &progress) == 0);
+  GSList *matches = SearchProgress_take(&progress);
+  bool found = !expected;
+  for (GSList *node = matches; node; node = node->next) {
+    if (expected && strcmp(((File_t *) node->data)->name, expected) == 0) found = true;
+  }
+  assert(found);
+  const unsigned count = g_slist_length(matches);
+  clear_Filelist(matches);
+  SearchProgress_destroy(&progress);
+  return count;
+}
+
+
+int main() {
+  char *filename = index_filename("user", "host/22");
+  assert(strstr(filename, INDEX_FOLDER "/user@host_22.index"));
+  free(filename);
+
+  const char *file = "testINDEX/remote.index";
+  RemoteIndex *index = new_RemoteIndex(file);
+  assert(index && !index->map && !RemoteIndex_is_dirty(index));
+  SearchQuery all = { NULL, false, false, 0, 0, 0 };
+  SearchProgress progress;
+  SearchProgress_init(&progress);
+  assert(RemoteIndex_find(index, "/home", &all, &progress) == -1);
+  SearchProgress_destroy(&progress);
+  assert(!RemoteIndex_update(index, "relative/path", NULL, 1));
+
+  GSList *files = add_entry(NULL, ".", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  files = add_entry(files, "..", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  files = add_entry(files, "src", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  files = add_entry(files, "a.c", SSH_FILEXFER_TYPE_REGULAR, 10);
+  assert(RemoteIndex_update(index, "/home/user/", files, 1000));
+  clear_Filelist(files);
+  files = add_entry(NULL, "main.c", SSH_FILEXFER_TYPE_REGULAR, 20);
+  assert(RemoteIndex_update(index, "/home/user/src", files, 3000));
+  clear_Filelist(files);
+  assert(RemoteIndex_is_dirty(index));
+
+  // Ancestors are known only by name until they are listed
+  IndexFreshness freshness;
+  assert(RemoteIndex_freshness(index, "/", &freshness));
+  assert(freshness.folders == 4 && freshness.unlisted == 2 && freshness.oldest == 1000 && freshness.newest == 3000);
+  assert(count_matches(index, "/home/user", "*.c", "/home/user/src/main.c") == 2);
+  assert(count_matches(index, "/home/user/src", "*.c", "/home/user/src/main.c") == 1);
+
+  // Saved index is used from the mapped file
+  assert(RemoteIndex_save(index) == 0);
+  assert(!RemoteIndex_is_dirty(index) && index->map && index->node_count == 6);
+  free_RemoteIndex(index);
+  index = new_RemoteIndex(file);
+  assert(index->map);
+  assert(count_matches(index, "/", "*.c", "/home/user/a.c") == 2);
+  assert(RemoteIndex_freshness(index, "/home/user", &freshness));
+  assert(freshness.folders == 2 && freshness.unlisted == 0 && freshness.oldest == 1000);
+  assert(!RemoteIndex_freshness(index, "/home/none", &freshness));
+
+  // A new listing replaces the old one, listed subfolders keep their content
+  files = add_entry(NULL, "src", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  files = add_entry(files, "b.c", SSH_FILEXFER_TYPE_REGULAR, 30);
+  assert(RemoteIndex_update(index, "/home/user", files, 5000));
+  clear_Filelist(files);
+  files = add_entry(NULL, "user", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  files = add_entry(files, "other", SSH_FILEXFER_TYPE_DIRECTORY, 4096);
+  assert(RemoteIndex_update(index, "/home", files, 6000));
+  clear_Filelist(files);
+  assert(count_matches(index, "/", "*.c", "/home/user/b.c") == 2);
+  assert(count_matches(index, "/", "a.c", NULL) == 0);
+  assert(RemoteIndex_save(index) == 0);
+  assert(count_matches(index, "/", "*.c", "/home/user/src/main.c") == 2);
+  assert(RemoteIndex_freshness(index, "/", &freshness));
+  assert(freshness.folders == 5 && freshness.unlisted == 2 && freshness.newest == 6000);
+
+  // Listings stored while the index is locked are queued, not lost
+  pthread_mutex_lock(&(index->lock));
+  files = add_entry(NULL, "c.c", SSH_FILEXFER_TYPE_REGULAR, 40);
+  assert(RemoteIndex_update(index, "/home/other", files, 7000));
+  clear_Filelist(files);
+  files = add_entry(NULL, "d.c", SSH_FILEXFER_TYPE_REGULAR, 50);
+  assert(RemoteIndex_update(index, "/home/other", files, 8000));
+  clear_Filelist(files);
+  assert(g_slist_length(index->pending) == 2 && g_hash_table_size(index->folders) == 0);
+  pthread_mutex_unlock(&(index->lock));
+  assert(RemoteIndex_is_dirty(index) && !index->pending);
+  assert(count_matches(index, "/home/other", "*.c", "/home/other/d.c") == 1);
+  assert(RemoteIndex_save(index) == 0 && !RemoteIndex_is_dirty(index) && !index->saving);
+  assert(count_matches(index, "/", "*.c", "/home/other/d.c") == 3);
+
+  // Regular expressions and size predicates work as in the other searches
+  SearchQuery query = { "^ma.n\\.c$", true, false, 15, 0, 0 };
+  SearchProgress_init(&progress);
+  assert(RemoteIndex_find(index, "/home", &query, &progress) == 0 && progress.count == 1);
+  SearchProgress_destroy(&progress);
+  free_RemoteIndex(index);
+
+  // Damaged files are ignored
+  FILE *fp = fopen(file, "r+b");
+  fwrite("garbage", 1, 7, fp);
+  fclose(fp);
+  index = new_RemoteIndex(file);
+  assert(index && !index->map && index->node_count == 0);
+  free_RemoteIndex(index);
+  assert(unlink(file) == 0);
+  assert(rmdir("testINDEX") == 0);
+
+  printf("test_index.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
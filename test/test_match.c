@@ -0,0 +1,84 @@
+/**
+  *   @file test_match.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for match.c
+  */
+
+#include <assert.h>
+
+#include "../include/match.h"
+#include "../include/fs.h"
+
+/**
+  *   @brief Match pattern in table and check the matching indexes
+  *   @param table NameTable to be searched
+  *   @param pattern Pattern as typed
+  *   @param fuzzy Whether to use a subsequence match
+  *   @param expected Expected indexes, terminated by -1
+  */
+void assert_matches(NameTable *table, const char *pattern, const bool fuzzy, const int *expected) {
+  char *folded = fold_pattern(pattern);
+  GArray *matches = g_array_new(FALSE, FALSE, sizeof(unsigned));
+  int count = NameTable_match(table, folded, fuzzy, table->generation, matches);
+  int i = 0;
+  for (; expected[i] >= 0; i++) {
+    assert(i < count);
+    assert(g_array_index(matches, unsigned, i) == (unsigned) expected[i]);
+  }
+  assert(count == i);
+  g_array_free(matches, TRUE);
+  free(folded);
+}
+
+
+int main() {
+  const char *names[] = { "Makefile", "main.c", "README.md", "src", "test_main.c", ".hidden" };
+  GSList *files = NULL;
+  for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    files = g_slist_append(files, new_File(names[i], SSH_FILEXFER_TYPE_REGULAR));
+  }
+  NameTable *table = new_NameTable(files);
+  assert(table && table->count == 6);
+  clear_Filelist(files); // The table keeps its own copy
+  assert(strcmp(NameTable_name(table, 2), "README.md") == 0);
+
+  assert_matches(table, "main", false, (const int[]) { 1, 4, -1 });
+  assert_matches(table, "MA", false, (const int[]) { 0, 1, 4, -1 });
+  assert_matches(table, "readme", false, (const int[]) { 2, -1 });
+  assert_matches(table, "c", false, (const int[]) { 1, 3, 4, -1 });
+  assert_matches(table, "nothing", false, (const int[]) { -1 });
+  // Substring does not span two names
+  assert_matches(table, "csrc", false, (const int[]) { -1 });
+  assert_matches(table, "mkf", true, (const int[]) { 0, -1 });
+  assert_matches(table, "tmc", true, (const int[]) { 4, -1 });
+  assert_matches(table, "hdn", true, (const int[]) { 5, -1 });
+  assert_matches(table, "fm", true, (const int[]) { -1 });
+
+  // A newer request cancels the older one
+  GArray *matches = g_array_new(FALSE, FALSE, sizeof(unsigned));
+  const gint old = table->generation;
+  g_atomic_int_inc(&table->generation);
+  assert(NameTable_match(table, "main", false, old, matches) == -1);
+  assert(NameTable_match(table, "main", true, old, matches) == -1);
+  g_array_free(matches, TRUE);
+
+  assert(name_matches("Test_Main.c", "main", false));
+  assert(!name_matches("Test_Main.c", "mainc", false));
+  assert(name_matches("Test_Main.c", "mainc", true));
+  assert(!name_matches("Makefile", "fm", true));
+
+  NameTable *ref = NameTable_ref(table);
+  NameTable_unref(table);
+  assert(strcmp(NameTable_name(ref, 0), "Makefile") == 0);
+  NameTable_unref(ref);
+
+  files = NULL;
+  table = new_NameTable(files);
+  assert(table && table->count == 0);
+  assert_matches(table, "a", false, (const int[]) { -1 });
+  assert_matches(table, "a", true, (const int[]) { -1 });
+  NameTable_unref(table);
+
+  printf("test_match.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
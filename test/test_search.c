@@ -0,0 +1,237 @@
+/**
+  *   @file test_search.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for search.c
+  */
+
+#include <assert.h>
+
+#include "../include/search.h"
+
+
+int main() {
+  char *pattern = search_glob("main");
+  assert(strcmp(pattern, "*main*") == 0);
+  free(pattern);
+  pattern = search_glob("*.c");
+  assert(strcmp(pattern, "*.c") == 0);
+  free(pattern);
+  assert(!search_glob(""));
+
+  const time_t now = 1600000000;
+  File_t *file = new_File("Test_Main.c", SSH_FILEXFER_TYPE_REGULAR);
+  file->size = 2000;
+  file->mtime = now - 2 * 24 * 60 * 60 - 1;
+  SearchQuery query = { "*main*", false, false, 0, 0, 0 };
+  assert(!SearchQuery_matches(&query, NULL, file, now));
+  query.ignore_case = true;
+  assert(SearchQuery_matches(&query, NULL, file, now));
+  query.min_size = 2000;
+  query.max_size = 2000;
+  assert(SearchQuery_matches(&query, NULL, file, now));
+  query.min_size = 2001;
+  assert(!SearchQuery_matches(&query, NULL, file, now));
+  query.min_size = 0;
+  query.max_age = 3;
+  assert(SearchQuery_matches(&query, NULL, file, now));
+  query.max_age = 2;
+  assert(!SearchQuery_matches(&query, NULL, file, now));
+  free_File(file);
+
+  // Regular expressions match any part of the name
+  SearchQuery regex_query = { "^test_[a-z]+\\.c$", true, true, 0, 0, 0 };
+  regex_t regex;
+  assert(SearchQuery_compile(&regex_query, &regex) == 0);
+  assert(SearchQuery_matches_name(&regex_query, &regex, "Test_Main.c"));
+  assert(!SearchQuery_matches_name(&regex_query, &regex, "Test_Main.cpp"));
+  regfree(&regex);
+  regex_query.pattern = "ma(in";
+  assert(SearchQuery_compile(&regex_query, &regex) == -1);
+
+  // Quoting keeps the shell from expanding the pattern or the root
+  SearchQuery shell_query = { "*it's*", false, true, 10, 20, 7 };
+  char *cmd = find_command("/home/user/my files", &shell_query);
+  assert(strncmp(cmd, "find / -prune -printf '" FIND_SENTINEL "\\0'", strlen("find / -prune -printf '" FIND_SENTINEL "\\0'")) == 0);
+  assert(strstr(cmd, "&& find '/home/user/my files' -mindepth 1 -iname '*it'\\''s*' -size +9c -size -21c -mtime -7 -printf"));
+  free(cmd);
+  SearchQuery all = { NULL, false, false, 0, 0, 0 };
+  cmd = find_command("/", &all);
+  assert(!strstr(cmd, "-name") && !strstr(cmd, "-size") && !strstr(cmd, "-mtime"));
+  free(cmd);
+  SearchQuery find_regex = { "ma+in", true, false, 0, 0, 0 };
+  cmd = find_command("/", &find_regex);
+  assert(strstr(cmd, " -regextype posix-extended -regex '.*/[^/]*(ma+in)[^/]*' "));
+  free(cmd);
+  // Anchors apply to the last path component
+  find_regex.pattern = "^main$";
+  cmd = find_command("/", &find_regex);
+  assert(strstr(cmd, " -regex '.*/(main)' "));
+  free(cmd);
+  find_regex.pattern = "^ma";
+  cmd = find_command("/", &find_regex);
+  assert(strstr(cmd, " -regex '.*/(ma)[^/]*' "));
+  free(cmd);
+  find_regex.pattern = "\\.c$";
+  cmd = find_command("/", &find_regex);
+  assert(strstr(cmd, " -regex '.*/[^/]*(\\.c)' "));
+  free(cmd);
+  // Anchors which cannot be moved leave the matching to the names
+  char *unanchored[] = { "^a|b", "a\\$", "x[^/]y", "(^a)" };
+  for (unsigned i = 0; i < sizeof(unanchored) / sizeof(unanchored[0]); i++) {
+    find_regex.pattern = unanchored[i];
+    cmd = find_command("/", &find_regex);
+    assert(!strstr(cmd, "-regex "));
+    free(cmd);
+  }
+
+  file = parse_find_record("f 5000000000 1600000000.1234567890 /home/user/a file.txt");
+  assert(file && file->type == SSH_FILEXFER_TYPE_REGULAR && file->size == 5000000000 && file->mtime == 1600000000);
+  assert(strcmp(file->name, "/home/user/a file.txt") == 0 && !file->has_metadata);
+  free_File(file);
+  file = parse_find_record("d 4096 1600000000 /home");
+  assert(file && is_folder(file->type, true));
+  free_File(file);
+  assert(!parse_find_record(""));
+  assert(!parse_find_record("f 12 /no/mtime"));
+  assert(!parse_find_record("f 12 1600000000 "));
+
+  SearchProgress progress;
+  SearchProgress_init(&progress);
+  assert(SearchProgress_add(&progress, new_File("/a", SSH_FILEXFER_TYPE_REGULAR)));
+  assert(SearchProgress_add(&progress, new_File("/b", SSH_FILEXFER_TYPE_REGULAR)));
+  GSList *matches = SearchProgress_take(&progress);
+  assert(g_slist_length(matches) == 2 && strcmp(((File_t *) matches->data)->name, "/a") == 0);
+  clear_Filelist(matches);
+  assert(!SearchProgress_take(&progress) && progress.count == 2);
+  progress.count = SEARCH_MAX_RESULTS;
+  assert(!SearchProgress_add(&progress, new_File("/c", SSH_FILEXFER_TYPE_REGULAR)) && progress.truncated);
+  SearchProgress_destroy(&progress);
+
+  // Output without the sentinel is not taken as a complete result, the sftp walk runs instead
+  SearchProgress_init(&progress);
+  FindParser find_parser;
+  FindParser_init(&find_parser, &all, NULL, &progress);
+  const char plain[] = "f 3 1600000000 /a\0";
+  assert(FindParser_feed(&find_parser, plain, sizeof(plain) - 1) == OUTPUT_UNSUPPORTED);
+  assert(search_exec_status(EXEC_STOPPED, OUTPUT_UNSUPPORTED) == SEARCH_UNSUPPORTED);
+  assert(!SearchProgress_take(&progress));
+  FindParser_destroy(&find_parser);
+  FindParser_init(&find_parser, &all, NULL, &progress);
+  assert(FindParser_feed(&find_parser, NULL, 0) == OUTPUT_UNSUPPORTED);
+  assert(search_exec_status(EXEC_FINISHED, OUTPUT_UNSUPPORTED) == SEARCH_UNSUPPORTED);
+  assert(search_exec_status(EXEC_NOT_STARTED, OUTPUT_CONTINUE) == SEARCH_UNSUPPORTED);
+  FindParser_destroy(&find_parser);
+
+  // The sentinel may arrive split over chunks, the limit stops without falling back
+  FindParser_init(&find_parser, &all, NULL, &progress);
+  const char found[] = FIND_SENTINEL "\0f 3 1600000000 /a\0d 4096 1600000000 /b\0";
+  assert(FindParser_feed(&find_parser, found, 7) == OUTPUT_CONTINUE);
+  assert(FindParser_feed(&find_parser, found + 7, sizeof(found) - 8) == OUTPUT_CONTINUE);
+  assert(FindParser_feed(&find_parser, NULL, 0) == OUTPUT_CONTINUE);
+  assert(search_exec_status(EXEC_FINISHED, OUTPUT_CONTINUE) == 0);
+  matches = SearchProgress_take(&progress);
+  assert(g_slist_length(matches) == 2);
+  clear_Filelist(matches);
+  progress.count = SEARCH_MAX_RESULTS;
+  const char more[] = "f 3 1600000000 /c\0";
+  assert(FindParser_feed(&find_parser, more, sizeof(more) - 1) == OUTPUT_STOP);
+  assert(search_exec_status(EXEC_STOPPED, OUTPUT_STOP) == 0);
+  assert(search_exec_status(EXEC_CANCELLED, OUTPUT_CONTINUE) == -1);
+  FindParser_destroy(&find_parser);
+  SearchProgress_destroy(&progress);
+
+  SearchQuery grep_query = { "it's", false, true, 10, 0, 0 };
+  cmd = grep_command("/home/user/my files", &grep_query);
+  assert(strncmp(cmd, "command -v grep", strlen("command -v grep")) == 0);
+  assert(strstr(cmd, "printf '" GREP_SENTINEL "\\0' && find '/home/user/my files' -type f -size +9c "));
+  assert(strstr(cmd, " -exec grep -nIH --null -i -F -e 'it'\\''s' -- {} + "));
+  free(cmd);
+  grep_query.regex = true;
+  grep_query.ignore_case = false;
+  cmd = grep_command("/", &grep_query);
+  assert(strstr(cmd, "grep -nIH --null -E -e "));
+  free(cmd);
+
+  // Output is parsed across arbitrary chunks, paths may contain ':'
+  const char output[] = GREP_SENTINEL "\0/a:b.c\0" "12:int main() {\n/c.txt\0" "3:x\r\n";
+  SearchProgress_init(&progress);
+  GrepParser parser;
+  GrepParser_init(&parser, &progress);
+  for (size_t i = 0; i < sizeof(output) - 1; i += 5) {
+    const size_t len = sizeof(output) - 1 - i < 5 ? sizeof(output) - 1 - i : 5;
+    assert(GrepParser_feed(&parser, output + i, len) == OUTPUT_CONTINUE);
+  }
+  assert(GrepParser_feed(&parser, NULL, 0) == OUTPUT_CONTINUE);
+  matches = SearchProgress_take(&progress);
+  assert(g_slist_length(matches) == 2);
+  GrepMatch *match = (GrepMatch *) matches->data;
+  assert(strcmp(match->path, "/a:b.c") == 0 && match->line == 12 && strcmp(match->text, "int main() {") == 0);
+  match = (GrepMatch *) matches->next->data;
+  assert(strcmp(match->path, "/c.txt") == 0 && match->line == 3 && strcmp(match->text, "x") == 0);
+  g_slist_free_full(matches, free_GrepMatch);
+
+  // Long lines are cut, invalid UTF-8 is replaced and malformed records are skipped
+  GString *line = g_string_new_len("/long\0" "1:", 8);
+  for (int i = 0; i < GREP_MAX_TEXT * 4; i++) g_string_append_c(line, 'x');
+  g_string_append_len(line, "\n/bad\0" "2:\xff\n/none\0" "x:y\n", 20);
+  assert(GrepParser_feed(&parser, line->str, line->len) == OUTPUT_CONTINUE);
+  g_string_free(line, TRUE);
+  matches = SearchProgress_take(&progress);
+  assert(g_slist_length(matches) == 2);
+  match = (GrepMatch *) matches->data;
+  assert(strncmp(match->text, "xxx", 3) == 0 && strlen(match->text) < GREP_MAX_TEXT + 8);
+  match = (GrepMatch *) matches->next->data;
+  assert(g_utf8_validate(match->text, -1, NULL));
+  g_slist_free_full(matches, free_GrepMatch);
+  GrepParser_destroy(&parser);
+  progress.count = SEARCH_MAX_RESULTS;
+  GrepParser_init(&parser, &progress);
+  assert(GrepParser_feed(&parser, GREP_SENTINEL "\0/a\0" "1:a\n", strlen(GREP_SENTINEL) + 9) == OUTPUT_STOP);
+  GrepParser_destroy(&parser);
+  SearchProgress_destroy(&progress);
+
+  // Servers without grep print something else or nothing
+  SearchProgress_init(&progress);
+  GrepParser_init(&parser, &progress);
+  assert(GrepParser_feed(&parser, NULL, 0) == OUTPUT_UNSUPPORTED);
+  assert(GrepParser_feed(&parser, "sh: grep: not found\n", 20) == OUTPUT_CONTINUE);
+  assert(GrepParser_feed(&parser, "\0", 1) == OUTPUT_UNSUPPORTED);
+  GrepParser_destroy(&parser);
+  SearchProgress_destroy(&progress);
+
+  // Local search over a tree wider than the number of threads
+  assert(fs_mkdir("testSEARCH", 0) == FILE_WRITTEN_SUCCESSFULLY);
+  char path[64];
+  for (int i = 0; i < 20; i++) {
+    sprintf(path, "testSEARCH/dir%d", i);
+    assert(fs_mkdir(path, 0) == FILE_WRITTEN_SUCCESSFULLY);
+    sprintf(path, "testSEARCH/dir%d/main%d.c", i, i);
+    int fd = open(path, O_CREAT | O_WRONLY, S_IRWXU);
+    assert(fd >= 0 && write(fd, "abc", 3) == 3);
+    close(fd);
+  }
+  SearchQuery local = { "*main1*.c", false, false, 0, 0, 0 };
+  SearchProgress_init(&progress);
+  assert(fs_find("testSEARCH", &local, &progress, 8) == 0);
+  matches = SearchProgress_take(&progress);
+  assert(g_slist_length(matches) == 11); // main1.c and main10.c to main19.c
+  file = (File_t *) matches->data;
+  assert(strncmp(file->name, "testSEARCH/dir1", strlen("testSEARCH/dir1")) == 0 && file->size == 3);
+  clear_Filelist(matches);
+  SearchProgress_destroy(&progress);
+  SearchQuery local_regex = { "^(dir1|main2\\.c)$", true, false, 0, 0, 0 };
+  SearchProgress_init(&progress);
+  assert(fs_find("testSEARCH", &local_regex, &progress, 3) == 0);
+  assert(progress.count == 2);
+  SearchProgress_destroy(&progress);
+  local.min_size = 4;
+  SearchProgress_init(&progress);
+  assert(fs_find("testSEARCH", &local, &progress, 2) == 0 && progress.count == 0);
+  g_atomic_int_set(&progress.cancel, 1);
+  assert(fs_find("testSEARCH", &local, &progress, 2) == -1);
+  SearchProgress_destroy(&progress);
+  assert(fs_rmdir("testSEARCH", true) == 0);
+
+  printf("test_search.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**
+  *   @file test_ssh.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for ssh.c
+  */
+
+#include <assert.h>
+
+#include "../include/ssh.h"
+
+/**
+  *   @struct FakeCommand
+  *   @brief Target of the ExecChannel of the tests, replays scripted output
+  */
+typedef struct {
+  const char **chunks; /**< Output chunks in order, stderr chunks start with '!' */
+  unsigned next; /**< Next chunk to be read */
+  bool hang; /**< Whether the output never ends */
+  bool fail; /**< Whether reads fail */
+  bool eof; /**< Set when stdout has ended */
+  int exit_status; /**< Reported exit status */
+} FakeCommand;
+
+int fake_read(void *target, char *buff, const unsigned len, const bool is_stderr, const int timeout) {
+  FakeCommand *command = (FakeCommand *) target;
+  if (command->fail) return -1;
+  const char *chunk = command->chunks[command->next];
+  if (chunk && (chunk[0] == '!') == is_stderr) {
+    const char *data = is_stderr ? chunk + 1 : chunk;
+    assert(strlen(data) <= len);
+    memcpy(buff, data, strlen(data));
+    command->next++;
+    return (int) strlen(data);
+  }
+  if (!chunk && !is_stderr && !command->hang) command->eof = true;
+  else if (timeout > 0) g_usleep((gulong) timeout * 1000);
+  return 0;
+}
+
+bool fake_eof(void *target) {
+  return ((FakeCommand *) target)->eof;
+}
+
+int fake_exit_status(void *target) {
+  return ((FakeCommand *) target)->exit_status;
+}
+
+/**
+  *   @brief Collect output, ExecOutput of the tests
+  *   @param user_data GString, output is appended to it
+  */
+bool collect_output(const char *data, const size_t len, void *user_data) {
+  g_string_append_len((GString *) user_data, data, len);
+  return true;
+}
+
+/**
+  *   @brief Refuse output, ExecOutput of the tests
+  */
+bool refuse_output(__attribute__((unused)) const char *data, __attribute__((unused)) const size_t len,
+                   __attribute__((unused)) void *user_data) {
+  return false;
+}
+
+
+int main() {
+  // Output arrives in chunks, stderr is read before waiting for stdout
+  const char *chunks[] = { "ab", "!warn", "cd", NULL };
+  FakeCommand command = { chunks, 0, false, false, false, 3 };
+  ExecChannel channel = { fake_read, fake_eof, fake_exit_status, &command };
+  GString *out = g_string_new("");
+  RemoteExec exec = { .out = collect_output, .err = collect_output, .user_data = out, .exit_status = -1 };
+  assert(ExecChannel_run(&channel, &exec) == EXEC_FINISHED && exec.exit_status == 3);
+  assert(strcmp(out->str, "abwarncd") == 0);
+  g_string_set_size(out, 0);
+
+  // Separate callbacks, stderr dropped
+  command.next = 0;
+  command.eof = false;
+  exec.err = NULL;
+  assert(ExecChannel_run(&channel, &exec) == EXEC_FINISHED && strcmp(out->str, "abcd") == 0);
+
+  // A callback stops the command, the exit status is not known
+  command.next = 0;
+  command.eof = false;
+  exec.out = refuse_output;
+  assert(ExecChannel_run(&channel, &exec) == EXEC_STOPPED && exec.exit_status == -1 && command.next == 1);
+  exec.out = collect_output;
+
+  // A command which does not end is stopped by its timeout or cancel
+  const char *none[] = { NULL };
+  FakeCommand hanging = { none, 0, true, false, false, 0 };
+  channel.target = &hanging;
+  exec.timeout = 2 * EXEC_POLL_TIMEOUT;
+  const gint64 start = g_get_monotonic_time();
+  assert(ExecChannel_run(&channel, &exec) == EXEC_TIMED_OUT && exec.exit_status == -1);
+  assert(g_get_monotonic_time() - start >= 2 * EXEC_POLL_TIMEOUT * 1000);
+  exec.timeout = 0;
+  volatile gint cancel = 1;
+  exec.cancel = &cancel;
+  assert(ExecChannel_run(&channel, &exec) == EXEC_CANCELLED);
+  exec.cancel = NULL;
+
+  // Read errors fail the command
+  FakeCommand failing = { none, 0, false, true, false, 0 };
+  channel.target = &failing;
+  assert(ExecChannel_run(&channel, &exec) == EXEC_FAILED && exec.exit_status == -1);
+  g_string_free(out, TRUE);
+
+  // Paths are quoted for the shell
+  char *cmd = copy_command("/home/user/it's a file", "/tmp/$(rm -rf ~)", false);
+  assert(strcmp(cmd, "cp -- '/home/user/it'\\''s a file' '/tmp/$(rm -rf ~)'") == 0);
+  free(cmd);
+  cmd = copy_command("/srv/-dir", "/tmp", true);
+  assert(strcmp(cmd, "cp -r -- '/srv/-dir' '/tmp'") == 0);
+  free(cmd);
+
+  printf("test_ssh.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/**
+  *   @file test_thumb.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for thumb.c
+  */
+
+#include <assert.h>
+
+#include "../include/thumb.h"
+
+
+/**
+  *   @brief Write a TIFF value in the given byte order
+  */
+static void put_value(unsigned char *data, const uint32_t value, const unsigned size, const bool big_endian) {
+  for (unsigned i = 0; i < size; i++) {
+    data[big_endian ? size - 1 - i : i] = (unsigned char) (value >> (8 * i));
+  }
+}
+
+/**
+  *   @brief Write an IFD entry holding one number
+  */
+static void put_entry(unsigned char *data, const unsigned tag, const uint32_t value, const bool big_endian) {
+  put_value(data, tag, 2, big_endian);
+  put_value(data + 2, 4, 2, big_endian); // LONG
+  put_value(data + 4, 1, 4, big_endian);
+  put_value(data + 8, value, 4, big_endian);
+}
+
+/**
+  *   @brief Build the start of a JPEG with an EXIF thumbnail at TIFF offset 56
+  *   @return Length of the data
+  */
+static size_t build_jpeg(unsigned char *data, const bool big_endian) {
+  memset(data, 0, 128);
+  const unsigned char head[] = { 0xFF, 0xD8, 0xFF, 0xE1, 0x00, 68, 'E', 'x', 'i', 'f', 0, 0 };
+  memcpy(data, head, sizeof(head));
+  unsigned char *tiff = data + sizeof(head);
+  tiff[0] = tiff[1] = big_endian ? 'M' : 'I';
+  put_value(tiff + 2, 42, 2, big_endian);
+  put_value(tiff + 4, 8, 4, big_endian); // IFD0
+  put_value(tiff + 8, 1, 2, big_endian);
+  put_entry(tiff + 10, 0x0112, 1, big_endian); // Orientation
+  put_value(tiff + 22, 26, 4, big_endian); // IFD1
+  put_value(tiff + 26, 2, 2, big_endian);
+  put_entry(tiff + 28, 0x0201, 56, big_endian);
+  put_entry(tiff + 40, 0x0202, 4, big_endian);
+  put_value(tiff + 52, 0, 4, big_endian);
+  const unsigned char thumb[] = { 0xFF, 0xD8, 0xFF, 0xD9, 0xFF, 0xDA };
+  memcpy(tiff + 56, thumb, sizeof(thumb));
+  return sizeof(head) + 56 + sizeof(thumb);
+}
+
+
+int main() {
+  // ThumbBudget
+  ThumbBudget budget;
+  ThumbBudget_init(&budget, 1000, 0);
+  assert(ThumbBudget_take(&budget, 600, 0));
+  assert(!ThumbBudget_take(&budget, 600, 0));
+  assert(ThumbBudget_take(&budget, 600, G_USEC_PER_SEC / 2));
+  assert(!ThumbBudget_take(&budget, 400, G_USEC_PER_SEC / 2));
+  // Idle time does not allow bursts above the rate
+  assert(ThumbBudget_take(&budget, 1000, 10 * G_USEC_PER_SEC));
+  assert(!ThumbBudget_take(&budget, 1, 10 * G_USEC_PER_SEC));
+  // The clock going backwards does not add tokens
+  assert(!ThumbBudget_take(&budget, 1, 5 * G_USEC_PER_SEC));
+
+  // URIs and cache files, the example of the thumbnail specification
+  char *uri = thumbnail_uri("/home/jens/photos/me.png", NULL);
+  assert(strcmp(uri, "file:///home/jens/photos/me.png") == 0);
+  char *path = thumbnail_path(uri);
+  assert(strstr(path, THUMB_FOLDER "/c6ee772d9e49320e97ec29a7eb5b1697.png"));
+  free(uri);
+  free(path);
+  uri = thumbnail_uri("/tmp/a b#.png", NULL);
+  assert(strcmp(uri, "file:///tmp/a%20b%23.png") == 0);
+  free(uri);
+  uri = thumbnail_uri("/srv/a b#.png", "sftp://user@host");
+  assert(strcmp(uri, "sftp://user@host/srv/a%20b%23.png") == 0);
+  free(uri);
+
+  // EXIF thumbnails in both byte orders
+  unsigned char data[128];
+  size_t offset, length;
+  for (unsigned i = 0; i < 2; i++) {
+    const size_t len = build_jpeg(data, i == 1);
+    offset = length = 0;
+    assert(exif_thumbnail(data, len, &offset, &length));
+    assert(offset == 68 && length == 4);
+    assert(data[offset] == 0xFF && data[offset + 1] == 0xD8);
+    // Only the EXIF segment has been read
+    assert(exif_thumbnail(data, 72, &offset, &length));
+    // Truncated before the end of the EXIF segment
+    assert(!exif_thumbnail(data, 40, &offset, &length));
+  }
+  size_t len = build_jpeg(data, false);
+  data[12] = 'X'; // Not a TIFF header
+  assert(!exif_thumbnail(data, len, &offset, &length));
+  len = build_jpeg(data, false);
+  put_value(data + 12 + 22, 0, 4, false); // No IFD1
+  assert(!exif_thumbnail(data, len, &offset, &length));
+  len = build_jpeg(data, false);
+  put_value(data + 12 + 22, 1000, 4, false); // IFD1 beyond the segment
+  assert(!exif_thumbnail(data, len, &offset, &length));
+  len = build_jpeg(data, false);
+  data[9] = 'F'; // Not EXIF
+  assert(!exif_thumbnail(data, len, &offset, &length));
+  const unsigned char png[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  assert(!exif_thumbnail(png, sizeof(png), &offset, &length));
+  const unsigned char plain[] = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x08 };
+  assert(!exif_thumbnail(plain, sizeof(plain), &offset, &length));
+
+  printf("test_thumb.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**
+  *   @file test_viewer.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for viewer.c
+  */
+
+#include <assert.h>
+
+#include "../include/viewer.h"
+
+#define TEST_LINES 5000 /**< Lines in the test file */
+#define TEST_LINE_LEN 11 /**< Length of "line 00000\n" */
+
+
+/**
+  *   @brief Append numbered lines to a file
+  */
+static void append_lines(const char *filename, const unsigned first, const unsigned count) {
+  FILE *fp = fopen(filename, "a");
+  assert(fp);
+  for (unsigned i = first; i < first + count; i++) fprintf(fp, "line %05u\n", i);
+  fclose(fp);
+}
+
+
+int main() {
+  const char *filename = "testVIEWER.txt";
+  unlink(filename);
+  append_lines(filename, 0, TEST_LINES);
+  assert(!open_local_PagedFile("testVIEWER_missing.txt"));
+  PagedFile *file = open_local_PagedFile(filename);
+  assert(file && file->size == TEST_LINES * TEST_LINE_LEN && file->transferred == 0);
+
+  // The last lines cost only the block they are in
+  uint64_t start, end;
+  assert(PagedFile_lines_before(file, file->size, 10, &start) == 0);
+  assert(start == file->size - 10 * TEST_LINE_LEN);
+  assert(file->transferred == file->size % VIEWER_BLOCK_SIZE);
+  GString *text = g_string_new(NULL);
+  assert(PagedFile_lines(file, start, 100, VIEWER_PAGE_BYTES, text, &end) == 0);
+  assert(end == file->size && text->len == 10 * TEST_LINE_LEN);
+  assert(strncmp(text->str, "line 04990\n", TEST_LINE_LEN) == 0);
+  assert(file->transferred == file->size % VIEWER_BLOCK_SIZE); // Cached
+
+  // Pages from the start
+  g_string_truncate(text, 0);
+  assert(PagedFile_lines(file, 0, 3, VIEWER_PAGE_BYTES, text, &end) == 0);
+  assert(strcmp(text->str, "line 00000\nline 00001\nline 00002\n") == 0 && end == 3 * TEST_LINE_LEN);
+  g_string_truncate(text, 0);
+  assert(PagedFile_lines(file, 0, 3, 15, text, &end) == 0);
+  assert(end == 15 && text->len == 15);
+  assert(PagedFile_lines_before(file, 3 * TEST_LINE_LEN, 1, &start) == 0 && start == 2 * TEST_LINE_LEN);
+  assert(PagedFile_lines_before(file, 3 * TEST_LINE_LEN, 10, &start) == 0 && start == 0);
+
+  // Reads across block boundaries
+  char buff[3 * VIEWER_BLOCK_SIZE];
+  const uint64_t offset = VIEWER_BLOCK_SIZE - 5 * TEST_LINE_LEN - 1;
+  assert(PagedFile_read(file, buff, sizeof(buff), offset) == (long) sizeof(buff));
+  for (size_t i = 0; i < sizeof(buff); i++) {
+    const uint64_t pos = offset + i;
+    const unsigned line = (unsigned) (pos / TEST_LINE_LEN);
+    char expected[TEST_LINE_LEN + 1];
+    snprintf(expected, sizeof(expected), "line %05u\n", line);
+    assert(buff[i] == expected[pos % TEST_LINE_LEN]);
+  }
+  assert(PagedFile_read(file, buff, sizeof(buff), file->size) == 0);
+  assert(PagedFile_read(file, buff, sizeof(buff), file->size - 5) == 5);
+
+  // Following fetches only the appended bytes
+  uint64_t appended;
+  const uint64_t old_size = file->size;
+  const uint64_t transferred = file->transferred;
+  append_lines(filename, TEST_LINES, 2);
+  assert(PagedFile_refresh(file, &appended) == 0 && appended == 2 * TEST_LINE_LEN);
+  g_string_truncate(text, 0);
+  assert(PagedFile_lines(file, old_size, UINT_MAX, file->size - old_size, text, &end) == 0);
+  assert(strcmp(text->str, "line 05000\nline 05001\n") == 0 && end == file->size);
+  assert(file->transferred == transferred + 2 * TEST_LINE_LEN);
+  assert(PagedFile_refresh(file, &appended) == 0 && appended == 0);
+
+  // A truncated file is read again
+  assert(truncate(filename, TEST_LINE_LEN) == 0);
+  assert(PagedFile_refresh(file, &appended) == 1 && appended == 0 && file->size == TEST_LINE_LEN);
+  assert(g_hash_table_size(file->blocks) == 0);
+  g_string_truncate(text, 0);
+  assert(PagedFile_lines(file, 0, 10, VIEWER_PAGE_BYTES, text, &end) == 0);
+  assert(strcmp(text->str, "line 00000\n") == 0);
+
+  // A renamed file is read until a new one takes its path, even a larger one
+  const char *rotated = "testVIEWER.txt.1";
+  assert(rename(filename, rotated) == 0);
+  append_lines(rotated, 1, 1);
+  assert(PagedFile_refresh(file, &appended) == 0 && appended == TEST_LINE_LEN);
+  append_lines(filename, 100, 3);
+  assert(PagedFile_refresh(file, &appended) == 1 && appended == 0 && file->size == 3 * TEST_LINE_LEN);
+  g_string_truncate(text, 0);
+  assert(PagedFile_lines(file, 0, 1, VIEWER_PAGE_BYTES, text, &end) == 0);
+  assert(strcmp(text->str, "line 00100\n") == 0);
+  assert(PagedFile_refresh(file, &appended) == 0 && appended == 0);
+  assert(unlink(rotated) == 0);
+  free_PagedFile(file);
+
+  // The cache keeps at most max_blocks
+  unlink(filename);
+  append_lines(filename, 0, TEST_LINES);
+  file = open_local_PagedFile(filename);
+  assert(file);
+  file->max_blocks = 4;
+  for (uint64_t pos = 0; pos < file->size; pos += sizeof(buff)) {
+    assert(PagedFile_read(file, buff, sizeof(buff), pos) > 0);
+    assert(g_hash_table_size(file->blocks) <= 4 && g_queue_get_length(&(file->lru)) <= 4);
+  }
+  assert(file->transferred == file->size);
+  free_PagedFile(file);
+
+  g_string_free(text, TRUE);
+  assert(unlink(filename) == 0);
+  printf("test_viewer.c successfully finished\n");
+  return EXIT_SUCCESS;
+}
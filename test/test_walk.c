@@ -0,0 +1,499 @@
+/**
+  *   @file test_walk.c
+  *   @author Lauri Westerholm
+  *   @brief Test file for walk.c
+  */
+
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/walk.h"
+
+/**
+  *   @brief Append one SSH_FXP_NAME entry to a packet
+  *   @param packet Packet
+  *   @param name Filename
+  *   @param longname ls -l style long name
+  *   @param permissions Permissions including the S_IFMT bits
+  *   @param size File size
+  */
+void append_entry(GByteArray *packet, const char *name, const char *longname, const uint32_t permissions, const uint64_t size) {
+  SftpPacket_string(packet, name, strlen(name));
+  SftpPacket_string(packet, longname, strlen(longname));
+  SftpPacket_u32(packet, SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_UIDGID | SSH_FILEXFER_ATTR_PERMISSIONS |
+                          SSH_FILEXFER_ATTR_ACMODTIME | SSH_FILEXFER_ATTR_EXTENDED);
+  SftpPacket_u64(packet, size);
+  SftpPacket_u32(packet, 1000); // uid
+  SftpPacket_u32(packet, 100); // gid
+  SftpPacket_u32(packet, permissions);
+  SftpPacket_u32(packet, 1); // atime
+  SftpPacket_u32(packet, 1600000000); // mtime
+  SftpPacket_u32(packet, 1);
+  SftpPacket_string(packet, "key", 3);
+  SftpPacket_string(packet, "value", 5);
+}
+
+
+/* Fake sftp server serving the local filesystem */
+
+/**
+  *   @struct FakeServer
+  *   @brief Target of the WalkChannel of the tests, answers requests as they are written
+  */
+typedef struct {
+  GByteArray *in; /**< Request bytes not yet handled */
+  GByteArray *out; /**< Reply bytes not yet read */
+  GPtrArray *dirs; /**< Open DIR * by handle */
+  GPtrArray *dir_paths; /**< Paths of the open folders by handle */
+  unsigned handled; /**< Requests answered */
+  unsigned stall_after; /**< Requests answered before the server stops answering, 0 never stops */
+  unsigned polls; /**< Reads which timed out */
+  volatile gint *cancel; /**< Set after three polls when not NULL */
+  const char *fail; /**< Name of the entries whose removal is refused, may be NULL */
+  GPtrArray *removals; /**< "E path" for REMOVE and "L path" for RMDIR requests as in WalkLog, may be NULL */
+} FakeServer;
+
+/**
+  *   @brief Queue a SSH_FXP_STATUS reply
+  */
+void fake_status(FakeServer *server, const uint32_t id, const uint32_t status) {
+  GByteArray *packet = new_SftpPacket(SSH_FXP_STATUS, id);
+  SftpPacket_u32(packet, status);
+  SftpPacket_string(packet, "", 0);
+  SftpPacket_string(packet, "", 0);
+  SftpPacket_finish(packet);
+  g_byte_array_append(server->out, packet->data, packet->len);
+  g_byte_array_free(packet, TRUE);
+}
+
+/**
+  *   @brief Append the attributes of a file to a packet
+  */
+void fake_attrs(GByteArray *packet, const struct stat *st) {
+  SftpPacket_u32(packet, SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACMODTIME);
+  SftpPacket_u64(packet, st->st_size);
+  SftpPacket_u32(packet, st->st_mode);
+  SftpPacket_u32(packet, st->st_atime);
+  SftpPacket_u32(packet, st->st_mtime);
+}
+
+/**
+  *   @brief Answer one request
+  *   @param server FakeServer
+  *   @param type Packet type
+  *   @param id Request id
+  *   @param str String argument of the request, '\0' terminated
+  */
+void fake_request(FakeServer *server, const uint8_t type, const uint32_t id, const char *str) {
+  GByteArray *packet = NULL;
+  struct stat st;
+  if (type == SSH_FXP_OPENDIR) {
+    DIR *dir = opendir(str);
+    if (!dir) fake_status(server, id, SSH_FX_NO_SUCH_FILE);
+    else {
+      char handle[16];
+      snprintf(handle, sizeof(handle), "%u", server->dirs->len);
+      g_ptr_array_add(server->dirs, dir);
+      g_ptr_array_add(server->dir_paths, g_strdup(str));
+      packet = new_SftpPacket(SSH_FXP_HANDLE, id);
+      SftpPacket_string(packet, handle, strlen(handle));
+    }
+  } else if (type == SSH_FXP_READDIR || type == SSH_FXP_CLOSE) {
+    const unsigned handle = (unsigned) atoi(str);
+    assert(handle < server->dirs->len && g_ptr_array_index(server->dirs, handle));
+    DIR *dir = (DIR *) g_ptr_array_index(server->dirs, handle);
+    if (type == SSH_FXP_CLOSE) {
+      closedir(dir);
+      g_ptr_array_index(server->dirs, handle) = NULL;
+      fake_status(server, id, SSH_FX_OK);
+      server->handled++;
+      return;
+    }
+    // Two entries per reply so that folders take several READDIRs
+    struct dirent *entries[2];
+    uint32_t count = 0;
+    while (count < 2 && (entries[count] = readdir(dir))) count++;
+    if (count == 0) fake_status(server, id, SSH_FX_EOF);
+    else {
+      packet = new_SftpPacket(SSH_FXP_NAME, id);
+      SftpPacket_u32(packet, count);
+      for (uint32_t i = 0; i < count; i++) {
+        char *path = g_build_filename(g_ptr_array_index(server->dir_paths, handle), entries[i]->d_name, NULL);
+        assert(lstat(path, &st) == 0);
+        g_free(path);
+        char *longname = g_strdup_printf("-rw-r--r-- 1 user group 0 Jan 1 00:00 %s", entries[i]->d_name);
+        SftpPacket_string(packet, entries[i]->d_name, strlen(entries[i]->d_name));
+        SftpPacket_string(packet, longname, strlen(longname));
+        g_free(longname);
+        fake_attrs(packet, &st);
+      }
+    }
+  } else if (type == SSH_FXP_STAT) {
+    if (stat(str, &st) != 0) fake_status(server, id, SSH_FX_NO_SUCH_FILE);
+    else {
+      packet = new_SftpPacket(SSH_FXP_ATTRS, id);
+      fake_attrs(packet, &st);
+    }
+  } else if (type == SSH_FXP_REALPATH) {
+    char *real = realpath(str, NULL);
+    assert(real);
+    packet = new_SftpPacket(SSH_FXP_NAME, id);
+    SftpPacket_u32(packet, 1);
+    SftpPacket_string(packet, real, strlen(real));
+    SftpPacket_string(packet, "", 0);
+    SftpPacket_u32(packet, 0);
+    free(real);
+  } else if (type == SSH_FXP_REMOVE || type == SSH_FXP_RMDIR) {
+    const char *name = strrchr(str, '/') ? strrchr(str, '/') + 1 : str;
+    if (server->removals) g_ptr_array_add(server->removals, g_strdup_printf("%c %s", type == SSH_FXP_RMDIR ? 'L' : 'E', str));
+    if (server->fail && strcmp(name, server->fail) == 0) fake_status(server, id, SSH_FX_PERMISSION_DENIED);
+    else if ((type == SSH_FXP_REMOVE ? unlink(str) : rmdir(str)) != 0) fake_status(server, id, SSH_FX_FAILURE);
+    else fake_status(server, id, SSH_FX_OK);
+  } else assert(false);
+  if (packet) {
+    SftpPacket_finish(packet);
+    g_byte_array_append(server->out, packet->data, packet->len);
+    g_byte_array_free(packet, TRUE);
+  }
+  server->handled++;
+}
+
+/**
+  *   @brief Take requests written to a FakeServer, WalkWrite of the tests
+  */
+int fake_write(void *target, const uint8_t *buff, const uint32_t len) {
+  FakeServer *server = (FakeServer *) target;
+  g_byte_array_append(server->in, buff, len);
+  SftpReader reader = { server->in->data, server->in->data + server->in->len };
+  uint32_t packet_len, id, str_len;
+  const char *str;
+  const uint8_t *done = reader.pos;
+  while (SftpReader_u32(&reader, &packet_len) && (uint32_t) (reader.end - reader.pos) >= packet_len) {
+    const uint8_t *end = reader.pos + packet_len;
+    const uint8_t type = *(reader.pos++);
+    assert(SftpReader_u32(&reader, &id));
+    if (server->stall_after && server->handled >= server->stall_after) {
+      // Busy server, the request is never answered
+    } else if (type == SSH_FXP_INIT) {
+      GByteArray *packet = new_SftpPacket(SSH_FXP_VERSION, WALK_SFTP_VERSION);
+      SftpPacket_finish(packet);
+      g_byte_array_append(server->out, packet->data, packet->len);
+      g_byte_array_free(packet, TRUE);
+      server->handled++;
+    } else {
+      assert(SftpReader_string(&reader, &str, &str_len));
+      char *arg = g_strndup(str, str_len);
+      fake_request(server, type, id, arg);
+      g_free(arg);
+    }
+    reader.pos = done = end;
+  }
+  g_byte_array_remove_range(server->in, 0, done - server->in->data);
+  return (int) len;
+}
+
+/**
+  *   @brief Read replies of a FakeServer, WalkRead of the tests
+  */
+int fake_read(void *target, uint8_t *buff, const uint32_t len, __attribute__((unused)) const int timeout) {
+  FakeServer *server = (FakeServer *) target;
+  if (server->out->len == 0) {
+    // The walker only waits for requests in flight
+    assert(server->stall_after && ++(server->polls) < 100);
+    if (server->cancel && server->polls == 3) g_atomic_int_set(server->cancel, 1);
+    return 0;
+  }
+  const uint32_t n = len < server->out->len ? len : server->out->len;
+  memcpy(buff, server->out->data, n);
+  g_byte_array_remove_range(server->out, 0, n);
+  return (int) n;
+}
+
+/**
+  *   @brief Walk a local folder through a FakeServer
+  *   @param server FakeServer, initialized here
+  *   @param root Folder
+  *   @param walk RemoteWalk
+  *   @return Return value of WalkChannel_walk
+  */
+int fake_walk(FakeServer *server, const char *root, RemoteWalk *walk) {
+  server->in = g_byte_array_new();
+  server->out = g_byte_array_new();
+  server->dirs = g_ptr_array_new();
+  server->dir_paths = g_ptr_array_new_with_free_func(g_free);
+  WalkChannel channel = { fake_write, fake_read, server };
+  char *real = realpath(root, NULL);
+  const int ret = WalkChannel_walk(&channel, root, real, walk);
+  free(real);
+  for (guint i = 0; i < server->dirs->len; i++) {
+    if (g_ptr_array_index(server->dirs, i)) closedir((DIR *) g_ptr_array_index(server->dirs, i));
+  }
+  g_ptr_array_free(server->dirs, TRUE);
+  g_ptr_array_free(server->dir_paths, TRUE);
+  g_byte_array_free(server->in, TRUE);
+  g_byte_array_free(server->out, TRUE);
+  return ret;
+}
+
+/**
+  *   @struct WalkLog
+  *   @brief Callbacks and entries seen by a test walk
+  */
+typedef struct {
+  GPtrArray *events; /**< "E parent/name" for entries, "L path" for left folders */
+  unsigned entries; /**< Entries reported */
+  unsigned stop_after; /**< Entries after which the walk is stopped, 0 never */
+  volatile gint *cancel; /**< Set after cancel_after entries */
+  unsigned cancel_after; /**< Entries after which cancel is set, 0 never */
+  unsigned unreadable; /**< Folders left as unreadable */
+} WalkLog;
+
+enum WalkAction log_entry(const char *parent, const File_t *file, void *data) {
+  WalkLog *log = (WalkLog *) data;
+  g_ptr_array_add(log->events, g_strdup_printf("E %s/%s", parent, file->name));
+  log->entries++;
+  if (log->cancel_after && log->entries == log->cancel_after) g_atomic_int_set(log->cancel, 1);
+  return log->stop_after && log->entries >= log->stop_after ? WALK_STOP : WALK_CONTINUE;
+}
+
+enum WalkAction log_leave(const char *path, const bool readable, void *data) {
+  WalkLog *log = (WalkLog *) data;
+  g_ptr_array_add(log->events, g_strdup_printf("L %s", path));
+  if (!readable) log->unreadable++;
+  return WALK_CONTINUE;
+}
+
+/**
+  *   @brief Count the events of a WalkLog
+  *   @param log WalkLog
+  *   @param prefix Prefix of the counted events
+  *   @return Number of events starting with prefix
+  */
+unsigned count_events(WalkLog *log, const char *prefix) {
+  unsigned count = 0;
+  for (guint i = 0; i < log->events->len; i++) {
+    if (g_str_has_prefix(g_ptr_array_index(log->events, i), prefix)) count++;
+  }
+  return count;
+}
+
+/**
+  *   @brief Check that nothing below a folder is reported after the folder was left
+  *   @param log WalkLog
+  *   @return true if every folder is left in post-order
+  */
+bool is_post_order(WalkLog *log) {
+  for (guint i = 0; i < log->events->len; i++) {
+    const char *event = g_ptr_array_index(log->events, i);
+    if (event[0] != 'L') continue;
+    char *below = g_strdup_printf("%s/", event + 2);
+    for (guint j = i + 1; j < log->events->len; j++) {
+      if (g_str_has_prefix((const char *) g_ptr_array_index(log->events, j) + 2, below)) {
+        g_free(below);
+        return false;
+      }
+    }
+    g_free(below);
+  }
+  return true;
+}
+
+/**
+  *   @brief Remove a local test tree
+  *   @param path Path of the tree, links are removed and not followed
+  */
+void remove_tree(const char *path) {
+  struct stat st;
+  if (lstat(path, &st) != 0) return;
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(path);
+    assert(dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+      char *child = g_build_filename(path, entry->d_name, NULL);
+      remove_tree(child);
+      g_free(child);
+    }
+    closedir(dir);
+    assert(rmdir(path) == 0);
+  } else assert(unlink(path) == 0);
+}
+
+/**
+  *   @brief Create the local test trees
+  *   @details walkTEST: a/x, a/b/y, a/b/up -> walkTEST, c/, z, ext and ext2 -> walkEXT.
+  *   walkEXT: e, self -> walkEXT
+  */
+void create_trees() {
+  remove_tree("walkTEST");
+  remove_tree("walkEXT");
+  const char *folders[] = { "walkTEST", "walkTEST/a", "walkTEST/a/b", "walkTEST/c", "walkEXT" };
+  for (unsigned i = 0; i < sizeof(folders) / sizeof(folders[0]); i++) assert(mkdir(folders[i], S_IRWXU) == 0);
+  const char *files[] = { "walkTEST/a/x", "walkTEST/a/b/y", "walkTEST/z", "walkEXT/e" };
+  for (unsigned i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    const int fd = open(files[i], O_CREAT | O_WRONLY, S_IRWXU);
+    assert(fd >= 0 && write(fd, "abc", 3) == 3);
+    close(fd);
+  }
+  assert(symlink("../..", "walkTEST/a/b/up") == 0);
+  assert(symlink("../walkEXT", "walkTEST/ext") == 0);
+  assert(symlink("../walkEXT", "walkTEST/ext2") == 0);
+  assert(symlink(".", "walkEXT/self") == 0);
+}
+
+
+int main() {
+  GByteArray *packet = new_SftpPacket(SSH_FXP_NAME, 7);
+  SftpPacket_u32(packet, 3);
+  append_entry(packet, "file.txt", "-rw-r--r--    1 user     group    5000000000 Jan 1 00:00 file.txt", S_IFREG | 0644, 5000000000);
+  append_entry(packet, "folder", "drwxr-xr-x    2 user     group        4096 Jan 1 00:00 folder", S_IFDIR | 0755, 4096);
+  append_entry(packet, "link", "", S_IFLNK | 0777, 4);
+  SftpPacket_finish(packet);
+  SftpReader reader = { packet->data, packet->data + packet->len };
+  uint32_t len, id, count;
+  assert(SftpReader_u32(&reader, &len) && len == packet->len - 4);
+  assert(packet->data[4] == SSH_FXP_NAME);
+  reader.pos++;
+  assert(SftpReader_u32(&reader, &id) && id == 7);
+  assert(SftpReader_u32(&reader, &count) && count == 3);
+  File_t *file = SftpReader_File(&reader);
+  assert(file && strcmp(file->name, "file.txt") == 0 && file->type == SSH_FILEXFER_TYPE_REGULAR);
+  assert(file->size == 5000000000 && file->uid == 1000 && file->gid == 100 && file->mtime == 1600000000);
+  assert(file->has_metadata && strcmp(file->owner, "user") == 0 && strcmp(file->group, "group") == 0);
+  free_File(file);
+  file = SftpReader_File(&reader);
+  assert(file && file->type == SSH_FILEXFER_TYPE_DIRECTORY && is_folder(file->type, true));
+  free_File(file);
+  file = SftpReader_File(&reader);
+  assert(file && file->type == SSH_FILEXFER_TYPE_SYMLINK && !file->owner && !file->group);
+  free_File(file);
+  assert(reader.pos == reader.end);
+  assert(!SftpReader_File(&reader));
+
+  // Truncated packets are rejected
+  reader.pos = packet->data + 13;
+  reader.end = packet->data + 40;
+  assert(!SftpReader_File(&reader));
+  g_byte_array_free(packet, TRUE);
+
+  // Attributes without permissions leave the type unknown
+  packet = new_SftpPacket(SSH_FXP_ATTRS, 1);
+  SftpPacket_u32(packet, SSH_FILEXFER_ATTR_SIZE);
+  SftpPacket_u64(packet, 42);
+  SftpPacket_finish(packet);
+  reader.pos = packet->data + 9;
+  reader.end = packet->data + packet->len;
+  File_t attrs = { 0 };
+  assert(SftpReader_attrs(&reader, &attrs) && attrs.size == 42 && attrs.type == SSH_FILEXFER_TYPE_UNKNOWN);
+  g_byte_array_free(packet, TRUE);
+
+
+  // Walks through a fake server serving the local test trees
+  create_trees();
+  FakeServer server = { 0 };
+  WalkLog log = { 0 };
+  log.events = g_ptr_array_new_with_free_func(g_free);
+  RemoteWalk walk = { .entry = log_entry, .leave = log_leave, .data = &log };
+  assert(fake_walk(&server, "walkTEST", &walk) == 0);
+  // Every entry once, links are reported but not followed
+  assert(log.entries == 9 && count_events(&log, "E walkTEST/ext/") == 0);
+  assert(count_events(&log, "L ") == 4 && log.unreadable == 0);
+  assert(is_post_order(&log));
+  assert(strcmp(g_ptr_array_index(log.events, log.events->len - 1), "L walkTEST") == 0);
+  g_ptr_array_set_size(log.events, 0);
+
+  // Following links: links to the root or a visited target are not followed again
+  log.entries = 0;
+  walk.follow_links = true;
+  assert(fake_walk(&server, "walkTEST", &walk) == 0);
+  assert(log.entries == 11 && count_events(&log, "L ") == 5 && is_post_order(&log));
+  assert(count_events(&log, "E walkTEST/ext/e") + count_events(&log, "E walkTEST/ext2/e") == 1);
+  assert(count_events(&log, "E walkTEST/a/b/up/") == 0);
+  g_ptr_array_set_size(log.events, 0);
+
+  // WALK_STOP ends the walk at once
+  log.entries = 0;
+  log.stop_after = 3;
+  walk.follow_links = false;
+  assert(fake_walk(&server, "walkTEST", &walk) == -1);
+  assert(log.entries == 3 && count_events(&log, "L walkTEST") == 0);
+  g_ptr_array_set_size(log.events, 0);
+  log.stop_after = 0;
+
+  // Cancel stops the walk before the rest of the tree is requested
+  volatile gint cancel = 0;
+  log.entries = 0;
+  log.cancel = &cancel;
+  log.cancel_after = 1;
+  walk.cancel = &cancel;
+  assert(fake_walk(&server, "walkTEST", &walk) == -1);
+  assert(log.entries < 9);
+  g_ptr_array_set_size(log.events, 0);
+  log.cancel_after = 0;
+
+  // Cancel is noticed while waiting for a server which does not answer
+  g_atomic_int_set(&cancel, 0);
+  log.entries = 0;
+  server.stall_after = 3; // INIT, OPENDIR and the first READDIR
+  server.cancel = &cancel;
+  assert(fake_walk(&server, "walkTEST", &walk) == -1);
+  assert(server.polls == 3 && log.entries <= 2);
+  g_ptr_array_free(log.events, TRUE);
+
+  // An unreadable root is left as unreadable
+  memset(&server, 0, sizeof(server));
+  WalkLog missing = { 0 };
+  missing.events = g_ptr_array_new_with_free_func(g_free);
+  walk.data = &missing;
+  walk.cancel = NULL;
+  assert(fake_walk(&server, "walkTEST/missing", &walk) == 0);
+  assert(missing.entries == 0 && missing.unreadable == 1);
+  g_ptr_array_free(missing.events, TRUE);
+
+  // Remove mode removes every entry and each folder after everything below it
+  memset(&server, 0, sizeof(server));
+  WalkLog removals = { 0 };
+  removals.events = g_ptr_array_new_with_free_func(g_free);
+  server.removals = removals.events;
+  log = (WalkLog) { 0 };
+  log.events = g_ptr_array_new_with_free_func(g_free);
+  walk = (RemoteWalk) { .entry = log_entry, .data = &log, .remove = true };
+  assert(fake_walk(&server, "walkTEST", &walk) == 0);
+  assert(log.entries == 9 && removals.events->len == 10 && is_post_order(&removals));
+  assert(strcmp(g_ptr_array_index(removals.events, removals.events->len - 1), "L walkTEST") == 0);
+  struct stat st;
+  assert(lstat("walkTEST", &st) != 0 && lstat("walkEXT/e", &st) == 0);
+  g_ptr_array_set_size(log.events, 0);
+  g_ptr_array_set_size(removals.events, 0);
+
+  // Refused removals fail the walk, the rest of the tree is still removed
+  create_trees();
+  log.entries = 0;
+  server.fail = "y";
+  assert(fake_walk(&server, "walkTEST", &walk) == -1);
+  assert(log.entries == 9 && removals.events->len == 10 && is_post_order(&removals));
+  assert(lstat("walkTEST/a/b/y", &st) == 0 && lstat("walkTEST/a/x", &st) != 0);
+  assert(lstat("walkTEST/c", &st) != 0 && lstat("walkTEST/z", &st) != 0);
+  g_ptr_array_set_size(log.events, 0);
+  g_ptr_array_set_size(removals.events, 0);
+
+  // WALK_STOP keeps what is not removed yet, the root included
+  create_trees();
+  log.entries = 0;
+  log.stop_after = 2;
+  server.fail = NULL;
+  assert(fake_walk(&server, "walkTEST", &walk) == -1);
+  assert(log.entries == 2 && removals.events->len <= 2 && count_events(&removals, "L ") == 0);
+  assert(lstat("walkTEST", &st) == 0);
+  g_ptr_array_free(log.events, TRUE);
+  g_ptr_array_free(removals.events, TRUE);
+
+  remove_tree("walkTEST");
+  remove_tree("walkEXT");
+
+  printf("test_walk.c successfully finished\n");
+  return EXIT_SUCCESS;
+}